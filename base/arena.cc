@@ -1,26 +1,55 @@
 #include "arena.h"
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
 
-static const int kBlockSize = 4096;
+static const size_t kHugePageSize = 2 << 20;
 
+Arena::Arena(size_t block_size, BlockSource source)
+    : block_size_(block_size),
+      source_(source),
+      alloc_ptr_(nullptr),
+      alloc_bytes_remaining_(0),
+      memory_usage_(0),
+      wasted_bytes_(0),
+      huge_page_blocks_(0) {
+  assert(block_size_ >= 64);
+}
+
+Arena::~Arena() {
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    if (blocks_[i].mapped) {
+      munmap(blocks_[i].ptr, blocks_[i].size);
+    } else {
+      delete[] blocks_[i].ptr;
+    }
+  }
+}
 
 size_t Arena::MemoryUsage() const {
   return memory_usage_.load(std::memory_order_relaxed);
 }
 
+double Arena::Fragmentation() const {
+  size_t usage = MemoryUsage();
+  return usage == 0 ? 0 : double(wasted_bytes_) / usage;
+}
+
 /*
 分配时有如下三个规则:
   1.如果bytes小于当前块剩余内存大小，直接分配，并调整 alloc_ptr_ 与
     alloc_bytes_remaining_
-  2.如果bytes大于当前块剩余内存大小，且小于1024(kBlockSize/ 4)，
+  2.如果bytes大于当前块剩余内存大小，且小于block_size_ / 4，
     则申请一个新的块(block)，插入到 blocks_ 中，将 alloc_ptr_ 指向新块，调整
-    alloc_bytes_remaining_ 为 kBlockSizebytes
-  3.如果bytes大于1024(kBlockSize / 4)，那么直接分配一个新的块(block)，并插入
-    blocks 中，此时 alloc_ptr_ 与 alloc_bytes_remaining_ 不做调整
+    alloc_bytes_remaining_ 为新块大小减去bytes, 旧块剩余的内存计入wasted_bytes_
+  3.如果bytes大于block_size_ / 4，那么直接分配一个新的块(block)，并插入
+    blocks 中，此时 alloc_ptr_ 与 alloc_bytes_remaining_ 不做调整。
+    这样的块总是从堆上分配: 按页或2MB取整多出的部分不会再被使用
 */
 char* Arena::Allocate(size_t bytes) {
   // assert(bytes > 0);
@@ -37,26 +66,71 @@ char* Arena::Allocate(size_t bytes) {
 
 char* Arena::AllocateFallback(size_t bytes) {
   // 第三个规则
-  if (bytes > kBlockSize / 4) {
-    char* result = AllocateNewBlock(bytes);
+  if (bytes > block_size_ / 4) {
+    char* result = AllocateNewBlock(bytes, kHeap);
     return result;
   }
   // 第二个规则
-  alloc_ptr_ = AllocateNewBlock(kBlockSize);
-  alloc_bytes_remaining_ = kBlockSize;
+  wasted_bytes_ += alloc_bytes_remaining_;
+  alloc_ptr_ = AllocateNewBlock(block_size_, source_);
+  // mmap的块按页取整, 多出的部分同样可用
+  alloc_bytes_remaining_ = blocks_.back().size;
   char* result = alloc_ptr_;
   alloc_ptr_ += bytes;
   alloc_bytes_remaining_ -= bytes;
   return result;
 }
 
-char* Arena::AllocateNewBlock(size_t block_bytes) {
-  char* result = new char[block_bytes];
-  blocks_.push_back(result);
+bool Arena::MapBlock(size_t block_bytes, Block* block) {
+  if (source_ == kHugePage) {
+    size_t size = (block_bytes + kHugePageSize - 1) & ~(kHugePageSize - 1);
+#ifdef MAP_HUGETLB
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      block->ptr = static_cast<char*>(p);
+      block->size = size;
+      block->mapped = true;
+      huge_page_blocks_++;
+      return true;
+    }
+#endif
+    // 没有预留大页, 退回到普通mmap并请求透明大页
+    void* q = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (q == MAP_FAILED) return false;
+#ifdef MADV_HUGEPAGE
+    madvise(q, size, MADV_HUGEPAGE);
+#endif
+    block->ptr = static_cast<char*>(q);
+    block->size = size;
+    block->mapped = true;
+    return true;
+  }
+
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t size = (block_bytes + page - 1) & ~(page - 1);
+  void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) return false;
+  block->ptr = static_cast<char*>(p);
+  block->size = size;
+  block->mapped = true;
+  return true;
+}
+
+char* Arena::AllocateNewBlock(size_t block_bytes, BlockSource source) {
+  Block block;
+  if (source == kHeap || !MapBlock(block_bytes, &block)) {
+    block.ptr = new char[block_bytes];
+    block.size = block_bytes;
+    block.mapped = false;
+  }
+  blocks_.push_back(block);
   //当前内存总共使用了之前的内存+当前分配内存块大小+指向当前内存块指针大小
-  memory_usage_.fetch_add(block_bytes + sizeof(char*),
+  memory_usage_.fetch_add(block.size + sizeof(char*),
                           std::memory_order_relaxed);
-  return result;
+  return block.ptr;
 }
 
 char* Arena::AllocateAligned(size_t bytes) {
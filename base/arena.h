@@ -7,18 +7,29 @@
 // 内存管理类
 class Arena {
  public:
-  Arena() : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {}
-  ~Arena() {
-    for (size_t i = 0; i < blocks_.size(); ++i) {
-      delete[] blocks_[i];
-    }
-  }
+  // 内存块的来源, 单独分配的大内存总是来自堆
+  enum BlockSource {
+    // new char[]
+    kHeap,
+    // 匿名mmap, 块大小按页对齐
+    kMmap,
+    // 优先使用MAP_HUGETLB的大页, 失败时退回到mmap + 透明大页(THP),
+    // 再失败则退回到new char[]
+    kHugePage,
+  };
+
+  static const size_t kDefaultBlockSize = 4096;
+
+  explicit Arena(size_t block_size = kDefaultBlockSize,
+                 BlockSource source = kHeap);
+  ~Arena();
   // 删除拷贝构造
   Arena(const Arena&) = delete;
   Arena& operator=(const Arena&) = delete;
   // Get 用于测试
   size_t GetRemainBytes() { return alloc_bytes_remaining_; }
   size_t GetBlocksSize() { return blocks_.size(); }
+  size_t GetBlockSize() const { return block_size_; }
   // Allocate()函数用于提供给上层调用者申请一块大小为bytes的内存
   // 不保证给上层调用者的内存首地址是字节对齐的
   char* Allocate(size_t bytes);
@@ -26,19 +37,38 @@ class Arena {
   char* AllocateAligned(size_t bytes);
   // 统计内存使用量
   size_t MemoryUsage() const;
+  // 换块时被丢弃的块尾字节总数
+  size_t WastedBytes() const { return wasted_bytes_; }
+  // 丢弃的块尾字节占内存使用量的比例
+  double Fragmentation() const;
+  // 由MAP_HUGETLB大页提供的块数
+  size_t HugePageBlocks() const { return huge_page_blocks_; }
 
  private:
+  struct Block {
+    char* ptr;
+    size_t size;
+    // 由mmap分配, 需要munmap释放
+    bool mapped;
+  };
+
   // Allocate()的辅助函数
   char* AllocateFallback(size_t bytes);
-  // 分配一个新的block
-  char* AllocateNewBlock(size_t block_bytes);
+  // 从source分配一个新的block
+  char* AllocateNewBlock(size_t block_bytes, BlockSource source);
+  // 按source_申请一块内存, 实际大小写入block
+  bool MapBlock(size_t block_bytes, Block* block);
 
  private:
+  const size_t block_size_;
+  const BlockSource source_;
   // alloc_ptr_指向的是当前可提供给上层调用者申请的内存的首地址
   char* alloc_ptr_;
   size_t alloc_bytes_remaining_;
   // blocks_来管理申请的内存块
-  std::vector<char*> blocks_;
+  std::vector<Block> blocks_;
   // memory_usage_用于统计内存使用量
   std::atomic<size_t> memory_usage_;
-};
\ No newline at end of file
+  size_t wasted_bytes_;
+  size_t huge_page_blocks_;
+};
@@ -0,0 +1,784 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "ordered_index.hpp"
+
+// Byte string view of a key whose byte order equals the key order.
+// Integral keys are written big-endian with the sign bit flipped, strings
+// are their own bytes. Other key types have no ART encoding.
+template <typename K, typename Enable = void>
+struct ArtKey {
+  static const bool kSupported = false;
+};
+
+template <typename K>
+struct ArtKey<K, typename std::enable_if<std::is_integral<K>::value>::type> {
+  static const bool kSupported = true;
+
+  class Bytes {
+   public:
+    explicit Bytes(const K& k) {
+      typedef typename std::make_unsigned<K>::type U;
+      U u = static_cast<U>(k);
+      if (std::is_signed<K>::value) u ^= U(1) << (sizeof(K) * 8 - 1);
+      for (size_t i = 0; i < sizeof(K); i++) {
+        _buf[sizeof(K) - 1 - i] = static_cast<uint8_t>(u >> (8 * i));
+      }
+    }
+    const uint8_t* data() const { return _buf; }
+    size_t size() const { return sizeof(K); }
+
+   private:
+    uint8_t _buf[sizeof(K)];
+  };
+};
+
+template <>
+struct ArtKey<std::string> {
+  static const bool kSupported = true;
+
+  class Bytes {
+   public:
+    explicit Bytes(const std::string& k)
+        : _data(reinterpret_cast<const uint8_t*>(k.data())),
+          _size(k.size()) {}
+    const uint8_t* data() const { return _data; }
+    size_t size() const { return _size; }
+
+   private:
+    const uint8_t* _data;
+    size_t _size;
+  };
+};
+
+/*
+  Adaptive radix tree (Leis et al., ICDE 2013). Inner nodes branch on one
+  key byte and grow 4 -> 16 -> 48 -> 256 children as they fill, shrinking
+  back on delete. Path compression stores the bytes shared by a whole
+  subtree in the node's prefix. Keys may be prefixes of one another (e.g.
+  "ab" and "abc"), so an inner node also holds the leaf of the key that
+  ends right after its prefix; that key sorts before all children.
+
+  Only meaningful with the default comparator: the tree orders keys by
+  their ArtKey bytes.
+*/
+template <typename K, typename V>
+class ArtIndex : public OrderedIndex<K, V> {
+  static_assert(ArtKey<K>::kSupported, "no ART encoding for this key type");
+
+ public:
+  typedef typename OrderedIndex<K, V>::Iterator Iterator;
+
+  ArtIndex() : _root(nullptr), _size(0), _memoryUsage(0), _nodeCount() {}
+  ~ArtIndex() { destroy(_root); }
+
+  ArtIndex(const ArtIndex&) = delete;
+  ArtIndex& operator=(const ArtIndex&) = delete;
+
+  bool Insert(const K& k, const V& v) override {
+    typename ArtKey<K>::Bytes key(k);
+    bool added = insert(&_root, key, 0, k, v);
+    if (added) _size++;
+    return added;
+  }
+  V* Lookup(const K& k) override;
+  bool Erase(const K& k) override {
+    typename ArtKey<K>::Bytes key(k);
+    bool found = erase(&_root, key, 0);
+    if (found) _size--;
+    return found;
+  }
+  size_t Size() const override { return _size; }
+  size_t MemoryUsage() const override { return _memoryUsage; }
+  std::unique_ptr<Iterator> NewIterator() override;
+  const char* Name() const override { return "art"; }
+  void AppendMetrics(std::ostream& os) override;
+
+ private:
+  enum NodeType : uint8_t { kLeaf = 0, kNode4, kNode16, kNode48, kNode256 };
+
+  struct ArtNode {
+    explicit ArtNode(NodeType t) : type(t) {}
+    NodeType type;
+  };
+
+  struct Leaf : ArtNode {
+    Leaf(const K& k, const V& v) : ArtNode(kLeaf), key(k), value(v) {}
+    K key;
+    V value;
+  };
+
+  struct Inner : ArtNode {
+    explicit Inner(NodeType t) : ArtNode(t), count(0), terminal(nullptr) {}
+    uint16_t count;
+    // bytes shared by every key below, after the branch byte that led here
+    std::string prefix;
+    // the key ending right after prefix
+    Leaf* terminal;
+  };
+
+  // sorted keys[0, count)
+  struct Node4 : Inner {
+    Node4() : Inner(kNode4) {}
+    uint8_t keys[4];
+    ArtNode* children[4];
+  };
+
+  struct Node16 : Inner {
+    Node16() : Inner(kNode16) {}
+    uint8_t keys[16];
+    ArtNode* children[16];
+  };
+
+  // index[b] is 1 + the slot of byte b in children, 0 if absent
+  struct Node48 : Inner {
+    Node48() : Inner(kNode48) {
+      memset(index, 0, sizeof(index));
+      memset(children, 0, sizeof(children));
+    }
+    uint8_t index[256];
+    ArtNode* children[48];
+  };
+
+  struct Node256 : Inner {
+    Node256() : Inner(kNode256) { memset(children, 0, sizeof(children)); }
+    ArtNode* children[256];
+  };
+
+  class TreeIterator;
+
+  static bool sameKey(const Leaf* leaf, const typename ArtKey<K>::Bytes& key) {
+    typename ArtKey<K>::Bytes lk(leaf->key);
+    return lk.size() == key.size() &&
+           memcmp(lk.data(), key.data(), key.size()) == 0;
+  }
+  // number of leading prefix bytes of n that match key from depth
+  static size_t matchPrefix(const Inner* n,
+                            const typename ArtKey<K>::Bytes& key,
+                            size_t depth) {
+    size_t i = 0;
+    while (i < n->prefix.size() && depth + i < key.size() &&
+           static_cast<uint8_t>(n->prefix[i]) == key.data()[depth + i]) {
+      i++;
+    }
+    return i;
+  }
+
+  // the slot holding the child for byte b, or nullptr
+  static ArtNode** findChild(Inner* n, uint8_t b);
+  // the first child whose byte is >= from, its byte in *byte
+  static ArtNode* nextChild(const Inner* n, int from, uint8_t* byte);
+
+  template <typename T>
+  T* newNode() {
+    T* n = new T();
+    _memoryUsage += sizeof(T);
+    _nodeCount[n->type]++;
+    return n;
+  }
+  Leaf* newLeaf(const K& k, const V& v) {
+    _memoryUsage += sizeof(Leaf);
+    _nodeCount[kLeaf]++;
+    return new Leaf(k, v);
+  }
+  void freeNode(ArtNode* n);
+  void destroy(ArtNode* n);
+
+  // add a child to a node that has room for it
+  static void addChildNoGrow(Inner* n, uint8_t b, ArtNode* child);
+  // add a child to *ref, replacing it with a larger node when full
+  void addChild(ArtNode** ref, uint8_t b, ArtNode* child);
+  // remove the child of byte b from *ref, shrinking or collapsing it
+  void removeChild(ArtNode** ref, uint8_t b);
+  // after a removal: move *ref to a smaller node type, or replace a node
+  // left with a single entry by that entry
+  void shrink(ArtNode** ref);
+  // copy count, prefix and terminal
+  static void copyHeader(Inner* to, const Inner* from) {
+    to->count = from->count;
+    to->prefix.swap(const_cast<Inner*>(from)->prefix);
+    to->terminal = from->terminal;
+  }
+
+  bool insert(ArtNode** ref, const typename ArtKey<K>::Bytes& key,
+              size_t depth, const K& k, const V& v);
+  bool erase(ArtNode** ref, const typename ArtKey<K>::Bytes& key,
+             size_t depth);
+
+  ArtNode* _root;
+  size_t _size;
+  size_t _memoryUsage;
+  // live nodes per NodeType
+  size_t _nodeCount[5];
+};
+
+template <typename K, typename V>
+typename ArtIndex<K, V>::ArtNode** ArtIndex<K, V>::findChild(Inner* n,
+                                                             uint8_t b) {
+  switch (n->type) {
+    case kNode4: {
+      Node4* n4 = static_cast<Node4*>(n);
+      for (int i = 0; i < n4->count; i++) {
+        if (n4->keys[i] == b) return &n4->children[i];
+      }
+      return nullptr;
+    }
+    case kNode16: {
+      Node16* n16 = static_cast<Node16*>(n);
+      for (int i = 0; i < n16->count && n16->keys[i] <= b; i++) {
+        if (n16->keys[i] == b) return &n16->children[i];
+      }
+      return nullptr;
+    }
+    case kNode48: {
+      Node48* n48 = static_cast<Node48*>(n);
+      int slot = n48->index[b];
+      return slot ? &n48->children[slot - 1] : nullptr;
+    }
+    default: {
+      Node256* n256 = static_cast<Node256*>(n);
+      return n256->children[b] ? &n256->children[b] : nullptr;
+    }
+  }
+}
+
+template <typename K, typename V>
+typename ArtIndex<K, V>::ArtNode* ArtIndex<K, V>::nextChild(const Inner* n,
+                                                            int from,
+                                                            uint8_t* byte) {
+  switch (n->type) {
+    case kNode4: {
+      const Node4* n4 = static_cast<const Node4*>(n);
+      for (int i = 0; i < n4->count; i++) {
+        if (n4->keys[i] >= from) {
+          *byte = n4->keys[i];
+          return n4->children[i];
+        }
+      }
+      return nullptr;
+    }
+    case kNode16: {
+      const Node16* n16 = static_cast<const Node16*>(n);
+      for (int i = 0; i < n16->count; i++) {
+        if (n16->keys[i] >= from) {
+          *byte = n16->keys[i];
+          return n16->children[i];
+        }
+      }
+      return nullptr;
+    }
+    case kNode48: {
+      const Node48* n48 = static_cast<const Node48*>(n);
+      for (int b = from; b < 256; b++) {
+        if (n48->index[b]) {
+          *byte = b;
+          return n48->children[n48->index[b] - 1];
+        }
+      }
+      return nullptr;
+    }
+    default: {
+      const Node256* n256 = static_cast<const Node256*>(n);
+      for (int b = from; b < 256; b++) {
+        if (n256->children[b]) {
+          *byte = b;
+          return n256->children[b];
+        }
+      }
+      return nullptr;
+    }
+  }
+}
+
+template <typename K, typename V>
+void ArtIndex<K, V>::freeNode(ArtNode* n) {
+  _nodeCount[n->type]--;
+  switch (n->type) {
+    case kLeaf:
+      _memoryUsage -= sizeof(Leaf);
+      delete static_cast<Leaf*>(n);
+      break;
+    case kNode4:
+      _memoryUsage -= sizeof(Node4);
+      delete static_cast<Node4*>(n);
+      break;
+    case kNode16:
+      _memoryUsage -= sizeof(Node16);
+      delete static_cast<Node16*>(n);
+      break;
+    case kNode48:
+      _memoryUsage -= sizeof(Node48);
+      delete static_cast<Node48*>(n);
+      break;
+    case kNode256:
+      _memoryUsage -= sizeof(Node256);
+      delete static_cast<Node256*>(n);
+      break;
+  }
+}
+
+template <typename K, typename V>
+void ArtIndex<K, V>::destroy(ArtNode* n) {
+  if (n == nullptr) return;
+  if (n->type != kLeaf) {
+    Inner* in = static_cast<Inner*>(n);
+    if (in->terminal) freeNode(in->terminal);
+    uint8_t b;
+    for (ArtNode* c = nextChild(in, 0, &b); c != nullptr;
+         c = b < 255 ? nextChild(in, b + 1, &b) : nullptr) {
+      destroy(c);
+    }
+  }
+  freeNode(n);
+}
+
+template <typename K, typename V>
+void ArtIndex<K, V>::addChildNoGrow(Inner* n, uint8_t b, ArtNode* child) {
+  switch (n->type) {
+    case kNode4:
+    case kNode16: {
+      uint8_t* keys = n->type == kNode4 ? static_cast<Node4*>(n)->keys
+                                        : static_cast<Node16*>(n)->keys;
+      ArtNode** children = n->type == kNode4
+                               ? static_cast<Node4*>(n)->children
+                               : static_cast<Node16*>(n)->children;
+      int pos = n->count;
+      while (pos > 0 && keys[pos - 1] > b) {
+        keys[pos] = keys[pos - 1];
+        children[pos] = children[pos - 1];
+        pos--;
+      }
+      keys[pos] = b;
+      children[pos] = child;
+      break;
+    }
+    case kNode48: {
+      Node48* n48 = static_cast<Node48*>(n);
+      // deletes leave holes, take the first free slot
+      int slot = 0;
+      while (n48->children[slot] != nullptr) slot++;
+      n48->children[slot] = child;
+      n48->index[b] = slot + 1;
+      break;
+    }
+    default:
+      static_cast<Node256*>(n)->children[b] = child;
+      break;
+  }
+  n->count++;
+}
+
+template <typename K, typename V>
+void ArtIndex<K, V>::addChild(ArtNode** ref, uint8_t b, ArtNode* child) {
+  Inner* n = static_cast<Inner*>(*ref);
+  if (n->type == kNode4 && n->count == 4) {
+    Node4* old = static_cast<Node4*>(n);
+    Node16* grown = newNode<Node16>();
+    copyHeader(grown, old);
+    memcpy(grown->keys, old->keys, 4);
+    memcpy(grown->children, old->children, 4 * sizeof(ArtNode*));
+    freeNode(old);
+    n = grown;
+  } else if (n->type == kNode16 && n->count == 16) {
+    Node16* old = static_cast<Node16*>(n);
+    Node48* grown = newNode<Node48>();
+    copyHeader(grown, old);
+    for (int i = 0; i < 16; i++) {
+      grown->children[i] = old->children[i];
+      grown->index[old->keys[i]] = i + 1;
+    }
+    freeNode(old);
+    n = grown;
+  } else if (n->type == kNode48 && n->count == 48) {
+    Node48* old = static_cast<Node48*>(n);
+    Node256* grown = newNode<Node256>();
+    copyHeader(grown, old);
+    for (int i = 0; i < 256; i++) {
+      if (old->index[i]) grown->children[i] = old->children[old->index[i] - 1];
+    }
+    freeNode(old);
+    n = grown;
+  }
+  addChildNoGrow(n, b, child);
+  *ref = n;
+}
+
+template <typename K, typename V>
+void ArtIndex<K, V>::removeChild(ArtNode** ref, uint8_t b) {
+  Inner* n = static_cast<Inner*>(*ref);
+  switch (n->type) {
+    case kNode4:
+    case kNode16: {
+      uint8_t* keys = n->type == kNode4 ? static_cast<Node4*>(n)->keys
+                                        : static_cast<Node16*>(n)->keys;
+      ArtNode** children = n->type == kNode4
+                               ? static_cast<Node4*>(n)->children
+                               : static_cast<Node16*>(n)->children;
+      int pos = 0;
+      while (keys[pos] != b) pos++;
+      for (int i = pos; i + 1 < n->count; i++) {
+        keys[i] = keys[i + 1];
+        children[i] = children[i + 1];
+      }
+      break;
+    }
+    case kNode48: {
+      Node48* n48 = static_cast<Node48*>(n);
+      n48->children[n48->index[b] - 1] = nullptr;
+      n48->index[b] = 0;
+      break;
+    }
+    default:
+      static_cast<Node256*>(n)->children[b] = nullptr;
+      break;
+  }
+  n->count--;
+  shrink(ref);
+}
+
+template <typename K, typename V>
+void ArtIndex<K, V>::shrink(ArtNode** ref) {
+  Inner* n = static_cast<Inner*>(*ref);
+  switch (n->type) {
+    case kNode4: {
+      Node4* n4 = static_cast<Node4*>(n);
+      if (n4->count == 0) {
+        // only the terminal is left, or nothing at all for an empty root
+        *ref = n4->terminal;
+        freeNode(n4);
+      } else if (n4->count == 1 && n4->terminal == nullptr) {
+        ArtNode* child = n4->children[0];
+        if (child->type != kLeaf) {
+          // the child absorbs our prefix and the branch byte
+          Inner* in = static_cast<Inner*>(child);
+          std::string prefix = n4->prefix;
+          prefix.push_back(static_cast<char>(n4->keys[0]));
+          prefix += in->prefix;
+          in->prefix.swap(prefix);
+        }
+        *ref = child;
+        freeNode(n4);
+      }
+      break;
+    }
+    case kNode16: {
+      Node16* old = static_cast<Node16*>(n);
+      if (old->count > 3) break;
+      Node4* small = newNode<Node4>();
+      copyHeader(small, old);
+      memcpy(small->keys, old->keys, old->count);
+      memcpy(small->children, old->children, old->count * sizeof(ArtNode*));
+      freeNode(old);
+      *ref = small;
+      break;
+    }
+    case kNode48: {
+      Node48* old = static_cast<Node48*>(n);
+      if (old->count > 12) break;
+      Node16* small = newNode<Node16>();
+      copyHeader(small, old);
+      int pos = 0;
+      for (int b = 0; b < 256; b++) {
+        if (old->index[b]) {
+          small->keys[pos] = b;
+          small->children[pos++] = old->children[old->index[b] - 1];
+        }
+      }
+      freeNode(old);
+      *ref = small;
+      break;
+    }
+    default: {
+      Node256* old = static_cast<Node256*>(n);
+      if (old->count > 37) break;
+      Node48* small = newNode<Node48>();
+      copyHeader(small, old);
+      int slot = 0;
+      for (int b = 0; b < 256; b++) {
+        if (old->children[b]) {
+          small->children[slot] = old->children[b];
+          small->index[b] = ++slot;
+        }
+      }
+      freeNode(old);
+      *ref = small;
+      break;
+    }
+  }
+}
+
+template <typename K, typename V>
+bool ArtIndex<K, V>::insert(ArtNode** ref,
+                            const typename ArtKey<K>::Bytes& key,
+                            size_t depth, const K& k, const V& v) {
+  ArtNode* n = *ref;
+  if (n == nullptr) {
+    *ref = newLeaf(k, v);
+    return true;
+  }
+
+  if (n->type == kLeaf) {
+    Leaf* leaf = static_cast<Leaf*>(n);
+    if (sameKey(leaf, key)) {
+      leaf->value = v;
+      return false;
+    }
+    // split the leaf: a new node holds the common bytes of both keys
+    typename ArtKey<K>::Bytes lk(leaf->key);
+    size_t i = depth;
+    while (i < lk.size() && i < key.size() && lk.data()[i] == key.data()[i]) {
+      i++;
+    }
+    Node4* split = newNode<Node4>();
+    split->prefix.assign(reinterpret_cast<const char*>(key.data()) + depth,
+                         i - depth);
+    Leaf* added = newLeaf(k, v);
+    if (i == lk.size()) {
+      split->terminal = leaf;
+    } else {
+      addChildNoGrow(split, lk.data()[i], leaf);
+    }
+    if (i == key.size()) {
+      split->terminal = added;
+    } else {
+      addChildNoGrow(split, key.data()[i], added);
+    }
+    *ref = split;
+    return true;
+  }
+
+  Inner* in = static_cast<Inner*>(n);
+  size_t matched = matchPrefix(in, key, depth);
+  if (matched < in->prefix.size()) {
+    // the key leaves the compressed path: split the prefix
+    Node4* split = newNode<Node4>();
+    split->prefix = in->prefix.substr(0, matched);
+    uint8_t b = static_cast<uint8_t>(in->prefix[matched]);
+    in->prefix.erase(0, matched + 1);
+    addChildNoGrow(split, b, in);
+    Leaf* added = newLeaf(k, v);
+    if (depth + matched == key.size()) {
+      split->terminal = added;
+    } else {
+      addChildNoGrow(split, key.data()[depth + matched], added);
+    }
+    *ref = split;
+    return true;
+  }
+
+  depth += in->prefix.size();
+  if (depth == key.size()) {
+    if (in->terminal != nullptr) {
+      in->terminal->value = v;
+      return false;
+    }
+    in->terminal = newLeaf(k, v);
+    return true;
+  }
+  ArtNode** child = findChild(in, key.data()[depth]);
+  if (child != nullptr) return insert(child, key, depth + 1, k, v);
+  addChild(ref, key.data()[depth], newLeaf(k, v));
+  return true;
+}
+
+template <typename K, typename V>
+V* ArtIndex<K, V>::Lookup(const K& k) {
+  typename ArtKey<K>::Bytes key(k);
+  ArtNode* n = _root;
+  size_t depth = 0;
+  while (n != nullptr) {
+    if (n->type == kLeaf) {
+      Leaf* leaf = static_cast<Leaf*>(n);
+      return sameKey(leaf, key) ? &leaf->value : nullptr;
+    }
+    Inner* in = static_cast<Inner*>(n);
+    if (matchPrefix(in, key, depth) != in->prefix.size()) return nullptr;
+    depth += in->prefix.size();
+    if (depth == key.size()) {
+      return in->terminal ? &in->terminal->value : nullptr;
+    }
+    ArtNode** child = findChild(in, key.data()[depth]);
+    n = child ? *child : nullptr;
+    depth++;
+  }
+  return nullptr;
+}
+
+template <typename K, typename V>
+bool ArtIndex<K, V>::erase(ArtNode** ref,
+                           const typename ArtKey<K>::Bytes& key,
+                           size_t depth) {
+  ArtNode* n = *ref;
+  if (n == nullptr) return false;
+  if (n->type == kLeaf) {
+    // only reached for a leaf root
+    if (!sameKey(static_cast<Leaf*>(n), key)) return false;
+    freeNode(n);
+    *ref = nullptr;
+    return true;
+  }
+
+  Inner* in = static_cast<Inner*>(n);
+  if (matchPrefix(in, key, depth) != in->prefix.size()) return false;
+  depth += in->prefix.size();
+  if (depth == key.size()) {
+    if (in->terminal == nullptr) return false;
+    freeNode(in->terminal);
+    in->terminal = nullptr;
+    shrink(ref);
+    return true;
+  }
+
+  uint8_t b = key.data()[depth];
+  ArtNode** child = findChild(in, b);
+  if (child == nullptr) return false;
+  if ((*child)->type == kLeaf) {
+    if (!sameKey(static_cast<Leaf*>(*child), key)) return false;
+    freeNode(*child);
+    removeChild(ref, b);
+    return true;
+  }
+  // an inner child keeps at least one entry, it never turns null
+  return erase(child, key, depth + 1);
+}
+
+// Walks the tree with an explicit stack. Each frame is an inner node and
+// the next byte to visit in it, -1 while its terminal is still pending.
+template <typename K, typename V>
+class ArtIndex<K, V>::TreeIterator : public Iterator {
+ public:
+  explicit TreeIterator(const ArtIndex* index)
+      : _index(index), _leaf(nullptr) {}
+
+  bool Valid() const override { return _leaf != nullptr; }
+  const K& key() const override { return _leaf->key; }
+  const V& value() const override { return _leaf->value; }
+  void Next() override { advance(); }
+
+  void SeekToFirst() override {
+    _stack.clear();
+    _leaf = nullptr;
+    ArtNode* root = _index->_root;
+    if (root == nullptr) return;
+    if (root->type == kLeaf) {
+      _leaf = static_cast<Leaf*>(root);
+      return;
+    }
+    _stack.push_back(Frame{static_cast<Inner*>(root), -1});
+    advance();
+  }
+
+  void Seek(const K& target) override {
+    typename ArtKey<K>::Bytes key(target);
+    _stack.clear();
+    _leaf = nullptr;
+    ArtNode* n = _index->_root;
+    size_t depth = 0;
+    while (n != nullptr) {
+      if (n->type == kLeaf) {
+        Leaf* leaf = static_cast<Leaf*>(n);
+        typename ArtKey<K>::Bytes lk(leaf->key);
+        if (compare(lk.data(), lk.size(), key.data(), key.size()) >= 0) {
+          _leaf = leaf;
+        } else {
+          advance();
+        }
+        return;
+      }
+      Inner* in = static_cast<Inner*>(n);
+      size_t avail = key.size() - depth;
+      size_t len = in->prefix.size() < avail ? in->prefix.size() : avail;
+      int cmp = memcmp(in->prefix.data(), key.data() + depth, len);
+      if (cmp == 0 && len < in->prefix.size()) cmp = 1;
+      if (cmp > 0) {
+        // every key below is greater than target
+        _stack.push_back(Frame{in, -1});
+        advance();
+        return;
+      }
+      if (cmp < 0) {
+        // every key below is smaller
+        advance();
+        return;
+      }
+      depth += in->prefix.size();
+      if (depth == key.size()) {
+        _stack.push_back(Frame{in, -1});
+        advance();
+        return;
+      }
+      // the terminal and the children before b are smaller than target
+      uint8_t b = key.data()[depth];
+      _stack.push_back(Frame{in, b + 1});
+      ArtNode** child = findChild(in, b);
+      n = child ? *child : nullptr;
+      depth++;
+    }
+    advance();
+  }
+
+ private:
+  struct Frame {
+    Inner* node;
+    int next;
+  };
+
+  static int compare(const uint8_t* a, size_t na, const uint8_t* b,
+                     size_t nb) {
+    int r = memcmp(a, b, na < nb ? na : nb);
+    if (r != 0) return r;
+    return na < nb ? -1 : (na > nb ? 1 : 0);
+  }
+
+  // move to the next leaf in key order
+  void advance() {
+    _leaf = nullptr;
+    while (!_stack.empty()) {
+      Frame& f = _stack.back();
+      if (f.next == -1) {
+        f.next = 0;
+        if (f.node->terminal != nullptr) {
+          _leaf = f.node->terminal;
+          return;
+        }
+      }
+      uint8_t b;
+      ArtNode* child = f.next < 256 ? nextChild(f.node, f.next, &b) : nullptr;
+      if (child == nullptr) {
+        _stack.pop_back();
+        continue;
+      }
+      f.next = b + 1;
+      if (child->type == kLeaf) {
+        _leaf = static_cast<Leaf*>(child);
+        return;
+      }
+      _stack.push_back(Frame{static_cast<Inner*>(child), -1});
+    }
+  }
+
+  const ArtIndex* _index;
+  std::vector<Frame> _stack;
+  Leaf* _leaf;
+};
+
+template <typename K, typename V>
+std::unique_ptr<typename ArtIndex<K, V>::Iterator>
+ArtIndex<K, V>::NewIterator() {
+  return std::unique_ptr<Iterator>(new TreeIterator(this));
+}
+
+template <typename K, typename V>
+void ArtIndex<K, V>::AppendMetrics(std::ostream& os) {
+  static const char* const kNames[] = {"leaf", "node4", "node16", "node48",
+                                       "node256"};
+  os << "# TYPE minikv_art_nodes gauge\n";
+  for (int i = 0; i < 5; i++) {
+    os << "minikv_art_nodes{type=\"" << kNames[i] << "\"} " << _nodeCount[i]
+       << "\n";
+  }
+}
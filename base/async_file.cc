@@ -0,0 +1,629 @@
+#include "async_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <set>
+#include <thread>
+
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#endif
+
+#include "log.hpp"
+
+class AsyncFile::Backend {
+ public:
+  virtual ~Backend() {}
+  virtual const char* Name() const = 0;
+  // 接管req, 完成后由后台线程调用AsyncFile::Finish
+  virtual void Submit(Request* req) = 0;
+};
+
+#ifdef __NR_io_uring_setup
+
+/*
+  一个io_uring实例和一个提交线程
+  1.提交线程把调用者入队的请求放进SQ, 用io_uring_enter提交并等待完成,
+    SQ和CQ只由这个线程访问
+  2.写直接使用文件偏移, 相互独立, 可以并发执行; Sync前面的写带上
+    IOSQE_IO_DRAIN | IOSQE_IO_LINK, 等此前提交的所有请求完成后才开始,
+    fsync链接在它后面
+  3.写被截断时提交剩余部分, 被取消的fsync重新提交; outstanding_记录
+    未完成的写, Sync只有在它之前的写全部完成后才算完成
+  4.io_uring_enter出现不可重试的错误时, 以这个错误结束还没有提交的请求,
+    已提交的请求照常等待完成
+*/
+class AsyncFile::UringBackend : public AsyncFile::Backend {
+ public:
+  // 内核不支持或被禁用时返回nullptr
+  static UringBackend* Create(AsyncFile* file);
+  ~UringBackend() override;
+
+  const char* Name() const override { return "io_uring"; }
+  void Submit(Request* req) override {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      queue_.push_back(req);
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  explicit UringBackend(AsyncFile* file)
+      : file_(file),
+        ring_fd_(-1),
+        ring_(MAP_FAILED),
+        ring_size_(0),
+        sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)),
+        sqes_size_(0),
+        fixed_(false),
+        to_submit_(0),
+        inflight_(0),
+        stop_(false) {}
+
+  bool Init();
+  void Run();
+  void Prepare(const std::vector<Request*>& batch);
+  // 保证SQ中还能放下n个SQE, 链接的写和fsync必须在同一次提交中
+  void Reserve(unsigned n);
+  io_uring_sqe* NextSqe();
+  void PrepareWrite(Request* req, uint8_t flags);
+  void PrepareSync(Request* req, uint8_t flags);
+  // 提交已放入SQ的请求, 等待至少一个完成并处理
+  void SubmitAndWait();
+  // io_uring_enter失败后, 以err结束内核还没有取走的请求
+  void FailUnsubmitted(int err);
+  void Reap();
+  void Complete(Request* req, int res);
+
+  AsyncFile* file_;
+  int ring_fd_;
+  void* ring_;
+  size_t ring_size_;
+  io_uring_sqe* sqes_;
+  size_t sqes_size_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned sq_entries_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  io_uring_cqe* cqes_;
+  // 缓冲区注册成功, 使用WRITE_FIXED
+  bool fixed_;
+
+  // 以下成员只由提交线程访问
+  // 已放入SQ还没有提交的个数
+  unsigned to_submit_;
+  // 已放入SQ还没有完成的个数
+  unsigned inflight_;
+  std::set<uint64_t> outstanding_;
+  std::vector<Request*> retry_writes_;
+  std::vector<Request*> retry_syncs_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::vector<Request*> queue_;
+  bool stop_;
+  std::thread thread_;
+};
+
+AsyncFile::UringBackend* AsyncFile::UringBackend::Create(AsyncFile* file) {
+  UringBackend* backend = new UringBackend(file);
+  if (!backend->Init()) {
+    delete backend;
+    return nullptr;
+  }
+  backend->thread_ = std::thread(&UringBackend::Run, backend);
+  return backend;
+}
+
+bool AsyncFile::UringBackend::Init() {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  unsigned entries = std::max(16, file_->options_.num_buffers * 2);
+  ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+  if (ring_fd_ < 0) {
+    KV_LOG("io_uring_setup: " << strerror(errno));
+    return false;
+  }
+  // 5.4之前的内核SQ和CQ需要分别mmap, 不再支持
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+    KV_LOG("io_uring: kernel too old");
+    return false;
+  }
+  ring_size_ = std::max(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                        p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+  ring_ = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size_,
+                                          PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, ring_fd_,
+                                          IORING_OFF_SQES));
+  if (ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+    KV_LOG("io_uring mmap: " << strerror(errno));
+    return false;
+  }
+  char* base = static_cast<char*>(ring_);
+  sq_tail_ = reinterpret_cast<unsigned*>(base + p.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned*>(base + p.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned*>(base + p.sq_off.array);
+  sq_entries_ = p.sq_entries;
+  cq_head_ = reinterpret_cast<unsigned*>(base + p.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(base + p.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned*>(base + p.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(base + p.cq_off.cqes);
+
+  // 注册失败(如RLIMIT_MEMLOCK不足)时退回到普通的writev
+  std::vector<struct iovec> iovs;
+  for (Buffer& b : file_->buffers_) {
+    iovs.push_back({b.data, file_->options_.buffer_size});
+  }
+  fixed_ = !iovs.empty() &&
+           syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+                   iovs.data(), static_cast<unsigned>(iovs.size())) == 0;
+  return true;
+}
+
+AsyncFile::UringBackend::~UringBackend() {
+  if (thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+  if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+  if (ring_ != MAP_FAILED) munmap(ring_, ring_size_);
+  // 关闭ring时内核注销固定缓冲区
+  if (ring_fd_ >= 0) close(ring_fd_);
+}
+
+void AsyncFile::UringBackend::Run() {
+  std::vector<Request*> batch;
+  while (true) {
+    batch.clear();
+    // 重试的写排在重试的Sync前面, 让fsync链接在它们之后
+    batch.swap(retry_writes_);
+    batch.insert(batch.end(), retry_syncs_.begin(), retry_syncs_.end());
+    retry_syncs_.clear();
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      cv_.wait(lock, [&] {
+        return !batch.empty() || !queue_.empty() || inflight_ > 0 || stop_;
+      });
+      if (batch.empty() && queue_.empty() && inflight_ == 0) return;
+      batch.insert(batch.end(), queue_.begin(), queue_.end());
+      queue_.clear();
+    }
+    Prepare(batch);
+    if (inflight_ > 0) SubmitAndWait();
+  }
+}
+
+void AsyncFile::UringBackend::Prepare(const std::vector<Request*>& batch) {
+  for (size_t i = 0; i < batch.size(); i++) {
+    Request* req = batch[i];
+    if (req->type == Request::kWrite) {
+      outstanding_.insert(req->seq);
+      bool linked =
+          i + 1 < batch.size() && batch[i + 1]->type == Request::kSync;
+      Reserve(linked ? 2 : 1);
+      PrepareWrite(req, linked ? IOSQE_IO_DRAIN | IOSQE_IO_LINK : 0);
+    } else {
+      bool linked = i > 0 && batch[i - 1]->type == Request::kWrite;
+      if (!linked) Reserve(1);
+      PrepareSync(req, linked ? 0 : IOSQE_IO_DRAIN);
+    }
+  }
+}
+
+void AsyncFile::UringBackend::Reserve(unsigned n) {
+  while (inflight_ + n > sq_entries_) SubmitAndWait();
+}
+
+io_uring_sqe* AsyncFile::UringBackend::NextSqe() {
+  // 只有提交线程修改tail, 内核在io_uring_enter中才读取SQE
+  unsigned tail = *sq_tail_;
+  unsigned idx = tail & *sq_mask_;
+  io_uring_sqe* sqe = &sqes_[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[idx] = idx;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  to_submit_++;
+  inflight_++;
+  return sqe;
+}
+
+void AsyncFile::UringBackend::PrepareWrite(Request* req, uint8_t flags) {
+  io_uring_sqe* sqe = NextSqe();
+  Buffer* b = req->buf;
+  sqe->fd = file_->fd_;
+  sqe->off = req->offset + req->done_bytes;
+  sqe->flags = flags;
+  sqe->user_data = reinterpret_cast<uint64_t>(req);
+  if (fixed_ && b->index >= 0) {
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->addr = reinterpret_cast<uint64_t>(b->data + req->done_bytes);
+    sqe->len = static_cast<uint32_t>(b->len - req->done_bytes);
+    sqe->buf_index = static_cast<uint16_t>(b->index);
+  } else {
+    req->iov.iov_base = b->data + req->done_bytes;
+    req->iov.iov_len = b->len - req->done_bytes;
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->addr = reinterpret_cast<uint64_t>(&req->iov);
+    sqe->len = 1;
+  }
+}
+
+void AsyncFile::UringBackend::PrepareSync(Request* req, uint8_t flags) {
+  io_uring_sqe* sqe = NextSqe();
+  sqe->opcode = IORING_OP_FSYNC;
+  sqe->fd = file_->fd_;
+  sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+  sqe->flags = flags;
+  sqe->user_data = reinterpret_cast<uint64_t>(req);
+}
+
+void AsyncFile::UringBackend::SubmitAndWait() {
+  // 内核一次没有取走全部SQE时(如内存不足)继续提交
+  do {
+    int r = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_,
+                                     to_submit_, 1, IORING_ENTER_GETEVENTS,
+                                     nullptr, 0));
+    if (r >= 0) {
+      to_submit_ -= std::min(static_cast<unsigned>(r), to_submit_);
+    } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      int err = errno;
+      KV_LOG("io_uring_enter: " << strerror(err));
+      FailUnsubmitted(err);
+      // 已提交的请求还在使用缓冲区, 不能提前结束; 内核完成后仍会写CQ,
+      // 这里轮询CQ而不是再进入io_uring_enter
+      unsigned before = inflight_;
+      Reap();
+      if (inflight_ == before && inflight_ > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      return;
+    }
+    Reap();
+  } while (to_submit_ > 0);
+}
+
+void AsyncFile::UringBackend::FailUnsubmitted(int err) {
+  // 内核只在io_uring_enter中读取SQE, 收回tail后它们不会再被执行
+  unsigned tail = *sq_tail_ - to_submit_;
+  for (unsigned i = 0; i < to_submit_; i++) {
+    io_uring_sqe* sqe = &sqes_[(tail + i) & *sq_mask_];
+    Request* req = reinterpret_cast<Request*>(sqe->user_data);
+    inflight_--;
+    if (req->type == Request::kWrite) outstanding_.erase(req->seq);
+    file_->Finish(req, err);
+  }
+  __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+  to_submit_ = 0;
+}
+
+void AsyncFile::UringBackend::Reap() {
+  unsigned head = *cq_head_;
+  unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++) {
+    io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+    Request* req = reinterpret_cast<Request*>(cqe->user_data);
+    int res = cqe->res;
+    // 先归还CQE, Complete可能执行用户回调
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    Complete(req, res);
+  }
+}
+
+void AsyncFile::UringBackend::Complete(Request* req, int res) {
+  inflight_--;
+  if (req->type == Request::kWrite) {
+    if (res == -EINTR || res == -EAGAIN) {
+      retry_writes_.push_back(req);
+      return;
+    }
+    if (res > 0) {
+      req->done_bytes += res;
+      if (req->done_bytes < req->buf->len) {
+        retry_writes_.push_back(req);
+        return;
+      }
+    }
+    outstanding_.erase(req->seq);
+    file_->Finish(req, res < 0 ? -res : (res == 0 ? EIO : 0));
+    return;
+  }
+  // 链接的写被截断或失败时fsync被取消; 它之前的写还有没完成的
+  // (在重试)时也要重新fsync
+  bool earlier_writes =
+      !outstanding_.empty() && *outstanding_.begin() <= req->seq;
+  if (res == -ECANCELED || res == -EINTR || res == -EAGAIN ||
+      (res == 0 && earlier_writes)) {
+    retry_syncs_.push_back(req);
+    return;
+  }
+  file_->Finish(req, res < 0 ? -res : 0);
+}
+
+#endif  // __NR_io_uring_setup
+
+/*
+  线程池: 每个线程从队列中取请求, 写用阻塞的pwrite, 各写之间没有顺序;
+  Sync等到序号不大于它的写全部完成后再fdatasync
+*/
+class AsyncFile::PoolBackend : public AsyncFile::Backend {
+ public:
+  PoolBackend(AsyncFile* file, int threads) : file_(file), stop_(false) {
+    for (int i = 0; i < std::max(1, threads); i++) {
+      threads_.emplace_back(&PoolBackend::Run, this);
+    }
+  }
+
+  ~PoolBackend() override {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : threads_) t.join();
+  }
+
+  const char* Name() const override { return "threadpool"; }
+
+  void Submit(Request* req) override {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (req->type == Request::kWrite) outstanding_.insert(req->seq);
+      queue_.push_back(req);
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  void Run() {
+    while (true) {
+      Request* req;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) return;
+        req = queue_.front();
+        queue_.pop_front();
+      }
+      if (req->type == Request::kWrite) {
+        Write(req);
+      } else {
+        Sync(req);
+      }
+    }
+  }
+
+  void Write(Request* req) {
+    const Buffer* b = req->buf;
+    int err = 0;
+    while (req->done_bytes < b->len) {
+      ssize_t r = pwrite(file_->fd_, b->data + req->done_bytes,
+                         b->len - req->done_bytes,
+                         req->offset + req->done_bytes);
+      if (r < 0 && errno == EINTR) continue;
+      if (r <= 0) {
+        err = r < 0 ? errno : EIO;
+        break;
+      }
+      req->done_bytes += r;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      outstanding_.erase(req->seq);
+    }
+    written_cv_.notify_all();
+    file_->Finish(req, err);
+  }
+
+  void Sync(Request* req) {
+    {
+      // 这些写在队列中排在前面, 已经被其他线程取走
+      std::unique_lock<std::mutex> lock(mu_);
+      written_cv_.wait(lock, [this, req] {
+        return outstanding_.empty() || *outstanding_.begin() > req->seq;
+      });
+    }
+    int err = fdatasync(file_->fd_) == 0 ? 0 : errno;
+    file_->Finish(req, err);
+  }
+
+  AsyncFile* file_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  // 有写完成时通知等待的Sync
+  std::condition_variable written_cv_;
+  std::deque<Request*> queue_;
+  // 未完成的写的序号
+  std::set<uint64_t> outstanding_;
+  bool stop_;
+  std::vector<std::thread> threads_;
+};
+
+AsyncFile::AsyncFile(const AsyncFileOptions& options)
+    : options_(options),
+      fd_(-1),
+      pool_(nullptr),
+      cur_(nullptr),
+      offset_(0),
+      next_seq_(0),
+      pending_(0) {
+  assert(options_.buffer_size > 0);
+}
+
+AsyncFile::~AsyncFile() {
+  Close();
+  free(pool_);
+}
+
+bool AsyncFile::Open(const std::string& fname, bool truncate,
+                     std::string* error) {
+  assert(fd_ < 0);
+  int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0);
+  fd_ = open(fname.c_str(), flags, 0644);
+  if (fd_ < 0) {
+    *error = fname + ": " + strerror(errno);
+    return false;
+  }
+  // 写使用显式偏移, 追加模式从文件末尾开始
+  struct stat st;
+  offset_ = fstat(fd_, &st) == 0 ? st.st_size : 0;
+  error_.clear();
+
+  if (pool_ == nullptr && options_.num_buffers > 0) {
+    size_t bytes = options_.buffer_size * options_.num_buffers;
+    void* p = nullptr;
+    if (posix_memalign(&p, 4096, bytes) == 0) {
+      pool_ = static_cast<char*>(p);
+      for (int i = 0; i < options_.num_buffers; i++) {
+        buffers_.push_back({pool_ + i * options_.buffer_size, 0, i});
+      }
+      for (Buffer& b : buffers_) free_.push_back(&b);
+    }
+  }
+
+#ifdef __NR_io_uring_setup
+  if (options_.use_io_uring) backend_.reset(UringBackend::Create(this));
+#endif
+  if (!backend_) {
+    KV_LOG("async file: use the thread pool");
+    backend_.reset(new PoolBackend(this, options_.threads));
+  }
+  return true;
+}
+
+AsyncFile::Buffer* AsyncFile::NewBuffer() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!free_.empty()) {
+      Buffer* b = free_.back();
+      free_.pop_back();
+      b->len = 0;
+      return b;
+    }
+  }
+  // 固定缓冲区都在写, 临时分配一个而不是等待
+  return new Buffer{new char[options_.buffer_size], 0, -1};
+}
+
+void AsyncFile::Append(const char* data, size_t n) {
+  assert(fd_ >= 0);
+  while (n > 0) {
+    if (cur_ == nullptr) cur_ = NewBuffer();
+    size_t m = std::min(n, options_.buffer_size - cur_->len);
+    memcpy(cur_->data + cur_->len, data, m);
+    cur_->len += m;
+    data += m;
+    n -= m;
+    if (cur_->len == options_.buffer_size) SubmitBuffer();
+  }
+}
+
+void AsyncFile::SubmitBuffer() {
+  if (cur_ == nullptr || cur_->len == 0) return;
+  Request* req = new Request();
+  req->type = Request::kWrite;
+  req->buf = cur_;
+  req->offset = offset_;
+  req->done_bytes = 0;
+  offset_ += cur_->len;
+  cur_ = nullptr;
+  Submit(req);
+}
+
+void AsyncFile::Sync(std::function<void(bool)> done) {
+  assert(fd_ >= 0);
+  SubmitBuffer();
+  Request* req = new Request();
+  req->type = Request::kSync;
+  req->buf = nullptr;
+  req->callback = std::move(done);
+  Submit(req);
+}
+
+void AsyncFile::Submit(Request* req) {
+  req->seq = req->type == Request::kWrite ? ++next_seq_ : next_seq_;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    pending_++;
+  }
+  backend_->Submit(req);
+}
+
+void AsyncFile::Finish(Request* req, int err) {
+  bool ok;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (err != 0 && error_.empty()) error_ = strerror(err);
+    // 出错后的Sync都返回失败
+    ok = error_.empty();
+    Buffer* b = req->buf;
+    if (b != nullptr && b->index >= 0) {
+      free_.push_back(b);
+    } else if (b != nullptr) {
+      delete[] b->data;
+      delete b;
+    }
+  }
+  if (req->callback) req->callback(ok);
+  delete req;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    pending_--;
+  }
+  cv_.notify_all();
+}
+
+bool AsyncFile::Close() {
+  if (fd_ < 0) return error().empty();
+  SubmitBuffer();
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    cv_.wait(lock, [this] { return pending_ == 0; });
+  }
+  backend_.reset();
+  if (cur_ != nullptr) {
+    // 空的缓冲区, 没有提交
+    if (cur_->index >= 0) {
+      free_.push_back(cur_);
+    } else {
+      delete[] cur_->data;
+      delete cur_;
+    }
+    cur_ = nullptr;
+  }
+  int err = close(fd_) == 0 ? 0 : errno;
+  fd_ = -1;
+  std::lock_guard<std::mutex> lock(mu_);
+  if (err != 0 && error_.empty()) error_ = strerror(err);
+  return error_.empty();
+}
+
+const char* AsyncFile::backend() const {
+  return backend_ ? backend_->Name() : "";
+}
+
+std::string AsyncFile::error() {
+  std::lock_guard<std::mutex> lock(mu_);
+  return error_;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+struct AsyncFileOptions {
+  // Append先把数据拷贝到缓冲区, 缓冲区写满后整块提交
+  size_t buffer_size = 256 << 10;
+  // 预先分配的缓冲区个数, io_uring下会注册为固定缓冲区(registered buffers)
+  int num_buffers = 8;
+  // false时不尝试io_uring, 直接使用线程池
+  bool use_io_uring = true;
+  // 后备线程池的线程数
+  int threads = 2;
+};
+
+/*
+  异步顺序写文件, 用于快照和日志
+  1.调用者只做内存拷贝和入队: Append把数据拷贝到缓冲区, 缓冲区写满后
+    交给后台提交, 缓冲区用完时临时从堆上分配, 所以调用者不会等待磁盘
+  2.后台优先使用io_uring(直接系统调用, 不依赖liburing), 预分配的缓冲区
+    注册为固定缓冲区, 用WRITE_FIXED提交; 内核不支持或被禁用时退回到
+    线程池中的阻塞pwrite
+  3.Sync在此前提交的所有写完成之后fdatasync, io_uring下fsync链接
+    (IOSQE_IO_LINK)在最后一个写之后, 写被截断时重新提交剩余部分和fsync
+  Append/Sync/Close由同一个线程调用; Sync的回调在后台线程上执行,
+  回调中不能再调用这个AsyncFile
+*/
+class AsyncFile {
+ public:
+  explicit AsyncFile(const AsyncFileOptions& options = AsyncFileOptions());
+  // 等待未完成的写, 不会fsync
+  ~AsyncFile();
+
+  AsyncFile(const AsyncFile&) = delete;
+  AsyncFile& operator=(const AsyncFile&) = delete;
+
+  // truncate为false时追加到文件末尾
+  bool Open(const std::string& fname, bool truncate, std::string* error);
+  void Append(const char* data, size_t n);
+  void Append(const std::string& s) { Append(s.data(), s.size()); }
+  // 此前Append的数据全部写入并落盘后调用done(ok), ok为false表示有写失败
+  void Sync(std::function<void(bool)> done);
+  // 提交剩余数据并等待所有写完成, 返回是否全部成功
+  bool Close();
+
+  // "io_uring" 或 "threadpool", Open之前为""
+  const char* backend() const;
+  // Append的总字节数
+  uint64_t size() const { return offset_ + (cur_ ? cur_->len : 0); }
+  // 第一个失败的原因
+  std::string error();
+
+ private:
+  struct Buffer {
+    char* data;
+    size_t len;
+    // 固定缓冲区的下标, 临时从堆上分配的为-1
+    int index;
+  };
+
+  struct Request {
+    enum Type { kWrite, kSync };
+    Type type;
+    Buffer* buf;
+    uint64_t offset;
+    // 截断的写已经完成的字节数
+    size_t done_bytes;
+    std::function<void(bool)> callback;
+    // 写的序号; Sync为它之前最后一个写的序号, 这些写完成后才能fsync
+    uint64_t seq;
+    // io_uring: 非固定缓冲区的writev参数
+    struct iovec iov;
+  };
+
+  class Backend;
+  class UringBackend;
+  class PoolBackend;
+
+  Buffer* NewBuffer();
+  // 提交当前缓冲区
+  void SubmitBuffer();
+  void Submit(Request* req);
+  // 后台线程完成一个请求, err为0或errno
+  void Finish(Request* req, int err);
+
+  const AsyncFileOptions options_;
+  int fd_;
+  std::unique_ptr<Backend> backend_;
+  // 预分配的缓冲区共用一块内存
+  char* pool_;
+  std::vector<Buffer> buffers_;
+  // 正在填充的缓冲区
+  Buffer* cur_;
+  // 下一个写的文件偏移
+  uint64_t offset_;
+  // 最后一个写的序号
+  uint64_t next_seq_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  // 以下成员由mu_保护
+  std::vector<Buffer*> free_;
+  // 已提交未完成的请求数
+  int pending_;
+  std::string error_;
+};
+
+// 把std::ostream的输出追加到AsyncFile, 便于按operator<<格式化写入
+class AsyncFileStreamBuf : public std::streambuf {
+ public:
+  explicit AsyncFileStreamBuf(AsyncFile* file) : file_(file) {}
+
+ protected:
+  int_type overflow(int_type c) override {
+    if (c != traits_type::eof()) {
+      char ch = traits_type::to_char_type(c);
+      file_->Append(&ch, 1);
+    }
+    return traits_type::not_eof(c);
+  }
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    file_->Append(s, static_cast<size_t>(n));
+    return n;
+  }
+
+ private:
+  AsyncFile* file_;
+};
@@ -1,6 +1,8 @@
 #pragma once
 #include <cstddef>
 #include <iostream>
+#include <string>
+#include <type_traits>
 #include <vector>
 
 class BitMap {
@@ -24,6 +26,13 @@ class BitMap {
     }
   }
 
+  // safe against other SetAtomic calls, but not against Set or Found;
+  // _size is not maintained
+  void SetAtomic(size_t num) {
+    __atomic_fetch_or(&_array[num >> 5], size_t(1) << (31 - num % 32),
+                      __ATOMIC_RELAXED);
+  }
+
   bool Found(size_t num) {
     size_t index = num >> 5;
     size_t n = num % 32;
@@ -92,29 +101,67 @@ size_t JSHash(const char* str) {
   return hash;
 }
 
+// The hash functions work on NUL-terminated strings. String keys are hashed
+// as is, integral keys are first rendered in decimal into a stack buffer.
+inline const char* BloomKeyStr(const std::string& key, char*) {
+  return key.c_str();
+}
+
+template <class T, typename std::enable_if<std::is_integral<T>::value,
+                                           int>::type = 0>
+const char* BloomKeyStr(T key, char* buf) {
+  // buf must hold at least 24 bytes
+  char* p = buf + 23;
+  *p = '\0';
+  bool neg = key < 0;
+  unsigned long long v = neg ? 0ULL - static_cast<unsigned long long>(key)
+                             : static_cast<unsigned long long>(key);
+  do {
+    *--p = static_cast<char>('0' + v % 10);
+    v /= 10;
+  } while (v != 0);
+  if (neg) *--p = '-';
+  return p;
+}
+
 template <class T>
 struct __HashFun1 {
-  size_t operator()(const T& key) const { return BKDRHash<T>(key.c_str()); }
+  size_t operator()(const T& key) const {
+    char buf[24];
+    return BKDRHash<T>(BloomKeyStr(key, buf));
+  }
 };
 
 template <class T>
 struct __HashFun2 {
-  size_t operator()(const T& key) const { return SDBMHash<T>(key.c_str()); }
+  size_t operator()(const T& key) const {
+    char buf[24];
+    return SDBMHash<T>(BloomKeyStr(key, buf));
+  }
 };
 
 template <class T>
 struct __HashFun3 {
-  size_t operator()(const T& key) const { return RSHash<T>(key.c_str()); }
+  size_t operator()(const T& key) const {
+    char buf[24];
+    return RSHash<T>(BloomKeyStr(key, buf));
+  }
 };
 
 template <class T>
 struct __HashFun4 {
-  size_t operator()(const T& key) const { return APHash<T>(key.c_str()); }
+  size_t operator()(const T& key) const {
+    char buf[24];
+    return APHash<T>(BloomKeyStr(key, buf));
+  }
 };
 
 template <class T>
 struct __HashFun5 {
-  size_t operator()(const T& key) const { return JSHash<T>(key.c_str()); }
+  size_t operator()(const T& key) const {
+    char buf[24];
+    return JSHash<T>(BloomKeyStr(key, buf));
+  }
 };
 
 template <class K = std::string, class HashFun1 = __HashFun1<K>,
@@ -136,12 +183,21 @@ class BloomFilter {
     _bitmap.Set(HashFun5()(key) % _capacity);
   }
 
+  // for loaders filling the filter from several threads at once
+  void _SetConcurrent(const K& key) {
+    _bitmap.SetAtomic(HashFun1()(key) % _capacity);
+    _bitmap.SetAtomic(HashFun2()(key) % _capacity);
+    _bitmap.SetAtomic(HashFun3()(key) % _capacity);
+    _bitmap.SetAtomic(HashFun4()(key) % _capacity);
+    _bitmap.SetAtomic(HashFun5()(key) % _capacity);
+  }
+
   bool _IsIn(const K& key) {
     if (!_bitmap.Found(HashFun1()(key) % _capacity)) return false;
-    if (!_bitmap.Found(HashFun1()(key) % _capacity)) return false;
-    if (!_bitmap.Found(HashFun1()(key) % _capacity)) return false;
-    if (!_bitmap.Found(HashFun1()(key) % _capacity)) return false;
-    if (!_bitmap.Found(HashFun1()(key) % _capacity)) return false;
+    if (!_bitmap.Found(HashFun2()(key) % _capacity)) return false;
+    if (!_bitmap.Found(HashFun3()(key) % _capacity)) return false;
+    if (!_bitmap.Found(HashFun4()(key) % _capacity)) return false;
+    if (!_bitmap.Found(HashFun5()(key) % _capacity)) return false;
     return true;
   }
 
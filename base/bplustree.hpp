@@ -0,0 +1,342 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "ordered_index.hpp"
+
+/*
+  In-memory B+tree. Items live in the leaves, which are doubly linked in
+  key order for scans; inner nodes hold count children and count - 1
+  separators, separator i being the smallest key under child i + 1. A full
+  node splits in half on insert. Deletes free a node once it is empty and
+  do not merge half-empty siblings: the tree stays valid, only occupancy
+  can drop after heavy delete loads.
+*/
+template <typename K, typename V, typename Comp = Less<K>, int Fanout = 32>
+class BPlusTreeIndex : public OrderedIndex<K, V> {
+  static_assert(Fanout >= 4, "fanout too small");
+
+ public:
+  typedef typename OrderedIndex<K, V>::Iterator Iterator;
+
+  BPlusTreeIndex()
+      : _root(nullptr), _height(0), _size(0), _leaves(0), _inners(0) {}
+  ~BPlusTreeIndex() { destroy(_root, _height); }
+
+  BPlusTreeIndex(const BPlusTreeIndex&) = delete;
+  BPlusTreeIndex& operator=(const BPlusTreeIndex&) = delete;
+
+  bool Insert(const K& k, const V& v) override { return upsert(k, v); }
+  bool Insert(const K& k, V&& v) override { return upsert(k, std::move(v)); }
+  V* Lookup(const K& k) override;
+  bool Erase(const K& k) override;
+  size_t Size() const override { return _size; }
+  size_t MemoryUsage() const override {
+    return _leaves * sizeof(LeafNode) + _inners * sizeof(InnerNode);
+  }
+  std::unique_ptr<Iterator> NewIterator() override;
+  const char* Name() const override { return "bplustree"; }
+  void AppendMetrics(std::ostream& os) override;
+
+ private:
+  struct BNode {
+    int count;
+  };
+
+  // one spare slot so a node can overflow before it splits
+  struct LeafNode : BNode {
+    K keys[Fanout + 1];
+    V values[Fanout + 1];
+    LeafNode* prev;
+    LeafNode* next;
+  };
+
+  struct InnerNode : BNode {
+    K keys[Fanout];
+    BNode* children[Fanout + 1];
+  };
+
+  // an inner node on the way down and the child index taken
+  typedef std::vector<std::pair<InnerNode*, int>> Path;
+
+  class LeafIterator;
+
+  template <typename VV>
+  bool upsert(const K& k, VV&& v);
+  // the leaf that would hold k; path collects the inner nodes
+  LeafNode* findLeaf(const K& k, Path* path) const;
+  // the first slot in leaf whose key is not less than k
+  int lowerBound(const LeafNode* leaf, const K& k) const {
+    return std::lower_bound(leaf->keys, leaf->keys + leaf->count, k, _less) -
+           leaf->keys;
+  }
+  // add sep / right next to the child split off at path.back()
+  void insertIntoParent(Path* path, const K& sep, BNode* right);
+  // drop the now empty child at path.back()
+  void removeFromParent(Path* path);
+  void destroy(BNode* n, int height);
+
+  BNode* _root;
+  // 0 for an empty tree, 1 while the root is a leaf
+  int _height;
+  size_t _size;
+  size_t _leaves;
+  size_t _inners;
+  Comp _less;
+};
+
+template <typename K, typename V, typename Comp, int Fanout>
+typename BPlusTreeIndex<K, V, Comp, Fanout>::LeafNode*
+BPlusTreeIndex<K, V, Comp, Fanout>::findLeaf(const K& k, Path* path) const {
+  BNode* n = _root;
+  for (int level = _height; level > 1; level--) {
+    InnerNode* in = static_cast<InnerNode*>(n);
+    int i = std::upper_bound(in->keys, in->keys + in->count - 1, k, _less) -
+            in->keys;
+    if (path != nullptr) path->emplace_back(in, i);
+    n = in->children[i];
+  }
+  return static_cast<LeafNode*>(n);
+}
+
+template <typename K, typename V, typename Comp, int Fanout>
+template <typename VV>
+bool BPlusTreeIndex<K, V, Comp, Fanout>::upsert(const K& k, VV&& v) {
+  if (_root == nullptr) {
+    LeafNode* leaf = new LeafNode();
+    leaf->count = 0;
+    leaf->prev = leaf->next = nullptr;
+    _root = leaf;
+    _height = 1;
+    _leaves++;
+  }
+
+  Path path;
+  LeafNode* leaf = findLeaf(k, &path);
+  int pos = lowerBound(leaf, k);
+  if (pos < leaf->count && !_less(k, leaf->keys[pos])) {
+    leaf->values[pos] = std::forward<VV>(v);
+    return false;
+  }
+  for (int i = leaf->count; i > pos; i--) {
+    leaf->keys[i] = std::move(leaf->keys[i - 1]);
+    leaf->values[i] = std::move(leaf->values[i - 1]);
+  }
+  leaf->keys[pos] = k;
+  leaf->values[pos] = std::forward<VV>(v);
+  leaf->count++;
+  _size++;
+
+  if (leaf->count > Fanout) {
+    LeafNode* right = new LeafNode();
+    _leaves++;
+    int half = leaf->count / 2;
+    right->count = leaf->count - half;
+    for (int i = 0; i < right->count; i++) {
+      right->keys[i] = std::move(leaf->keys[half + i]);
+      right->values[i] = std::move(leaf->values[half + i]);
+    }
+    leaf->count = half;
+    right->prev = leaf;
+    right->next = leaf->next;
+    if (leaf->next != nullptr) leaf->next->prev = right;
+    leaf->next = right;
+    insertIntoParent(&path, right->keys[0], right);
+  }
+  return true;
+}
+
+template <typename K, typename V, typename Comp, int Fanout>
+void BPlusTreeIndex<K, V, Comp, Fanout>::insertIntoParent(Path* path,
+                                                          const K& sep,
+                                                          BNode* right) {
+  if (path->empty()) {
+    // the root split
+    InnerNode* root = new InnerNode();
+    _inners++;
+    root->count = 2;
+    root->keys[0] = sep;
+    root->children[0] = _root;
+    root->children[1] = right;
+    _root = root;
+    _height++;
+    return;
+  }
+
+  InnerNode* parent = path->back().first;
+  int idx = path->back().second;
+  path->pop_back();
+  for (int i = parent->count - 1; i > idx; i--) {
+    parent->keys[i] = std::move(parent->keys[i - 1]);
+    parent->children[i + 1] = parent->children[i];
+  }
+  parent->keys[idx] = sep;
+  parent->children[idx + 1] = right;
+  parent->count++;
+  if (parent->count <= Fanout) return;
+
+  // children [0, mid) stay, keys[mid - 1] moves up
+  InnerNode* sibling = new InnerNode();
+  _inners++;
+  int mid = parent->count / 2;
+  sibling->count = parent->count - mid;
+  for (int i = 0; i < sibling->count; i++) {
+    sibling->children[i] = parent->children[mid + i];
+    if (i + 1 < sibling->count) {
+      sibling->keys[i] = std::move(parent->keys[mid + i]);
+    }
+  }
+  K up = std::move(parent->keys[mid - 1]);
+  parent->count = mid;
+  insertIntoParent(path, up, sibling);
+}
+
+template <typename K, typename V, typename Comp, int Fanout>
+V* BPlusTreeIndex<K, V, Comp, Fanout>::Lookup(const K& k) {
+  if (_root == nullptr) return nullptr;
+  LeafNode* leaf = findLeaf(k, nullptr);
+  int pos = lowerBound(leaf, k);
+  if (pos < leaf->count && !_less(k, leaf->keys[pos])) {
+    return &leaf->values[pos];
+  }
+  return nullptr;
+}
+
+template <typename K, typename V, typename Comp, int Fanout>
+bool BPlusTreeIndex<K, V, Comp, Fanout>::Erase(const K& k) {
+  if (_root == nullptr) return false;
+  Path path;
+  LeafNode* leaf = findLeaf(k, &path);
+  int pos = lowerBound(leaf, k);
+  if (pos == leaf->count || _less(k, leaf->keys[pos])) return false;
+  for (int i = pos; i + 1 < leaf->count; i++) {
+    leaf->keys[i] = std::move(leaf->keys[i + 1]);
+    leaf->values[i] = std::move(leaf->values[i + 1]);
+  }
+  leaf->count--;
+  // release what the moved-from slot still holds
+  leaf->keys[leaf->count] = K();
+  leaf->values[leaf->count] = V();
+  _size--;
+  if (leaf->count > 0) return true;
+
+  if (leaf->prev != nullptr) leaf->prev->next = leaf->next;
+  if (leaf->next != nullptr) leaf->next->prev = leaf->prev;
+  delete leaf;
+  _leaves--;
+  if (path.empty()) {
+    _root = nullptr;
+    _height = 0;
+    return true;
+  }
+  removeFromParent(&path);
+  // a root left with a single child is replaced by it
+  while (_height > 1 && _root->count == 1) {
+    InnerNode* old = static_cast<InnerNode*>(_root);
+    _root = old->children[0];
+    delete old;
+    _inners--;
+    _height--;
+  }
+  return true;
+}
+
+template <typename K, typename V, typename Comp, int Fanout>
+void BPlusTreeIndex<K, V, Comp, Fanout>::removeFromParent(Path* path) {
+  InnerNode* parent = path->back().first;
+  int idx = path->back().second;
+  path->pop_back();
+  if (parent->count == 1) {
+    // the parent empties as well
+    delete parent;
+    _inners--;
+    if (path->empty()) {
+      _root = nullptr;
+      _height = 0;
+    } else {
+      removeFromParent(path);
+    }
+    return;
+  }
+  // the separator left of the child goes with it, or the first one when
+  // the child was leftmost
+  int key = idx > 0 ? idx - 1 : 0;
+  for (int i = key; i + 2 < parent->count; i++) {
+    parent->keys[i] = std::move(parent->keys[i + 1]);
+  }
+  for (int i = idx; i + 1 < parent->count; i++) {
+    parent->children[i] = parent->children[i + 1];
+  }
+  parent->count--;
+}
+
+template <typename K, typename V, typename Comp, int Fanout>
+void BPlusTreeIndex<K, V, Comp, Fanout>::destroy(BNode* n, int height) {
+  if (n == nullptr) return;
+  if (height == 1) {
+    delete static_cast<LeafNode*>(n);
+    return;
+  }
+  InnerNode* in = static_cast<InnerNode*>(n);
+  for (int i = 0; i < in->count; i++) destroy(in->children[i], height - 1);
+  delete in;
+}
+
+template <typename K, typename V, typename Comp, int Fanout>
+class BPlusTreeIndex<K, V, Comp, Fanout>::LeafIterator : public Iterator {
+ public:
+  explicit LeafIterator(const BPlusTreeIndex* index)
+      : _index(index), _leaf(nullptr), _pos(0) {}
+
+  bool Valid() const override { return _leaf != nullptr; }
+  const K& key() const override { return _leaf->keys[_pos]; }
+  const V& value() const override { return _leaf->values[_pos]; }
+  void Next() override {
+    if (++_pos == _leaf->count) {
+      _leaf = _leaf->next;
+      _pos = 0;
+    }
+  }
+  void Seek(const K& target) override {
+    _leaf = nullptr;
+    if (_index->_root == nullptr) return;
+    _leaf = _index->findLeaf(target, nullptr);
+    _pos = _index->lowerBound(_leaf, target);
+    if (_pos == _leaf->count) {
+      _leaf = _leaf->next;
+      _pos = 0;
+    }
+  }
+  void SeekToFirst() override {
+    _leaf = nullptr;
+    _pos = 0;
+    BNode* n = _index->_root;
+    if (n == nullptr) return;
+    for (int level = _index->_height; level > 1; level--) {
+      n = static_cast<InnerNode*>(n)->children[0];
+    }
+    _leaf = static_cast<LeafNode*>(n);
+  }
+
+ private:
+  const BPlusTreeIndex* _index;
+  LeafNode* _leaf;
+  int _pos;
+};
+
+template <typename K, typename V, typename Comp, int Fanout>
+std::unique_ptr<typename BPlusTreeIndex<K, V, Comp, Fanout>::Iterator>
+BPlusTreeIndex<K, V, Comp, Fanout>::NewIterator() {
+  return std::unique_ptr<Iterator>(new LeafIterator(this));
+}
+
+template <typename K, typename V, typename Comp, int Fanout>
+void BPlusTreeIndex<K, V, Comp, Fanout>::AppendMetrics(std::ostream& os) {
+  os << "# TYPE minikv_bplustree_height gauge\n";
+  os << "minikv_bplustree_height " << _height << "\n";
+  os << "# TYPE minikv_bplustree_nodes gauge\n";
+  os << "minikv_bplustree_nodes{type=\"leaf\"} " << _leaves << "\n";
+  os << "minikv_bplustree_nodes{type=\"inner\"} " << _inners << "\n";
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// 定长整数按小端编码, 变长整数每字节7位, 最高位表示后面还有字节
+
+inline void EncodeFixed32(char* dst, uint32_t v) {
+  for (int i = 0; i < 4; i++) dst[i] = static_cast<char>(v >> (8 * i));
+}
+
+inline void EncodeFixed64(char* dst, uint64_t v) {
+  for (int i = 0; i < 8; i++) dst[i] = static_cast<char>(v >> (8 * i));
+}
+
+inline uint32_t DecodeFixed32(const char* p) {
+  uint32_t v = 0;
+  for (int i = 0; i < 4; i++) v |= uint32_t(uint8_t(p[i])) << (8 * i);
+  return v;
+}
+
+inline uint64_t DecodeFixed64(const char* p) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; i++) v |= uint64_t(uint8_t(p[i])) << (8 * i);
+  return v;
+}
+
+inline void PutFixed32(std::string* dst, uint32_t v) {
+  char buf[4];
+  EncodeFixed32(buf, v);
+  dst->append(buf, 4);
+}
+
+inline void PutFixed64(std::string* dst, uint64_t v) {
+  char buf[8];
+  EncodeFixed64(buf, v);
+  dst->append(buf, 8);
+}
+
+inline void PutVarint64(std::string* dst, uint64_t v) {
+  char buf[10];
+  int n = 0;
+  while (v >= 128) {
+    buf[n++] = static_cast<char>(v | 128);
+    v >>= 7;
+  }
+  buf[n++] = static_cast<char>(v);
+  dst->append(buf, n);
+}
+
+inline void PutVarint32(std::string* dst, uint32_t v) { PutVarint64(dst, v); }
+
+// 解析[*p, limit)开头的变长整数, 成功时*p移到它后面
+inline bool GetVarint64(const char** p, const char* limit, uint64_t* v) {
+  uint64_t result = 0;
+  for (int shift = 0; shift <= 63 && *p < limit; shift += 7) {
+    uint64_t byte = uint8_t(**p);
+    (*p)++;
+    result |= (byte & 127) << shift;
+    if (byte < 128) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+inline bool GetVarint32(const char** p, const char* limit, uint32_t* v) {
+  uint64_t v64;
+  if (!GetVarint64(p, limit, &v64) || v64 > UINT32_MAX) return false;
+  *v = static_cast<uint32_t>(v64);
+  return true;
+}
+
+// 长度前缀的字节串, 返回指向[*p, limit)内部的指针
+inline bool GetLengthPrefixed(const char** p, const char* limit,
+                              const char** data, size_t* n) {
+  uint32_t len;
+  if (!GetVarint32(p, limit, &len) || len > size_t(limit - *p)) return false;
+  *data = *p;
+  *n = len;
+  *p += len;
+  return true;
+}
+
+inline void PutLengthPrefixed(std::string* dst, const char* data, size_t n) {
+  PutVarint32(dst, static_cast<uint32_t>(n));
+  dst->append(data, n);
+}
+
+// CRC-32C (Castagnoli), 按字节查表
+inline uint32_t Crc32c(const char* data, size_t n, uint32_t crc = 0) {
+  struct Table {
+    uint32_t t[256];
+    Table() {
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+          c = (c >> 1) ^ (0x82f63b78 & (0u - (c & 1)));
+        }
+        t[i] = c;
+      }
+    }
+  };
+  static const Table table;
+  crc = ~crc;
+  for (size_t i = 0; i < n; i++) {
+    crc = table.t[(crc ^ uint8_t(data[i])) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
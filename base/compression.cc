@@ -0,0 +1,253 @@
+#include "compression.h"
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#ifdef KV_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef KV_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "coding.h"
+
+namespace {
+
+/*
+  内置的LZ77, 格式与LZ4的块格式相同, 前面加上变长编码的原始长度
+  1.每个序列: token(高4位字面量长度, 低4位匹配长度-4, 等于15时后面
+    跟若干字节, 逐个累加直到一个不是255的字节), 字面量, 2字节的偏移
+  2.最后一个序列只有字面量, 解压到原始长度时结束
+  3.压缩用4字节哈希找候选位置, 只保留每个哈希最近的位置(贪心匹配),
+    连续找不到匹配时加大步长, 不可压缩的数据很快跳过
+*/
+class LZCodec : public Codec {
+ public:
+  CompressionType type() const override { return kLZCompression; }
+  const char* Name() const override { return "lz"; }
+
+  void Compress(const char* in, size_t n, std::string* out) const override {
+    PutVarint32(out, static_cast<uint32_t>(n));
+    size_t anchor = 0;
+    // 最后12个字节只作为字面量, 保证4字节的读取和匹配的扩展不越界
+    if (n >= kMinInput) {
+      std::vector<uint32_t> table(1 << kHashBits, uint32_t(kEmpty));
+      const size_t search_limit = n - 12;
+      const size_t match_limit = n - 5;
+      size_t i = 0;
+      while (i < search_limit) {
+        uint32_t v = Load32(in + i);
+        uint32_t& slot = table[Hash(v)];
+        size_t cand = slot;
+        slot = static_cast<uint32_t>(i);
+        if (cand == kEmpty || i - cand > kMaxOffset ||
+            Load32(in + cand) != v) {
+          i += 1 + ((i - anchor) >> 5);
+          continue;
+        }
+        size_t len = 4;
+        while (i + len < match_limit && in[cand + len] == in[i + len]) len++;
+        while (i > anchor && cand > 0 && in[i - 1] == in[cand - 1]) {
+          i--;
+          cand--;
+          len++;
+        }
+        EmitSequence(in + anchor, i - anchor, i - cand, len, out);
+        i += len;
+        anchor = i;
+      }
+    }
+    EmitLiterals(in + anchor, n - anchor, out);
+  }
+
+  bool Uncompress(const char* in, size_t n, std::string* out) const override {
+    const char* p = in;
+    const char* limit = in + n;
+    uint32_t raw;
+    if (!GetVarint32(&p, limit, &raw)) return false;
+    const size_t base = out->size();
+    out->resize(base + raw);
+    char* begin = &(*out)[0] + base;
+    char* d = begin;
+    char* end = begin + raw;
+    while (true) {
+      if (p >= limit) return false;
+      const uint8_t token = uint8_t(*p++);
+      size_t lit = token >> 4;
+      if (lit == 15 && !ReadLength(&p, limit, &lit)) return false;
+      if (lit > size_t(limit - p) || lit > size_t(end - d)) return false;
+      memcpy(d, p, lit);
+      d += lit;
+      p += lit;
+      if (d == end) return p == limit;
+      if (limit - p < 2) return false;
+      size_t offset = uint8_t(p[0]) | (size_t(uint8_t(p[1])) << 8);
+      p += 2;
+      if (offset == 0 || offset > size_t(d - begin)) return false;
+      size_t len = token & 15;
+      if (len == 15 && !ReadLength(&p, limit, &len)) return false;
+      len += 4;
+      if (len > size_t(end - d)) return false;
+      const char* src = d - offset;
+      if (offset >= len) {
+        memcpy(d, src, len);
+        d += len;
+      } else {
+        // 重叠的匹配, 如重复的短串, 逐字节复制
+        for (size_t k = 0; k < len; k++) *d++ = src[k];
+      }
+    }
+  }
+
+ private:
+  static const int kHashBits = 14;
+  static const uint32_t kEmpty = UINT32_MAX;
+  static const size_t kMaxOffset = 65535;
+  static const size_t kMinInput = 16;
+
+  static uint32_t Load32(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+  }
+
+  static uint32_t Hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - kHashBits);
+  }
+
+  static void PutLength(size_t len, std::string* out) {
+    for (; len >= 255; len -= 255) out->push_back(char(255));
+    out->push_back(static_cast<char>(len));
+  }
+
+  static bool ReadLength(const char** p, const char* limit, size_t* len) {
+    while (*p < limit) {
+      uint8_t b = uint8_t(*(*p)++);
+      *len += b;
+      if (b != 255) return true;
+    }
+    return false;
+  }
+
+  static void EmitLiterals(const char* lit, size_t n, std::string* out) {
+    out->push_back(static_cast<char>((n < 15 ? n : 15) << 4));
+    if (n >= 15) PutLength(n - 15, out);
+    out->append(lit, n);
+  }
+
+  static void EmitSequence(const char* lit, size_t n, size_t offset,
+                           size_t len, std::string* out) {
+    const size_t m = len - 4;
+    out->push_back(static_cast<char>(((n < 15 ? n : 15) << 4) |
+                                     (m < 15 ? m : 15)));
+    if (n >= 15) PutLength(n - 15, out);
+    out->append(lit, n);
+    out->push_back(static_cast<char>(offset & 0xff));
+    out->push_back(static_cast<char>(offset >> 8));
+    if (m >= 15) PutLength(m - 15, out);
+  }
+};
+
+#ifdef KV_HAVE_LZ4
+class LZ4Codec : public Codec {
+ public:
+  CompressionType type() const override { return kLZ4Compression; }
+  const char* Name() const override { return "lz4"; }
+
+  void Compress(const char* in, size_t n, std::string* out) const override {
+    PutVarint32(out, static_cast<uint32_t>(n));
+    const size_t base = out->size();
+    out->resize(base + LZ4_compressBound(static_cast<int>(n)));
+    int r = LZ4_compress_default(in, &(*out)[base], static_cast<int>(n),
+                                 static_cast<int>(out->size() - base));
+    out->resize(base + r);
+  }
+
+  bool Uncompress(const char* in, size_t n, std::string* out) const override {
+    const char* p = in;
+    uint32_t raw;
+    if (!GetVarint32(&p, in + n, &raw)) return false;
+    const size_t base = out->size();
+    out->resize(base + raw);
+    int r = LZ4_decompress_safe(p, &(*out)[0] + base,
+                                static_cast<int>(in + n - p),
+                                static_cast<int>(raw));
+    return r == static_cast<int>(raw);
+  }
+};
+#endif
+
+#ifdef KV_HAVE_ZSTD
+class ZstdCodec : public Codec {
+ public:
+  CompressionType type() const override { return kZstdCompression; }
+  const char* Name() const override { return "zstd"; }
+
+  void Compress(const char* in, size_t n, std::string* out) const override {
+    PutVarint32(out, static_cast<uint32_t>(n));
+    const size_t base = out->size();
+    out->resize(base + ZSTD_compressBound(n));
+    size_t r = ZSTD_compress(&(*out)[base], out->size() - base, in, n, 3);
+    out->resize(base + (ZSTD_isError(r) ? 0 : r));
+  }
+
+  bool Uncompress(const char* in, size_t n, std::string* out) const override {
+    const char* p = in;
+    uint32_t raw;
+    if (!GetVarint32(&p, in + n, &raw)) return false;
+    const size_t base = out->size();
+    out->resize(base + raw);
+    size_t r = ZSTD_decompress(&(*out)[0] + base, raw, p, in + n - p);
+    return !ZSTD_isError(r) && r == raw;
+  }
+};
+#endif
+
+// 按编号索引的注册表, 内置算法在第一次使用时注册
+std::atomic<const Codec*>* Codecs() {
+  static std::atomic<const Codec*> codecs[256];
+  static const bool init = [] {
+    static const LZCodec lz;
+    codecs[kLZCompression].store(&lz);
+#ifdef KV_HAVE_LZ4
+    static const LZ4Codec lz4;
+    codecs[kLZ4Compression].store(&lz4);
+#endif
+#ifdef KV_HAVE_ZSTD
+    static const ZstdCodec zstd;
+    codecs[kZstdCompression].store(&zstd);
+#endif
+    return true;
+  }();
+  (void)init;
+  return codecs;
+}
+
+}  // namespace
+
+const Codec* GetCodec(CompressionType type) {
+  return Codecs()[type].load(std::memory_order_acquire);
+}
+
+bool RegisterCodec(const Codec* codec) {
+  if (codec->type() < kFirstCustomCompression) return false;
+  const Codec* expected = nullptr;
+  return Codecs()[codec->type()].compare_exchange_strong(expected, codec);
+}
+
+bool ParseCompressionType(const std::string& name, CompressionType* type) {
+  if (name == "none") {
+    *type = kNoCompression;
+    return true;
+  }
+  for (int t = 1; t < 256; t++) {
+    const Codec* codec = GetCodec(CompressionType(t));
+    if (codec != nullptr && name == codec->Name()) {
+      *type = CompressionType(t);
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 块压缩算法的编号, 写在每个块的尾部, 不能修改已有的值
+enum CompressionType : uint8_t {
+  kNoCompression = 0,
+  // 内置的LZ77, 不依赖第三方库
+  kLZCompression = 1,
+  // 需要以-DKV_WITH_LZ4=ON构建
+  kLZ4Compression = 2,
+  // 需要以-DKV_WITH_ZSTD=ON构建
+  kZstdCompression = 3,
+  // 128及以上留给RegisterCodec注册的自定义算法
+  kFirstCustomCompression = 128,
+};
+
+// 块压缩算法, 实现需要线程安全
+class Codec {
+ public:
+  virtual ~Codec() {}
+  virtual CompressionType type() const = 0;
+  virtual const char* Name() const = 0;
+  // 把[in, in + n)压缩后追加到*out
+  virtual void Compress(const char* in, size_t n, std::string* out) const = 0;
+  // 解压后追加到*out, 数据损坏时返回false
+  virtual bool Uncompress(const char* in, size_t n, std::string* out) const = 0;
+};
+
+// 未编译或未注册的算法返回nullptr, kNoCompression也返回nullptr
+const Codec* GetCodec(CompressionType type);
+// 注册自定义算法, 编号必须不小于kFirstCustomCompression且未被占用;
+// codec不会被释放
+bool RegisterCodec(const Codec* codec);
+// "none", "lz", "lz4", "zstd"或已注册算法的Name()
+bool ParseCompressionType(const std::string& name, CompressionType* type);
@@ -0,0 +1,115 @@
+#include "concurrent_arena.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+namespace {
+const size_t kAlign = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+static_assert((kAlign & (kAlign - 1)) == 0,
+              "Pointer size should be a power of 2!");
+
+size_t RoundUp(size_t bytes) { return (bytes + kAlign - 1) & ~(kAlign - 1); }
+}  // namespace
+
+void SpinMutex::lock() {
+  for (int spins = 0;; spins++) {
+    bool expected = false;
+    if (!locked_.load(std::memory_order_relaxed) &&
+        locked_.compare_exchange_weak(expected, true,
+                                      std::memory_order_acquire)) {
+      return;
+    }
+    if (spins > 64) std::this_thread::yield();
+  }
+}
+
+ConcurrentArena::ConcurrentArena(size_t block_size)
+    : block_size_(RoundUp(block_size)), tail_(nullptr), memory_usage_(0) {
+  void* mem = nullptr;
+  if (posix_memalign(&mem, 64, sizeof(Shard) * kNumShards) != 0) {
+    throw std::bad_alloc();
+  }
+  shards_ = static_cast<Shard*>(mem);
+  for (int i = 0; i < kNumShards; i++) new (&shards_[i]) Shard();
+  std::lock_guard<std::mutex> lock(refill_mu_);
+  tail_.store(NewBlock(block_size_), std::memory_order_release);
+}
+
+ConcurrentArena::~ConcurrentArena() {
+  for (Block* b : blocks_) {
+    delete[] b->base;
+    delete b;
+  }
+  for (int i = 0; i < kNumShards; i++) shards_[i].~Shard();
+  free(shards_);
+}
+
+int ConcurrentArena::ThreadShard() {
+  static std::atomic<int> next_id(0);
+  static thread_local int shard =
+      next_id.fetch_add(1, std::memory_order_relaxed) % kNumShards;
+  return shard;
+}
+
+char* ConcurrentArena::AllocateImpl(size_t bytes, bool aligned) {
+  // 大内存直接走共享尾部块, 避免浪费shard区域
+  if (bytes > kShardChunkSize / 4) {
+    return AllocateShared(bytes);
+  }
+
+  Shard& s = shards_[ThreadShard()];
+  std::lock_guard<SpinMutex> lock(s.mu);
+  size_t slop = 0;
+  if (aligned) {
+    size_t current_mod =
+        reinterpret_cast<uintptr_t>(s.alloc_ptr) & (kAlign - 1);
+    slop = (current_mod == 0 ? 0 : kAlign - current_mod);
+  }
+  if (bytes + slop > s.alloc_bytes_remaining) {
+    // shard剩余内存不足, 从共享尾部块取一段新区域, 新区域是对齐的
+    s.alloc_ptr = AllocateShared(kShardChunkSize);
+    s.alloc_bytes_remaining = kShardChunkSize;
+    slop = 0;
+  }
+  char* result = s.alloc_ptr + slop;
+  s.alloc_ptr += bytes + slop;
+  s.alloc_bytes_remaining -= bytes + slop;
+  assert(!aligned ||
+         (reinterpret_cast<uintptr_t>(result) & (kAlign - 1)) == 0);
+  return result;
+}
+
+char* ConcurrentArena::AllocateShared(size_t bytes) {
+  bytes = RoundUp(bytes);
+  if (bytes > block_size_ / 4) {
+    // 与Arena的第三个规则相同: 单独分配一个块, 尾部块不变
+    std::lock_guard<std::mutex> lock(refill_mu_);
+    return NewBlock(bytes)->base;
+  }
+  while (true) {
+    Block* b = tail_.load(std::memory_order_acquire);
+    size_t offset = b->used.fetch_add(bytes, std::memory_order_relaxed);
+    if (offset + bytes <= b->size) {
+      return b->base + offset;
+    }
+    // 尾部块已耗尽, 由第一个加锁的线程换上新块, 其他线程重试
+    std::lock_guard<std::mutex> lock(refill_mu_);
+    if (tail_.load(std::memory_order_relaxed) == b) {
+      tail_.store(NewBlock(block_size_), std::memory_order_release);
+    }
+  }
+}
+
+ConcurrentArena::Block* ConcurrentArena::NewBlock(size_t size) {
+  Block* b = new Block;
+  b->base = new char[size];
+  b->size = size;
+  b->used.store(0, std::memory_order_relaxed);
+  blocks_.push_back(b);
+  memory_usage_.fetch_add(size + sizeof(Block) + sizeof(Block*),
+                          std::memory_order_relaxed);
+  return b;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// 自旋锁, 只用于保护极短的临界区
+class SpinMutex {
+ public:
+  SpinMutex() : locked_(false) {}
+  void lock();
+  void unlock() { locked_.store(false, std::memory_order_release); }
+
+ private:
+  std::atomic<bool> locked_;
+};
+
+/*
+  线程安全的内存管理类, 接口与Arena相同
+  1.每个线程按线程编号映射到一个shard, 小内存从shard自己的区域中bump分配,
+    shard之间互不干扰, 线程数不超过shard数时shard上的自旋锁不会发生竞争
+  2.shard的区域用完后, 从共享的尾部块中取一段新区域, 共享尾部块通过原子
+    fetch_add分配, 只有在尾部块耗尽需要申请新块时才加互斥锁
+  3.大于kShardChunkSize/4的内存直接从共享尾部块分配,
+    大于block_size/4的内存单独分配一个块
+*/
+class ConcurrentArena {
+ public:
+  enum { kNumShards = 16 };
+
+  explicit ConcurrentArena(size_t block_size = kDefaultBlockSize);
+  ~ConcurrentArena();
+
+  ConcurrentArena(const ConcurrentArena&) = delete;
+  ConcurrentArena& operator=(const ConcurrentArena&) = delete;
+
+  // 不保证返回地址是字节对齐的
+  char* Allocate(size_t bytes) { return AllocateImpl(bytes, false); }
+  // 返回按指针大小对齐的地址
+  char* AllocateAligned(size_t bytes) { return AllocateImpl(bytes, true); }
+  // 统计内存使用量
+  size_t MemoryUsage() const {
+    return memory_usage_.load(std::memory_order_relaxed);
+  }
+
+  static const size_t kDefaultBlockSize = 1 << 20;
+  static const size_t kShardChunkSize = 1 << 14;
+
+ private:
+  struct Block {
+    char* base;
+    size_t size;
+    // 已分配出去的字节数, 可能超过size, 超过时表示该块已耗尽
+    std::atomic<size_t> used;
+  };
+
+  struct alignas(64) Shard {
+    SpinMutex mu;
+    char* alloc_ptr = nullptr;
+    size_t alloc_bytes_remaining = 0;
+  };
+
+  char* AllocateImpl(size_t bytes, bool aligned);
+  // 从共享尾部块分配, 返回的地址是对齐的
+  char* AllocateShared(size_t bytes);
+  // 申请一个新块并加入blocks_, 调用者需持有refill_mu_
+  Block* NewBlock(size_t size);
+
+  static int ThreadShard();
+
+  const size_t block_size_;
+  std::atomic<Block*> tail_;
+  // 保护blocks_与tail_的更换
+  std::mutex refill_mu_;
+  std::vector<Block*> blocks_;
+  // kNumShards个, 按64字节对齐单独分配: C++14的new不保证超过
+  // alignof(max_align_t)的对齐
+  Shard* shards_;
+  std::atomic<size_t> memory_usage_;
+};
@@ -0,0 +1,201 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "random.h"
+
+// what the store drops once it holds more than maxmemory, named as in redis
+enum EvictionPolicy {
+  // reject writes instead, insertElement returns -1
+  NO_EVICTION = 0,
+  // least recently used key
+  ALLKEYS_LRU,
+  // least frequently used key
+  ALLKEYS_LFU,
+  // least recently used key among those with a ttl
+  VOLATILE_LRU,
+  // key with the nearest expiry
+  VOLATILE_TTL,
+};
+
+inline const char* EvictionPolicyName(EvictionPolicy policy) {
+  static const char* const kNames[] = {"noeviction", "allkeys-lru",
+                                       "allkeys-lfu", "volatile-lru",
+                                       "volatile-ttl"};
+  return kNames[policy];
+}
+
+inline bool ParseEvictionPolicy(const std::string& name,
+                                EvictionPolicy* policy) {
+  for (int i = 0; i <= VOLATILE_TTL; i++) {
+    if (name == EvictionPolicyName(EvictionPolicy(i))) {
+      *policy = EvictionPolicy(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// heap bytes owned by a key or value besides its own sizeof
+template <typename T>
+size_t HeapBytes(const T&) {
+  return 0;
+}
+
+// by size rather than capacity, so the charge of an item does not depend
+// on which copy of it is measured; libstdc++ keeps up to 15 chars inline
+inline size_t HeapBytes(const std::string& s) {
+  return s.size() > 15 ? s.size() + 1 : 0;
+}
+
+// Bytes one item is charged against maxmemory: key and value with their
+// heap buffers, the key's copy in the KeyTracker, plus a flat estimate for
+// the index node's tower and the tracker's hash entry. The arena does not
+// return memory, but freed nodes are reused by the next inserts.
+template <typename K, typename V>
+size_t EntryCharge(const K& k, const V& v) {
+  const size_t kEntryOverhead = 80;
+  return kEntryOverhead + 2 * (sizeof(K) + HeapBytes(k)) + sizeof(V) +
+         HeapBytes(v);
+}
+
+// Access metadata of every key in the store, for sampled eviction the way
+// redis does it: no global LRU order is kept, Random() picks keys in O(1)
+// and the store evicts the best of a few samples. The slots arrays point
+// into the hash map, whose nodes never move.
+template <typename K>
+class KeyTracker {
+ public:
+  struct Meta {
+    // position in _slots and _volatile, kNone if the key has no ttl
+    uint32_t pos;
+    uint32_t vpos;
+    // Clock() of the last access
+    uint32_t access;
+    // minute of the last lfu decay
+    uint16_t decayMinute;
+    // logarithmic access counter, see Frequency()
+    uint8_t lfu;
+  };
+  typedef std::unordered_map<K, Meta> Map;
+  typedef typename Map::value_type Entry;
+
+  static const uint32_t kNone = UINT32_MAX;
+
+  KeyTracker() : _rnd(0x5eed) {}
+
+  // new keys start with a small counter, so they are not the first victims
+  void Add(const K& k) {
+    auto r = _map.emplace(k, Meta());
+    Meta& m = r.first->second;
+    if (!r.second) {
+      touch(&m);
+      return;
+    }
+    m.pos = static_cast<uint32_t>(_slots.size());
+    m.vpos = kNone;
+    m.access = Clock();
+    m.decayMinute = Minute();
+    m.lfu = kLfuInit;
+    _slots.push_back(&*r.first);
+  }
+
+  void Touch(const K& k) {
+    auto it = _map.find(k);
+    if (it != _map.end()) touch(&it->second);
+  }
+
+  void Remove(const K& k) {
+    auto it = _map.find(k);
+    if (it == _map.end()) return;
+    unlink(&_slots, it->second.pos, &Meta::pos);
+    if (it->second.vpos != kNone) {
+      unlink(&_volatile, it->second.vpos, &Meta::vpos);
+    }
+    _map.erase(it);
+  }
+
+  // whether the key has a ttl, volatile-* only pick those
+  void SetVolatile(const K& k, bool on) {
+    auto it = _map.find(k);
+    if (it == _map.end()) return;
+    Meta& m = it->second;
+    if (on && m.vpos == kNone) {
+      m.vpos = static_cast<uint32_t>(_volatile.size());
+      _volatile.push_back(&*it);
+    } else if (!on && m.vpos != kNone) {
+      unlink(&_volatile, m.vpos, &Meta::vpos);
+      m.vpos = kNone;
+    }
+  }
+
+  size_t size() const { return _slots.size(); }
+  size_t volatileSize() const { return _volatile.size(); }
+
+  // a uniformly random key, of those with a ttl if volatileOnly;
+  // REQUIRES: the set is not empty
+  const Entry* Random(bool volatileOnly) {
+    const std::vector<Entry*>& v = volatileOnly ? _volatile : _slots;
+    return v[_rnd.Uniform(static_cast<int>(v.size()))];
+  }
+
+  // milliseconds since the last access
+  uint32_t IdleTime(const Meta& m) const { return Clock() - m.access; }
+
+  // the access counter after one point of decay per idle minute, as
+  // redis' LFUDecrAndReturn
+  uint8_t Frequency(const Meta& m) const {
+    uint16_t idle = static_cast<uint16_t>(Minute() - m.decayMinute);
+    return idle >= m.lfu ? 0 : static_cast<uint8_t>(m.lfu - idle);
+  }
+
+  void Clear() {
+    _map.clear();
+    _slots.clear();
+    _volatile.clear();
+  }
+
+  // wraps after 49 days, differences stay right
+  static uint32_t Clock() {
+    return static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+
+ private:
+  static const uint8_t kLfuInit = 5;
+  static const int kLfuLogFactor = 10;
+
+  static uint16_t Minute() { return static_cast<uint16_t>(Clock() / 60000); }
+
+  void touch(Meta* m) {
+    m->lfu = Frequency(*m);
+    m->decayMinute = Minute();
+    // the counter grows with probability 1 / ((lfu - 5) * factor + 1), so
+    // 255 stands for about a million accesses
+    if (m->lfu < 255) {
+      int base = m->lfu > kLfuInit ? m->lfu - kLfuInit : 0;
+      if (_rnd.Uniform(base * kLfuLogFactor + 1) == 0) m->lfu++;
+    }
+    m->access = Clock();
+  }
+
+  // swap the last slot into pos
+  static void unlink(std::vector<Entry*>* slots, uint32_t pos,
+                     uint32_t Meta::*field) {
+    Entry* last = slots->back();
+    (*slots)[pos] = last;
+    last->second.*field = pos;
+    slots->pop_back();
+  }
+
+  Map _map;
+  std::vector<Entry*> _slots;
+  std::vector<Entry*> _volatile;
+  XorShift64 _rnd;
+};
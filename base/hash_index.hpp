@@ -0,0 +1,108 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Open addressing key -> node table for point lookups next to an ordered
+// index. The nodes own the keys: a slot holds the node pointer and the
+// full hash, so probes compare hashes and only dereference a node when
+// they match. Linear probing, power of two capacity, grown at 70% load;
+// deletes shift the following run back instead of leaving tombstones,
+// so probe chains never degrade under churn. The table does not shrink.
+// NodeT needs getKey(); equality is K's operator==, so the table only
+// pairs with indexes ordered by the default comparator.
+// Not thread safe, the owner serializes access.
+template <typename K, typename NodeT, typename Hash = std::hash<K>>
+class NodeHashIndex {
+ public:
+  NodeHashIndex() : _slots(kMinSlots), _size(0) {}
+
+  // the node holding k, or nullptr
+  NodeT* find(const K& k) const {
+    const uint64_t h = hashOf(k);
+    const size_t mask = _slots.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+      const Slot& s = _slots[i];
+      if (s.node == nullptr) return nullptr;
+      if (s.hash == h && s.node->getKey() == k) return s.node;
+    }
+  }
+
+  // node's key must not be in the table yet
+  void insert(NodeT* node) {
+    if ((_size + 1) * 10 > _slots.size() * 7) grow();
+    place(hashOf(node->getKey()), node);
+    _size++;
+  }
+
+  // drop k, false if it was not present
+  bool erase(const K& k) {
+    const uint64_t h = hashOf(k);
+    const size_t mask = _slots.size() - 1;
+    size_t i = h & mask;
+    for (;; i = (i + 1) & mask) {
+      if (_slots[i].node == nullptr) return false;
+      if (_slots[i].hash == h && _slots[i].node->getKey() == k) break;
+    }
+    // move back every later entry of the run whose home slot is not in
+    // (i, j], so it stays reachable from its home
+    for (size_t j = (i + 1) & mask; _slots[j].node != nullptr;
+         j = (j + 1) & mask) {
+      const size_t home = _slots[j].hash & mask;
+      const bool reachable = i <= j ? (i < home && home <= j)
+                                    : (i < home || home <= j);
+      if (!reachable) {
+        _slots[i] = _slots[j];
+        i = j;
+      }
+    }
+    _slots[i].node = nullptr;
+    _size--;
+    return true;
+  }
+
+  size_t size() const { return _size; }
+  size_t capacity() const { return _slots.size(); }
+  size_t memoryUsage() const { return _slots.size() * sizeof(Slot); }
+
+ private:
+  static const size_t kMinSlots = 64;
+
+  struct Slot {
+    uint64_t hash;
+    NodeT* node;
+    Slot() : hash(0), node(nullptr) {}
+  };
+
+  // std::hash is the identity for integers; finish with the murmur3
+  // finalizer so strided keys spread over the low bits
+  static uint64_t hashOf(const K& k) {
+    uint64_t h = static_cast<uint64_t>(Hash()(k));
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  void place(uint64_t h, NodeT* node) {
+    const size_t mask = _slots.size() - 1;
+    size_t i = h & mask;
+    while (_slots[i].node != nullptr) i = (i + 1) & mask;
+    _slots[i].hash = h;
+    _slots[i].node = node;
+  }
+
+  void grow() {
+    std::vector<Slot> old(_slots.size() * 2);
+    old.swap(_slots);
+    for (const Slot& s : old) {
+      if (s.node != nullptr) place(s.hash, s.node);
+    }
+  }
+
+  std::vector<Slot> _slots;
+  size_t _size;
+};
@@ -0,0 +1,145 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Log-linear (HDR-style) bucket layout. Values below kSubBuckets get one
+// bucket each; every following power of two is split into kSubBuckets
+// linear sub-buckets, so the relative error of any bucket is 1/kSubBuckets.
+class HistogramBuckets {
+ public:
+  enum { kSubBucketBits = 3 };
+  enum { kSubBuckets = 1 << kSubBucketBits };
+  // values up to 2^kMaxExponent (~18 minutes in nanoseconds)
+  enum { kMaxExponent = 40 };
+  enum { kNumBuckets = (kMaxExponent - kSubBucketBits + 2) * kSubBuckets };
+
+  static size_t IndexOf(uint64_t v) {
+    if (v < kSubBuckets) return static_cast<size_t>(v);
+    int e = 63 - __builtin_clzll(v);
+    if (e > kMaxExponent) return kNumBuckets - 1;
+    size_t sub = (v >> (e - kSubBucketBits)) & (kSubBuckets - 1);
+    return (e - kSubBucketBits + 1) * kSubBuckets + sub;
+  }
+
+  // smallest value that falls into bucket i
+  static uint64_t LowerBound(size_t i) {
+    if (i < kSubBuckets) return i;
+    int e = static_cast<int>(i / kSubBuckets) + kSubBucketBits - 1;
+    uint64_t sub = i % kSubBuckets;
+    return (uint64_t(1) << e) + (sub << (e - kSubBucketBits));
+  }
+
+  // one past the largest value that falls into bucket i
+  static uint64_t UpperBound(size_t i) {
+    if (i + 1 >= kNumBuckets) return std::numeric_limits<uint64_t>::max();
+    return LowerBound(i + 1);
+  }
+};
+
+// A merged, non-atomic view of one or more histograms.
+struct HistogramData {
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t min = std::numeric_limits<uint64_t>::max();
+  uint64_t max = 0;
+  uint64_t buckets[HistogramBuckets::kNumBuckets] = {};
+
+  void Add(uint64_t v) {
+    buckets[HistogramBuckets::IndexOf(v)]++;
+    count++;
+    sum += v;
+    min = std::min(min, v);
+    max = std::max(max, v);
+  }
+
+  void Merge(const HistogramData& other) {
+    for (size_t i = 0; i < HistogramBuckets::kNumBuckets; i++) {
+      buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    sum += other.sum;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+  }
+
+  double Average() const { return count == 0 ? 0 : double(sum) / count; }
+
+  // p in [0, 100], linearly interpolated inside the matching bucket
+  double Percentile(double p) const {
+    if (count == 0) return 0;
+    double threshold = count * (p / 100.0);
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < HistogramBuckets::kNumBuckets; i++) {
+      uint64_t n = buckets[i];
+      if (n == 0) continue;
+      cumulative += n;
+      if (cumulative >= threshold) {
+        double left = double(HistogramBuckets::LowerBound(i));
+        double right = double(std::min<uint64_t>(
+            HistogramBuckets::UpperBound(i), max + 1));
+        left = std::max(left, double(min));
+        double pos = (threshold - (cumulative - n)) / n;
+        double r = left + (right - left) * pos;
+        return std::min(r, double(max));
+      }
+    }
+    return double(max);
+  }
+};
+
+// Histogram that can be updated concurrently without locks. Every field is a
+// relaxed atomic, so a reader may observe a slightly torn snapshot, which is
+// fine for monitoring purposes.
+class Histogram {
+ public:
+  Histogram() { Clear(); }
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  void Add(uint64_t v) {
+    buckets_[HistogramBuckets::IndexOf(v)].fetch_add(1,
+                                                    std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(v, std::memory_order_relaxed);
+    uint64_t cur = min_.load(std::memory_order_relaxed);
+    while (v < cur && !min_.compare_exchange_weak(cur, v,
+                                                  std::memory_order_relaxed)) {
+    }
+    cur = max_.load(std::memory_order_relaxed);
+    while (v > cur && !max_.compare_exchange_weak(cur, v,
+                                                  std::memory_order_relaxed)) {
+    }
+  }
+
+  void MergeInto(HistogramData* data) const {
+    uint64_t n = count_.load(std::memory_order_relaxed);
+    if (n == 0) return;
+    for (size_t i = 0; i < HistogramBuckets::kNumBuckets; i++) {
+      data->buckets[i] += buckets_[i].load(std::memory_order_relaxed);
+    }
+    data->count += n;
+    data->sum += sum_.load(std::memory_order_relaxed);
+    data->min = std::min(data->min, min_.load(std::memory_order_relaxed));
+    data->max = std::max(data->max, max_.load(std::memory_order_relaxed));
+  }
+
+  void Clear() {
+    for (size_t i = 0; i < HistogramBuckets::kNumBuckets; i++) {
+      buckets_[i].store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    min_.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> min_;
+  std::atomic<uint64_t> max_;
+  std::atomic<uint64_t> buckets_[HistogramBuckets::kNumBuckets];
+};
@@ -0,0 +1,196 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "random.h"
+
+// The most accessed keys of a stream, for spotting hot keys:
+// 1. about one access in sampleRate is counted, the gap to the next
+//    sample is drawn at random, so most calls to Add are one decrement
+// 2. a count-min sketch of kDepth rows estimates the sampled accesses of
+//    any key in fixed memory. Conservative update: only the rows holding
+//    the minimum grow, which keeps collisions from inflating the estimate
+// 3. a Space-Saving summary holds the capacity keys with the highest
+//    estimates. A key outside it replaces the smallest entry once its
+//    estimate is larger; it takes the estimate instead of that entry's
+//    count plus one, so a newcomer is not credited with its victim's hits
+// Every kDecayFactor * width samples all counts are halved, so keys that
+// cool down drop out. Counts are reported in accesses, i.e. samples times
+// sampleRate. Not thread safe; the store calls it under its lock.
+template <typename K, typename Hash = std::hash<K>>
+class HotKeys {
+ public:
+  // width is rounded up to a power of two
+  HotKeys(size_t capacity, int sampleRate, size_t width = 4096);
+
+  HotKeys(const HotKeys&) = delete;
+  HotKeys& operator=(const HotKeys&) = delete;
+
+  void Add(const K& k) {
+    if (--_skip > 0) return;
+    // uniform in [1, 2 * sampleRate - 1], sampleRate on average
+    _skip = 1 + _rnd.Uniform(2 * _sampleRate - 1);
+    sample(k);
+  }
+  // estimated accesses of k
+  uint64_t Estimate(const K& k) const;
+  // the summary, most accessed first
+  std::vector<std::pair<K, uint64_t>> Top() const;
+  void Clear();
+
+  size_t capacity() const { return _capacity; }
+  int sampleRate() const { return _sampleRate; }
+  // the sketch only, the summary holds capacity keys
+  size_t memoryUsage() const { return _counts.size() * sizeof(uint32_t); }
+
+ private:
+  static const int kDepth = 4;
+  static const int kDecayFactor = 10;
+
+  void sample(const K& k);
+  // the slot of k in each row
+  void slots(const K& k, size_t* idx) const;
+  void decay();
+  // _floor := the smallest count of the summary
+  void updateFloor();
+
+  const size_t _capacity;
+  const int _sampleRate;
+  size_t _mask;
+  // kDepth rows of _mask + 1 counters
+  std::vector<uint32_t> _counts;
+  std::unordered_map<K, uint32_t, Hash> _top;
+  // no count of _top is smaller; counts only grow between decays, so it
+  // is refreshed when an entry is replaced or halved
+  uint32_t _floor;
+  uint64_t _samples;
+  uint32_t _skip;
+  XorShift64 _rnd;
+  Hash _hash;
+};
+
+template <typename K, typename Hash>
+HotKeys<K, Hash>::HotKeys(size_t capacity, int sampleRate, size_t width)
+    : _capacity(capacity),
+      _sampleRate(sampleRate < 1 ? 1 : sampleRate),
+      _floor(0),
+      _samples(0),
+      _skip(1),
+      _rnd(0x407c3e75) {
+  size_t w = 64;
+  while (w < width) w <<= 1;
+  _mask = w - 1;
+  _counts.assign(kDepth * w, 0);
+  _top.reserve(capacity + 1);
+}
+
+template <typename K, typename Hash>
+void HotKeys<K, Hash>::slots(const K& k, size_t* idx) const {
+  // splitmix64 finalizer, std::hash of an integer is the identity
+  uint64_t h = static_cast<uint64_t>(_hash(k));
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  h ^= h >> 31;
+  // double hashing derives the rows from two halves
+  const uint64_t h1 = h, h2 = (h >> 32) | 1;
+  for (int i = 0; i < kDepth; i++) {
+    idx[i] = i * (_mask + 1) + ((h1 + i * h2) & _mask);
+  }
+}
+
+template <typename K, typename Hash>
+void HotKeys<K, Hash>::sample(const K& k) {
+  size_t idx[kDepth];
+  slots(k, idx);
+  uint32_t est = UINT32_MAX;
+  for (int i = 0; i < kDepth; i++) est = std::min(est, _counts[idx[i]]);
+  est++;
+  for (int i = 0; i < kDepth; i++) {
+    if (_counts[idx[i]] < est) _counts[idx[i]] = est;
+  }
+
+  auto it = _top.find(k);
+  if (it != _top.end()) {
+    it->second = est;
+  } else if (_top.size() < _capacity) {
+    _top.emplace(k, est);
+    if (_top.size() == _capacity) updateFloor();
+  } else if (est > _floor && _capacity > 0) {
+    auto victim = std::min_element(
+        _top.begin(), _top.end(),
+        [](const std::pair<const K, uint32_t>& a,
+           const std::pair<const K, uint32_t>& b) {
+          return a.second < b.second;
+        });
+    if (est > victim->second) {
+      _top.erase(victim);
+      _top.emplace(k, est);
+    }
+    updateFloor();
+  }
+
+  if (++_samples >= uint64_t(kDecayFactor) * (_mask + 1)) decay();
+}
+
+template <typename K, typename Hash>
+void HotKeys<K, Hash>::decay() {
+  for (uint32_t& c : _counts) c >>= 1;
+  for (auto it = _top.begin(); it != _top.end();) {
+    it->second >>= 1;
+    if (it->second == 0) {
+      it = _top.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  updateFloor();
+  _samples = 0;
+}
+
+template <typename K, typename Hash>
+void HotKeys<K, Hash>::updateFloor() {
+  // a summary with room admits every key
+  if (_top.size() < _capacity) {
+    _floor = 0;
+    return;
+  }
+  _floor = UINT32_MAX;
+  for (auto& e : _top) _floor = std::min(_floor, e.second);
+}
+
+template <typename K, typename Hash>
+uint64_t HotKeys<K, Hash>::Estimate(const K& k) const {
+  size_t idx[kDepth];
+  slots(k, idx);
+  uint32_t est = UINT32_MAX;
+  for (int i = 0; i < kDepth; i++) est = std::min(est, _counts[idx[i]]);
+  return uint64_t(est) * _sampleRate;
+}
+
+template <typename K, typename Hash>
+std::vector<std::pair<K, uint64_t>> HotKeys<K, Hash>::Top() const {
+  std::vector<std::pair<K, uint64_t>> top;
+  top.reserve(_top.size());
+  for (auto& e : _top) {
+    top.emplace_back(e.first, uint64_t(e.second) * _sampleRate);
+  }
+  std::sort(top.begin(), top.end(),
+            [](const std::pair<K, uint64_t>& a,
+               const std::pair<K, uint64_t>& b) {
+              return a.second > b.second;
+            });
+  return top;
+}
+
+template <typename K, typename Hash>
+void HotKeys<K, Hash>::Clear() {
+  std::fill(_counts.begin(), _counts.end(), 0);
+  _top.clear();
+  _floor = 0;
+  _samples = 0;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <iostream>
+
+// Per-operation trace of the store. Build with -DKV_VERBOSE=0 to compile it
+// out, e.g. for benchmarks and servers.
+#ifndef KV_VERBOSE
+#define KV_VERBOSE 1
+#endif
+
+#define KV_LOG(msg)                               \
+  do {                                            \
+    if (KV_VERBOSE) std::cout << msg << std::endl; \
+  } while (0)
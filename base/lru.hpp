@@ -1,72 +1,91 @@
 #pragma once
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <list>
 #include <unordered_map>
+#include <utility>
+
+#include "log.hpp"
 
 template <typename K, typename V>
 class LRU {
  private:
+  typedef typename std::list<std::pair<K, V>>::iterator Iter;
+  // the map refers to the key inside the list node instead of keeping a
+  // copy of it; list nodes never move, and lookups wrap the probe key
+  // without copying it either
+  typedef std::unordered_map<std::reference_wrapper<const K>, Iter,
+                             std::hash<K>, std::equal_to<K>>
+      Map;
+
   int capacity_;
   // the list of LRU item, the front is the item most recently used
   std::list<std::pair<K, V>> lst_;
-  std::unordered_map<K, typename std::list<std::pair<K, V>>::iterator> mp_;
+  Map mp_;
 
  public:
-  LRU(int c) : capacity_(c) { std::cout << "LRU build" << std::endl; };
+  LRU(int c) : capacity_(c) { KV_LOG("LRU build"); };
   ~LRU() = default;
-  bool get(K, V&);
-  void put(K, V);
-  void del(K);
-  bool is_find(K);
+  bool get(const K&, V&);
+  // v is copied or moved in, whatever the caller passes
+  template <typename VV>
+  void put(const K&, VV&& v);
+  void del(const K&);
+  bool is_find(const K&);
+  void clear() {
+    mp_.clear();
+    lst_.clear();
+  }
   void printLRUCache();
 };
 
 // search the key in the LRU block, if found, move to the front
 template <typename K, typename V>
-bool LRU<K, V>::get(K k, V& v) {
-  if (mp_.find(k) != mp_.end()) {
-    std::pair<K, V> p = *(mp_[k]);
-    v = p.second;
-    lst_.erase(mp_[k]);
-    lst_.push_front(p);
-    mp_[k] = lst_.begin();
-    return true;
-  }
-  return false;
+bool LRU<K, V>::get(const K& k, V& v) {
+  auto it = mp_.find(k);
+  if (it == mp_.end()) return false;
+  lst_.splice(lst_.begin(), lst_, it->second);
+  v = it->second->second;
+  return true;
 }
 
-// insert the key item
+// insert the key item. Once the cache is full the least recently used node
+// is reused for the new item, so its key and value keep their buffers
 template <typename K, typename V>
-void LRU<K, V>::put(K k, V v) {
-  if (mp_.find(k) != mp_.end()) {
-    lst_.erase(mp_[k]);
-    lst_.push_front({k, v});
-    mp_[k] = lst_.begin();
+template <typename VV>
+void LRU<K, V>::put(const K& k, VV&& v) {
+  auto it = mp_.find(k);
+  if (it != mp_.end()) {
+    it->second->second = std::forward<VV>(v);
+    lst_.splice(lst_.begin(), lst_, it->second);
+    return;
+  }
+  if (capacity_ <= 0) return;
+  if (lst_.size() >= size_t(capacity_)) {
+    mp_.erase(lst_.back().first);
+    lst_.splice(lst_.begin(), lst_, std::prev(lst_.end()));
+    lst_.front().first = k;
+    lst_.front().second = std::forward<VV>(v);
   } else {
-    if (lst_.size() == capacity_) {
-      auto tail = lst_.back();
-      lst_.pop_back();
-      mp_.erase(tail.first);
-      lst_.push_front({k, v});
-      mp_[k] = lst_.begin();
-    } else {
-      lst_.push_front({k, v});
-      mp_[k] = lst_.begin();
-    }
+    lst_.emplace_front(k, std::forward<VV>(v));
   }
+  mp_.emplace(std::cref(lst_.front().first), lst_.begin());
 }
 
 // delete the key item
 template <typename K, typename V>
-void LRU<K, V>::del(K k) {
-  if (mp_.find(k) == mp_.end()) return;
-  lst_.erase(mp_[k]);
-  mp_.erase(k);
+void LRU<K, V>::del(const K& k) {
+  auto it = mp_.find(k);
+  if (it == mp_.end()) return;
+  Iter node = it->second;
+  mp_.erase(it);
+  lst_.erase(node);
 }
 
 // find the key item or not
 template <typename K, typename V>
-bool LRU<K, V>::is_find(K k) {
+bool LRU<K, V>::is_find(const K& k) {
   return mp_.find(k) != mp_.end();
 }
 
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+
+template <typename T>
+class Less {
+ public:
+  bool operator()(const T& a, const T& b) const { return a < b; }
+};
+
+// the index engines a store can be built on
+enum IndexEngine {
+  // the native skiplist, see skiplist_index.hpp
+  SKIPLIST_ENGINE = 0,
+  // adaptive radix tree, integral and std::string keys with the default
+  // comparator only, see art.hpp
+  ART_ENGINE,
+  // in-memory B+tree, see bplustree.hpp
+  BPLUSTREE_ENGINE,
+  // the skiplist plus a hash table for point lookups, default comparator
+  // only, see hash_index.hpp
+  HASHED_SKIPLIST_ENGINE,
+};
+
+// "skiplist", "art", "bplustree" or "hashed_skiplist", for command lines
+inline bool ParseIndexEngine(const std::string& name, IndexEngine* engine) {
+  static const char* const kNames[] = {"skiplist", "art", "bplustree",
+                                       "hashed_skiplist"};
+  for (int i = 0; i < 4; i++) {
+    if (name == kNames[i]) {
+      *engine = static_cast<IndexEngine>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// An ordered key -> value map the store keeps its items in. The store
+// serializes every call, engines need no locking of their own.
+template <typename K, typename V>
+class OrderedIndex {
+ public:
+  // in key order; invalidated by any write to the index
+  class Iterator {
+   public:
+    virtual ~Iterator() {}
+    virtual bool Valid() const = 0;
+    virtual const K& key() const = 0;
+    virtual const V& value() const = 0;
+    virtual void Next() = 0;
+    // position at the first key not less than target
+    virtual void Seek(const K& target) = 0;
+    virtual void SeekToFirst() = 0;
+    // position at the key with i smaller keys, invalid if i >= Size().
+    // The default steps from the first key
+    virtual void SeekToRank(size_t i) {
+      for (SeekToFirst(); Valid() && i > 0; i--) Next();
+    }
+  };
+
+  virtual ~OrderedIndex() {}
+
+  // insert k or overwrite its value, true if k was not present
+  virtual bool Insert(const K& k, const V& v) = 0;
+  // same, moving v into the index; the default copies it
+  virtual bool Insert(const K& k, V&& v) {
+    return Insert(k, static_cast<const V&>(v));
+  }
+  // the value stored for k or nullptr; valid until the next write
+  virtual V* Lookup(const K& k) = 0;
+  // insert n distinct keys in increasing order, e.g. a run of a sorted
+  // snapshot. Engines may link a run that sorts after all their keys
+  // without a search per key; the default inserts one by one.
+  virtual void InsertRun(const std::pair<K, V>* items, size_t n) {
+    for (size_t i = 0; i < n; i++) Insert(items[i].first, items[i].second);
+  }
+  // false if k was not present
+  virtual bool Erase(const K& k) = 0;
+  virtual size_t Size() const = 0;
+  // bytes held by the index structure, keys and values included
+  virtual size_t MemoryUsage() const = 0;
+  virtual std::unique_ptr<Iterator> NewIterator() = 0;
+  // number of keys less than k. The default walks the keys in order,
+  // the skiplist keeps counts that answer in O(log n)
+  virtual size_t Rank(const K& k) {
+    std::unique_ptr<Iterator> it = NewIterator();
+    it->Seek(k);
+    size_t n = Size();
+    for (; it->Valid(); it->Next()) n--;
+    return n;
+  }
+
+  virtual const char* Name() const = 0;
+  // human readable dump of the structure, for debugging
+  virtual void Display(std::ostream& os) {
+    std::unique_ptr<Iterator> it = NewIterator();
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+      os << it->key() << ":" << it->value() << "; ";
+    }
+    os << std::endl;
+  }
+  // engine specific properties and prometheus gauges
+  virtual bool GetProperty(const std::string& /*property*/,
+                           std::string* /*value*/) {
+    return false;
+  }
+  virtual void AppendMetrics(std::ostream& /*os*/) {}
+};
@@ -6,11 +6,12 @@
 #include <vector>
 
 #include "arena.h"
-#include "random.h"
+#include "skiplist_policy.hpp"
 
 class Arena;
 
-template <typename Key, typename Value, class Comparator>
+template <typename Key, typename Value, class Comparator,
+          class Policy = CompactPolicy>
 class SkipList {
  private:
   struct Node;
@@ -21,23 +22,50 @@ class SkipList {
   SkipList(const SkipList&) = delete;
   SkipList& operator=(const SkipList&) = delete;
 
+  // 插入key, 要求跳表中不存在与key相等的元素
+  // 写操作需要外部同步, 读操作可以与一个写操作并发
+  void Insert(const Key& key, const Value& value);
+
+  // 跳表中存在与key相等的元素时返回true
+  bool Contains(const Key& key) const;
+
+  // 查找key, 找到时将值拷贝到value
+  bool Get(const Key& key, Value* value) const;
+
  private:
-  enum { kMaxHeight = 12 };
+  // 最大高度与增长概率由Policy决定, 默认每层以1/4的概率增长, 最高20层
+  enum { kMaxHeight = Policy::kMaxHeight };
+
+  inline int GetMaxHeight() const {
+    return max_height_.load(std::memory_order_relaxed);
+  }
 
   Node* NewNode(const Key& key, const Value& value, int height);
+  int RandomHeight();
+  bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
+
+  // key比节点n中的key大时返回true
+  bool KeyIsAfterNode(const Key& key, Node* n) const;
+
+  // 返回第一个大于等于key的节点, 没有则返回nullptr
+  // prev不为空时, 在prev[level]中记录每一层的前驱节点
+  Node* FindGreaterOrEqual(const Key& key, Node** prev) const;
 
   Comparator compare_;
   Arena* arena_;
   Node* head_;
   std::atomic<int> max_height_;
-  Random rnd_;
+  typename Policy::RandomGenerator rnd_;
 };
 
-template <typename Key, typename Value, class Comparator>
-struct SkipList<Key, Value, Comparator>::Node {
+template <typename Key, typename Value, class Comparator, class Policy>
+struct SkipList<Key, Value, Comparator, Policy>::Node {
   explicit Node(const Key& key, const Value& value)
       : key_(key), value_(value) {}
 
+  const Key& key() const { return key_; }
+  const Value& value() const { return value_; }
+
   Node* Next(int n) {
     assert(n >= 0);
     return next_[n].load(std::memory_order_acquire);
@@ -64,11 +92,12 @@ struct SkipList<Key, Value, Comparator>::Node {
   std::atomic<Node*> next_[1];
 };
 
-template <typename Key, typename Value, class Comparator>
-SkipList<Key, Value, Comparator>::SkipList(Comparator cmp, Arena* arena)
+template <typename Key, typename Value, class Comparator, class Policy>
+SkipList<Key, Value, Comparator, Policy>::SkipList(Comparator cmp,
+                                                   Arena* arena)
     : compare_(cmp),
       arena_(arena),
-      head_(NewNode(0, {}, kMaxHeight)),
+      head_(NewNode(Key(), Value(), kMaxHeight)),
       max_height_(1),
       rnd_(0xdeadbeef) {
   for (int i = 0; i < kMaxHeight; ++i) {
@@ -77,19 +106,103 @@ SkipList<Key, Value, Comparator>::SkipList(Comparator cmp, Arena* arena)
 }
 
 /*
-  NewNode()方法用于申请并初始化一个节点,分配12层内存
-  默认有一层，总共12层，那么需要再动态分配 height-1层
+  NewNode()方法用于申请并初始化一个节点,分配height层内存
+  默认有一层，总共height层，那么需要再动态分配 height-1层
   而每个节点占用sizeof(std::atomic<Node*>)大小，
   所以总共需要sizeof(Node)+sizeof(std::atomic<Node*>)*(height-1))个大小
   sizeof(Node)=>当前节点整个node大小
   sizeof(std::atomic<Node*>)*(height-1))=>剩余的节点大小
 */
-template <typename Key, typename Value, class Comparator>
-typename SkipList<Key, Value, Comparator>::Node*
-SkipList<Key, Value, Comparator>::NewNode(const Key& key, const Value& value,
-                                          int height) {
+template <typename Key, typename Value, class Comparator, class Policy>
+typename SkipList<Key, Value, Comparator, Policy>::Node*
+SkipList<Key, Value, Comparator, Policy>::NewNode(const Key& key,
+                                                  const Value& value,
+                                                  int height) {
   char* node_memory = arena_->AllocateAligned(
       sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
   return new (node_memory) Node(key, value);
 }
 
+template <typename Key, typename Value, class Comparator, class Policy>
+int SkipList<Key, Value, Comparator, Policy>::RandomHeight() {
+  int height = Policy::RandomHeight(&rnd_);
+  assert(height > 0);
+  assert(height <= kMaxHeight);
+  return height;
+}
+
+template <typename Key, typename Value, class Comparator, class Policy>
+bool SkipList<Key, Value, Comparator, Policy>::KeyIsAfterNode(
+    const Key& key, Node* n) const {
+  // null n is considered infinite
+  return (n != nullptr) && (compare_(n->key(), key) < 0);
+}
+
+/*
+  从最高层开始查找: 当前层的下一个节点小于key时向右移动,
+  否则记录前驱并下降一层, 直到第0层
+*/
+template <typename Key, typename Value, class Comparator, class Policy>
+typename SkipList<Key, Value, Comparator, Policy>::Node*
+SkipList<Key, Value, Comparator, Policy>::FindGreaterOrEqual(
+    const Key& key, Node** prev) const {
+  Node* x = head_;
+  int level = GetMaxHeight() - 1;
+  while (true) {
+    Node* next = x->Next(level);
+    if (KeyIsAfterNode(key, next)) {
+      x = next;
+    } else {
+      if (prev != nullptr) prev[level] = x;
+      if (level == 0) {
+        return next;
+      } else {
+        level--;
+      }
+    }
+  }
+}
+
+template <typename Key, typename Value, class Comparator, class Policy>
+void SkipList<Key, Value, Comparator, Policy>::Insert(const Key& key,
+                                                      const Value& value) {
+  Node* prev[kMaxHeight];
+  Node* x = FindGreaterOrEqual(key, prev);
+
+  // 不允许重复插入
+  assert(x == nullptr || !Equal(key, x->key()));
+
+  int height = RandomHeight();
+  if (height > GetMaxHeight()) {
+    for (int i = GetMaxHeight(); i < height; i++) {
+      prev[i] = head_;
+    }
+    // 并发的读者看到新的高度时, head_的新层仍为nullptr, 读者会直接下降
+    max_height_.store(height, std::memory_order_relaxed);
+  }
+
+  x = NewNode(key, value, height);
+  for (int i = 0; i < height; i++) {
+    // 先设置x的后继, 再通过SetNext发布x
+    x->NoBarrier_SetNext(i, prev[i]->NoBarrier_Next(i));
+    prev[i]->SetNext(i, x);
+  }
+}
+
+template <typename Key, typename Value, class Comparator, class Policy>
+bool SkipList<Key, Value, Comparator, Policy>::Contains(
+    const Key& key) const {
+  Node* x = FindGreaterOrEqual(key, nullptr);
+  return x != nullptr && Equal(key, x->key());
+}
+
+template <typename Key, typename Value, class Comparator, class Policy>
+bool SkipList<Key, Value, Comparator, Policy>::Get(const Key& key,
+                                                   Value* value) const {
+  Node* x = FindGreaterOrEqual(key, nullptr);
+  if (x != nullptr && Equal(key, x->key())) {
+    *value = x->value();
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,539 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "arena.h"
+#include "hash_index.hpp"
+#include "ordered_index.hpp"
+#include "skiplist_policy.hpp"
+
+#define NODE_ARENA_BLOCK_SIZE (1 << 16)
+
+// an order preserving 8 byte prefix of a key: if prefix(a) < prefix(b)
+// then a < b, equal prefixes say nothing. only std::string has one; the
+// first 8 bytes are loaded big-endian and zero padded, which orders like
+// std::string::compare (unsigned bytes).
+template <typename K>
+struct KeyPrefix {
+  static const bool kEnabled = false;
+  static uint64_t of(const K&) { return 0; }
+};
+
+template <>
+struct KeyPrefix<std::string> {
+  static const bool kEnabled = true;
+  static uint64_t of(const std::string& k) {
+    uint64_t p = 0;
+    memcpy(&p, k.data(), k.size() < 8 ? k.size() : 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    p = __builtin_bswap64(p);
+#endif
+    return p;
+  }
+};
+
+// holds the cached prefix; empty for keys without one
+template <typename K, bool = KeyPrefix<K>::kEnabled>
+class NodePrefix {
+ public:
+  explicit NodePrefix(const K&) {}
+  uint64_t getPrefix() const { return 0; }
+};
+
+template <typename K>
+class NodePrefix<K, true> {
+ public:
+  explicit NodePrefix(const K& k) : _prefix(KeyPrefix<K>::of(k)) {}
+  uint64_t getPrefix() const { return _prefix; }
+
+ private:
+  uint64_t _prefix;
+};
+
+// a node and its tower are one allocation: _forward is the last member and
+// the node is placement-new'd into sizeOf(level) bytes, so _forward[level]
+// is valid. The spans follow the forward array, where descents that only
+// compare keys never load them. nodes are only built by
+// SkipListIndex::createNode.
+template <typename K, typename V>
+class Node : public NodePrefix<K> {
+ public:
+  template <typename VV>
+  Node(const K& k, VV&& v, int level);
+
+  const K& getKey() const { return _key; };
+  const V& getValue() const { return _value; };
+  V* mutableValue() { return &_value; }
+  template <typename VV>
+  void setValue(VV&& v) {
+    _value = std::forward<VV>(v);
+  }
+
+  // span(i): the number of level 0 links _forward[i] skips, so a descent
+  // that adds the spans it follows knows the rank of where it stands. The
+  // span of a null link is not maintained
+  size_t& span(int i) {
+    return reinterpret_cast<size_t*>(_forward + _nodeLevel + 1)[i];
+  }
+
+  static size_t sizeOf(int level) {
+    return sizeof(Node<K, V>) + sizeof(Node<K, V>*) * level +
+           sizeof(size_t) * (level + 1);
+  }
+
+  int _nodeLevel;
+
+ private:
+  K _key;
+  V _value;
+
+ public:
+  // array of length _nodeLevel + 1, _forward[0] is the lowest level
+  Node<K, V>* _forward[1];
+};
+
+template <typename K, typename V>
+template <typename VV>
+Node<K, V>::Node(const K& k, VV&& v, int level)
+    : NodePrefix<K>(k),
+      _nodeLevel(level),
+      _key(k),
+      _value(std::forward<VV>(v)) {
+  for (int i = 0; i <= level; i++) {
+    _forward[i] = nullptr;
+    span(i) = 0;
+  }
+}
+
+// The store's native engine. Policy fixes the tallest tower, the
+// branching factor and the level generator, see skiplist_policy.hpp. The
+// level passed to the constructor is clamped to Policy::kMaxHeight - 1.
+// With hash_index every node is also reachable through a NodeHashIndex:
+// point lookups, overwrites and misses cost one probe, the levels only
+// serve inserts, deletes and scans. It needs the default comparator and
+// is ignored otherwise, see hashed(). nodeArena picks where the node
+// arena gets its blocks, e.g. Arena::kHugePage to cut TLB misses of a
+// large index.
+template <typename K, typename V, typename Comp = Less<K>,
+          typename Policy = FastSearchPolicy>
+class SkipListIndex : public OrderedIndex<K, V> {
+ public:
+  typedef typename OrderedIndex<K, V>::Iterator Iterator;
+
+  explicit SkipListIndex(int level, bool hash_index = false,
+                         Arena::BlockSource nodeArena = Arena::kHeap);
+  ~SkipListIndex();
+
+  SkipListIndex(const SkipListIndex&) = delete;
+  SkipListIndex& operator=(const SkipListIndex&) = delete;
+
+  bool Insert(const K& k, const V& v) override { return upsert(k, v); }
+  bool Insert(const K& k, V&& v) override { return upsert(k, std::move(v)); }
+  void InsertRun(const std::pair<K, V>* items, size_t n) override;
+  V* Lookup(const K& k) override;
+  bool Erase(const K& k) override;
+  size_t Size() const override { return _size; }
+  size_t MemoryUsage() const override {
+    return _arena.MemoryUsage() + (_hash ? _hash->memoryUsage() : 0);
+  }
+  std::unique_ptr<Iterator> NewIterator() override;
+  size_t Rank(const K& k) override;
+  const char* Name() const override {
+    return _hash ? "skiplist+hash" : "skiplist";
+  }
+  // in level mode
+  void Display(std::ostream& os) override;
+  // "minikv.cur-level"
+  bool GetProperty(const std::string& property, std::string* value) override;
+  void AppendMetrics(std::ostream& os) override;
+
+  // hash equality must agree with the order
+  static bool canHash() { return std::is_same<Comp, Less<K>>::value; }
+  bool hashed() const { return _hash != nullptr; }
+
+  int getRandomLevel();
+  // v is copied or moved into the node
+  template <typename VV>
+  Node<K, V>* createNode(const K&, VV&& v, int);
+
+ private:
+  class NodeIterator;
+
+  template <typename VV>
+  bool upsert(const K& k, VV&& v);
+  // destroy the node and keep its memory for the next node of that level
+  void freeNode(Node<K, V>* node);
+  // the first node whose key is not less than k, or nullptr
+  Node<K, V>* findGreaterOrEqual(const K& k) const;
+  // the node with i smaller keys, or nullptr
+  Node<K, V>* findByRank(size_t i) const;
+  // node's key < k. prefix is KeyPrefix<K>::of(k); comparisons that the
+  // cached prefixes decide never touch the full key
+  bool nodeLess(const Node<K, V>* node, const K& k, uint64_t prefix) const {
+    if (kUsePrefix && node->getPrefix() != prefix)
+      return node->getPrefix() < prefix;
+    return _less(node->getKey(), k);
+  }
+  bool nodeEqual(const Node<K, V>* node, const K& k, uint64_t prefix) const {
+    if (kUsePrefix && node->getPrefix() != prefix) return false;
+    return !_less(node->getKey(), k) && !_less(k, node->getKey());
+  }
+
+  // distinct, reproducible seeds for the indexes of one process
+  static uint64_t nextSeed() {
+    static std::atomic<uint64_t> instances(0);
+    return 0x9e3779b97f4a7c15ull * (instances.fetch_add(1) + 1);
+  }
+
+  // the prefix order is only valid for the default comparator
+  static const bool kUsePrefix =
+      KeyPrefix<K>::kEnabled && std::is_same<Comp, Less<K>>::value;
+
+ private:
+  // max level of the skip list
+  int _maxLevel;
+  // curlevel of the skip list
+  int _curLevel;
+  // head ptr
+  Node<K, V>* _header;
+  size_t _size;
+
+  Comp _less;
+
+  // _levelCount[i]: number of nodes whose highest level is i
+  std::vector<size_t> _levelCount;
+
+  // every node lives in _arena; freed nodes are chained through _forward[0]
+  // in _freeList[level] and reused before the arena grows
+  Arena _arena;
+  std::vector<Node<K, V>*> _freeList;
+
+  // per instance level generator
+  typename Policy::RandomGenerator _rnd;
+
+  // key -> node for point lookups, null unless enabled
+  std::unique_ptr<NodeHashIndex<K, Node<K, V>>> _hash;
+};
+
+template <typename K, typename V, typename Comp, typename Policy>
+class SkipListIndex<K, V, Comp, Policy>::NodeIterator : public Iterator {
+ public:
+  explicit NodeIterator(const SkipListIndex* index)
+      : _index(index), _node(nullptr) {}
+
+  bool Valid() const override { return _node != nullptr; }
+  const K& key() const override { return _node->getKey(); }
+  const V& value() const override { return _node->getValue(); }
+  void Next() override { _node = _node->_forward[0]; }
+  void Seek(const K& target) override {
+    _node = _index->findGreaterOrEqual(target);
+  }
+  void SeekToFirst() override { _node = _index->_header->_forward[0]; }
+  void SeekToRank(size_t i) override { _node = _index->findByRank(i); }
+
+ private:
+  const SkipListIndex* _index;
+  Node<K, V>* _node;
+};
+
+template <typename K, typename V, typename Comp, typename Policy>
+SkipListIndex<K, V, Comp, Policy>::SkipListIndex(
+    int level, bool hash_index, Arena::BlockSource nodeArena)
+    : _size(0), _arena(NODE_ARENA_BLOCK_SIZE, nodeArena), _rnd(nextSeed()) {
+  static_assert(alignof(Node<K, V>) <= 8,
+                "arena only guarantees 8 byte alignment");
+  _maxLevel = level < Policy::kMaxHeight ? level : Policy::kMaxHeight - 1;
+  _curLevel = 0;
+  _freeList.assign(_maxLevel + 1, nullptr);
+  _header = createNode(K(), V(), _maxLevel);
+  _levelCount.assign(_maxLevel + 1, 0);
+  if (hash_index && canHash()) _hash.reset(new NodeHashIndex<K, Node<K, V>>());
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+SkipListIndex<K, V, Comp, Policy>::~SkipListIndex() {
+  // the arena releases the memory, only the keys and values need destroying
+  Node<K, V>* cur = _header;
+  while (cur != nullptr) {
+    Node<K, V>* next = cur->_forward[0];
+    cur->~Node<K, V>();
+    cur = next;
+  }
+}
+
+// random level of the node
+template <typename K, typename V, typename Comp, typename Policy>
+int SkipListIndex<K, V, Comp, Policy>::getRandomLevel() {
+  return Policy::RandomHeight(&_rnd, _maxLevel + 1) - 1;
+}
+
+// create Node<K,V>
+template <typename K, typename V, typename Comp, typename Policy>
+template <typename VV>
+Node<K, V>* SkipListIndex<K, V, Comp, Policy>::createNode(const K& k, VV&& v,
+                                                          int level) {
+  char* mem;
+  Node<K, V>* reuse = _freeList[level];
+  if (reuse != nullptr) {
+    _freeList[level] = reuse->_forward[0];
+    mem = reinterpret_cast<char*>(reuse);
+  } else {
+    mem = _arena.AllocateAligned(Node<K, V>::sizeOf(level));
+  }
+  return new (mem) Node<K, V>(k, std::forward<VV>(v), level);
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipListIndex<K, V, Comp, Policy>::freeNode(Node<K, V>* node) {
+  int level = node->_nodeLevel;
+  node->~Node<K, V>();
+  // the tower is still ours, reuse its first slot as the free list link
+  node->_forward[0] = _freeList[level];
+  _freeList[level] = node;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+template <typename VV>
+bool SkipListIndex<K, V, Comp, Policy>::upsert(const K& k, VV&& v) {
+  // an overwrite needs no descent
+  if (_hash) {
+    Node<K, V>* node = _hash->find(k);
+    if (node != nullptr) {
+      node->setValue(std::forward<VV>(v));
+      return false;
+    }
+  }
+
+  Node<K, V>* cur = _header;
+  const uint64_t prefix = KeyPrefix<K>::of(k);
+
+  // track the parent of the inserted-Node and its rank
+  Node<K, V>* update[Policy::kMaxHeight];
+  size_t rank[Policy::kMaxHeight];
+  for (int i = _curLevel; i >= 0; i--) {
+    rank[i] = i == _curLevel ? 0 : rank[i + 1];
+    while (cur->_forward[i] && nodeLess(cur->_forward[i], k, prefix)) {
+      rank[i] += cur->span(i);
+      cur = cur->_forward[i];
+    }
+    update[i] = cur;
+  }
+
+  // the position of key
+  cur = cur->_forward[0];
+
+  // the key is already in the skiplist, modify its value
+  if (cur != nullptr && nodeEqual(cur, k, prefix)) {
+    cur->setValue(std::forward<VV>(v));
+    return false;
+  }
+
+  int randomLevel = getRandomLevel();
+  // the new Node's level is higher than _curLevel
+  if (randomLevel > _curLevel) {
+    for (int i = _curLevel + 1; i <= randomLevel; i++) {
+      update[i] = _header;
+      rank[i] = 0;
+    }
+    _curLevel = randomLevel;
+  }
+  // insert, splitting the spans of the links it lands under
+  Node<K, V>* insertNode = createNode(k, std::forward<VV>(v), randomLevel);
+  for (int i = 0; i <= randomLevel; i++) {
+    insertNode->_forward[i] = update[i]->_forward[i];
+    update[i]->_forward[i] = insertNode;
+    insertNode->span(i) = update[i]->span(i) - (rank[0] - rank[i]);
+    update[i]->span(i) = rank[0] - rank[i] + 1;
+  }
+  // the links above it skip one more node
+  for (int i = randomLevel + 1; i <= _curLevel; i++) update[i]->span(i)++;
+  if (_hash) _hash->insert(insertNode);
+  _levelCount[randomLevel]++;
+  _size++;
+  return true;
+}
+
+// keys that sort after the last node are linked behind the rightmost node
+// of each level, found once per run, instead of descending per key
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipListIndex<K, V, Comp, Policy>::InsertRun(
+    const std::pair<K, V>* items, size_t n) {
+  Node<K, V>* tail[Policy::kMaxHeight];
+  size_t rank[Policy::kMaxHeight];
+  Node<K, V>* cur = _header;
+  size_t r = 0;
+  for (int i = _maxLevel; i >= 0; i--) {
+    while (cur->_forward[i]) {
+      r += cur->span(i);
+      cur = cur->_forward[i];
+    }
+    tail[i] = cur;
+    rank[i] = r;
+  }
+  size_t i = 0;
+  for (; i < n; i++) {
+    const K& k = items[i].first;
+    // out of order, the rest takes the normal path
+    if (tail[0] != _header && !_less(tail[0]->getKey(), k)) break;
+    int level = getRandomLevel();
+    if (level > _curLevel) _curLevel = level;
+    Node<K, V>* node = createNode(k, items[i].second, level);
+    // the links above it stay null, their spans are not kept
+    for (int l = 0; l <= level; l++) {
+      tail[l]->_forward[l] = node;
+      tail[l]->span(l) = _size + 1 - rank[l];
+      tail[l] = node;
+      rank[l] = _size + 1;
+    }
+    if (_hash) _hash->insert(node);
+    _levelCount[level]++;
+    _size++;
+  }
+  for (; i < n; i++) Insert(items[i].first, items[i].second);
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+V* SkipListIndex<K, V, Comp, Policy>::Lookup(const K& k) {
+  if (_hash) {
+    Node<K, V>* node = _hash->find(k);
+    return node != nullptr ? node->mutableValue() : nullptr;
+  }
+  Node<K, V>* cur = findGreaterOrEqual(k);
+  if (cur != nullptr && nodeEqual(cur, k, KeyPrefix<K>::of(k))) {
+    return cur->mutableValue();
+  }
+  return nullptr;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipListIndex<K, V, Comp, Policy>::Erase(const K& k) {
+  // a miss needs no descent
+  if (_hash && _hash->find(k) == nullptr) return false;
+
+  Node<K, V>* cur = _header;
+  const uint64_t prefix = KeyPrefix<K>::of(k);
+  // track the parent
+  Node<K, V>* update[Policy::kMaxHeight];
+  for (int i = _curLevel; i >= 0; i--) {
+    while (cur->_forward[i] && nodeLess(cur->_forward[i], k, prefix))
+      cur = cur->_forward[i];
+    update[i] = cur;
+  }
+  cur = cur->_forward[0];
+  if (cur == nullptr || !nodeEqual(cur, k, prefix)) return false;
+
+  for (int i = 0; i <= _curLevel; i++) {
+    if (update[i]->_forward[i] == cur) {
+      update[i]->span(i) += cur->span(i) - 1;
+      update[i]->_forward[i] = cur->_forward[i];
+    } else {
+      update[i]->span(i)--;
+    }
+  }
+  // before freeNode, the table compares against the node's key
+  if (_hash) _hash->erase(k);
+  _levelCount[cur->_nodeLevel]--;
+  freeNode(cur);
+  while (_curLevel > 0 && _header->_forward[_curLevel] == nullptr)
+    _curLevel--;
+  _size--;
+  return true;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+Node<K, V>* SkipListIndex<K, V, Comp, Policy>::findGreaterOrEqual(
+    const K& k) const {
+  Node<K, V>* cur = _header;
+  const uint64_t prefix = KeyPrefix<K>::of(k);
+  for (int i = _curLevel; i >= 0; i--) {
+    while (cur->_forward[i] && nodeLess(cur->_forward[i], k, prefix))
+      cur = cur->_forward[i];
+  }
+  return cur->_forward[0];
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+Node<K, V>* SkipListIndex<K, V, Comp, Policy>::findByRank(size_t i) const {
+  // the header has rank 0, the node with i smaller keys rank i + 1
+  Node<K, V>* cur = _header;
+  size_t rank = 0;
+  for (int l = _curLevel; l >= 0; l--) {
+    while (cur->_forward[l] && rank + cur->span(l) <= i + 1) {
+      rank += cur->span(l);
+      cur = cur->_forward[l];
+    }
+    if (rank == i + 1) return cur;
+  }
+  return nullptr;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+size_t SkipListIndex<K, V, Comp, Policy>::Rank(const K& k) {
+  Node<K, V>* cur = _header;
+  const uint64_t prefix = KeyPrefix<K>::of(k);
+  size_t rank = 0;
+  for (int i = _curLevel; i >= 0; i--) {
+    while (cur->_forward[i] && nodeLess(cur->_forward[i], k, prefix)) {
+      rank += cur->span(i);
+      cur = cur->_forward[i];
+    }
+  }
+  return rank;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+std::unique_ptr<typename SkipListIndex<K, V, Comp, Policy>::Iterator>
+SkipListIndex<K, V, Comp, Policy>::NewIterator() {
+  return std::unique_ptr<Iterator>(new NodeIterator(this));
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipListIndex<K, V, Comp, Policy>::Display(std::ostream& os) {
+  Node<K, V>* cur;
+  for (int i = _curLevel; i >= 0; i--) {
+    cur = _header->_forward[i];
+    os << "Level " << i << std::endl;
+    while (cur != nullptr) {
+      os << cur->getKey() << ":" << cur->getValue() << "; ";
+      cur = cur->_forward[i];
+    }
+    os << std::endl;
+  }
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipListIndex<K, V, Comp, Policy>::GetProperty(
+    const std::string& property, std::string* value) {
+  if (property == "minikv.cur-level") {
+    *value = std::to_string(_curLevel);
+    return true;
+  }
+  return false;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipListIndex<K, V, Comp, Policy>::AppendMetrics(std::ostream& os) {
+  os << "# TYPE minikv_arena_wasted_bytes gauge\n";
+  os << "minikv_arena_wasted_bytes " << _arena.WastedBytes() << "\n";
+  os << "# TYPE minikv_skiplist_cur_level gauge\n";
+  os << "minikv_skiplist_cur_level " << _curLevel << "\n";
+  os << "# TYPE minikv_skiplist_max_level gauge\n";
+  os << "minikv_skiplist_max_level " << _maxLevel << "\n";
+  os << "# TYPE minikv_skiplist_nodes gauge\n";
+  for (int i = 0; i <= _curLevel; i++) {
+    os << "minikv_skiplist_nodes{height=\"" << i + 1 << "\"} "
+       << _levelCount[i] << "\n";
+  }
+  if (_hash) {
+    os << "# TYPE minikv_hash_index_slots gauge\n";
+    os << "minikv_hash_index_slots " << _hash->capacity() << "\n";
+    os << "# TYPE minikv_hash_index_bytes gauge\n";
+    os << "minikv_hash_index_bytes " << _hash->memoryUsage() << "\n";
+  }
+}
@@ -1,434 +1,1541 @@
 #pragma once
 #include <time.h>
+#include <unistd.h>
 
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "arena.h"
+#include "art.hpp"
+#include "async_file.h"
 #include "bloomfilter.hpp"
+#include "bplustree.hpp"
+#include "eviction.hpp"
+#include "hot_keys.hpp"
+#include "log.hpp"
 #include "lru.hpp"
+#include "ordered_index.hpp"
+#include "skiplist_index.hpp"
+#include "snapshot.h"
+#include "statistics.hpp"
+#include "value_log.h"
+#include "write_listener.hpp"
 
 #define STORE_FILE "../store/dumpFile.txt"
 #define LRU_DEFAULT_SIZE 8
 #define CYCLE_DEL_NUM 20
 
-static std::mutex mtx;
-
-template <typename T>
-class Less {
- public:
-  bool operator()(const T& a, const T& b) const { return a < b; }
-};
-
-template <typename K, typename V>
-class Node {
- public:
-  Node() = default;
-  Node(K k, V v, int level);
-  ~Node();
-
-  K getKey() const { return _key; };
-  V getValue() const { return _value; };
-  void setValue(V v) { _value = v; };
-
-  Node<K, V>** _forward;
-  int _nodeLevel;
-
- private:
-  K _key;
-  V _value;
-};
-
-template <typename K, typename V>
-Node<K, V>::Node(const K k, const V v, int level) {
-  _key = k;
-  _value = v;
-  _nodeLevel = level;
-  _forward = new Node<K, V>*[_nodeLevel + 1]();
-}
-
-template <typename K, typename V>
-Node<K, V>::~Node() {
-  delete[] _forward;
-}
-
-template <typename K, typename V, typename Comp = Less<K>>
+// The store: bloom filter, LRU cache and ttl bookkeeping in front of an
+// ordered index. The engine is picked per store; Comp and Policy apply to
+// the skiplist engines, Comp to the B+tree as well. ART needs the default
+// comparator and an integral or std::string key, the skiplist is used
+// where it cannot be built; the hashed skiplist drops its hash table
+// under a custom comparator. nodeArena is the block source of the
+// skiplist engines' node arena, see Arena::BlockSource.
+template <typename K, typename V, typename Comp = Less<K>,
+          typename Policy = FastSearchPolicy>
 class SkipList {
  public:
   SkipList() = default;
-  SkipList(int level, int lrusize = LRU_DEFAULT_SIZE);
+  SkipList(int level, int lrusize = LRU_DEFAULT_SIZE,
+           IndexEngine engine = SKIPLIST_ENGINE,
+           Arena::BlockSource nodeArena = Arena::kHeap);
   ~SkipList();
 
-  int getRandomLevel();
-  Node<K, V>* createNode(K, V, int);
   void displayList();
-  int insertElement(K, V);
-  bool searchElement(K, V&);
-  bool deleteElement(K);
-  int size() { return _elementCount; };
+  // 0 for a new key, 1 for an overwrite, -1 if the store is over
+  // maxmemory and nothing may be evicted. An rvalue value is moved into
+  // the index instead of copied
+  int insertElement(const K&, const V&);
+  int insertElement(const K&, V&&);
+  // store v and give k a new ttl in one step: k expires seconds from now,
+  // or never for 0, where insertElement keeps the old ttl. Listeners see
+  // one OnSet. Returns as insertElement
+  int setElement(const K& k, V v, int seconds);
+  bool searchElement(const K&, V&);
+  bool deleteElement(const K&);
 
-  void dumpFile();
-  void loadFile();
+  // atomic read-modify-write under one lock and one lookup; the value is
+  // changed where it lies in the index, no copy goes in or out.
+  // fn(V* v, bool found) gets the value, V() if k is missing or expired,
+  // and returns whether to store *v; it must leave *v untouched when it
+  // returns false. A stored key keeps its ttl, as with insertElement.
+  // 1 if fn stored the value, 0 if not, -1 if the store is over maxmemory
+  // and nothing may be evicted
+  template <typename Fn>
+  int updateElement(const K& k, Fn fn);
+  // add delta to the value, a missing key counts as 0. V is integral or a
+  // std::string holding a decimal integer. 0 with the sum in *result, -1
+  // over maxmemory, -2 if the value is no integer or the sum overflows
+  int incrementElement(const K& k, long long delta, long long* result);
+  // append suffix to the value, a missing key starts empty; for string
+  // values. 0 with the new length in *size, -1 over maxmemory
+  int appendElement(const K& k, const V& suffix, size_t* size);
+  // store desired if k holds expected: 1 if it did, 0 if not or missing,
+  // -1 over maxmemory
+  int compareAndSwap(const K& k, const V& expected, const V& desired);
+  // store v and move the old value to *old: 1 if there was one, 0 for a
+  // new key, -1 over maxmemory. Like setElement(k, v, 0) the key loses its
+  // ttl
+  int getSetElement(const K& k, V v, V* old);
+  // collect at most limit items whose key is not less than begin, in order
+  int scanElement(const K& begin, int limit,
+                  std::vector<std::pair<K, V>>* out);
+  // order statistics over the keys size() counts, keys whose ttl ran out
+  // included until they are reclaimed. O(log n) on the skiplist engines;
+  // the other engines and a mapped snapshot walk the keys.
+  // the number of keys less than k
+  size_t rankElement(const K& k);
+  // the key with i smaller keys; false if there is none or it expired
+  bool selectElement(size_t i, K* k, V* v);
+  // the number of keys in [begin, end)
+  size_t countRange(const K& begin, const K& end);
+  // the items with ranks offset .. offset + limit - 1 in order. Expired
+  // keys leave gaps, so the next page still starts at offset + limit
+  int pageElement(size_t offset, int limit,
+                  std::vector<std::pair<K, V>>* out);
+  int size() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return entries();
+  };
 
-  void element_expire_time(K, int);
-  int element_ttl(const K);
+  // write the store to path and wait until it is on disk; false if the
+  // file could not be written or another dump is running, with the reason
+  // in *error if error is not nullptr
+  bool dumpFile(const std::string& path = STORE_FILE,
+                std::string* error = nullptr);
+  // same, but return once the items are copied into the snapshot blocks.
+  // Compression, the disk writes and the fsync run in the background, the
+  // file replaces path once it is synced, then done(ok) runs on the writer
+  // thread.
+  // cut runs under the store lock right after the items are copied, with
+  // the seconds left of every key that has a ttl (0 if it expired but is
+  // still in the dump); a new replica is synced from that point on.
+  // A dump that cannot start returns false and sets *error, if given.
+  typedef std::function<void(const std::vector<std::pair<K, int>>&)> DumpCut;
+  bool bgDumpFile(const std::string& path = STORE_FILE,
+                  std::function<void(bool)> done = nullptr,
+                  DumpCut cut = nullptr, std::string* error = nullptr);
+  // reads block compressed snapshots and the old "key:value" text dumps.
+  // Snapshot blocks are decoded on threads workers, 0 for one per core;
+  // an empty store links them in as sorted runs.
+  void loadFile(const std::string& path = STORE_FILE, int threads = 0);
+  // serve the sorted snapshot at path from a read-only mapping instead of
+  // loading it, the store must be empty. Writes go to the index, which
+  // overlays the snapshot; the next dump merges both into one file. Keys
+  // must be ordered by Comp the way SnapshotCoder orders their bytes.
+  bool openSnapshot(const std::string& path, std::string* error);
+  // cap the items at bytes, as charged by EntryCharge; 0 turns the cap
+  // and the access tracking off. Writes evict sampled keys by policy once
+  // the store is over the cap.
+  void setMaxMemory(size_t bytes, EvictionPolicy policy);
+  // keep the values that own more than options.min_value_size heap bytes
+  // in a value log under dir, see base/value_log.h; the index holds V()
+  // for them and a side table the pointer. Applies to the following
+  // writes and loads. Unless options.gc_interval_ms is 0 a background
+  // thread runs gcValueLog. false if the log cannot be opened or is open
+  bool openValueLog(const std::string& dir, const ValueLogOptions& options,
+                    std::string* error);
+  // move the live values out of the value log file with the most dead
+  // bytes and delete it; false if no file has options.gc_ratio dead
+  bool gcValueLog();
+  // track the capacity most accessed keys of searchElement and of
+  // insertElement, counting about one call in sampleRate, see
+  // base/hot_keys.hpp; capacity 0 turns the tracking off
+  void setHotKeys(size_t capacity, int sampleRate);
+  // the tracked keys of the reads or the writes with their estimated
+  // accesses, hottest first; empty while the tracking is off
+  std::vector<std::pair<K, uint64_t>> hotKeys(bool writes);
+  // tell listener about every following mutation, nullptr to stop; the
+  // listener must outlive the store or be detached first
+  void setWriteListener(WriteListener<K, V>* listener) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _listener = listener;
+  }
+  // drop every item, ttl and the mapped snapshot, for a replica that
+  // resyncs from scratch; the listener is not told
+  void clear();
+  // block size and codec of the following dumps
+  void setSnapshotOptions(const SnapshotOptions& options) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _snapshotOptions = options;
+  }
+
+  // false if the key does not exist
+  bool element_expire_time(const K&, int);
+  int element_ttl(const K&);
+  // drop the ttl of the key, false if it had none
+  bool element_persist(const K&);
   void cycle_del();
 
   void printLRU() { _lrulist->printLRUCache(); };
 
+  // "minikv.stats": prometheus text dump of every counter and histogram
+  // "minikv.num-entries", "minikv.memory-usage", "minikv.index-engine":
+  // single values, plus the properties of the engine such as
+  // "minikv.cur-level" for the skiplist
+  // "minikv.dump-in-progress" (0/1), "minikv.last-dump-status" (ok/err),
+  // "minikv.dump-io-backend" (io_uring/threadpool): the background dump
+  // "minikv.mapped-snapshot": the file under openSnapshot, empty if none
+  // "minikv.used-memory", "minikv.maxmemory", "minikv.maxmemory-policy":
+  // bytes charged against the cap, see setMaxMemory
+  // "minikv.value-log-files", "minikv.value-log-bytes",
+  // "minikv.value-log-live-bytes": see openValueLog, 0 without a log
+  // "minikv.hot-reads", "minikv.hot-writes": one "<key> <accesses>" line
+  // per hotKeys entry
+  bool getProperty(const std::string& property, std::string* value);
+  Statistics* getStatistics() { return &_stats; }
+
  private:
+  typedef typename OrderedIndex<K, V>::Iterator Iterator;
+
   void get_key_value_from_string(const std::string& str, std::string* key,
                                  std::string* value);
   bool is_valid_string(const std::string& str);
-  int is_expire(K k);
+  // keys are written with operator<<, read them back the same way
+  static void parse_key(const std::string& str, std::string* k) { *k = str; }
+  template <typename T>
+  static void parse_key(const std::string& str, T* k) {
+    std::istringstream(str) >> *k;
+  }
+  // scanElement from *begin, or pageElement from offset if begin is null
+  int scan(const K* begin, size_t offset, int limit,
+           std::vector<std::pair<K, V>>* out);
+  // rankElement without the lock
+  size_t rank(const K& k);
+  void loadSnapshot(const std::string& path, int threads);
+  void loadText(const std::string& path);
+  int is_expire(const K& k);
+  // the ttl argument of a write: kKeepTtl keeps the ttl of the key, 0
+  // drops it, a positive value is the seconds until the key expires
+  enum { kKeepTtl = -1 };
+  template <typename VV>
+  int insertImpl(const K& k, VV&& v, int ttl);
+  template <typename Fn>
+  int updateImpl(const K& k, Fn fn, int ttl);
+  // the helpers below expect the caller to hold _mtx
+  // tell the listener about a write of v with ttl, before v is moved
+  void notifyWrite(const K& k, const V& v, int ttl) {
+    if (_listener == nullptr) return;
+    if (ttl == kKeepTtl) {
+      _listener->OnInsert(k, v);
+    } else {
+      _listener->OnSet(k, v, ttl);
+    }
+  }
+  // give k, which is in the index, the ttl of a write
+  void applyTtl(const K& k, int ttl);
+  // unlink the key
+  bool removeElement(const K& k);
+  int entries() {
+    return _index->Size() + (_base ? int(_base->num_entries()) : 0) -
+           int(_hidden.size());
+  }
+  bool tracking() const { return _maxMemory != 0; }
+  // evict until the items fit in _maxMemory, false if they cannot
+  bool evictIfNeeded();
+  // find k in the mapped snapshot unless it is hidden, v may be null
+  bool baseGet(const K& k, V* v);
+  // hide k of the mapped snapshot, false if it is not there
+  bool hideBase(const K& k);
+  // whether v goes to the value log
+  bool separable(const V& v) const {
+    return _valueLog && HeapBytes(v) > _valueLog->options().min_value_size;
+  }
+  // store v in the index, or in the value log with V() in the index;
+  // charges the item and returns whether k was not in the index
+  template <typename VV>
+  bool putIndex(const K& k, VV&& v);
+  bool vlogAdd(const K& k, const V& v, ValuePointer* ptr);
+  bool vlogGet(const ValuePointer& ptr, V* v);
+  // the value log pointer of k if its value lives there, stored being the
+  // value the index holds for k
+  const ValuePointer* vlogPointer(const K& k, const V& stored) const {
+    if (_vlogPtrs.empty() || HeapBytes(stored) != 0) return nullptr;
+    auto it = _vlogPtrs.find(k);
+    return it == _vlogPtrs.end() ? nullptr : &it->second;
+  }
+  // point k at ptr, or drop its pointer if ptr is null; the value it
+  // pointed at becomes garbage
+  void setVlogPointer(const K& k, const ValuePointer* ptr);
+  // EntryCharge of an index entry plus its side table entry, if any
+  size_t itemCharge(const K& k, const V& stored) const {
+    return EntryCharge(k, stored) +
+           (vlogPointer(k, stored) ? pointerCharge(k) : 0);
+  }
+  static size_t pointerCharge(const K& k) {
+    const size_t kNodeOverhead = 32;
+    return kNodeOverhead + sizeof(K) + HeapBytes(k) + sizeof(ValuePointer);
+  }
+  void gcLoop();
+
+  // the bytes of keys and values in the value log, strings as they are
+  static const std::string& encodeBytes(const std::string& v,
+                                        std::string*) {
+    return v;
+  }
+  template <typename T>
+  static const std::string& encodeBytes(const T& v, std::string* scratch) {
+    scratch->clear();
+    SnapshotCoder<T>::Encode(v, scratch);
+    return *scratch;
+  }
+  // *v += delta, see incrementElement; *v is only changed on success
+  static bool addInteger(std::string* v, bool found, long long delta,
+                         long long* result) {
+    long long cur = 0;
+    if (found) {
+      if (v->empty() || v->size() > 20 ||
+          !(isdigit(static_cast<unsigned char>((*v)[0])) || (*v)[0] == '-')) {
+        return false;
+      }
+      char* end;
+      errno = 0;
+      cur = strtoll(v->c_str(), &end, 10);
+      if (errno != 0 || end != v->c_str() + v->size()) return false;
+    }
+    if (__builtin_add_overflow(cur, delta, result)) return false;
+    // keeps the buffer of the old value
+    char buf[24];
+    v->assign(buf, snprintf(buf, sizeof(buf), "%lld", *result));
+    return true;
+  }
+  template <typename T>
+  static bool addInteger(T* v, bool found, long long delta,
+                         long long* result) {
+    static_assert(std::is_integral<T>::value,
+                  "incrementElement needs integral or string values");
+    const long long cur = found ? static_cast<long long>(*v) : 0;
+    if (__builtin_add_overflow(cur, delta, result)) return false;
+    const T next = static_cast<T>(*result);
+    if (static_cast<long long>(next) != *result) return false;
+    *v = next;
+    return true;
+  }
+  static bool decodeBytes(std::string&& bytes, std::string* v) {
+    *v = std::move(bytes);
+    return true;
+  }
+  template <typename T>
+  static bool decodeBytes(std::string&& bytes, T* v) {
+    return SnapshotCoder<T>::Decode(bytes.data(), bytes.size(), v);
+  }
+
+  static OrderedIndex<K, V>* newIndex(IndexEngine engine, int level,
+                                      Arena::BlockSource nodeArena);
+  static OrderedIndex<K, V>* newArt(std::true_type) {
+    return new ArtIndex<K, V>();
+  }
+  static OrderedIndex<K, V>* newArt(std::false_type) { return nullptr; }
 
  private:
-  // max level of the skip list
-  int _maxLevel;
-  // curlevel of the skip list
-  int _curLevel;
-  // head ptr
-  Node<K, V>* _header;
+  std::unique_ptr<OrderedIndex<K, V>> _index;
 
   BloomFilter<K> BF;
-  // cur element num
-  int _elementCount;
   // file operator
-  std::ofstream _fileWriter;
   std::ifstream _fileReader;
+  // writer of the running or the last dump
+  std::unique_ptr<AsyncFile> _dumpWriter;
+  // compresses and writes the blocks of the running or the last dump
+  std::thread _dumpThread;
+  SnapshotOptions _snapshotOptions;
+  // mapped snapshot under the index, see openSnapshot
+  std::unique_ptr<SnapshotReader> _base;
+  // keys of _base that were deleted or live in the index now
+  std::unordered_set<K> _hidden;
+
+  // see setMaxMemory; the tracker and the charge cover the index only
+  size_t _maxMemory = 0;
+  EvictionPolicy _evictionPolicy = NO_EVICTION;
+  size_t _usedMemory = 0;
+  KeyTracker<K> _tracker;
+  WriteListener<K, V>* _listener = nullptr;
+  // see setHotKeys, null while it is off
+  std::unique_ptr<HotKeys<K>> _hotReads;
+  std::unique_ptr<HotKeys<K>> _hotWrites;
+  // see openValueLog, set once
+  std::unique_ptr<ValueLog> _valueLog;
+  // keys whose value lives in _valueLog
+  std::unordered_map<K, ValuePointer> _vlogPtrs;
+  // encoding scratch of vlogAdd
+  std::string _vlogKey;
+  std::string _vlogValue;
+  std::atomic<bool> _dumping{false};
+  std::atomic<bool> _lastDumpOk{true};
 
   // the store timestamp and time of alive
   std::unordered_map<K, std::pair<int, time_t>> expire_key_mp;
   // LRU cache
   LRU<K, V>* _lrulist;
 
-  Comp _less;
+  Statistics _stats;
+
+  // guards every member above except _stats and the dump flags
+  std::mutex _mtx;
+
+  // serializes gc passes, the gc thread sleeps on _gcCv
+  std::mutex _gcMu;
+  std::condition_variable _gcCv;
+  std::atomic<bool> _gcStop{false};
+  std::thread _gcThread;
 };
 
 // init of SkipList
-template <typename K, typename V, typename Comp>
-SkipList<K, V, Comp>::SkipList(int level, int lrusize) {
-  _maxLevel = level;
-  _curLevel = 0;
-  _elementCount = 0;
-  K k;
-  V v;
-  _header = new Node<K, V>(k, v, _maxLevel);
+template <typename K, typename V, typename Comp, typename Policy>
+SkipList<K, V, Comp, Policy>::SkipList(int level, int lrusize,
+                                       IndexEngine engine,
+                                       Arena::BlockSource nodeArena)
+    : _index(newIndex(engine, level, nodeArena)) {
   _lrulist = new LRU<K, V>(lrusize);
-  // _less(Comp());
 }
 
 // destroy of SkipList
-template <typename K, typename V, typename Comp>
-SkipList<K, V, Comp>::~SkipList() {
-  if (_fileWriter.is_open()) _fileWriter.close();
+template <typename K, typename V, typename Comp, typename Policy>
+SkipList<K, V, Comp, Policy>::~SkipList() {
+  if (_gcThread.joinable()) {
+    {
+      std::lock_guard<std::mutex> gc(_gcMu);
+      _gcStop = true;
+    }
+    _gcCv.notify_all();
+    _gcThread.join();
+  }
+  // wait for a background dump, its callback uses the store
+  if (_dumpThread.joinable()) _dumpThread.join();
+  if (_dumpWriter) _dumpWriter->Close();
   if (_fileReader.is_open()) _fileReader.close();
-  delete _header;
   delete _lrulist;
 }
 
-// random level of the node
-template <typename K, typename V, typename Comp>
-int SkipList<K, V, Comp>::getRandomLevel() {
-  int k = 0;
-  while (rand() % 2) k++;
-  k = (k < _maxLevel) ? k : _maxLevel;
-  return k;
+template <typename K, typename V, typename Comp, typename Policy>
+OrderedIndex<K, V>* SkipList<K, V, Comp, Policy>::newIndex(
+    IndexEngine engine, int level, Arena::BlockSource nodeArena) {
+  OrderedIndex<K, V>* index = nullptr;
+  if (engine == ART_ENGINE) {
+    typedef std::integral_constant<
+        bool, ArtKey<K>::kSupported && std::is_same<Comp, Less<K>>::value>
+        art_supported;
+    index = newArt(art_supported());
+    if (index == nullptr) KV_LOG("ART can not order these keys, use skiplist");
+  } else if (engine == BPLUSTREE_ENGINE) {
+    index = new BPlusTreeIndex<K, V, Comp>();
+  } else if (engine == HASHED_SKIPLIST_ENGINE) {
+    typedef SkipListIndex<K, V, Comp, Policy> Index;
+    if (!Index::canHash()) KV_LOG("no hash index for custom comparators");
+    index = new Index(level, true, nodeArena);
+  }
+  if (index == nullptr) {
+    index = new SkipListIndex<K, V, Comp, Policy>(level, false, nodeArena);
+  }
+  return index;
 }
 
-// create Node<K,V>
-template <typename K, typename V, typename Comp>
-Node<K, V>* SkipList<K, V, Comp>::createNode(K k, V v, int level) {
-  Node<K, V>* node = new Node<K, V>(k, v, level);
-  return node;
+// insert element
+template <typename K, typename V, typename Comp, typename Policy>
+int SkipList<K, V, Comp, Policy>::insertElement(const K& k, const V& v) {
+  return insertImpl(k, v, kKeepTtl);
 }
 
-// insert element
-template <typename K, typename V, typename Comp>
-int SkipList<K, V, Comp>::insertElement(K k, V v) {
+template <typename K, typename V, typename Comp, typename Policy>
+int SkipList<K, V, Comp, Policy>::insertElement(const K& k, V&& v) {
+  return insertImpl(k, std::move(v), kKeepTtl);
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+int SkipList<K, V, Comp, Policy>::setElement(const K& k, V v, int seconds) {
+  return insertImpl(k, std::move(v), seconds > 0 ? seconds : 0);
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+template <typename VV>
+int SkipList<K, V, Comp, Policy>::insertImpl(const K& k, VV&& v, int ttl) {
+  StopWatch sw(&_stats, INSERT_LATENCY);
   // lock
-  mtx.lock();
+  _mtx.lock();
+  if (_hotWrites) _hotWrites->Add(k);
 
-  std::cout << "begin insert key: " << k << std::endl;
+  KV_LOG("begin insert key: " << k);
+  if (!evictIfNeeded()) {
+    KV_LOG("over maxmemory, reject key: " << k);
+    _mtx.unlock();
+    return -1;
+  }
+  // the key moves from the mapped snapshot to the index
+  bool replaced = hideBase(k);
   // if the item is expired, else put the item in LRU
   if (is_expire(k) == 1) {
-    std::cout << "expired, lazy delete the key: " << k << std::endl;
-    deleteElement(k);
+    KV_LOG("expired, lazy delete the key: " << k);
+    removeElement(k);
+    _stats.RecordTick(EXPIRED_RECLAIMED);
+  } else if (separable(v)) {
+    // values of the value log are not cached
+    _lrulist->del(k);
   } else {
-    std::cout << "put the key: " << k << std::endl;
+    KV_LOG("put the key: " << k);
     _lrulist->put(k, v);
   }
 
   BF._Set(k);
 
-  Node<K, V>* cur = _header;
-
-  // track the parent of the inserted-Node
-  Node<K, V>** update = new Node<K, V>*[_maxLevel + 1];
-  for (int i = _curLevel; i >= 0; i--) {
-    while (cur->_forward[i] && _less(cur->_forward[i]->getKey(), k))
-      cur = cur->_forward[i];
-    update[i] = cur;
-  }
-
-  // the position of key
-  cur = cur->_forward[0];
-
-  // the key is already in the skiplist, modify its value
-  if (cur != nullptr &&
-      (!_less(cur->getKey(), k) && !_less(k, cur->getKey()))) {
+  notifyWrite(k, v, ttl);
+  KV_LOG("insert key: " << k << ", value: " << v);
+  // last use of v, an rvalue is moved into the index
+  const bool inserted = putIndex(k, std::forward<VV>(v));
+  applyTtl(k, ttl);
+  // the key is already in the store, its value was modified
+  if (!inserted || replaced) {
     // std::cout<<"modify the Node key: "<<k<<", value: "<<v<<std::endl;
-    _lrulist->printLRUCache();
-    cur->setValue(v);
-    mtx.unlock();
+    if (KV_VERBOSE) _lrulist->printLRUCache();
+    _mtx.unlock();
     return 1;
   }
-
-  // insert the new Node
-  if (cur == nullptr || _less(k, cur->getKey())) {
-    int randomLevel = getRandomLevel();
-    // the new Node's level is higher than _curLevel
-    if (randomLevel > _curLevel) {
-      for (int i = _curLevel + 1; i <= randomLevel; i++) {
-        update[i] = _header;
-      }
-      _curLevel = randomLevel;
-    }
-    // insert
-    Node<K, V>* insertNode = createNode(k, v, randomLevel);
-    for (int i = 0; i <= randomLevel; i++) {
-      insertNode->_forward[i] = update[i]->_forward[i];
-      update[i]->_forward[i] = insertNode;
-    }
-    std::cout << "Successfully inserted key: " << k << ", value: " << v
-              << std::endl;
-    _elementCount++;
-  }
-
   // unlock the mutex
-  mtx.unlock();
+  _mtx.unlock();
   return 0;
 }
 
 // search the given key, and return its value
-template <typename K, typename V, typename Comp>
-bool SkipList<K, V, Comp>::searchElement(K k, V& v) {
-  if (!BF._IsIn(k)) {
-    std::cout << "BloomFilter: key=" << k << " doesn't exist" << std::endl;
-    return false;
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::searchElement(const K& k, V& v) {
+  StopWatch sw(&_stats, SEARCH_LATENCY);
+  // the LRU is reordered on every hit, so readers need the lock as well
+  std::lock_guard<std::mutex> lock(_mtx);
+  if (_hotReads) _hotReads->Add(k);
+  _stats.RecordTick(BLOOM_CHECKED);
+  const bool maybe = BF._IsIn(k);
+  if (!maybe) {
+    _stats.RecordTick(BLOOM_NEGATIVE);
+    KV_LOG("BloomFilter: key=" << k << " doesn't exist");
+    // the filter only covers the index, not the mapped snapshot
+    if (!_base) return false;
   }
 
   // firstly search from LRU
   if (_lrulist->get(k, v)) {
+    _stats.RecordTick(LRU_HIT);
     // lazy delete
     if (is_expire(k) == 1) {
-      std::cout << "The key: " << k << " has expired, lazy delete it"
-                << std::endl;
-      deleteElement(k);
+      KV_LOG("The key: " << k << " has expired, lazy delete it");
+      removeElement(k);
+      _stats.RecordTick(EXPIRED_RECLAIMED);
       return false;
     }
-    _lrulist->put(k, v);
+    // get() already moved the key to the head of the LRU
+    if (tracking()) _tracker.Touch(k);
     // std::cout << "Found key: " << k << ", value: " << v << " and move to the
     // head of LRU"<<std::endl;
     return true;
   }
-  Node<K, V>* cur = _header;
-  for (int i = _curLevel; i >= 0; i--) {
-    while (cur->_forward[i] && _less(cur->_forward[i]->getKey(), k))
-      cur = cur->_forward[i];
-  }
-  cur = cur->_forward[0];
+  _stats.RecordTick(LRU_MISS);
+  V* found = _index->Lookup(k);
   // lazy delete
-  if (cur && is_expire(cur->getKey()) == 1) {
-    deleteElement(cur->getKey());
+  if (found && is_expire(k) == 1) {
+    removeElement(k);
+    _stats.RecordTick(EXPIRED_RECLAIMED);
     return false;
   }
   // find the key-value
-  if (cur != nullptr &&
-      (!_less(cur->getKey(), k) && !_less(k, cur->getKey()))) {
-    v = cur->getValue();
-    _lrulist->put(k, v);
-    // std::cout << "Found key: " << k << ", value: " << cur->getValue() <<" and
+  if (found != nullptr) {
+    const ValuePointer* ptr = vlogPointer(k, *found);
+    if (ptr == nullptr) {
+      v = *found;
+      _lrulist->put(k, v);
+    } else if (!vlogGet(*ptr, &v)) {
+      return false;
+    }
+    if (tracking()) _tracker.Touch(k);
+    // std::cout << "Found key: " << k << ", value: " << v <<" and
     // put into the LRU"<< std::endl;
     return true;
   }
+  if (baseGet(k, &v)) {
+    _lrulist->put(k, v);
+    return true;
+  }
   // std::cout << "Not Found Key:" << k << std::endl;
+  if (maybe) _stats.RecordTick(BLOOM_FALSE_POSITIVE);
   return false;
 }
 
+template <typename K, typename V, typename Comp, typename Policy>
+template <typename Fn>
+int SkipList<K, V, Comp, Policy>::updateElement(const K& k, Fn fn) {
+  return updateImpl(k, fn, kKeepTtl);
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+template <typename Fn>
+int SkipList<K, V, Comp, Policy>::updateImpl(const K& k, Fn fn, int ttl) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  if (_hotWrites) _hotWrites->Add(k);
+  if (!evictIfNeeded()) return -1;
+  if (is_expire(k) == 1) {
+    removeElement(k);
+    _stats.RecordTick(EXPIRED_RECLAIMED);
+  }
+  // a cached copy is dropped rather than rewritten
+  _lrulist->del(k);
+
+  V* cur = _index->Lookup(k);
+  if (cur != nullptr && vlogPointer(k, *cur) == nullptr) {
+    const size_t charge = tracking() ? itemCharge(k, *cur) : 0;
+    if (!fn(cur, true)) return 0;
+    notifyWrite(k, *cur, ttl);
+    if (!separable(*cur)) {
+      if (tracking()) {
+        _usedMemory -= charge;
+        _usedMemory += itemCharge(k, *cur);
+        _tracker.Add(k);
+      }
+      applyTtl(k, ttl);
+      return 1;
+    }
+    // grown past the value log threshold: putIndex moves it there and
+    // charges the entry anew
+    V v(std::move(*cur));
+    if (tracking()) {
+      _usedMemory -= charge;
+      _usedMemory += itemCharge(k, *cur);
+    }
+    putIndex(k, std::move(v));
+    applyTtl(k, ttl);
+    return 1;
+  }
+
+  // the value lives in the value log or the mapped snapshot, or nowhere
+  V v = V();
+  bool found;
+  if (cur != nullptr) {
+    if (!vlogGet(*vlogPointer(k, *cur), &v)) return 0;
+    found = true;
+  } else {
+    found = baseGet(k, &v);
+  }
+  if (!fn(&v, found)) return 0;
+  hideBase(k);
+  BF._Set(k);
+  notifyWrite(k, v, ttl);
+  putIndex(k, std::move(v));
+  applyTtl(k, ttl);
+  return 1;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+int SkipList<K, V, Comp, Policy>::incrementElement(const K& k,
+                                                   long long delta,
+                                                   long long* result) {
+  const int r = updateElement(k, [&](V* v, bool found) {
+    return addInteger(v, found, delta, result);
+  });
+  return r < 0 ? -1 : r == 0 ? -2 : 0;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+int SkipList<K, V, Comp, Policy>::appendElement(const K& k, const V& suffix,
+                                                size_t* size) {
+  const int r = updateElement(k, [&](V* v, bool) {
+    v->append(suffix);
+    *size = v->size();
+    return true;
+  });
+  return r < 0 ? -1 : 0;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+int SkipList<K, V, Comp, Policy>::compareAndSwap(const K& k,
+                                                 const V& expected,
+                                                 const V& desired) {
+  return updateElement(k, [&](V* v, bool found) {
+    if (!found || !(*v == expected)) return false;
+    *v = desired;
+    return true;
+  });
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+int SkipList<K, V, Comp, Policy>::getSetElement(const K& k, V v, V* old) {
+  bool had = false;
+  const int r = updateImpl(k, [&](V* cur, bool found) {
+    had = found;
+    if (found) *old = std::move(*cur);
+    *cur = std::move(v);
+    return true;
+  }, 0);
+  return r < 0 ? -1 : had ? 1 : 0;
+}
+
 // delete the given key element
-template <typename K, typename V, typename Comp>
-bool SkipList<K, V, Comp>::deleteElement(K k) {
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::deleteElement(const K& k) {
+  StopWatch sw(&_stats, DELETE_LATENCY);
   // lock the mutex
-  mtx.lock();
+  _mtx.lock();
+  bool ret = removeElement(k);
+  _mtx.unlock();
+  return ret;
+}
 
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::removeElement(const K& k) {
   if (!BF._IsIn(k)) {
-    std::cout << "BloomFilter: key=" << k << " doesn't exist" << std::endl;
-    mtx.unlock();
-    return false;
+    KV_LOG("BloomFilter: key=" << k << " doesn't exist");
+    // a key of the mapped snapshot is never in the filter
+    if (!hideBase(k)) return false;
+    if (_listener) _listener->OnRemove(k);
+    return true;
   }
 
   // whether the key in the LRU cache
   if (_lrulist->is_find(k)) {
     _lrulist->del(k);
-    expire_key_mp.erase(k);
   }
+  // a re-inserted key must not inherit the old ttl
+  expire_key_mp.erase(k);
 
-  Node<K, V>* cur = _header;
-  // track the parent
-  Node<K, V>** update = new Node<K, V>*[_maxLevel + 1];
-  for (int i = _curLevel; i >= 0; i--) {
-    while (cur->_forward[i] && _less(cur->_forward[i]->getKey(), k))
-      cur = cur->_forward[i];
-    update[i] = cur;
+  if (tracking()) {
+    V* old = _index->Lookup(k);
+    if (old != nullptr) _usedMemory -= itemCharge(k, *old);
+    _tracker.Remove(k);
   }
-  cur = cur->_forward[0];
-
   // if find the key-element, delete
-  if (cur != nullptr &&
-      (!_less(cur->getKey(), k) && !_less(k, cur->getKey()))) {
-    for (int i = 0; i <= _curLevel; i++) {
-      if (update[i]->_forward[i] != cur) break;
-      update[i]->_forward[i] = cur->_forward[i];
-    }
-    std::cout << "Delete key: " << k << " value: " << cur->getValue()
-              << std::endl;
-    delete cur;
-    while (_curLevel > 0 && _header->_forward[_curLevel] == nullptr)
-      _curLevel--;
-    _elementCount--;
-    mtx.unlock();
-    return true;
+  bool found = _index->Erase(k);
+  setVlogPointer(k, nullptr);
+  if (hideBase(k)) found = true;
+  if (found) {
+    KV_LOG("Delete key: " << k);
+    if (_listener) _listener->OnRemove(k);
+  } else {
+    KV_LOG("Delete key: " << k << " failed, not exist");
   }
-  std::cout << "Delete key: " << k << " failed, not exist" << std::endl;
-  mtx.unlock();
-  return false;
+  return found;
 }
 
-// display the skip list
-// in level mode
-template <typename K, typename V, typename Comp>
-void SkipList<K, V, Comp>::displayList() {
-  std::cout << "\n**********Display SkipList**********\n";
-  Node<K, V>* cur;
-  for (int i = _curLevel; i >= 0; i--) {
-    cur = _header->_forward[i];
-    std::cout << "Level " << i << std::endl;
-    while (cur != nullptr) {
-      std::cout << cur->getKey() << ":" << cur->getValue() << "; ";
-      cur = cur->_forward[i];
+// range scan from the first key not less than begin
+template <typename K, typename V, typename Comp, typename Policy>
+int SkipList<K, V, Comp, Policy>::scanElement(
+    const K& begin, int limit, std::vector<std::pair<K, V>>* out) {
+  return scan(&begin, 0, limit, out);
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+int SkipList<K, V, Comp, Policy>::pageElement(
+    size_t offset, int limit, std::vector<std::pair<K, V>>* out) {
+  return scan(nullptr, offset, limit, out);
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::selectElement(size_t i, K* k, V* v) {
+  std::vector<std::pair<K, V>> items;
+  if (scan(nullptr, i, 1, &items) == 0) return false;
+  *k = std::move(items[0].first);
+  *v = std::move(items[0].second);
+  return true;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+size_t SkipList<K, V, Comp, Policy>::rankElement(const K& k) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  return rank(k);
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+size_t SkipList<K, V, Comp, Policy>::countRange(const K& begin,
+                                                const K& end) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  if (!Comp()(begin, end)) return 0;
+  return rank(end) - rank(begin);
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+size_t SkipList<K, V, Comp, Policy>::rank(const K& k) {
+  size_t n = _index->Rank(k);
+  if (!_base) return n;
+  // plus the visible keys of the snapshot that sort before k
+  SnapshotReader::Iterator bit(_base.get());
+  Comp less;
+  K bk;
+  for (bit.SeekToFirst(); bit.Valid(); bit.Next()) {
+    if (!SnapshotCoder<K>::Decode(bit.key(), bit.key_size(), &bk)) continue;
+    if (!less(bk, k)) break;
+    if (_hidden.count(bk) == 0) n++;
+  }
+  return n;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+int SkipList<K, V, Comp, Policy>::scan(const K* begin, size_t offset,
+                                       int limit,
+                                       std::vector<std::pair<K, V>>* out) {
+  _mtx.lock();
+  std::unique_ptr<Iterator> it = _index->NewIterator();
+  // without a snapshot to merge the index finds the offset itself
+  if (begin != nullptr) {
+    it->Seek(*begin);
+  } else if (!_base) {
+    it->SeekToRank(offset);
+    offset = 0;
+  } else {
+    it->SeekToFirst();
+  }
+  // merged with the mapped snapshot, skipping its hidden keys
+  std::unique_ptr<SnapshotReader::Iterator> bit;
+  K bk;
+  auto skipHidden = [&] {
+    for (; bit->Valid(); bit->Next()) {
+      if (SnapshotCoder<K>::Decode(bit->key(), bit->key_size(), &bk) &&
+          _hidden.count(bk) == 0) {
+        return;
+      }
+    }
+  };
+  if (_base) {
+    bit.reset(new SnapshotReader::Iterator(_base.get()));
+    if (begin != nullptr) {
+      std::string target;
+      SnapshotCoder<K>::Encode(*begin, &target);
+      bit->Seek(target);
+    } else {
+      bit->SeekToFirst();
     }
-    std::cout << std::endl;
+    skipHidden();
   }
+  Comp less;
+  int n = 0;
+  // a page counts the keys it passes, a scan the items it returns
+  int passed = 0;
+  while ((begin != nullptr ? n : passed) < limit) {
+    const bool fromBase =
+        bit && bit->Valid() && (!it->Valid() || less(bk, it->key()));
+    if (!fromBase && !it->Valid()) break;
+    if (offset > 0) {
+      // the rest of the offset, merged with the snapshot
+      offset--;
+    } else if (fromBase) {
+      V v;
+      if (SnapshotCoder<V>::Decode(bit->value(), bit->value_size(), &v)) {
+        out->emplace_back(bk, v);
+        n++;
+      }
+      passed++;
+    } else {
+      // expired keys are skipped here and reclaimed lazily elsewhere
+      if (is_expire(it->key()) != 1) {
+        const ValuePointer* ptr = vlogPointer(it->key(), it->value());
+        V v;
+        if (ptr == nullptr) {
+          out->emplace_back(it->key(), it->value());
+          n++;
+        } else if (vlogGet(*ptr, &v)) {
+          out->emplace_back(it->key(), std::move(v));
+          n++;
+        }
+      }
+      passed++;
+    }
+    if (fromBase) {
+      bit->Next();
+      skipHidden();
+    } else {
+      it->Next();
+    }
+  }
+  _mtx.unlock();
+  return n;
+}
+
+// display the index, the skiplist in level mode
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipList<K, V, Comp, Policy>::displayList() {
+  std::lock_guard<std::mutex> lock(_mtx);
+  std::cout << "\n**********Display SkipList**********\n";
+  _index->Display(std::cout);
   std::cout << "\n************Display  End************\n";
 }
 
 // write return disk
-template <typename K, typename V, typename Comp>
-void SkipList<K, V, Comp>::dumpFile() {
-  std::cout << "\ndump file\n";
-  _fileWriter.open(STORE_FILE);
-  if (!_fileWriter.is_open()) {
-    std::cout << "file not open" << std::endl;
-    return;
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::dumpFile(const std::string& path,
+                                            std::string* error) {
+  std::promise<bool> done;
+  std::future<bool> ok = done.get_future();
+  if (!bgDumpFile(path, [&done](bool r) { done.set_value(r); }, nullptr,
+                  error)) {
+    return false;
   }
-  Node<K, V>* cur = _header->_forward[0];
-  while (cur != nullptr) {
-    _fileWriter << cur->getKey() << ":" << cur->getValue() << std::endl;
-    cur = cur->_forward[0];
+  if (ok.get()) return true;
+  if (error != nullptr) *error = "writing " + path + " failed";
+  return false;
+}
+
+// the items are encoded into the snapshot blocks under the lock, so the
+// file is a consistent snapshot; compression and the disk writes happen on
+// _dumpThread after unlock
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::bgDumpFile(const std::string& path,
+                                              std::function<void(bool)> done,
+                                              DumpCut cut,
+                                              std::string* error) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  KV_LOG("dump file");
+  bool idle = false;
+  if (!_dumping.compare_exchange_strong(idle, true)) {
+    KV_LOG("dump in progress");
+    if (error != nullptr) *error = "a dump is in progress";
+    return false;
+  }
+  // the last dump is finished, release its threads
+  if (_dumpThread.joinable()) _dumpThread.join();
+  if (_dumpWriter) _dumpWriter->Close();
+  _dumpWriter.reset(new AsyncFile());
+  // written next to path and renamed once synced, so a crash never
+  // leaves a half written dump behind
+  const std::string tmp = path + ".tmp";
+  std::string openError;
+  if (!_dumpWriter->Open(tmp, true, &openError)) {
+    KV_LOG("file not open: " << openError);
+    if (error != nullptr) *error = openError;
+    _lastDumpOk = false;
+    _dumping = false;
+    return false;
   }
-  _fileWriter.flush();
-  _fileWriter.close();
+  auto start = std::chrono::steady_clock::now();
+  AsyncFile* file = _dumpWriter.get();
+  std::shared_ptr<SnapshotWriter> writer =
+      std::make_shared<SnapshotWriter>(file, _snapshotOptions);
+  std::string key, value;
+  std::unique_ptr<Iterator> it = _index->NewIterator();
+  it->SeekToFirst();
+  // merge the mapped snapshot in, its records are copied as they are
+  std::unique_ptr<SnapshotReader::Iterator> bit;
+  if (_base) {
+    bit.reset(new SnapshotReader::Iterator(_base.get()));
+    bit->SeekToFirst();
+  }
+  K bk;
+  // a value of the value log is read back into the dump
+  std::string vlogError;
+  while (true) {
+    while (bit && bit->Valid() &&
+           (!SnapshotCoder<K>::Decode(bit->key(), bit->key_size(), &bk) ||
+            _hidden.count(bk) != 0)) {
+      bit->Next();
+    }
+    if (it->Valid()) {
+      key.clear();
+      SnapshotCoder<K>::Encode(it->key(), &key);
+    }
+    if (bit && bit->Valid() &&
+        (!it->Valid() ||
+         key.compare(0, key.size(), bit->key(), bit->key_size()) > 0)) {
+      writer->Add(bit->key(), bit->key_size(), bit->value(),
+                  bit->value_size());
+      bit->Next();
+    } else if (it->Valid()) {
+      value.clear();
+      const ValuePointer* ptr = vlogPointer(it->key(), it->value());
+      if (ptr == nullptr) {
+        SnapshotCoder<V>::Encode(it->value(), &value);
+      } else if (!_valueLog->Get(*ptr, &value, &vlogError)) {
+        break;
+      }
+      writer->Add(key, value);
+      it->Next();
+    } else {
+      break;
+    }
+  }
+  if ((bit && !bit->error().empty()) || !vlogError.empty()) {
+    KV_LOG("snapshot not readable: " << (bit ? bit->error() : "")
+                                     << vlogError);
+    if (error != nullptr) *error = (bit ? bit->error() : "") + vlogError;
+    _dumpWriter->Close();
+    unlink(tmp.c_str());
+    _lastDumpOk = false;
+    _dumping = false;
+    return false;
+  }
+  if (cut) {
+    std::vector<std::pair<K, int>> ttls;
+    ttls.reserve(expire_key_mp.size());
+    const time_t now = time(nullptr);
+    for (auto& e : expire_key_mp) {
+      time_t left = e.second.first - (now - e.second.second);
+      ttls.emplace_back(e.first, left > 0 ? int(left) : 0);
+    }
+    cut(ttls);
+  }
+  _dumpThread = std::thread([this, file, writer, tmp, path, done, start] {
+    writer->Finish();
+    _stats.RecordTick(SNAPSHOT_RAW_BYTES, writer->raw_bytes());
+    _stats.RecordTick(SNAPSHOT_FILE_BYTES, writer->file_bytes());
+    file->Sync([this, tmp, path, done, start](bool ok) {
+      if (ok && rename(tmp.c_str(), path.c_str()) != 0) ok = false;
+      if (!ok) unlink(tmp.c_str());
+      _stats.MeasureTime(SNAPSHOT_DUMP_TIME,
+                         std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count());
+      _lastDumpOk = ok;
+      _dumping = false;
+      if (done) done(ok);
+    });
+  });
+  return true;
 }
 
 // load the data from disk
-template <typename K, typename V, typename Comp>
-void SkipList<K, V, Comp>::loadFile() {
-  std::cout << "\nload file\n";
-  _fileReader.open(STORE_FILE);
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipList<K, V, Comp, Policy>::loadFile(const std::string& path,
+                                            int threads) {
+  StopWatch sw(&_stats, SNAPSHOT_LOAD_TIME);
+  KV_LOG("load file");
+  if (SnapshotReader::IsSnapshotFile(path)) {
+    if (threads <= 0) threads = std::thread::hardware_concurrency();
+    loadSnapshot(path, threads);
+  } else {
+    loadText(path);
+  }
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipList<K, V, Comp, Policy>::loadSnapshot(const std::string& path,
+                                                int threads) {
+  std::unique_ptr<SnapshotReader> reader;
+  std::string error;
+  if (!SnapshotReader::Open(path, &reader, &error, true)) {
+    KV_LOG("snapshot not open: " << error);
+    return;
+  }
+  // an empty store is held locked and takes every block as a sorted run:
+  // the workers fill the bloom filter, the index links the run behind its
+  // tail. Otherwise the items go through insertElement in file order.
+  std::unique_lock<std::mutex> lock(_mtx, std::defer_lock);
+  bool splice = false;
+  if (reader->sorted()) {
+    lock.lock();
+    splice = !_base && _index->Size() == 0 && expire_key_mp.empty() &&
+             !tracking();
+    if (!splice) lock.unlock();
+  }
+  typedef std::vector<std::pair<K, V>> Run;
+  std::vector<Run> runs(reader->num_blocks());
+  std::atomic<uint64_t> undecodable(0);
+  auto decode = [&](size_t i, const char* p, size_t n) {
+    const char* limit = p + n;
+    Run& run = runs[i];
+    run.reserve(reader->block_entries(i));
+    while (p < limit) {
+      const char *key, *value;
+      size_t klen, vlen;
+      if (!SnapshotReader::ParseRecord(&p, limit, &key, &klen, &value,
+                                       &vlen)) {
+        return false;
+      }
+      run.emplace_back();
+      if (!SnapshotCoder<K>::Decode(key, klen, &run.back().first) ||
+          !SnapshotCoder<V>::Decode(value, vlen, &run.back().second)) {
+        run.pop_back();
+        undecodable++;
+        continue;
+      }
+      if (splice) BF._SetConcurrent(run.back().first);
+    }
+    return true;
+  };
+  auto consume = [&](size_t i) {
+    Run run;
+    run.swap(runs[i]);
+    if (splice) {
+      if (_valueLog) {
+        ValuePointer ptr;
+        for (auto& item : run) {
+          if (separable(item.second) &&
+              vlogAdd(item.first, item.second, &ptr)) {
+            setVlogPointer(item.first, &ptr);
+            item.second = V();
+          }
+        }
+      }
+      _index->InsertRun(run.data(), run.size());
+    } else {
+      for (auto& item : run) {
+        insertElement(item.first, std::move(item.second));
+      }
+    }
+  };
+  if (!ReadBlocksParallel(reader.get(), threads, decode, consume, &error)) {
+    KV_LOG("snapshot stopped: " << error);
+  }
+  if (undecodable > 0) {
+    KV_LOG(undecodable.load() << " undecodable snapshot items");
+  }
+}
+
+// the text format of the older versions, "key:value" per line
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipList<K, V, Comp, Policy>::loadText(const std::string& path) {
+  _fileReader.open(path);
   if (!_fileReader.is_open()) {
-    std::cout << "file not open" << std::endl;
+    KV_LOG("file not open");
     return;
   }
   std::string line;
-  std::string* key = new std::string();
-  std::string* value = new std::string();
+  std::string key;
+  std::string value;
   while (getline(_fileReader, line)) {
-    get_key_value_from_string(line, key, value);
-    if (key->empty() || value->empty()) continue;
-    insertElement(stoi(*key), *value);
-    std::cout << "load item key: " << *key << " value: " << *value << std::endl;
+    key.clear();
+    value.clear();
+    get_key_value_from_string(line, &key, &value);
+    if (key.empty() || value.empty()) continue;
+    K k;
+    parse_key(key, &k);
+    KV_LOG("load item key: " << key << " value: " << value);
+    insertElement(k, std::move(value));
   }
   _fileReader.close();
 }
 
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::openSnapshot(const std::string& path,
+                                                std::string* error) {
+  StopWatch sw(&_stats, SNAPSHOT_LOAD_TIME);
+  std::unique_ptr<SnapshotReader> reader;
+  if (!SnapshotReader::Open(path, &reader, error, true)) return false;
+  if (!reader->sorted()) {
+    *error = path + ": keys are not sorted";
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(_mtx);
+  if (_base || _index->Size() != 0) {
+    *error = "the store is not empty";
+    return false;
+  }
+  _base = std::move(reader);
+  return true;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::baseGet(const K& k, V* v) {
+  if (!_base || _hidden.count(k) != 0) return false;
+  std::string key, value, error;
+  SnapshotCoder<K>::Encode(k, &key);
+  if (!_base->Get(key, v ? &value : nullptr, &error)) {
+    if (!error.empty()) KV_LOG("snapshot not readable: " << error);
+    return false;
+  }
+  return v == nullptr ||
+         SnapshotCoder<V>::Decode(value.data(), value.size(), v);
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::hideBase(const K& k) {
+  // a key in the index already hides the snapshot's copy
+  if (!_base || _index->Lookup(k) != nullptr || !baseGet(k, nullptr)) {
+    return false;
+  }
+  _hidden.insert(k);
+  if (_lrulist->is_find(k)) _lrulist->del(k);
+  return true;
+}
+
+// the bloom filter keeps its bits, stale bits only cost a lookup
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipList<K, V, Comp, Policy>::clear() {
+  std::lock_guard<std::mutex> lock(_mtx);
+  std::vector<K> keys;
+  keys.reserve(_index->Size());
+  std::unique_ptr<Iterator> it = _index->NewIterator();
+  for (it->SeekToFirst(); it->Valid(); it->Next()) keys.push_back(it->key());
+  it.reset();
+  for (const K& k : keys) _index->Erase(k);
+  _lrulist->clear();
+  expire_key_mp.clear();
+  _base.reset();
+  _hidden.clear();
+  _tracker.Clear();
+  _usedMemory = 0;
+  _vlogPtrs.clear();
+  if (_valueLog) _valueLog->Clear();
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+template <typename VV>
+bool SkipList<K, V, Comp, Policy>::putIndex(const K& k, VV&& v) {
+  ValuePointer ptr;
+  const bool separate = separable(v) && vlogAdd(k, v, &ptr);
+  if (tracking()) {
+    V* old = _index->Lookup(k);
+    if (old != nullptr) _usedMemory -= itemCharge(k, *old);
+    _usedMemory += separate ? EntryCharge(k, V()) + pointerCharge(k)
+                            : EntryCharge(k, v);
+    _tracker.Add(k);
+  }
+  if (!separate) {
+    setVlogPointer(k, nullptr);
+    return _index->Insert(k, std::forward<VV>(v));
+  }
+  setVlogPointer(k, &ptr);
+  return _index->Insert(k, V());
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::vlogAdd(const K& k, const V& v,
+                                           ValuePointer* ptr) {
+  const std::string& key = encodeBytes(k, &_vlogKey);
+  const std::string& value = encodeBytes(v, &_vlogValue);
+  std::string error;
+  if (!_valueLog->Add(key.data(), key.size(), value.data(), value.size(), ptr,
+                      &error)) {
+    // the value stays in the index
+    KV_LOG("value log not writable: " << error);
+    return false;
+  }
+  _stats.RecordTick(VLOG_BYTES_WRITTEN, value.size());
+  return true;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::vlogGet(const ValuePointer& ptr, V* v) {
+  std::string value, error;
+  if (!_valueLog->Get(ptr, &value, &error)) {
+    KV_LOG("value log not readable: " << error);
+    return false;
+  }
+  return decodeBytes(std::move(value), v);
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipList<K, V, Comp, Policy>::setVlogPointer(const K& k,
+                                                  const ValuePointer* ptr) {
+  if (ptr == nullptr && _vlogPtrs.empty()) return;
+  auto it = _vlogPtrs.find(k);
+  if (it != _vlogPtrs.end()) {
+    _valueLog->Drop(it->second);
+    if (ptr == nullptr) {
+      _vlogPtrs.erase(it);
+    } else {
+      it->second = *ptr;
+    }
+  } else if (ptr != nullptr) {
+    _vlogPtrs.emplace(k, *ptr);
+  }
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::openValueLog(
+    const std::string& dir, const ValueLogOptions& options,
+    std::string* error) {
+  {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_valueLog) {
+      *error = "value log is open already";
+      return false;
+    }
+    if (!ValueLog::Open(dir, options, &_valueLog, error)) return false;
+  }
+  if (options.gc_interval_ms > 0) _gcThread = std::thread([this] { gcLoop(); });
+  return true;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipList<K, V, Comp, Policy>::gcLoop() {
+  const auto interval =
+      std::chrono::milliseconds(_valueLog->options().gc_interval_ms);
+  std::unique_lock<std::mutex> gc(_gcMu);
+  while (!_gcStop) {
+    _gcCv.wait_for(gc, interval);
+    gc.unlock();
+    while (!_gcStop && gcValueLog()) {
+    }
+    gc.lock();
+  }
+}
+
+// WiscKey style: the records of the picked file are read outside the store
+// lock, and the live ones are moved in batches under it. A value is live
+// while its key still points at it; writes never go to the picked file, so
+// once it is read through no pointer is left in it.
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::gcValueLog() {
+  const size_t kBatchBytes = 1 << 20;
+  std::lock_guard<std::mutex> gc(_gcMu);
+  ValueLog* log;
+  {
+    std::lock_guard<std::mutex> lock(_mtx);
+    log = _valueLog.get();
+  }
+  uint32_t file;
+  uint64_t live;
+  if (log == nullptr || !log->PickGarbageFile(&file, &live)) return false;
+
+  struct Record {
+    K key;
+    std::string keyBytes;
+    std::string value;
+    ValuePointer ptr;
+  };
+  std::vector<Record> batch;
+  size_t batchBytes = 0;
+  std::string error;
+  auto relocate = [&] {
+    std::lock_guard<std::mutex> lock(_mtx);
+    for (Record& r : batch) {
+      auto it = _vlogPtrs.find(r.key);
+      if (it == _vlogPtrs.end() || !(it->second == r.ptr)) continue;
+      ValuePointer moved;
+      if (!log->Add(r.keyBytes.data(), r.keyBytes.size(), r.value.data(),
+                    r.value.size(), &moved, &error)) {
+        return false;
+      }
+      it->second = moved;
+      _stats.RecordTick(VLOG_BYTES_WRITTEN, r.value.size());
+      _stats.RecordTick(VLOG_GC_RELOCATED_BYTES, r.value.size());
+    }
+    batch.clear();
+    batchBytes = 0;
+    return true;
+  };
+  bool ok = true;
+  auto add = [&](const char* key, size_t klen, const char* value,
+                 size_t vlen, const ValuePointer& ptr) {
+    if (!ok) return;
+    batch.emplace_back();
+    Record& r = batch.back();
+    if (!SnapshotCoder<K>::Decode(key, klen, &r.key)) {
+      error = "undecodable key";
+      ok = false;
+      return;
+    }
+    r.keyBytes.assign(key, klen);
+    r.value.assign(value, vlen);
+    r.ptr = ptr;
+    batchBytes += klen + vlen;
+    if (batchBytes >= kBatchBytes) ok = relocate();
+  };
+  // a file without live values is just deleted
+  if (live > 0) ok = log->ForEach(file, add, &error) && ok && relocate();
+  if (!ok) {
+    KV_LOG("value log gc stopped: " << error);
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(_mtx);
+  log->RemoveFile(file);
+  _stats.RecordTick(VLOG_GC_FILES);
+  return true;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipList<K, V, Comp, Policy>::setMaxMemory(size_t bytes,
+                                                EvictionPolicy policy) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  const bool was = tracking();
+  _maxMemory = bytes;
+  _evictionPolicy = policy;
+  if (!tracking()) {
+    _tracker.Clear();
+    _usedMemory = 0;
+  } else if (!was) {
+    // start tracking the items already in the index
+    std::unique_ptr<Iterator> it = _index->NewIterator();
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+      _usedMemory += itemCharge(it->key(), it->value());
+      _tracker.Add(it->key());
+    }
+    for (auto& e : expire_key_mp) _tracker.SetVolatile(e.first, true);
+  }
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipList<K, V, Comp, Policy>::setHotKeys(size_t capacity,
+                                              int sampleRate) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  if (capacity == 0) {
+    _hotReads.reset();
+    _hotWrites.reset();
+    return;
+  }
+  _hotReads.reset(new HotKeys<K>(capacity, sampleRate));
+  _hotWrites.reset(new HotKeys<K>(capacity, sampleRate));
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+std::vector<std::pair<K, uint64_t>> SkipList<K, V, Comp, Policy>::hotKeys(
+    bool writes) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  HotKeys<K>* hot = writes ? _hotWrites.get() : _hotReads.get();
+  return hot ? hot->Top() : std::vector<std::pair<K, uint64_t>>();
+}
+
+// sampled like redis: each victim is the best of kSamples random keys, so
+// a write evicts about as much as it adds and never walks the whole store
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::evictIfNeeded() {
+  const int kSamples = 5;
+  if (!tracking() || _usedMemory <= _maxMemory) return true;
+  if (_evictionPolicy == NO_EVICTION) return false;
+  const bool volatileOnly =
+      _evictionPolicy == VOLATILE_LRU || _evictionPolicy == VOLATILE_TTL;
+  time_t now = time(nullptr);
+  while (_usedMemory > _maxMemory) {
+    if ((volatileOnly ? _tracker.volatileSize() : _tracker.size()) == 0) {
+      return false;
+    }
+    const typename KeyTracker<K>::Entry* victim = nullptr;
+    int64_t best = 0;
+    for (int i = 0; i < kSamples; i++) {
+      const typename KeyTracker<K>::Entry* e = _tracker.Random(volatileOnly);
+      // higher is a better victim
+      int64_t score;
+      if (_evictionPolicy == ALLKEYS_LFU) {
+        score = 255 - _tracker.Frequency(e->second);
+      } else if (_evictionPolicy == VOLATILE_TTL) {
+        const std::pair<int, time_t>& ttl = expire_key_mp[e->first];
+        score = -(ttl.second + ttl.first - now);
+      } else {
+        score = _tracker.IdleTime(e->second);
+      }
+      if (victim == nullptr || score > best) {
+        victim = e;
+        best = score;
+      }
+    }
+    K k = victim->first;
+    KV_LOG("evict key: " << k);
+    removeElement(k);
+    _stats.RecordTick(EVICTED_KEYS);
+  }
+  return true;
+}
+
 // recover the KV-item from string
-template <typename K, typename V, typename Comp>
-void SkipList<K, V, Comp>::get_key_value_from_string(const std::string& str,
-                                                     std::string* key,
-                                                     std::string* value) {
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipList<K, V, Comp, Policy>::get_key_value_from_string(
+    const std::string& str, std::string* key, std::string* value) {
   if (str.empty() || str.find(':') == std::string::npos) return;
   *key = str.substr(0, str.find(':'));
   *value = str.substr(str.find(':') + 1);
 }
 
 // set the expire time of the key
-template <typename K, typename V, typename Comp>
-void SkipList<K, V, Comp>::element_expire_time(K k, int seconds) {
-  V v;
-  if (searchElement(k, v) == false) {
-    std::cout << "expire time set failed, "
-              << "key: " << k << " not found" << std::endl;
-    return;
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::element_expire_time(const K& k,
+                                                       int seconds) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  if (is_expire(k) == 1) {
+    removeElement(k);
+    _stats.RecordTick(EXPIRED_RECLAIMED);
+  }
+  if (_index->Lookup(k) == nullptr) {
+    // a key of the mapped snapshot moves to the index to carry the ttl
+    V v;
+    if (!baseGet(k, &v)) {
+      KV_LOG("expire time set failed, "
+             << "key: " << k << " not found");
+      return false;
+    }
+    hideBase(k);
+    BF._Set(k);
+    putIndex(k, std::move(v));
   }
 
   time_t tm;
   time(&tm);
   expire_key_mp[k] = std::make_pair(seconds, tm);
-  std::cout << "successfully set the expire time of key: " << k << " seconds "
-            << seconds << std::endl;
+  if (tracking()) _tracker.SetVolatile(k, true);
+  if (_listener) _listener->OnExpire(k, seconds);
+  KV_LOG("successfully set the expire time of key: "
+         << k << " seconds " << seconds);
+  return true;
 }
 
-template <typename K, typename V, typename Comp>
-int SkipList<K, V, Comp>::is_expire(K k) {
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipList<K, V, Comp, Policy>::applyTtl(const K& k, int ttl) {
+  if (ttl == kKeepTtl) return;
+  if (ttl == 0) {
+    expire_key_mp.erase(k);
+  } else {
+    expire_key_mp[k] = std::make_pair(ttl, time(nullptr));
+  }
+  if (tracking()) _tracker.SetVolatile(k, ttl != 0);
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::element_persist(const K& k) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  if (is_expire(k) == 1) {
+    removeElement(k);
+    _stats.RecordTick(EXPIRED_RECLAIMED);
+    return false;
+  }
+  if (tracking()) _tracker.SetVolatile(k, false);
+  if (expire_key_mp.erase(k) == 0) return false;
+  if (_listener) _listener->OnPersist(k);
+  return true;
+}
+
+template <typename K, typename V, typename Comp, typename Policy>
+int SkipList<K, V, Comp, Policy>::is_expire(const K& k) {
   // not found
-  // std::cout<<"try to find key: "<<k<<" in LRU"<<std::endl;
-  if (expire_key_mp.find(k) == expire_key_mp.end()) return -1;
+  auto it = expire_key_mp.find(k);
+  if (it == expire_key_mp.end()) return -1;
   time_t tm;
   time(&tm);
   // is expire or not
-  if (tm - expire_key_mp[k].second >= expire_key_mp[k].first)
+  if (tm - it->second.second >= it->second.first)
     return 1;
   else
     return 0;
 }
 
-// return the ttl of the given key
-template <typename K, typename V, typename Comp>
-int SkipList<K, V, Comp>::element_ttl(const K k) {
-  if (expire_key_mp.find(k) == expire_key_mp.end()) {
-    std::cout << "ask for the ttl for a permanent key: " << k << std::endl;
+// return the ttl of the given key, -1 for a permanent key and -2 for a
+// missing key, including one that has expired and been deleted
+template <typename K, typename V, typename Comp, typename Policy>
+int SkipList<K, V, Comp, Policy>::element_ttl(const K& k) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  auto it = expire_key_mp.find(k);
+  if (it == expire_key_mp.end()) {
+    if (_index->Lookup(k) == nullptr && !baseGet(k, nullptr)) return -2;
+    KV_LOG("ask for the ttl for a permanent key: " << k);
     return -1;
   }
 
-  if (is_expire(k)) {
-    deleteElement(k);
-    std::cout << "key: " << k << " is expired, delete it" << std::endl;
+  if (is_expire(k) == 1) {
+    removeElement(k);
+    _stats.RecordTick(EXPIRED_RECLAIMED);
+    KV_LOG("key: " << k << " is expired, delete it");
+    return -2;
   }
 
   time_t tm;
   time(&tm);
-  int sec = expire_key_mp[k].first - (tm - expire_key_mp[k].second);
-  std::cout << "key: " << k << " has " << sec << " seconds left" << std::endl;
+  int sec = it->second.first - (tm - it->second.second);
+  KV_LOG("key: " << k << " has " << sec << " seconds left");
   return sec;
 }
 
 // cycle delete
-template <typename K, typename V, typename Comp>
-void SkipList<K, V, Comp>::cycle_del() {
+template <typename K, typename V, typename Comp, typename Policy>
+void SkipList<K, V, Comp, Policy>::cycle_del() {
   int cnt, num;
+  std::lock_guard<std::mutex> lock(_mtx);
   do {
     cnt = 0;
     num = std::min(int(expire_key_mp.size()), CYCLE_DEL_NUM);
@@ -443,9 +1550,110 @@ void SkipList<K, V, Comp>::cycle_del() {
       if (++i >= num) break;
     }
     for (auto k : del_vec) {
-      std::cout << "Cycle delete, "
-                << "key: " << k << std::endl;
-      deleteElement(k);
+      KV_LOG("Cycle delete, "
+             << "key: " << k);
+      removeElement(k);
+      _stats.RecordTick(EXPIRED_RECLAIMED);
     }
   } while (num * 0.5 < cnt);
 }
+
+// answer a named property of the store
+template <typename K, typename V, typename Comp, typename Policy>
+bool SkipList<K, V, Comp, Policy>::getProperty(const std::string& property,
+                                               std::string* value) {
+  if (property == "minikv.num-entries") {
+    std::lock_guard<std::mutex> lock(_mtx);
+    *value = std::to_string(entries());
+    return true;
+  }
+  if (property == "minikv.used-memory") {
+    std::lock_guard<std::mutex> lock(_mtx);
+    *value = std::to_string(_usedMemory);
+    return true;
+  }
+  if (property == "minikv.maxmemory") {
+    std::lock_guard<std::mutex> lock(_mtx);
+    *value = std::to_string(_maxMemory);
+    return true;
+  }
+  if (property == "minikv.maxmemory-policy") {
+    std::lock_guard<std::mutex> lock(_mtx);
+    *value = EvictionPolicyName(_evictionPolicy);
+    return true;
+  }
+  if (property == "minikv.value-log-files") {
+    std::lock_guard<std::mutex> lock(_mtx);
+    *value = std::to_string(_valueLog ? _valueLog->num_files() : 0);
+    return true;
+  }
+  if (property == "minikv.value-log-bytes") {
+    std::lock_guard<std::mutex> lock(_mtx);
+    *value = std::to_string(_valueLog ? _valueLog->total_bytes() : 0);
+    return true;
+  }
+  if (property == "minikv.value-log-live-bytes") {
+    std::lock_guard<std::mutex> lock(_mtx);
+    *value = std::to_string(_valueLog ? _valueLog->live_bytes() : 0);
+    return true;
+  }
+  if (property == "minikv.hot-reads" || property == "minikv.hot-writes") {
+    std::ostringstream os;
+    for (auto& e : hotKeys(property == "minikv.hot-writes")) {
+      os << e.first << " " << e.second << "\n";
+    }
+    *value = os.str();
+    return true;
+  }
+  if (property == "minikv.mapped-snapshot") {
+    std::lock_guard<std::mutex> lock(_mtx);
+    *value = _base ? _base->fname() : "";
+    return true;
+  }
+  if (property == "minikv.memory-usage") {
+    std::lock_guard<std::mutex> lock(_mtx);
+    *value = std::to_string(_index->MemoryUsage());
+    return true;
+  }
+  if (property == "minikv.index-engine") {
+    *value = _index->Name();
+    return true;
+  }
+  if (property == "minikv.dump-in-progress") {
+    *value = _dumping ? "1" : "0";
+    return true;
+  }
+  if (property == "minikv.last-dump-status") {
+    *value = _lastDumpOk ? "ok" : "err";
+    return true;
+  }
+  if (property == "minikv.dump-io-backend") {
+    std::lock_guard<std::mutex> lock(_mtx);
+    *value = _dumpWriter ? _dumpWriter->backend() : "";
+    return true;
+  }
+  if (property != "minikv.stats") {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _index->GetProperty(property, value);
+  }
+
+  std::ostringstream os;
+  os << _stats.ToPrometheus();
+  _mtx.lock();
+  os << "# TYPE minikv_keys gauge\n";
+  os << "minikv_keys " << entries() << "\n";
+  os << "# TYPE minikv_memory_usage_bytes gauge\n";
+  os << "minikv_memory_usage_bytes " << _index->MemoryUsage() << "\n";
+  os << "# TYPE minikv_used_memory_bytes gauge\n";
+  os << "minikv_used_memory_bytes " << _usedMemory << "\n";
+  if (_valueLog) {
+    os << "# TYPE minikv_value_log_bytes gauge\n";
+    os << "minikv_value_log_bytes " << _valueLog->total_bytes() << "\n";
+    os << "# TYPE minikv_value_log_live_bytes gauge\n";
+    os << "minikv_value_log_live_bytes " << _valueLog->live_bytes() << "\n";
+  }
+  _index->AppendMetrics(os);
+  _mtx.unlock();
+  *value = os.str();
+  return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+#include "random.h"
+
+// Compile time shape of a skiplist: the tallest tower, the probability
+// PromoteNum / PromoteDen that a tower of height h also reaches h + 1, and
+// the generator drawing the heights. Each list owns its generator.
+//
+// A node carries 1 / (1 - p) pointers on average and a search does about
+// log(n) / (p * log(1 / p)) comparisons, so a smaller p trades comparisons
+// for memory. 1/e minimizes the comparisons, 1/2 is close to it with
+// faster descents, 1/4 needs 1/3 fewer pointers than 1/2. kMaxHeight
+// should be about log(n) / log(1 / p) for the largest expected n.
+template <int MaxHeight, uint32_t PromoteNum, uint32_t PromoteDen,
+          typename Rng = XorShift64>
+struct SkipListPolicy {
+  static_assert(MaxHeight > 0, "need at least one level");
+  static_assert(PromoteNum < PromoteDen, "p must be below 1");
+
+  enum { kMaxHeight = MaxHeight };
+  typedef Rng RandomGenerator;
+
+  // a height in [1, max_height], max_height <= kMaxHeight
+  static int RandomHeight(Rng* rnd, int max_height = kMaxHeight) {
+    int height = 1;
+    while (height < max_height && rnd->Next() % PromoteDen < PromoteNum) {
+      height++;
+    }
+    assert(height <= kMaxHeight);
+    return height;
+  }
+};
+
+// p = 1/2, 2 pointers per node, good up to 2^32 keys
+typedef SkipListPolicy<32, 1, 2> FastSearchPolicy;
+// p = 1/e, 1.58 pointers per node, fewest comparisons
+typedef SkipListPolicy<24, 367879, 1000000> EulerPolicy;
+// p = 1/4, 1.33 pointers per node, good up to 4^20 keys
+typedef SkipListPolicy<20, 1, 4> CompactPolicy;
@@ -0,0 +1,451 @@
+#include "snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "coding.h"
+
+namespace {
+const uint64_t kSnapshotMagic = 0x31307670616e736bull;  // "ksnapv01"
+const size_t kFooterSize = 40;
+// 压缩算法编号和crc32c
+const size_t kTrailerSize = 5;
+const uint32_t kSortedFlag = 1;
+
+// 读满n个字节, 文件过短时返回false
+bool ReadFully(int fd, uint64_t offset, size_t n, char* buf,
+               std::string* error) {
+  while (n > 0) {
+    ssize_t r = pread(fd, buf, n, offset);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) {
+      *error = r < 0 ? strerror(errno) : "unexpected end of file";
+      return false;
+    }
+    buf += r;
+    offset += r;
+    n -= r;
+  }
+  return true;
+}
+}  // namespace
+
+SnapshotWriter::SnapshotWriter(AsyncFile* file, const SnapshotOptions& options)
+    : file_(file),
+      options_(options),
+      codec_(GetCodec(options.compression)),
+      num_entries_(0),
+      raw_bytes_(0),
+      offset_(0),
+      sorted_(true) {
+  assert(file_->size() == 0);
+}
+
+void SnapshotWriter::Add(const char* key, size_t klen, const char* value,
+                         size_t vlen) {
+  if (sorted_ && num_entries_ > 0 &&
+      last_key_.compare(0, last_key_.size(), key, klen) >= 0) {
+    sorted_ = false;
+  }
+  const size_t before = cur_.contents.size();
+  PutLengthPrefixed(&cur_.contents, key, klen);
+  PutLengthPrefixed(&cur_.contents, value, vlen);
+  raw_bytes_ += cur_.contents.size() - before;
+  cur_.count++;
+  num_entries_++;
+  last_key_.assign(key, klen);
+  if (cur_.contents.size() >= options_.block_size) {
+    cur_.last_key = last_key_;
+    full_.push_back(std::move(cur_));
+    cur_ = Block();
+  }
+}
+
+void SnapshotWriter::Flush() {
+  for (const Block& b : full_) {
+    const char* data = b.contents.data();
+    size_t n = b.contents.size();
+    CompressionType type = kNoCompression;
+    if (codec_ != nullptr) {
+      scratch_.clear();
+      codec_->Compress(data, n, &scratch_);
+      // 压缩率太低时存原始数据, 读取时省去解压
+      if (scratch_.size() < n - n / 8) {
+        data = scratch_.data();
+        n = scratch_.size();
+        type = codec_->type();
+      }
+    }
+    PutVarint64(&index_, offset_);
+    PutVarint64(&index_, n);
+    PutVarint32(&index_, b.count);
+    PutLengthPrefixed(&index_, b.last_key.data(), b.last_key.size());
+    WriteBlock(data, n, type);
+  }
+  full_.clear();
+}
+
+void SnapshotWriter::WriteBlock(const char* data, size_t n,
+                                CompressionType type) {
+  char trailer[kTrailerSize];
+  trailer[0] = static_cast<char>(type);
+  EncodeFixed32(trailer + 1, Crc32c(trailer, 1, Crc32c(data, n)));
+  file_->Append(data, n);
+  file_->Append(trailer, kTrailerSize);
+  offset_ += n + kTrailerSize;
+}
+
+void SnapshotWriter::Finish() {
+  if (cur_.count > 0) {
+    cur_.last_key = last_key_;
+    full_.push_back(std::move(cur_));
+    cur_ = Block();
+  }
+  Flush();
+  const uint64_t index_offset = offset_;
+  WriteBlock(index_.data(), index_.size(), kNoCompression);
+  std::string footer;
+  PutFixed64(&footer, index_offset);
+  PutFixed64(&footer, index_.size());
+  PutFixed64(&footer, num_entries_);
+  PutFixed32(&footer, sorted_ ? kSortedFlag : 0);
+  PutFixed32(&footer, 0);
+  PutFixed64(&footer, kSnapshotMagic);
+  file_->Append(footer);
+  offset_ += footer.size();
+}
+
+SnapshotReader::~SnapshotReader() {
+  if (map_ != nullptr) munmap(const_cast<char*>(map_), map_size_);
+  close(fd_);
+}
+
+bool SnapshotReader::IsSnapshotFile(const std::string& fname) {
+  int fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st;
+  char buf[8];
+  std::string error;
+  bool is = fstat(fd, &st) == 0 && uint64_t(st.st_size) >= kFooterSize &&
+            ReadFully(fd, st.st_size - 8, 8, buf, &error) &&
+            DecodeFixed64(buf) == kSnapshotMagic;
+  close(fd);
+  return is;
+}
+
+bool SnapshotReader::Open(const std::string& fname,
+                          std::unique_ptr<SnapshotReader>* reader,
+                          std::string* error, bool use_mmap) {
+  int fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    *error = fname + ": " + strerror(errno);
+    return false;
+  }
+  std::unique_ptr<SnapshotReader> r(new SnapshotReader(fd, fname));
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    *error = fname + ": " + strerror(errno);
+    return false;
+  }
+  const uint64_t size = st.st_size;
+  char footer[kFooterSize];
+  if (size < kFooterSize ||
+      !ReadFully(fd, size - kFooterSize, kFooterSize, footer, error) ||
+      DecodeFixed64(footer + 32) != kSnapshotMagic) {
+    *error = fname + ": not a snapshot";
+    return false;
+  }
+  const uint64_t index_offset = DecodeFixed64(footer);
+  const uint64_t index_size = DecodeFixed64(footer + 8);
+  r->num_entries_ = DecodeFixed64(footer + 16);
+  r->sorted_ = DecodeFixed32(footer + 24) & kSortedFlag;
+  if (index_offset + index_size + kTrailerSize + kFooterSize != size) {
+    *error = fname + ": bad footer";
+    return false;
+  }
+  if (use_mmap) {
+    void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+      *error = fname + ": mmap: " + strerror(errno);
+      return false;
+    }
+    r->map_ = static_cast<const char*>(base);
+    r->map_size_ = size;
+  }
+  std::string scratch;
+  const char* index;
+  size_t n;
+  if (!r->ReadPayload(index_offset, index_size, nullptr, &scratch, &index, &n,
+                      error)) {
+    return false;
+  }
+
+  const char* p = index;
+  const char* limit = p + n;
+  uint64_t entries = 0;
+  while (p < limit) {
+    BlockHandle h;
+    const char* key;
+    size_t klen;
+    if (!GetVarint64(&p, limit, &h.offset) ||
+        !GetVarint64(&p, limit, &h.size) ||
+        !GetVarint32(&p, limit, &h.count) ||
+        !GetLengthPrefixed(&p, limit, &key, &klen) ||
+        h.offset + h.size + kTrailerSize > index_offset) {
+      *error = fname + ": bad index block";
+      return false;
+    }
+    h.last_key.assign(key, klen);
+    entries += h.count;
+    r->blocks_.push_back(std::move(h));
+  }
+  if (entries != r->num_entries_) {
+    *error = fname + ": index does not match the footer";
+    return false;
+  }
+  if (use_mmap) {
+    r->verified_.reset(new std::atomic<bool>[r->blocks_.size()]);
+    for (size_t i = 0; i < r->blocks_.size(); i++) r->verified_[i] = false;
+  }
+  *reader = std::move(r);
+  return true;
+}
+
+bool SnapshotReader::ReadPayload(uint64_t offset, uint64_t size,
+                                 std::atomic<bool>* verified,
+                                 std::string* scratch, const char** data,
+                                 size_t* n, std::string* error) const {
+  const char* buf;
+  std::string copy;
+  if (map_ != nullptr) {
+    buf = map_ + offset;
+  } else {
+    copy.resize(size + kTrailerSize);
+    if (!ReadFully(fd_, offset, copy.size(), &copy[0], error)) {
+      *error = fname_ + ": " + *error;
+      return false;
+    }
+    buf = copy.data();
+  }
+  if (verified == nullptr || !verified->load(std::memory_order_relaxed)) {
+    const uint32_t crc = Crc32c(buf + size, 1, Crc32c(buf, size));
+    if (crc != DecodeFixed32(buf + size + 1)) {
+      *error =
+          fname_ + ": block checksum mismatch at " + std::to_string(offset);
+      return false;
+    }
+    if (verified != nullptr) verified->store(true, std::memory_order_relaxed);
+  }
+  const CompressionType type = static_cast<CompressionType>(buf[size]);
+  scratch->clear();
+  if (type == kNoCompression) {
+    if (map_ != nullptr) {
+      *data = buf;
+      *n = size;
+      return true;
+    }
+    copy.resize(size);
+    scratch->swap(copy);
+  } else {
+    const Codec* codec = GetCodec(type);
+    if (codec == nullptr) {
+      *error = fname_ + ": unsupported compression " + std::to_string(type);
+      return false;
+    }
+    if (!codec->Uncompress(buf, size, scratch)) {
+      *error = fname_ + ": corrupted block at " + std::to_string(offset);
+      return false;
+    }
+  }
+  *data = scratch->data();
+  *n = scratch->size();
+  return true;
+}
+
+bool SnapshotReader::BlockContents(size_t i, std::string* scratch,
+                                   const char** data, size_t* n,
+                                   std::string* error) const {
+  return ReadPayload(blocks_[i].offset, blocks_[i].size,
+                     verified_ ? &verified_[i] : nullptr, scratch, data, n,
+                     error);
+}
+
+bool SnapshotReader::ReadBlock(size_t i, std::string* contents,
+                               std::string* error) const {
+  const char* data;
+  size_t n;
+  if (!BlockContents(i, contents, &data, &n, error)) return false;
+  if (data != contents->data()) contents->assign(data, n);
+  return true;
+}
+
+bool SnapshotReader::ParseRecord(const char** p, const char* limit,
+                                 const char** key, size_t* klen,
+                                 const char** value, size_t* vlen) {
+  return GetLengthPrefixed(p, limit, key, klen) &&
+         GetLengthPrefixed(p, limit, value, vlen);
+}
+
+bool SnapshotReader::SearchBlock(size_t i, const std::string& key,
+                                 std::string* value,
+                                 std::string* error) const {
+  std::string scratch;
+  const char* p;
+  size_t n;
+  if (!BlockContents(i, &scratch, &p, &n, error)) return false;
+  const char* limit = p + n;
+  while (p < limit) {
+    const char *k, *v;
+    size_t klen, vlen;
+    if (!ParseRecord(&p, limit, &k, &klen, &v, &vlen)) {
+      *error = fname_ + ": corrupted record in block " + std::to_string(i);
+      return false;
+    }
+    int c = key.compare(0, key.size(), k, klen);
+    if (c == 0) {
+      if (value != nullptr) value->assign(v, vlen);
+      return true;
+    }
+    // 有序时块内后面的key都更大
+    if (sorted_ && c < 0) return false;
+  }
+  return false;
+}
+
+size_t SnapshotReader::FindBlock(const std::string& key) const {
+  auto it = std::lower_bound(
+      blocks_.begin(), blocks_.end(), key,
+      [](const BlockHandle& b, const std::string& k) {
+        return b.last_key < k;
+      });
+  return it - blocks_.begin();
+}
+
+bool SnapshotReader::Get(const std::string& key, std::string* value,
+                         std::string* error) const {
+  error->clear();
+  if (sorted_) {
+    size_t i = FindBlock(key);
+    return i < blocks_.size() && SearchBlock(i, key, value, error);
+  }
+  for (size_t i = 0; i < blocks_.size(); i++) {
+    if (SearchBlock(i, key, value, error)) return true;
+    if (!error->empty()) return false;
+  }
+  return false;
+}
+
+void SnapshotReader::Iterator::SeekToFirst() {
+  block_ = 0;
+  error_.clear();
+  LoadBlock();
+}
+
+void SnapshotReader::Iterator::Seek(const std::string& target) {
+  error_.clear();
+  block_ = reader_->FindBlock(target);
+  LoadBlock();
+  while (Valid() && target.compare(0, target.size(), key_, klen_) > 0) {
+    Next();
+  }
+}
+
+void SnapshotReader::Iterator::LoadBlock() {
+  key_ = nullptr;
+  while (block_ < reader_->num_blocks()) {
+    size_t n;
+    if (!reader_->BlockContents(block_++, &contents_, &p_, &n, &error_)) {
+      return;
+    }
+    limit_ = p_ + n;
+    if (p_ < limit_) {
+      Next();
+      return;
+    }
+  }
+}
+
+void SnapshotReader::Iterator::Next() {
+  if (p_ == limit_) {
+    LoadBlock();
+    return;
+  }
+  if (!ParseRecord(&p_, limit_, &key_, &klen_, &value_, &vlen_)) {
+    error_ = "corrupted record in block " + std::to_string(block_ - 1);
+    key_ = nullptr;
+  }
+}
+
+bool ReadBlocksParallel(
+    const SnapshotReader* reader, int threads,
+    const std::function<bool(size_t, const char*, size_t)>& decode,
+    const std::function<void(size_t)>& consume, std::string* error) {
+  const size_t n = reader->num_blocks();
+  if (threads < 1) threads = 1;
+  const size_t window = 4 * size_t(threads);
+  std::mutex mu;
+  std::condition_variable cv;
+  std::vector<bool> decoded(n, false);
+  size_t next = 0;
+  size_t consumed = 0;
+  bool failed = false;
+
+  auto work = [&] {
+    std::string contents, e;
+    while (true) {
+      size_t i;
+      {
+        std::unique_lock<std::mutex> lock(mu);
+        // 不超前consume太多, 限制解码结果占用的内存
+        cv.wait(lock, [&] {
+          return failed || next >= n || next < consumed + window;
+        });
+        if (failed || next >= n) return;
+        i = next++;
+      }
+      bool ok = reader->ReadBlock(i, &contents, &e);
+      if (ok && !decode(i, contents.data(), contents.size())) {
+        e = reader->fname() + ": corrupted record in block " +
+            std::to_string(i);
+        ok = false;
+      }
+      {
+        std::lock_guard<std::mutex> lock(mu);
+        if (!ok && !failed) {
+          failed = true;
+          *error = e;
+        }
+        decoded[i] = true;
+      }
+      cv.notify_all();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) workers.emplace_back(work);
+
+  while (consumed < n) {
+    {
+      std::unique_lock<std::mutex> lock(mu);
+      cv.wait(lock, [&] { return failed || decoded[consumed]; });
+      if (failed) break;
+    }
+    consume(consumed);
+    {
+      std::lock_guard<std::mutex> lock(mu);
+      consumed++;
+    }
+    cv.notify_all();
+  }
+  for (std::thread& t : workers) t.join();
+  return !failed;
+}
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "async_file.h"
+#include "compression.h"
+
+struct SnapshotOptions {
+  // 数据块压缩前的目标大小
+  size_t block_size = 32 << 10;
+  CompressionType compression = kLZCompression;
+};
+
+/*
+  块压缩的二进制快照
+  文件: [数据块]...[数据块][索引块][footer]
+  1.数据块: 若干条记录, 每条为长度前缀的key和长度前缀的value; 按
+    options.compression整块压缩, 压缩后没有小于原来的7/8时存原始数据.
+    每个块后面跟1字节的压缩算法编号和4字节的crc32c(覆盖数据和编号)
+  2.索引块: 每个数据块一项, varint64偏移, varint64大小(不含尾部),
+    varint32记录数, 长度前缀的块内最后一个key; 不压缩, 带同样的尾部
+  3.footer(40字节): fixed64索引偏移, fixed64索引大小, fixed64记录数,
+    fixed32 flags, fixed32保留, fixed64魔数
+  key按字节序严格递增时flags带kSortedFlag, 点查二分索引后只解压一个块
+*/
+class SnapshotWriter {
+ public:
+  // file由调用者打开和Sync, 快照从文件开头写起
+  SnapshotWriter(AsyncFile* file, const SnapshotOptions& options);
+
+  SnapshotWriter(const SnapshotWriter&) = delete;
+  SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+  // 只把记录拷贝进当前块, 写满的块排队等待Flush
+  void Add(const char* key, size_t klen, const char* value, size_t vlen);
+  void Add(const std::string& key, const std::string& value) {
+    Add(key.data(), key.size(), value.data(), value.size());
+  }
+  // 压缩排队的块并写入file, 可以在锁外调用
+  void Flush();
+  // 写出剩余的块, 索引块和footer
+  void Finish();
+
+  uint64_t num_entries() const { return num_entries_; }
+  // 记录编码后压缩前的字节数
+  uint64_t raw_bytes() const { return raw_bytes_; }
+  // 已写入file的字节数, Finish之后为文件大小
+  uint64_t file_bytes() const { return offset_; }
+
+ private:
+  struct Block {
+    std::string contents;
+    std::string last_key;
+    uint32_t count = 0;
+  };
+
+  void WriteBlock(const char* data, size_t n, CompressionType type);
+
+  AsyncFile* file_;
+  const SnapshotOptions options_;
+  const Codec* codec_;
+  // 正在填充的块
+  Block cur_;
+  // 写满等待Flush的块
+  std::vector<Block> full_;
+  std::string index_;
+  std::string last_key_;
+  std::string scratch_;
+  uint64_t num_entries_;
+  uint64_t raw_bytes_;
+  uint64_t offset_;
+  bool sorted_;
+};
+
+// 打开快照文件, 按块读取和解压; 所有方法都是线程安全的
+// use_mmap时把整个文件映射进来, 不压缩的块直接指向映射的内存, 每个块只在
+// 第一次读取时校验crc; 多个进程打开同一个快照时共享page cache
+class SnapshotReader {
+ public:
+  ~SnapshotReader();
+
+  SnapshotReader(const SnapshotReader&) = delete;
+  SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+  // 读取footer和索引块, 失败时返回false并设置*error
+  static bool Open(const std::string& fname,
+                   std::unique_ptr<SnapshotReader>* reader,
+                   std::string* error, bool use_mmap = false);
+  // 文件末尾是否有快照的魔数, 用于区分旧的文本格式
+  static bool IsSnapshotFile(const std::string& fname);
+
+  uint64_t num_entries() const { return num_entries_; }
+  size_t num_blocks() const { return blocks_.size(); }
+  bool sorted() const { return sorted_; }
+  bool mapped() const { return map_ != nullptr; }
+  const std::string& fname() const { return fname_; }
+  // 第i个块的记录数
+  uint32_t block_entries(size_t i) const { return blocks_[i].count; }
+
+  // 读取并解压第i个块, 校验crc
+  bool ReadBlock(size_t i, std::string* contents, std::string* error) const;
+  // 找到时返回true; 文件损坏时也返回false, 并设置*error. value为nullptr
+  // 时只判断是否存在
+  bool Get(const std::string& key, std::string* value,
+           std::string* error) const;
+
+  // 解析块中的下一条记录, 成功时*p移到它后面
+  static bool ParseRecord(const char** p, const char* limit, const char** key,
+                          size_t* klen, const char** value, size_t* vlen);
+
+  // 按文件中的顺序遍历所有记录, 同一时间只解压一个块
+  class Iterator {
+   public:
+    explicit Iterator(const SnapshotReader* reader)
+        : reader_(reader), block_(0), p_(nullptr), limit_(nullptr) {}
+
+    bool Valid() const { return key_ != nullptr; }
+    void SeekToFirst();
+    // 第一个不小于target的记录, 只用于有序的快照
+    void Seek(const std::string& target);
+    void Next();
+    // 在Next之前有效
+    const char* key() const { return key_; }
+    size_t key_size() const { return klen_; }
+    const char* value() const { return value_; }
+    size_t value_size() const { return vlen_; }
+    // 遇到损坏的块时停止遍历, error()非空
+    const std::string& error() const { return error_; }
+
+   private:
+    // 从block_开始读取下一个非空的块
+    void LoadBlock();
+
+    const SnapshotReader* reader_;
+    size_t block_;
+    // 解压后的块, 映射的不压缩的块不经过这里
+    std::string contents_;
+    const char* p_;
+    const char* limit_;
+    const char* key_ = nullptr;
+    size_t klen_ = 0;
+    const char* value_ = nullptr;
+    size_t vlen_ = 0;
+    std::string error_;
+  };
+
+ private:
+  struct BlockHandle {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t count;
+    std::string last_key;
+  };
+
+  SnapshotReader(int fd, const std::string& fname)
+      : fd_(fd),
+        fname_(fname),
+        map_(nullptr),
+        map_size_(0),
+        num_entries_(0),
+        sorted_(false) {}
+
+  // 读取[offset, offset + size)和尾部并校验, 内容为[*data, *data + *n):
+  // 映射的不压缩的块指向映射的内存, 否则在*scratch中. *verified为true时
+  // 跳过crc, 校验通过后置为true
+  bool ReadPayload(uint64_t offset, uint64_t size, std::atomic<bool>* verified,
+                   std::string* scratch, const char** data, size_t* n,
+                   std::string* error) const;
+  bool BlockContents(size_t i, std::string* scratch, const char** data,
+                     size_t* n, std::string* error) const;
+  // 第一个最后一个key不小于key的块, 没有时返回num_blocks()
+  size_t FindBlock(const std::string& key) const;
+  bool SearchBlock(size_t i, const std::string& key, std::string* value,
+                   std::string* error) const;
+
+  int fd_;
+  const std::string fname_;
+  const char* map_;
+  size_t map_size_;
+  // 映射时每个块是否已经校验过crc
+  std::unique_ptr<std::atomic<bool>[]> verified_;
+  std::vector<BlockHandle> blocks_;
+  uint64_t num_entries_;
+  bool sorted_;
+};
+
+// 用threads个线程并行读取和解压reader的所有块, 在这些线程上调用
+// decode(i, data, n), 块内有损坏的记录时decode返回false; 同时在调用者的
+// 线程上按块的顺序调用consume(i). 已解码未consume的块不超过4 * threads
+// 个. 失败时停止并设置*error, 已经consume的块不会撤销
+bool ReadBlocksParallel(
+    const SnapshotReader* reader, int threads,
+    const std::function<bool(size_t, const char*, size_t)>& decode,
+    const std::function<void(size_t)>& consume, std::string* error);
+
+// 快照中key和value的字节串编码. std::string原样保存; 整数按大端保存,
+// 有符号数翻转符号位, 使字节序与数值顺序一致; 其他类型用operator<<和>>
+template <typename T, typename Enable = void>
+struct SnapshotCoder {
+  static void Encode(const T& v, std::string* out) {
+    std::ostringstream os;
+    os << v;
+    out->append(os.str());
+  }
+  static bool Decode(const char* p, size_t n, T* v) {
+    std::istringstream is(std::string(p, n));
+    return static_cast<bool>(is >> *v);
+  }
+};
+
+template <>
+struct SnapshotCoder<std::string> {
+  static void Encode(const std::string& v, std::string* out) {
+    out->append(v);
+  }
+  static bool Decode(const char* p, size_t n, std::string* v) {
+    v->assign(p, n);
+    return true;
+  }
+};
+
+template <typename T>
+struct SnapshotCoder<
+    T, typename std::enable_if<std::is_integral<T>::value &&
+                               !std::is_same<T, bool>::value>::type> {
+  typedef typename std::make_unsigned<T>::type U;
+  static const U kSignBit = std::is_signed<T>::value
+                                ? U(U(1) << (sizeof(T) * 8 - 1))
+                                : U(0);
+
+  static void Encode(const T& v, std::string* out) {
+    U u = static_cast<U>(v) ^ kSignBit;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      out->push_back(static_cast<char>(u >> (8 * (sizeof(T) - 1 - i))));
+    }
+  }
+  static bool Decode(const char* p, size_t n, T* v) {
+    if (n != sizeof(T)) return false;
+    U u = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      u = static_cast<U>((u << 8) | uint8_t(p[i]));
+    }
+    *v = static_cast<T>(u ^ kSignBit);
+    return true;
+  }
+};
@@ -0,0 +1,203 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include "histogram.hpp"
+
+// counters maintained by the store
+enum Ticker : uint32_t {
+  // lookups that consulted the bloom filter
+  BLOOM_CHECKED = 0,
+  // lookups the bloom filter rejected
+  BLOOM_NEGATIVE,
+  // lookups the bloom filter let through but the key did not exist
+  BLOOM_FALSE_POSITIVE,
+  LRU_HIT,
+  LRU_MISS,
+  // keys removed because their ttl ran out (lazy or cycle delete)
+  EXPIRED_RECLAIMED,
+  // keys dropped to stay under maxmemory
+  EVICTED_KEYS,
+  // record bytes handed to snapshots before and after block compression
+  SNAPSHOT_RAW_BYTES,
+  SNAPSHOT_FILE_BYTES,
+  // value bytes appended to the value log, by writes and by its gc
+  VLOG_BYTES_WRITTEN,
+  // value log files collected and the live value bytes they moved
+  VLOG_GC_FILES,
+  VLOG_GC_RELOCATED_BYTES,
+  TICKER_ENUM_MAX
+};
+
+// latency / duration distributions, all in nanoseconds
+enum HistogramType : uint32_t {
+  INSERT_LATENCY = 0,
+  SEARCH_LATENCY,
+  DELETE_LATENCY,
+  SNAPSHOT_DUMP_TIME,
+  SNAPSHOT_LOAD_TIME,
+  HISTOGRAM_ENUM_MAX
+};
+
+// Statistics keeps every ticker and histogram in kNumShards copies. A thread
+// always updates the copy picked by its thread index, so concurrent writers
+// touch different cache lines; readers merge all shards.
+class Statistics {
+ public:
+  enum { kNumShards = 16 };
+
+  // the shards are allocated apart: C++14 new ignores their alignment,
+  // and an over-aligned member would make the store over-aligned too
+  Statistics() {
+    void* mem = nullptr;
+    if (posix_memalign(&mem, 64, sizeof(Shard) * kNumShards) != 0) {
+      throw std::bad_alloc();
+    }
+    shards_ = static_cast<Shard*>(mem);
+    for (int i = 0; i < kNumShards; i++) new (&shards_[i]) Shard();
+  }
+  ~Statistics() {
+    for (int i = 0; i < kNumShards; i++) shards_[i].~Shard();
+    free(shards_);
+  }
+  Statistics(const Statistics&) = delete;
+  Statistics& operator=(const Statistics&) = delete;
+
+  void RecordTick(Ticker t, uint64_t n = 1) {
+    shards_[ThreadShard()].tickers[t].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  void MeasureTime(HistogramType h, uint64_t nanos) {
+    shards_[ThreadShard()].histograms[h].Add(nanos);
+  }
+
+  uint64_t GetTickerCount(Ticker t) const {
+    uint64_t sum = 0;
+    for (int i = 0; i < kNumShards; i++) {
+      sum += shards_[i].tickers[t].load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+  void GetHistogram(HistogramType h, HistogramData* data) const {
+    for (int i = 0; i < kNumShards; i++) {
+      shards_[i].histograms[h].MergeInto(data);
+    }
+  }
+
+  void Reset() {
+    for (int i = 0; i < kNumShards; i++) {
+      for (uint32_t t = 0; t < TICKER_ENUM_MAX; t++) {
+        shards_[i].tickers[t].store(0, std::memory_order_relaxed);
+      }
+      for (uint32_t h = 0; h < HISTOGRAM_ENUM_MAX; h++) {
+        shards_[i].histograms[h].Clear();
+      }
+    }
+  }
+
+  static const char* TickerName(Ticker t) {
+    static const char* const kNames[TICKER_ENUM_MAX] = {
+        "bloom_checked",      "bloom_negative",
+        "bloom_false_positive", "lru_hit",
+        "lru_miss",           "expired_reclaimed",
+        "evicted_keys",       "snapshot_raw_bytes",
+        "snapshot_file_bytes", "vlog_bytes_written",
+        "vlog_gc_files",      "vlog_gc_relocated_bytes"};
+    return kNames[t];
+  }
+
+  static const char* HistogramName(HistogramType h) {
+    static const char* const kNames[HISTOGRAM_ENUM_MAX] = {
+        "insert", "search", "delete", "snapshot_dump", "snapshot_load"};
+    return kNames[h];
+  }
+
+  // Prometheus text exposition of every ticker and histogram. Store level
+  // gauges are appended by the caller.
+  std::string ToPrometheus() const {
+    std::ostringstream os;
+    for (uint32_t t = 0; t < TICKER_ENUM_MAX; t++) {
+      const char* name = TickerName(Ticker(t));
+      os << "# TYPE minikv_" << name << "_total counter\n";
+      os << "minikv_" << name << "_total " << GetTickerCount(Ticker(t))
+         << "\n";
+    }
+
+    uint64_t checked = GetTickerCount(BLOOM_CHECKED);
+    uint64_t negative = GetTickerCount(BLOOM_NEGATIVE);
+    uint64_t fp = GetTickerCount(BLOOM_FALSE_POSITIVE);
+    uint64_t hit = GetTickerCount(LRU_HIT);
+    uint64_t miss = GetTickerCount(LRU_MISS);
+    os << "# TYPE minikv_bloom_negative_ratio gauge\n";
+    os << "minikv_bloom_negative_ratio " << Ratio(negative, checked) << "\n";
+    // observed false positive rate: passed the filter but were absent
+    os << "# TYPE minikv_bloom_false_positive_ratio gauge\n";
+    os << "minikv_bloom_false_positive_ratio "
+       << Ratio(fp, checked - negative) << "\n";
+    os << "# TYPE minikv_lru_hit_ratio gauge\n";
+    os << "minikv_lru_hit_ratio " << Ratio(hit, hit + miss) << "\n";
+
+    static const double kQuantiles[] = {50, 90, 99, 99.9};
+    for (uint32_t h = 0; h < HISTOGRAM_ENUM_MAX; h++) {
+      const char* name = HistogramName(HistogramType(h));
+      HistogramData data;
+      GetHistogram(HistogramType(h), &data);
+      os << "# TYPE minikv_" << name << "_seconds summary\n";
+      for (double q : kQuantiles) {
+        os << "minikv_" << name << "_seconds{quantile=\"" << q / 100 << "\"} "
+           << data.Percentile(q) / 1e9 << "\n";
+      }
+      os << "minikv_" << name << "_seconds_sum " << data.sum / 1e9 << "\n";
+      os << "minikv_" << name << "_seconds_count " << data.count << "\n";
+    }
+    return os.str();
+  }
+
+ private:
+  // padded to whole cache lines, so shards in the array share none
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> tickers[TICKER_ENUM_MAX] = {};
+    Histogram histograms[HISTOGRAM_ENUM_MAX];
+  };
+
+  static double Ratio(uint64_t a, uint64_t b) {
+    return b == 0 ? 0 : double(a) / b;
+  }
+
+  static int ThreadShard() {
+    static std::atomic<int> next_id(0);
+    static thread_local int shard =
+        next_id.fetch_add(1, std::memory_order_relaxed) % kNumShards;
+    return shard;
+  }
+
+  // kNumShards of them, 64 byte aligned
+  Shard* shards_;
+};
+
+// records the lifetime of the scope into one histogram
+class StopWatch {
+ public:
+  StopWatch(Statistics* stats, HistogramType h)
+      : stats_(stats), type_(h), start_(std::chrono::steady_clock::now()) {}
+  ~StopWatch() {
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    stats_->MeasureTime(
+        type_,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  }
+
+  StopWatch(const StopWatch&) = delete;
+  StopWatch& operator=(const StopWatch&) = delete;
+
+ private:
+  Statistics* stats_;
+  HistogramType type_;
+  std::chrono::steady_clock::time_point start_;
+};
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <stdlib.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "skiplist_policy.hpp"
+
+/*
+  展开跳表: 每个块保存最多kBlockKeys(16)个有序的int key, 正好占满一个
+  64字节的cache line, 跳表的索引层连接的是块而不是单个key
+  1.查找时按块的最小key(keys[0])逐层下降, 找到最后一个最小key不大于目标的块,
+    再在块内用SIMD一次比较全部16个key, 每一跳只访问一个块
+  2.块满时分裂为两个各有一半key的块, 新块以随机高度插入索引层
+  3.块变空时从索引层中摘除, 不做相邻块的合并
+  4.块内key之外的部分: count, height, 索引指针, 然后是16个值
+  写操作需要外部同步
+  使用-mavx2或-march=native编译时走AVX2, 否则走SSE2, 其他平台走标量循环
+*/
+template <typename Value, class Policy = CompactPolicy>
+class UnrolledSkipList {
+ private:
+  struct Block;
+
+ public:
+  enum { kBlockKeys = 16 };
+
+  UnrolledSkipList();
+  ~UnrolledSkipList();
+
+  UnrolledSkipList(const UnrolledSkipList&) = delete;
+  UnrolledSkipList& operator=(const UnrolledSkipList&) = delete;
+
+  // 插入key, key已存在时覆盖其值并返回false
+  bool Insert(int key, const Value& value);
+
+  // 查找key, 找到时将值拷贝到value
+  bool Get(int key, Value* value) const;
+
+  bool Contains(int key) const;
+
+  // 删除key, key不存在时返回false
+  bool Erase(int key);
+
+  size_t Size() const { return size_; }
+
+  // 所有块占用的内存
+  size_t MemoryUsage() const { return memory_usage_; }
+
+  // 按key的顺序遍历
+  class Iterator {
+   public:
+    explicit Iterator(const UnrolledSkipList* list)
+        : list_(list), block_(nullptr), index_(0) {}
+
+    bool Valid() const { return block_ != nullptr; }
+    int key() const { return block_->keys[index_]; }
+    const Value& value() const { return block_->values()[index_]; }
+
+    void Next();
+    // 定位到第一个大于等于target的key
+    void Seek(int target);
+    void SeekToFirst();
+
+   private:
+    const UnrolledSkipList* list_;
+    Block* block_;
+    int index_;
+  };
+
+ private:
+  enum { kMaxHeight = Policy::kMaxHeight };
+
+  // keys[0, count)中小于key的个数
+  static int Rank(const int* keys, int count, int key);
+
+  Block* NewBlock(int height);
+  void FreeBlock(Block* b);
+
+  // 返回最后一个keys[0] <= key(or_equal为false时为keys[0] < key)的块,
+  // 没有则返回head_. prev不为空时在prev[level]中记录每一层的前驱
+  Block* FindBlock(int key, bool or_equal, Block** prev) const;
+
+  Block* head_;
+  int max_height_;
+  size_t size_;
+  size_t memory_usage_;
+  typename Policy::RandomGenerator rnd_;
+};
+
+template <typename Value, class Policy>
+struct UnrolledSkipList<Value, Policy>::Block {
+  // 第一个cache line, [count, kBlockKeys)的槽位无意义
+  alignas(64) int keys[kBlockKeys];
+  int count;
+  int height;
+  // 长度为height
+  Block* next[1];
+
+  static size_t ValuesOffset(int height) {
+    size_t off = offsetof(Block, next) + sizeof(Block*) * height;
+    return (off + alignof(Value) - 1) & ~(alignof(Value) - 1);
+  }
+  static size_t AllocSize(int height) {
+    return ValuesOffset(height) + sizeof(Value) * kBlockKeys;
+  }
+
+  // 值紧跟在索引指针之后, 与块在同一次分配中
+  Value* values() const {
+    return reinterpret_cast<Value*>(const_cast<char*>(
+        reinterpret_cast<const char*>(this) + ValuesOffset(height)));
+  }
+};
+
+template <typename Value, class Policy>
+UnrolledSkipList<Value, Policy>::UnrolledSkipList()
+    : head_(nullptr), max_height_(1), size_(0), memory_usage_(0),
+      rnd_(0xdeadbeef) {
+  head_ = NewBlock(kMaxHeight);
+}
+
+template <typename Value, class Policy>
+UnrolledSkipList<Value, Policy>::~UnrolledSkipList() {
+  Block* b = head_;
+  while (b != nullptr) {
+    Block* next = b->next[0];
+    FreeBlock(b);
+    b = next;
+  }
+}
+
+template <typename Value, class Policy>
+int UnrolledSkipList<Value, Policy>::Rank(const int* keys, int count,
+                                          int key) {
+  // 槽位按有序排列, 小于key的槽位构成前缀, 统计个数即为插入位置
+  const uint32_t valid = (1u << count) - 1;
+#if defined(__AVX2__)
+  const __m256i k = _mm256_set1_epi32(key);
+  const __m256i lo = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys));
+  const __m256i hi =
+      _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + 8));
+  uint32_t lt = static_cast<uint32_t>(_mm256_movemask_ps(
+                    _mm256_castsi256_ps(_mm256_cmpgt_epi32(k, lo)))) |
+                static_cast<uint32_t>(_mm256_movemask_ps(
+                    _mm256_castsi256_ps(_mm256_cmpgt_epi32(k, hi))))
+                    << 8;
+  return __builtin_popcount(lt & valid);
+#elif defined(__SSE2__)
+  const __m128i k = _mm_set1_epi32(key);
+  uint32_t lt = 0;
+  for (int i = 0; i < kBlockKeys / 4; i++) {
+    const __m128i v =
+        _mm_load_si128(reinterpret_cast<const __m128i*>(keys + 4 * i));
+    lt |= static_cast<uint32_t>(
+              _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, v))))
+          << (4 * i);
+  }
+  return __builtin_popcount(lt & valid);
+#else
+  (void)valid;
+  int n = 0;
+  while (n < count && keys[n] < key) n++;
+  return n;
+#endif
+}
+
+template <typename Value, class Policy>
+typename UnrolledSkipList<Value, Policy>::Block*
+UnrolledSkipList<Value, Policy>::NewBlock(int height) {
+  void* mem = nullptr;
+  if (posix_memalign(&mem, 64, Block::AllocSize(height)) != 0) {
+    throw std::bad_alloc();
+  }
+  Block* b = static_cast<Block*>(mem);
+  b->count = 0;
+  b->height = height;
+  for (int i = 0; i < height; i++) b->next[i] = nullptr;
+  Value* values = b->values();
+  for (int i = 0; i < kBlockKeys; i++) new (&values[i]) Value();
+  memory_usage_ += Block::AllocSize(height);
+  return b;
+}
+
+template <typename Value, class Policy>
+void UnrolledSkipList<Value, Policy>::FreeBlock(Block* b) {
+  Value* values = b->values();
+  for (int i = 0; i < kBlockKeys; i++) values[i].~Value();
+  memory_usage_ -= Block::AllocSize(b->height);
+  free(b);
+}
+
+template <typename Value, class Policy>
+typename UnrolledSkipList<Value, Policy>::Block*
+UnrolledSkipList<Value, Policy>::FindBlock(int key, bool or_equal,
+                                           Block** prev) const {
+  Block* x = head_;
+  for (int level = max_height_ - 1; level >= 0; level--) {
+    while (true) {
+      Block* next = x->next[level];
+      if (next == nullptr) break;
+      int first = next->keys[0];
+      if (first < key || (or_equal && first == key)) {
+        x = next;
+      } else {
+        break;
+      }
+    }
+    if (prev != nullptr) prev[level] = x;
+  }
+  return x;
+}
+
+template <typename Value, class Policy>
+bool UnrolledSkipList<Value, Policy>::Insert(int key, const Value& value) {
+  Block* prev[kMaxHeight];
+  Block* b = FindBlock(key, true, prev);
+  for (int i = max_height_; i < kMaxHeight; i++) prev[i] = head_;
+
+  if (b == head_) {
+    // key比所有key都小, 放入第一个块, 此时所有层的前驱都是head_
+    b = head_->next[0];
+    if (b == nullptr) {
+      b = NewBlock(Policy::RandomHeight(&rnd_));
+      for (int i = 0; i < b->height; i++) head_->next[i] = b;
+      if (b->height > max_height_) max_height_ = b->height;
+    }
+  }
+
+  int pos = Rank(b->keys, b->count, key);
+  if (pos < b->count && b->keys[pos] == key) {
+    b->values()[pos] = value;
+    return false;
+  }
+
+  if (b->count == kBlockKeys) {
+    // 分裂: 后一半移到新块, 新块的最小key大于b的最小key,
+    // 且小于b之后所有块的最小key, 所以低于b高度的层以b为前驱
+    const int half = kBlockKeys / 2;
+    Block* n = NewBlock(Policy::RandomHeight(&rnd_));
+    Value* from = b->values();
+    Value* to = n->values();
+    for (int i = half; i < kBlockKeys; i++) {
+      n->keys[i - half] = b->keys[i];
+      to[i - half] = std::move(from[i]);
+    }
+    n->count = kBlockKeys - half;
+    b->count = half;
+    for (int i = 0; i < n->height; i++) {
+      Block* p = i < b->height ? b : prev[i];
+      n->next[i] = p->next[i];
+      p->next[i] = n;
+    }
+    if (n->height > max_height_) max_height_ = n->height;
+    if (pos > half) {
+      b = n;
+      pos -= half;
+    }
+  }
+
+  Value* values = b->values();
+  for (int i = b->count; i > pos; i--) {
+    b->keys[i] = b->keys[i - 1];
+    values[i] = std::move(values[i - 1]);
+  }
+  b->keys[pos] = key;
+  values[pos] = value;
+  b->count++;
+  size_++;
+  return true;
+}
+
+template <typename Value, class Policy>
+bool UnrolledSkipList<Value, Policy>::Get(int key, Value* value) const {
+  Block* b = FindBlock(key, true, nullptr);
+  if (b == head_) return false;
+  int pos = Rank(b->keys, b->count, key);
+  if (pos < b->count && b->keys[pos] == key) {
+    *value = b->values()[pos];
+    return true;
+  }
+  return false;
+}
+
+template <typename Value, class Policy>
+bool UnrolledSkipList<Value, Policy>::Contains(int key) const {
+  Block* b = FindBlock(key, true, nullptr);
+  if (b == head_) return false;
+  int pos = Rank(b->keys, b->count, key);
+  return pos < b->count && b->keys[pos] == key;
+}
+
+template <typename Value, class Policy>
+bool UnrolledSkipList<Value, Policy>::Erase(int key) {
+  Block* b = FindBlock(key, true, nullptr);
+  if (b == head_) return false;
+  int pos = Rank(b->keys, b->count, key);
+  if (pos == b->count || b->keys[pos] != key) return false;
+  size_--;
+
+  if (b->count == 1) {
+    // 块将变空: 以严格小于的条件再下降一次, 得到b在每一层的前驱
+    Block* prev[kMaxHeight];
+    FindBlock(key, false, prev);
+    for (int i = 0; i < b->height; i++) {
+      assert(prev[i]->next[i] == b);
+      prev[i]->next[i] = b->next[i];
+    }
+    FreeBlock(b);
+    while (max_height_ > 1 && head_->next[max_height_ - 1] == nullptr) {
+      max_height_--;
+    }
+    return true;
+  }
+
+  Value* values = b->values();
+  for (int i = pos; i + 1 < b->count; i++) {
+    b->keys[i] = b->keys[i + 1];
+    values[i] = std::move(values[i + 1]);
+  }
+  b->count--;
+  // 留在空槽位中的旧值不再需要
+  values[b->count] = Value();
+  return true;
+}
+
+template <typename Value, class Policy>
+void UnrolledSkipList<Value, Policy>::Iterator::Next() {
+  assert(Valid());
+  if (++index_ == block_->count) {
+    block_ = block_->next[0];
+    index_ = 0;
+  }
+}
+
+template <typename Value, class Policy>
+void UnrolledSkipList<Value, Policy>::Iterator::Seek(int target) {
+  block_ = list_->FindBlock(target, true, nullptr);
+  if (block_ == list_->head_) {
+    block_ = block_->next[0];
+    index_ = 0;
+    return;
+  }
+  index_ = Rank(block_->keys, block_->count, target);
+  if (index_ == block_->count) {
+    block_ = block_->next[0];
+    index_ = 0;
+  }
+}
+
+template <typename Value, class Policy>
+void UnrolledSkipList<Value, Policy>::Iterator::SeekToFirst() {
+  block_ = list_->head_->next[0];
+  index_ = 0;
+}
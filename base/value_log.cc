@@ -0,0 +1,283 @@
+#include "value_log.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "coding.h"
+
+namespace {
+const char kSuffix[] = ".vlog";
+// fixed32 key长度, fixed32 value长度
+const size_t kHeaderSize = 8;
+
+bool EndsWith(const std::string& s, const char* suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// 读满n个字节, 文件过短时返回false
+bool ReadFully(int fd, uint64_t offset, size_t n, char* buf,
+               std::string* error) {
+  while (n > 0) {
+    ssize_t r = pread(fd, buf, n, offset);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) {
+      *error = r < 0 ? strerror(errno) : "unexpected end of file";
+      return false;
+    }
+    buf += r;
+    offset += r;
+    n -= r;
+  }
+  return true;
+}
+
+// 写满iov, 中途被截断时接着写剩下的部分
+bool WriteFully(int fd, uint64_t offset, struct iovec* iov, int cnt,
+                std::string* error) {
+  while (cnt > 0) {
+    ssize_t r = pwritev(fd, iov, cnt, offset);
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0) {
+      *error = strerror(errno);
+      return false;
+    }
+    offset += r;
+    size_t done = r;
+    while (cnt > 0 && done >= iov->iov_len) {
+      done -= iov->iov_len;
+      iov++;
+      cnt--;
+    }
+    if (cnt > 0) {
+      iov->iov_base = static_cast<char*>(iov->iov_base) + done;
+      iov->iov_len -= done;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+ValueLog::Handle::~Handle() { close(fd); }
+
+ValueLog::~ValueLog() {}
+
+bool ValueLog::Open(const std::string& dir, const ValueLogOptions& options,
+                    std::unique_ptr<ValueLog>* log, std::string* error) {
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    *error = dir + ": " + strerror(errno);
+    return false;
+  }
+  DIR* d = opendir(dir.c_str());
+  if (d == nullptr) {
+    *error = dir + ": " + strerror(errno);
+    return false;
+  }
+  // 上次运行留下的文件没有指针引用它们
+  std::vector<std::string> stale;
+  while (struct dirent* e = readdir(d)) {
+    if (EndsWith(e->d_name, kSuffix)) stale.push_back(dir + "/" + e->d_name);
+  }
+  closedir(d);
+  for (const std::string& fname : stale) unlink(fname.c_str());
+
+  std::unique_ptr<ValueLog> l(new ValueLog(dir, options));
+  std::lock_guard<std::mutex> lock(l->mu_);
+  if (!l->NewFile(error)) return false;
+  *log = std::move(l);
+  return true;
+}
+
+std::string ValueLog::FileName(uint32_t file) const {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "/%06u", file);
+  return dir_ + buf + kSuffix;
+}
+
+bool ValueLog::NewFile(std::string* error) {
+  const std::string fname = FileName(next_file_);
+  int fd = open(fname.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    *error = fname + ": " + strerror(errno);
+    return false;
+  }
+  active_ = next_file_++;
+  files_[active_].handle = std::make_shared<Handle>(fd);
+  return true;
+}
+
+std::shared_ptr<ValueLog::Handle> ValueLog::FindHandle(uint32_t file) const {
+  auto it = files_.find(file);
+  return it == files_.end() ? nullptr : it->second.handle;
+}
+
+bool ValueLog::Add(const char* key, size_t klen, const char* value,
+                   size_t vlen, ValuePointer* ptr, std::string* error) {
+  if (klen > UINT32_MAX || vlen > UINT32_MAX) {
+    *error = "value log record too large";
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = files_.find(active_);
+  if (it == files_.end() || it->second.size >= options_.file_size) {
+    if (!NewFile(error)) return false;
+    it = files_.find(active_);
+  }
+  File& f = it->second;
+  char header[kHeaderSize];
+  EncodeFixed32(header, static_cast<uint32_t>(klen));
+  EncodeFixed32(header + 4, static_cast<uint32_t>(vlen));
+  struct iovec iov[3];
+  iov[0].iov_base = header;
+  iov[0].iov_len = kHeaderSize;
+  iov[1].iov_base = const_cast<char*>(key);
+  iov[1].iov_len = klen;
+  iov[2].iov_base = const_cast<char*>(value);
+  iov[2].iov_len = vlen;
+  if (!WriteFully(f.handle->fd, f.size, iov, 3, error)) {
+    *error = FileName(active_) + ": " + *error;
+    // 写了一部分的记录不计入size, 下一条记录覆盖它
+    return false;
+  }
+  ptr->file = active_;
+  ptr->offset = f.size + kHeaderSize + klen;
+  ptr->size = static_cast<uint32_t>(vlen);
+  f.size += kHeaderSize + klen + vlen;
+  f.value_bytes += vlen;
+  return true;
+}
+
+bool ValueLog::Get(const ValuePointer& ptr, std::string* value,
+                   std::string* error) const {
+  std::shared_ptr<Handle> handle;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    handle = FindHandle(ptr.file);
+  }
+  if (!handle) {
+    *error = FileName(ptr.file) + ": removed";
+    return false;
+  }
+  value->resize(ptr.size);
+  if (!ReadFully(handle->fd, ptr.offset, ptr.size, &(*value)[0], error)) {
+    *error = FileName(ptr.file) + ": " + *error;
+    return false;
+  }
+  return true;
+}
+
+void ValueLog::Drop(const ValuePointer& ptr) {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = files_.find(ptr.file);
+  if (it != files_.end()) it->second.garbage += ptr.size;
+}
+
+bool ValueLog::PickGarbageFile(uint32_t* file, uint64_t* live) {
+  std::lock_guard<std::mutex> lock(mu_);
+  double best = 0;
+  auto pick = files_.end();
+  for (auto it = files_.begin(); it != files_.end(); ++it) {
+    const File& f = it->second;
+    if (f.garbage == 0) continue;
+    double ratio = double(f.garbage) / f.value_bytes;
+    if (ratio >= options_.gc_ratio && ratio > best) {
+      best = ratio;
+      pick = it;
+    }
+  }
+  if (pick == files_.end()) return false;
+  *file = pick->first;
+  *live = pick->second.value_bytes - pick->second.garbage;
+  if (*file == active_) {
+    std::string error;
+    // 换不了文件时先不回收它, 写入也会在这个文件上失败
+    if (!NewFile(&error)) return false;
+  }
+  return true;
+}
+
+bool ValueLog::ForEach(uint32_t file, const RecordFn& fn,
+                       std::string* error) const {
+  std::shared_ptr<Handle> handle;
+  uint64_t size;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    handle = FindHandle(file);
+    if (!handle) return true;
+    size = files_.find(file)->second.size;
+  }
+  std::string record;
+  uint64_t offset = 0;
+  while (offset < size) {
+    char header[kHeaderSize];
+    if (size - offset < kHeaderSize) {
+      *error = FileName(file) + ": truncated record";
+      return false;
+    }
+    if (!ReadFully(handle->fd, offset, kHeaderSize, header, error)) {
+      *error = FileName(file) + ": " + *error;
+      return false;
+    }
+    const uint64_t klen = DecodeFixed32(header);
+    const uint64_t vlen = DecodeFixed32(header + 4);
+    offset += kHeaderSize;
+    if (size - offset < klen + vlen) {
+      *error = FileName(file) + ": truncated record";
+      return false;
+    }
+    record.resize(klen + vlen);
+    if (!ReadFully(handle->fd, offset, record.size(), &record[0], error)) {
+      *error = FileName(file) + ": " + *error;
+      return false;
+    }
+    ValuePointer ptr;
+    ptr.file = file;
+    ptr.offset = offset + klen;
+    ptr.size = static_cast<uint32_t>(vlen);
+    fn(record.data(), klen, record.data() + klen, vlen, ptr);
+    offset += klen + vlen;
+  }
+  return true;
+}
+
+void ValueLog::RemoveFile(uint32_t file) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (file == active_ || files_.erase(file) == 0) return;
+  unlink(FileName(file).c_str());
+}
+
+void ValueLog::Clear() {
+  std::lock_guard<std::mutex> lock(mu_);
+  for (auto& f : files_) unlink(FileName(f.first).c_str());
+  files_.clear();
+  std::string error;
+  // 失败时由下一次Add再试
+  NewFile(&error);
+}
+
+size_t ValueLog::num_files() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return files_.size();
+}
+
+uint64_t ValueLog::total_bytes() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  uint64_t n = 0;
+  for (auto& f : files_) n += f.second.size;
+  return n;
+}
+
+uint64_t ValueLog::live_bytes() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  uint64_t n = 0;
+  for (auto& f : files_) n += f.second.value_bytes - f.second.garbage;
+  return n;
+}
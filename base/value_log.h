@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct ValueLogOptions {
+  // 堆上占用超过这个大小的value写入value log(std::string为size()不小于它)
+  size_t min_value_size = 4 << 10;
+  // 当前文件写到这个大小后换一个新文件
+  uint64_t file_size = 64 << 20;
+  // 文件中失效的value字节不低于这个比例时, GC把有效的value搬到当前文件,
+  // 然后删除它
+  double gc_ratio = 0.5;
+  // 后台GC两次检查之间的毫秒数, 0时不启动后台线程
+  int gc_interval_ms = 1000;
+};
+
+// value在value log中的位置, offset指向value本身
+struct ValuePointer {
+  uint32_t file = 0;
+  uint32_t size = 0;
+  uint64_t offset = 0;
+};
+
+inline bool operator==(const ValuePointer& a, const ValuePointer& b) {
+  return a.file == b.file && a.offset == b.offset && a.size == b.size;
+}
+
+/*
+  键值分离(WiscKey): 大value追加写入value log, 索引中只保留指针
+  1.目录下的文件名为<编号>.vlog, 每条记录为fixed32 key长度, fixed32 value
+    长度, key, value. 记录中的key供GC判断value是否仍然有效
+  2.覆盖和删除只在内存中把旧value记为失效; GC挑出失效比例最高的文件,
+    由调用者把仍然有效的value重新Add到当前文件, 再删除这个文件
+  3.value log只是运行期间存放大value的地方, 持久化仍然靠快照, 快照中的
+    value是内联的. 所以Open时删除目录中旧的文件, 写入也不fsync
+  写入用同步的pwritev, 之后的Get马上能读到. 所有方法都是线程安全的;
+  被删除的文件在最后一个读完它的ForEach/Get之后才关闭
+*/
+class ValueLog {
+ public:
+  ~ValueLog();
+
+  ValueLog(const ValueLog&) = delete;
+  ValueLog& operator=(const ValueLog&) = delete;
+
+  // 不存在时创建dir, 失败时返回false并设置*error
+  static bool Open(const std::string& dir, const ValueLogOptions& options,
+                   std::unique_ptr<ValueLog>* log, std::string* error);
+
+  // 追加一条记录, *ptr指向其中的value
+  bool Add(const char* key, size_t klen, const char* value, size_t vlen,
+           ValuePointer* ptr, std::string* error);
+  bool Get(const ValuePointer& ptr, std::string* value,
+           std::string* error) const;
+  // ptr指向的value不再被引用
+  void Drop(const ValuePointer& ptr);
+
+  // 失效比例最高且不低于gc_ratio的文件, 没有时返回false; *live为其中
+  // 仍然有效的value字节数. 选中当前文件时换一个新文件, 之后的写入和搬迁
+  // 都不会再写到它
+  bool PickGarbageFile(uint32_t* file, uint64_t* live);
+  // 按顺序读取file中的每条记录, 调用fn(key, klen, value, vlen, ptr)
+  typedef std::function<void(const char*, size_t, const char*, size_t,
+                             const ValuePointer&)>
+      RecordFn;
+  bool ForEach(uint32_t file, const RecordFn& fn, std::string* error) const;
+  // 删除file, 调用者保证已经没有指向它的指针
+  void RemoveFile(uint32_t file);
+  // 删除所有文件, 从一个新文件开始
+  void Clear();
+
+  const ValueLogOptions& options() const { return options_; }
+  const std::string& dir() const { return dir_; }
+  size_t num_files() const;
+  // 所有文件的字节数
+  uint64_t total_bytes() const;
+  // 仍被引用的value字节数
+  uint64_t live_bytes() const;
+
+ private:
+  // 关闭时才close fd, 见上面的说明
+  struct Handle {
+    explicit Handle(int f) : fd(f) {}
+    ~Handle();
+    int fd;
+  };
+
+  struct File {
+    std::shared_ptr<Handle> handle;
+    uint64_t size = 0;
+    // 写入的value字节数和其中已经失效的部分
+    uint64_t value_bytes = 0;
+    uint64_t garbage = 0;
+  };
+
+  ValueLog(const std::string& dir, const ValueLogOptions& options)
+      : dir_(dir), options_(options), next_file_(1), active_(0) {}
+
+  std::string FileName(uint32_t file) const;
+  // 以下方法要求持有mu_
+  // 新建next_file_并设为当前文件
+  bool NewFile(std::string* error);
+  std::shared_ptr<Handle> FindHandle(uint32_t file) const;
+
+  const std::string dir_;
+  const ValueLogOptions options_;
+
+  mutable std::mutex mu_;
+  std::map<uint32_t, File> files_;
+  uint32_t next_file_;
+  uint32_t active_;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+// Told about every mutation of a store, in the order the store applies
+// them. The store calls the listener under its lock, so calls never
+// overlap and a listener must not call back into the store. Replication
+// turns these calls into the stream its replicas replay.
+template <typename K, typename V>
+class WriteListener {
+ public:
+  virtual ~WriteListener() {}
+
+  // a new key or an overwrite, the key keeps its ttl
+  virtual void OnInsert(const K& k, const V& v) = 0;
+  // same, but the key expires seconds from now, or never for 0
+  virtual void OnSet(const K& k, const V& v, int seconds) = 0;
+  // deleted, expired or evicted
+  virtual void OnRemove(const K& k) = 0;
+  // the key expires seconds from now
+  virtual void OnExpire(const K& k, int seconds) = 0;
+  // the key lost its ttl
+  virtual void OnPersist(const K& k) = 0;
+};
@@ -0,0 +1,194 @@
+/**
+ * @file cli.cc
+ * @brief minikv-cli: command line client and load generator
+ *
+ * Example:
+ *   ./minikv-cli --port=6379 set k v
+ *   ./minikv-cli --unix_socket=/tmp/minikv.sock        (commands from stdin)
+ *   ./minikv-cli --bench=set,get --requests=100000 --clients=4 --pipeline=16
+ *
+ * --bench runs each listed command (set, get, mset, mget) from --clients
+ * connections with --pipeline requests in flight per connection and
+ * reports requests per second, like redis-benchmark -t ... -P ...
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "client.h"
+
+namespace {
+
+std::string FLAGS_host = "127.0.0.1";
+int FLAGS_port = 6379;
+std::string FLAGS_unix_socket;
+std::string FLAGS_bench;
+int FLAGS_requests = 100000;
+int FLAGS_clients = 4;
+int FLAGS_pipeline = 1;
+int FLAGS_value_size = 3;
+// keys are drawn from [0, keyspace)
+int FLAGS_keyspace = 100000;
+
+// --name=value
+bool ParseFlag(const char* arg, const char* name, std::string* value) {
+  size_t n = strlen(name);
+  if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, n) != 0 ||
+      arg[2 + n] != '=') {
+    return false;
+  }
+  *value = arg + 3 + n;
+  return true;
+}
+
+bool Connect(RespClient* client) {
+  std::string error;
+  bool ok = FLAGS_unix_socket.empty()
+                ? client->ConnectTcp(FLAGS_host, FLAGS_port, &error)
+                : client->ConnectUnix(FLAGS_unix_socket, &error);
+  if (!ok) fprintf(stderr, "minikv-cli: %s\n", error.c_str());
+  return ok;
+}
+
+std::vector<std::string> Split(const std::string& line) {
+  std::vector<std::string> argv;
+  std::istringstream is(line);
+  std::string word;
+  while (is >> word) argv.push_back(word);
+  return argv;
+}
+
+std::vector<std::string> BenchRequest(const std::string& name, uint32_t key,
+                                      const std::string& value) {
+  std::string k = "key:" + std::to_string(key % FLAGS_keyspace);
+  if (name == "set") return {"SET", k, value};
+  if (name == "get") return {"GET", k};
+  if (name == "mset") return {"MSET", k, value, k + ":2", value};
+  return {"MGET", k, k + ":2"};
+}
+
+// one connection's share of the requests; false on an error reply
+bool BenchClient(const std::string& name, int requests, uint32_t seed) {
+  RespClient client;
+  if (!Connect(&client)) return false;
+  const std::string value(FLAGS_value_size, 'x');
+  uint32_t x = seed;
+  RespValue reply;
+  for (int sent = 0; sent < requests;) {
+    int batch = std::min(FLAGS_pipeline, requests - sent);
+    for (int i = 0; i < batch; i++) {
+      // xorshift32, cheap and good enough to spread the keys
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      client.Append(BenchRequest(name, x, value));
+    }
+    if (!client.Flush()) return false;
+    for (int i = 0; i < batch; i++) {
+      if (!client.ReadReply(&reply) || reply.type == RespValue::kError) {
+        fprintf(stderr, "%s: %s\n", name.c_str(), reply.str.c_str());
+        return false;
+      }
+    }
+    sent += batch;
+  }
+  return true;
+}
+
+int RunBench() {
+  std::istringstream names(FLAGS_bench);
+  std::string name;
+  while (std::getline(names, name, ',')) {
+    if (name != "set" && name != "get" && name != "mset" && name != "mget") {
+      fprintf(stderr, "unknown benchmark '%s'\n", name.c_str());
+      return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    std::atomic<bool> ok(true);
+    for (int c = 0; c < FLAGS_clients; c++) {
+      int share = FLAGS_requests / FLAGS_clients +
+                  (c < FLAGS_requests % FLAGS_clients ? 1 : 0);
+      threads.emplace_back([&ok, name, share, c] {
+        uint32_t seed = 2463534242u + c * 7919;
+        if (!BenchClient(name, share, seed)) ok.store(false);
+      });
+    }
+    for (auto& t : threads) t.join();
+    double secs = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    if (!ok) return 1;
+    printf("%-6s: %10.0f requests per second (%d clients, pipeline %d)\n",
+           name.c_str(), FLAGS_requests / secs, FLAGS_clients,
+           FLAGS_pipeline);
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> command;
+  for (int i = 1; i < argc; i++) {
+    std::string v;
+    if (!command.empty() || strncmp(argv[i], "--", 2) != 0) {
+      command.push_back(argv[i]);
+    } else if (ParseFlag(argv[i], "host", &v)) {
+      FLAGS_host = v;
+    } else if (ParseFlag(argv[i], "port", &v)) {
+      FLAGS_port = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "unix_socket", &v)) {
+      FLAGS_unix_socket = v;
+    } else if (ParseFlag(argv[i], "bench", &v)) {
+      FLAGS_bench = v;
+    } else if (ParseFlag(argv[i], "requests", &v)) {
+      FLAGS_requests = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "clients", &v)) {
+      FLAGS_clients = std::max(1, atoi(v.c_str()));
+    } else if (ParseFlag(argv[i], "pipeline", &v)) {
+      FLAGS_pipeline = std::max(1, atoi(v.c_str()));
+    } else if (ParseFlag(argv[i], "value_size", &v)) {
+      FLAGS_value_size = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "keyspace", &v)) {
+      FLAGS_keyspace = std::max(1, atoi(v.c_str()));
+    } else {
+      fprintf(stderr, "invalid flag '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+  if (!FLAGS_bench.empty()) return RunBench();
+
+  RespClient client;
+  if (!Connect(&client)) return 1;
+  RespValue reply;
+  if (!command.empty()) {
+    if (!client.Call(command, &reply)) {
+      fprintf(stderr, "minikv-cli: connection lost\n");
+      return 1;
+    }
+    printf("%s\n", FormatReply(reply).c_str());
+    return reply.type == RespValue::kError ? 1 : 0;
+  }
+
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    std::vector<std::string> args = Split(line);
+    if (args.empty()) continue;
+    if (!client.Call(args, &reply)) {
+      fprintf(stderr, "minikv-cli: connection lost\n");
+      return 1;
+    }
+    printf("%s\n", FormatReply(reply).c_str());
+  }
+  return 0;
+}
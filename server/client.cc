@@ -0,0 +1,167 @@
+#include "client.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+bool RespClient::ConnectTcp(const std::string& host, int port,
+                            std::string* error) {
+  Close();
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* res;
+  int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+                       &res);
+  if (rc != 0) {
+    *error = gai_strerror(rc);
+    return false;
+  }
+  for (struct addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+    fd_ = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+                 ai->ai_protocol);
+    if (fd_ < 0) continue;
+    if (connect(fd_, ai->ai_addr, ai->ai_addrlen) == 0) break;
+    close(fd_);
+    fd_ = -1;
+  }
+  freeaddrinfo(res);
+  if (fd_ < 0) {
+    *error = std::string("connect: ") + strerror(errno);
+    return false;
+  }
+  int one = 1;
+  setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return true;
+}
+
+bool RespClient::ConnectUnix(const std::string& path, std::string* error) {
+  Close();
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    *error = "unix socket path too long";
+    return false;
+  }
+  strcpy(addr.sun_path, path.c_str());
+  fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd_ < 0 || connect(fd_, reinterpret_cast<struct sockaddr*>(&addr),
+                         sizeof(addr)) != 0) {
+    *error = std::string("connect: ") + strerror(errno);
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void RespClient::Close() {
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+  out_.clear();
+  in_.clear();
+  pos_ = 0;
+}
+
+int RespClient::Release() {
+  int fd = fd_;
+  fd_ = -1;
+  Close();
+  return fd;
+}
+
+void RespClient::Append(const std::vector<std::string>& argv) {
+  AppendRequest(&out_, argv);
+}
+
+bool RespClient::Flush() {
+  size_t off = 0;
+  while (off < out_.size()) {
+    ssize_t w = send(fd_, out_.data() + off, out_.size() - off, MSG_NOSIGNAL);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    off += w;
+  }
+  out_.clear();
+  return true;
+}
+
+bool RespClient::ReadReply(RespValue* reply) {
+  while (true) {
+    size_t consumed;
+    RespStatus s =
+        ParseReply(in_.data() + pos_, in_.size() - pos_, reply, &consumed);
+    if (s == RESP_OK) {
+      pos_ += consumed;
+      if (pos_ == in_.size()) {
+        in_.clear();
+        pos_ = 0;
+      }
+      return true;
+    }
+    if (s == RESP_ERROR) return false;
+    char buf[16 << 10];
+    ssize_t r = read(fd_, buf, sizeof(buf));
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    in_.append(buf, r);
+  }
+}
+
+bool RespClient::Call(const std::vector<std::string>& argv,
+                      RespValue* reply) {
+  Append(argv);
+  return Flush() && ReadReply(reply);
+}
+
+std::string FormatReply(const RespValue& v, const std::string& indent) {
+  switch (v.type) {
+    case RespValue::kSimpleString:
+      return v.str;
+    case RespValue::kError:
+      return "(error) " + v.str;
+    case RespValue::kInteger:
+      return "(integer) " + std::to_string(v.integer);
+    case RespValue::kNil:
+      return "(nil)";
+    case RespValue::kBulk: {
+      std::string r = "\"";
+      for (unsigned char c : v.str) {
+        if (c == '"' || c == '\\') {
+          r.push_back('\\');
+          r.push_back(c);
+        } else if (c < 0x20 || c >= 0x7f) {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\x%02x", c);
+          r += buf;
+        } else {
+          r.push_back(c);
+        }
+      }
+      return r + "\"";
+    }
+    case RespValue::kArray: {
+      if (v.elements.empty()) return "(empty array)";
+      std::string r;
+      for (size_t i = 0; i < v.elements.size(); i++) {
+        std::string prefix = std::to_string(i + 1) + ") ";
+        if (i > 0) r += "\n" + indent;
+        r += prefix +
+             FormatReply(v.elements[i],
+                         indent + std::string(prefix.size(), ' '));
+      }
+      return r;
+    }
+  }
+  return "";
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "resp.h"
+
+// Blocking RESP client, for minikv-cli and the tests.
+class RespClient {
+ public:
+  RespClient() : fd_(-1), pos_(0) {}
+  ~RespClient() { Close(); }
+
+  RespClient(const RespClient&) = delete;
+  RespClient& operator=(const RespClient&) = delete;
+
+  bool ConnectTcp(const std::string& host, int port, std::string* error);
+  bool ConnectUnix(const std::string& path, std::string* error);
+  void Close();
+  // hand the connected socket over, the client is closed afterwards. Any
+  // reply already read into the client is dropped.
+  int Release();
+
+  // queue a request; nothing is sent before Flush() or Call()
+  void Append(const std::vector<std::string>& argv);
+  // raw bytes, e.g. an inline command or a malformed request
+  void AppendRaw(const std::string& bytes) { out_ += bytes; }
+  bool Flush();
+  // the next reply; false on a closed connection or a malformed reply
+  bool ReadReply(RespValue* reply);
+  // Append + Flush + ReadReply
+  bool Call(const std::vector<std::string>& argv, RespValue* reply);
+
+ private:
+  int fd_;
+  std::string out_;
+  // unparsed replies are in_[pos_, in_.size())
+  std::string in_;
+  size_t pos_;
+};
+
+// redis-cli style rendering, e.g. (integer) 1, (nil), 1) "a"
+std::string FormatReply(const RespValue& v, const std::string& indent = "");
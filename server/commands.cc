@@ -0,0 +1,638 @@
+#include "commands.h"
+
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "replication.h"
+#include "resp.h"
+
+namespace {
+
+typedef std::vector<std::string> Args;
+typedef void (*Handler)(Session* s, const Args& argv, std::string* out);
+
+enum CommandFlags {
+  // changes the store, refused on a replica
+  kWrite = 1,
+};
+
+struct Command {
+  const char* name;
+  // redis convention: N exactly N arguments, -N at least N, name included
+  int arity;
+  int flags;
+  Handler handler;
+};
+
+bool ParseInt(const std::string& s, long long* v) {
+  if (s.empty() || s.size() > 20) return false;
+  char* end;
+  errno = 0;
+  *v = strtoll(s.c_str(), &end, 10);
+  return errno == 0 && *end == '\0';
+}
+
+std::string Lower(const std::string& s) {
+  std::string r(s);
+  for (char& c : r) {
+    c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+  }
+  return r;
+}
+
+void ReplyNotInteger(std::string* out) {
+  AppendError(out, "ERR value is not an integer or out of range");
+}
+
+void ReplySyntaxError(std::string* out) {
+  AppendError(out, "ERR syntax error");
+}
+
+// the store is over maxmemory and its policy frees nothing
+void ReplyOom(std::string* out) {
+  AppendError(out, "OOM command not allowed when used memory > 'maxmemory'.");
+}
+
+// the store keeps ttls in whole seconds
+int ClampSeconds(long long seconds) {
+  return seconds > INT_MAX ? INT_MAX : static_cast<int>(seconds);
+}
+
+void GetCommand(Session* s, const Args& argv, std::string* out) {
+  std::string v;
+  if (s->store->searchElement(argv[1], v)) {
+    AppendBulk(out, v);
+  } else {
+    AppendNil(out);
+  }
+}
+
+void SetCommand(Session* s, const Args& argv, std::string* out) {
+  long long ttl = 0;
+  bool keepttl = false;
+  for (size_t i = 3; i < argv.size(); i++) {
+    std::string opt = Lower(argv[i]);
+    if (opt == "keepttl" && ttl == 0) {
+      keepttl = true;
+    } else if ((opt == "ex" || opt == "px") && ttl == 0 && !keepttl &&
+               i + 1 < argv.size()) {
+      long long v;
+      if (!ParseInt(argv[++i], &v)) return ReplyNotInteger(out);
+      if (v <= 0) {
+        return AppendError(out, "ERR invalid expire time in 'set' command");
+      }
+      // milliseconds are rounded up to the next second
+      ttl = opt == "ex" ? v : (v + 999) / 1000;
+    } else {
+      return ReplySyntaxError(out);
+    }
+  }
+  // like redis, a plain SET drops the old ttl; the value and the ttl are
+  // written in one step, so the old ttl cannot expire the new value
+  int r = keepttl ? s->store->insertElement(argv[1], argv[2])
+                  : s->store->setElement(argv[1], argv[2], ClampSeconds(ttl));
+  if (r < 0) return ReplyOom(out);
+  AppendSimpleString(out, "OK");
+}
+
+// INCR, DECR, INCRBY and DECRBY; one atomic update of the stored value,
+// which keeps its ttl
+void IncrBy(Session* s, const std::string& key, long long delta,
+            std::string* out) {
+  long long result;
+  int r = s->store->incrementElement(key, delta, &result);
+  if (r == -1) return ReplyOom(out);
+  if (r < 0) return ReplyNotInteger(out);
+  AppendInteger(out, result);
+}
+
+void IncrCommand(Session* s, const Args& argv, std::string* out) {
+  IncrBy(s, argv[1], 1, out);
+}
+
+void DecrCommand(Session* s, const Args& argv, std::string* out) {
+  IncrBy(s, argv[1], -1, out);
+}
+
+void IncrbyCommand(Session* s, const Args& argv, std::string* out) {
+  long long delta;
+  if (!ParseInt(argv[2], &delta)) return ReplyNotInteger(out);
+  IncrBy(s, argv[1], delta, out);
+}
+
+void DecrbyCommand(Session* s, const Args& argv, std::string* out) {
+  long long delta;
+  // -LLONG_MIN overflows
+  if (!ParseInt(argv[2], &delta) || delta == LLONG_MIN) {
+    return ReplyNotInteger(out);
+  }
+  IncrBy(s, argv[1], -delta, out);
+}
+
+void AppendCommand(Session* s, const Args& argv, std::string* out) {
+  size_t size;
+  if (s->store->appendElement(argv[1], argv[2], &size) < 0) {
+    return ReplyOom(out);
+  }
+  AppendInteger(out, static_cast<long long>(size));
+}
+
+void GetsetCommand(Session* s, const Args& argv, std::string* out) {
+  std::string old;
+  // like SET, the new value has no ttl
+  int r = s->store->getSetElement(argv[1], argv[2], &old);
+  if (r < 0) return ReplyOom(out);
+  if (r == 1) {
+    AppendBulk(out, old);
+  } else {
+    AppendNil(out);
+  }
+}
+
+void DelCommand(Session* s, const Args& argv, std::string* out) {
+  long long n = 0;
+  for (size_t i = 1; i < argv.size(); i++) {
+    if (s->store->deleteElement(argv[i])) n++;
+  }
+  AppendInteger(out, n);
+}
+
+void ExistsCommand(Session* s, const Args& argv, std::string* out) {
+  long long n = 0;
+  std::string v;
+  for (size_t i = 1; i < argv.size(); i++) {
+    if (s->store->searchElement(argv[i], v)) n++;
+  }
+  AppendInteger(out, n);
+}
+
+void ExpireCommand(Session* s, const Args& argv, std::string* out) {
+  long long seconds;
+  if (!ParseInt(argv[2], &seconds)) return ReplyNotInteger(out);
+  // a ttl of 0 expires the key at once
+  bool ok = s->store->element_expire_time(
+      argv[1], seconds < 0 ? 0 : ClampSeconds(seconds));
+  AppendInteger(out, ok ? 1 : 0);
+}
+
+void PersistCommand(Session* s, const Args& argv, std::string* out) {
+  AppendInteger(out, s->store->element_persist(argv[1]) ? 1 : 0);
+}
+
+void TtlCommand(Session* s, const Args& argv, std::string* out) {
+  AppendInteger(out, s->store->element_ttl(argv[1]));
+}
+
+void PttlCommand(Session* s, const Args& argv, std::string* out) {
+  long long ttl = s->store->element_ttl(argv[1]);
+  AppendInteger(out, ttl > 0 ? ttl * 1000 : ttl);
+}
+
+// The cursor names the key to resume at; the key itself is kept on the
+// session since clients expect an integer cursor. Keys written behind the
+// cursor are not returned, keys that exist for the whole scan are returned
+// exactly once.
+void ScanCommand(Session* s, const Args& argv, std::string* out) {
+  std::string begin;
+  if (argv[1] != "0") {
+    long long id;
+    auto it = s->cursors.end();
+    if (ParseInt(argv[1], &id)) it = s->cursors.find(id);
+    if (it == s->cursors.end()) return AppendError(out, "ERR invalid cursor");
+    begin = it->second;
+    s->cursors.erase(it);
+  }
+
+  long long count = 10;
+  const std::string* pattern = nullptr;
+  for (size_t i = 2; i < argv.size(); i++) {
+    std::string opt = Lower(argv[i]);
+    if (opt == "count" && i + 1 < argv.size()) {
+      if (!ParseInt(argv[++i], &count)) return ReplyNotInteger(out);
+      if (count < 1) return ReplySyntaxError(out);
+      if (count > INT_MAX) count = INT_MAX;
+    } else if (opt == "match" && i + 1 < argv.size()) {
+      pattern = &argv[++i];
+    } else {
+      return ReplySyntaxError(out);
+    }
+  }
+
+  std::vector<std::pair<std::string, std::string>> items;
+  s->store->scanElement(begin, static_cast<int>(count), &items);
+  uint64_t next = 0;
+  if (static_cast<long long>(items.size()) == count) {
+    // the smallest key greater than the last one returned
+    std::string resume = items.back().first;
+    resume.push_back('\0');
+    next = s->next_cursor++;
+    s->cursors[next] = std::move(resume);
+    if (s->cursors.size() > kMaxScanCursors) {
+      s->cursors.erase(s->cursors.begin());
+    }
+  }
+
+  size_t matched = items.size();
+  if (pattern != nullptr) {
+    matched = 0;
+    for (auto& kv : items) {
+      if (GlobMatch(pattern->data(), pattern->size(), kv.first.data(),
+                    kv.first.size())) {
+        items[matched++].first.swap(kv.first);
+      }
+    }
+  }
+  AppendArrayHeader(out, 2);
+  AppendBulk(out, std::to_string(next));
+  AppendArrayHeader(out, matched);
+  for (size_t i = 0; i < matched; i++) AppendBulk(out, items[i].first);
+}
+
+void MgetCommand(Session* s, const Args& argv, std::string* out) {
+  AppendArrayHeader(out, argv.size() - 1);
+  std::string v;
+  for (size_t i = 1; i < argv.size(); i++) {
+    if (s->store->searchElement(argv[i], v)) {
+      AppendBulk(out, v);
+    } else {
+      AppendNil(out);
+    }
+  }
+}
+
+void MsetCommand(Session* s, const Args& argv, std::string* out) {
+  if (argv.size() % 2 != 1) {
+    return AppendError(out,
+                       "ERR wrong number of arguments for 'mset' command");
+  }
+  for (size_t i = 1; i < argv.size(); i += 2) {
+    // the pairs before a rejected one stay set
+    if (s->store->setElement(argv[i], argv[i + 1], 0) < 0) {
+      return ReplyOom(out);
+    }
+  }
+  AppendSimpleString(out, "OK");
+}
+
+void DbsizeCommand(Session* s, const Args& argv, std::string* out) {
+  AppendInteger(out, s->store->size());
+}
+
+void InfoCommand(Session* s, const Args& argv, std::string* out) {
+  std::string section = argv.size() > 1 ? Lower(argv[1]) : "default";
+  bool all = section == "all" || section == "everything";
+  bool dflt = all || section == "default";
+  std::ostringstream os;
+  if (dflt || section == "server") {
+    os << "# Server\r\n";
+    os << "tcp_port:" << s->stats->tcp_port << "\r\n";
+    os << "io_threads:" << s->stats->io_threads << "\r\n";
+    os << "uptime_in_seconds:" << time(nullptr) - s->stats->start_time
+       << "\r\n\r\n";
+  }
+  if (dflt || section == "clients") {
+    os << "# Clients\r\n";
+    os << "connected_clients:" << s->stats->connected_clients.load()
+       << "\r\n\r\n";
+  }
+  if (dflt || section == "stats") {
+    os << "# Stats\r\n";
+    os << "total_connections_received:"
+       << s->stats->connections_received.load() << "\r\n";
+    os << "total_commands_processed:" << s->stats->commands_processed.load()
+       << "\r\n";
+    os << "evicted_keys:"
+       << s->store->getStatistics()->GetTickerCount(EVICTED_KEYS)
+       << "\r\n\r\n";
+  }
+  if (dflt || section == "memory") {
+    std::string used, max, policy, vlog, vlog_live;
+    s->store->getProperty("minikv.used-memory", &used);
+    s->store->getProperty("minikv.maxmemory", &max);
+    s->store->getProperty("minikv.maxmemory-policy", &policy);
+    s->store->getProperty("minikv.value-log-bytes", &vlog);
+    s->store->getProperty("minikv.value-log-live-bytes", &vlog_live);
+    os << "# Memory\r\n";
+    os << "used_memory:" << used << "\r\n";
+    os << "maxmemory:" << max << "\r\n";
+    os << "maxmemory_policy:" << policy << "\r\n";
+    os << "value_log_bytes:" << vlog << "\r\n";
+    os << "value_log_live_bytes:" << vlog_live << "\r\n\r\n";
+  }
+  if (dflt || section == "replication") {
+    os << "# Replication\r\n";
+    if (s->replica != nullptr) {
+      ReplicaClient* r = s->replica;
+      os << "role:slave\r\n";
+      if (r->options().unix_socket.empty()) {
+        os << "master_host:" << r->options().host << "\r\n";
+        os << "master_port:" << r->options().port << "\r\n";
+      } else {
+        os << "master_unix_socket:" << r->options().unix_socket << "\r\n";
+      }
+      os << "master_link_status:" << (r->link_up() ? "up" : "down") << "\r\n";
+      os << "master_replid:" << r->replid() << "\r\n";
+      os << "master_repl_offset:" << r->offset() << "\r\n";
+      os << "master_sync_full:" << r->full_syncs() << "\r\n";
+      os << "master_sync_partial:" << r->partial_syncs() << "\r\n\r\n";
+    } else if (s->repl_log != nullptr) {
+      ReplicationLog* log = s->repl_log;
+      os << "role:master\r\n";
+      os << "connected_slaves:" << log->num_replicas() << "\r\n";
+      os << "master_replid:" << log->replid() << "\r\n";
+      os << "master_repl_offset:" << log->offset() << "\r\n";
+      os << "sync_full:" << log->full_syncs() << "\r\n";
+      os << "sync_partial_ok:" << log->partial_syncs() << "\r\n";
+      os << "repl_backlog_size:" << log->backlog_size() << "\r\n";
+      os << "repl_backlog_first_byte_offset:" << log->backlog_first_offset()
+         << "\r\n\r\n";
+    } else {
+      os << "role:master\r\n\r\n";
+    }
+  }
+  if (dflt || section == "persistence") {
+    std::string in_progress, status, backend;
+    s->store->getProperty("minikv.dump-in-progress", &in_progress);
+    s->store->getProperty("minikv.last-dump-status", &status);
+    s->store->getProperty("minikv.dump-io-backend", &backend);
+    os << "# Persistence\r\n";
+    os << "rdb_bgsave_in_progress:" << in_progress << "\r\n";
+    os << "rdb_last_bgsave_status:" << status << "\r\n";
+    os << "dump_io_backend:" << backend << "\r\n\r\n";
+  }
+  if (dflt || section == "keyspace") {
+    std::string engine, memory;
+    s->store->getProperty("minikv.index-engine", &engine);
+    s->store->getProperty("minikv.memory-usage", &memory);
+    os << "# Keyspace\r\n";
+    os << "keys:" << s->store->size() << "\r\n";
+    os << "index_engine:" << engine << "\r\n";
+    os << "index_memory_bytes:" << memory << "\r\n\r\n";
+  }
+  // empty unless the server runs with --hot_keys
+  if (dflt || section == "hotkeys") {
+    os << "# Hotkeys\r\n";
+    for (bool writes : {false, true}) {
+      std::vector<std::pair<std::string, uint64_t>> top =
+          s->store->hotKeys(writes);
+      for (size_t i = 0; i < top.size(); i++) {
+        os << (writes ? "hot_write_" : "hot_read_") << i
+           << ":key=" << top[i].first << ",accesses=" << top[i].second
+           << "\r\n";
+      }
+    }
+    os << "\r\n";
+  }
+  // every store counter and histogram, prometheus text format
+  if (all || section == "metrics") {
+    std::string metrics;
+    s->store->getProperty("minikv.stats", &metrics);
+    os << "# Metrics\r\n" << metrics << "\r\n";
+  }
+  AppendBulk(out, os.str());
+}
+
+void SaveCommand(Session* s, const Args& argv, std::string* out) {
+  std::string error;
+  if (s->store->dumpFile(s->dump_file, &error)) {
+    AppendSimpleString(out, "OK");
+  } else {
+    AppendError(out, "ERR could not write the dump file: " + error);
+  }
+}
+
+// the items are copied out under the store lock, the disk writes and the
+// fsync happen on the dump writer's thread
+void BgsaveCommand(Session* s, const Args& argv, std::string* out) {
+  std::string error;
+  if (s->store->bgDumpFile(s->dump_file, nullptr, nullptr, &error)) {
+    AppendSimpleString(out, "Background saving started");
+    return;
+  }
+  std::string in_progress;
+  s->store->getProperty("minikv.dump-in-progress", &in_progress);
+  if (in_progress == "1") {
+    AppendError(out, "ERR Background save already in progress");
+  } else {
+    AppendError(out, "ERR could not write the dump file: " + error);
+  }
+}
+
+void PingCommand(Session* s, const Args& argv, std::string* out) {
+  if (argv.size() > 1) {
+    AppendBulk(out, argv[1]);
+  } else {
+    AppendSimpleString(out, "PONG");
+  }
+}
+
+void EchoCommand(Session* s, const Args& argv, std::string* out) {
+  AppendBulk(out, argv[1]);
+}
+
+void QuitCommand(Session* s, const Args& argv, std::string* out) {
+  s->quit = true;
+  AppendSimpleString(out, "OK");
+}
+
+// redis-cli asks for command docs on startup, an empty answer is fine
+void CommandCommand(Session* s, const Args& argv, std::string* out) {
+  AppendArrayHeader(out, 0);
+}
+
+// maxmemory and maxmemory-policy can be read and set. redis-benchmark
+// reads "save" and "appendonly" and copes with no answer
+void ConfigCommand(Session* s, const Args& argv, std::string* out) {
+  const std::string sub = Lower(argv[1]);
+  if (sub == "get" && argv.size() == 3) {
+    const std::string name = Lower(argv[2]);
+    std::string value;
+    if (name != "maxmemory" && name != "maxmemory-policy") {
+      return AppendArrayHeader(out, 0);
+    }
+    s->store->getProperty("minikv." + name, &value);
+    AppendArrayHeader(out, 2);
+    AppendBulk(out, name);
+    AppendBulk(out, value);
+    return;
+  }
+  if (sub == "set" && argv.size() == 4) {
+    const std::string name = Lower(argv[2]);
+    std::string max, policy;
+    s->store->getProperty("minikv.maxmemory", &max);
+    s->store->getProperty("minikv.maxmemory-policy", &policy);
+    if (name == "maxmemory") {
+      max = argv[3];
+    } else if (name == "maxmemory-policy") {
+      policy = Lower(argv[3]);
+    } else {
+      return AppendError(out, "ERR Unsupported CONFIG parameter: " + argv[2]);
+    }
+    long long bytes;
+    EvictionPolicy p;
+    if (!ParseInt(max, &bytes) || bytes < 0 ||
+        !ParseEvictionPolicy(policy, &p)) {
+      return AppendError(out, "ERR Invalid argument '" + argv[3] +
+                                  "' for CONFIG SET '" + argv[2] + "'");
+    }
+    s->store->setMaxMemory(static_cast<size_t>(bytes), p);
+    return AppendSimpleString(out, "OK");
+  }
+  if (sub == "get") return AppendArrayHeader(out, 0);
+  AppendError(out, "ERR only CONFIG GET and CONFIG SET are supported");
+}
+
+// PSYNC <replid> <offset>: the replication log answers once the event
+// loop handed the connection over
+void PsyncCommand(Session* s, const Args& argv, std::string* out) {
+  if (s->repl_log == nullptr) {
+    return AppendError(out, "ERR PSYNC is only served by a primary");
+  }
+  long long offset;
+  if (!ParseInt(argv[2], &offset)) return ReplyNotInteger(out);
+  s->psync_replid = argv[1];
+  s->psync_offset = offset;
+  s->detach = true;
+}
+
+const Command kCommands[] = {
+    {"get", 2, 0, GetCommand},
+    {"set", -3, kWrite, SetCommand},
+    {"del", -2, kWrite, DelCommand},
+    {"incr", 2, kWrite, IncrCommand},
+    {"decr", 2, kWrite, DecrCommand},
+    {"incrby", 3, kWrite, IncrbyCommand},
+    {"decrby", 3, kWrite, DecrbyCommand},
+    {"append", 3, kWrite, AppendCommand},
+    {"getset", 3, kWrite, GetsetCommand},
+    {"exists", -2, 0, ExistsCommand},
+    {"expire", 3, kWrite, ExpireCommand},
+    {"persist", 2, kWrite, PersistCommand},
+    {"ttl", 2, 0, TtlCommand},
+    {"pttl", 2, 0, PttlCommand},
+    {"scan", -2, 0, ScanCommand},
+    {"mget", -2, 0, MgetCommand},
+    {"mset", -3, kWrite, MsetCommand},
+    {"dbsize", 1, 0, DbsizeCommand},
+    {"info", -1, 0, InfoCommand},
+    {"save", 1, 0, SaveCommand},
+    {"bgsave", 1, 0, BgsaveCommand},
+    {"ping", -1, 0, PingCommand},
+    {"echo", 2, 0, EchoCommand},
+    {"quit", 1, 0, QuitCommand},
+    {"command", -1, 0, CommandCommand},
+    {"config", -2, 0, ConfigCommand},
+    {"psync", 3, 0, PsyncCommand},
+};
+
+const Command* LookupCommand(const std::string& name) {
+  static const std::unordered_map<std::string, const Command*> table = [] {
+    std::unordered_map<std::string, const Command*> t;
+    for (const Command& c : kCommands) t[c.name] = &c;
+    return t;
+  }();
+  auto it = table.find(Lower(name));
+  return it == table.end() ? nullptr : it->second;
+}
+
+}  // namespace
+
+void ExecuteCommand(Session* session, const std::vector<std::string>& argv,
+                    std::string* out) {
+  session->stats->commands_processed.fetch_add(1, std::memory_order_relaxed);
+  const Command* cmd = LookupCommand(argv[0]);
+  if (cmd == nullptr) {
+    AppendError(out, "ERR unknown command '" + argv[0] + "'");
+    return;
+  }
+  int argc = static_cast<int>(argv.size());
+  if ((cmd->arity > 0 && argc != cmd->arity) || argc < -cmd->arity) {
+    AppendError(out, std::string("ERR wrong number of arguments for '") +
+                         cmd->name + "' command");
+    return;
+  }
+  if ((cmd->flags & kWrite) && session->replica != nullptr) {
+    AppendError(out, "READONLY You can't write against a read only replica.");
+    return;
+  }
+  cmd->handler(session, argv, out);
+}
+
+bool GlobMatch(const char* p, size_t plen, const char* s, size_t slen) {
+  while (plen > 0) {
+    switch (*p) {
+      case '*':
+        while (plen > 1 && p[1] == '*') {
+          p++;
+          plen--;
+        }
+        if (plen == 1) return true;
+        for (size_t i = 0; i <= slen; i++) {
+          if (GlobMatch(p + 1, plen - 1, s + i, slen - i)) return true;
+        }
+        return false;
+      case '?':
+        if (slen == 0) return false;
+        s++;
+        slen--;
+        break;
+      case '[': {
+        if (slen == 0) return false;
+        p++;
+        plen--;
+        bool negate = plen > 0 && *p == '^';
+        if (negate) {
+          p++;
+          plen--;
+        }
+        bool match = false;
+        while (plen > 0 && *p != ']') {
+          if (*p == '\\' && plen >= 2) {
+            p++;
+            plen--;
+            if (*p == *s) match = true;
+          } else if (plen >= 3 && p[1] == '-' && p[2] != ']') {
+            unsigned char lo = p[0], hi = p[2], c = *s;
+            if (lo > hi) std::swap(lo, hi);
+            if (c >= lo && c <= hi) match = true;
+            p += 2;
+            plen -= 2;
+          } else if (*p == *s) {
+            match = true;
+          }
+          p++;
+          plen--;
+        }
+        // an unterminated class runs to the end of the pattern
+        if (plen == 0) {
+          p--;
+          plen++;
+        }
+        if (match == negate) return false;
+        s++;
+        slen--;
+        break;
+      }
+      case '\\':
+        if (plen >= 2) {
+          p++;
+          plen--;
+        }
+        // fall through
+      default:
+        if (slen == 0 || *p != *s) return false;
+        s++;
+        slen--;
+        break;
+    }
+    p++;
+    plen--;
+  }
+  return slen == 0;
+}
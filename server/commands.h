@@ -0,0 +1,69 @@
+#pragma once
+
+#include <time.h>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "skiplist_old.hpp"
+
+typedef SkipList<std::string, std::string> Store;
+
+class ReplicationLog;
+class ReplicaClient;
+
+// Counters shared by every connection of a server, reported by INFO.
+struct ServerStats {
+  std::atomic<uint64_t> commands_processed{0};
+  std::atomic<uint64_t> connections_received{0};
+  std::atomic<int64_t> connected_clients{0};
+  time_t start_time = 0;
+  int tcp_port = -1;
+  int io_threads = 0;
+};
+
+// Per connection state of the command layer.
+struct Session {
+  Session(Store* s, ServerStats* st) : store(s), stats(st) {}
+
+  Store* store;
+  ServerStats* stats;
+  // SCAN cursors handed out on this connection -> the key to resume at.
+  // Only the newest kMaxScanCursors are kept.
+  std::map<uint64_t, std::string> cursors;
+  uint64_t next_cursor = 1;
+  // set by QUIT or a protocol error: close once the replies are written
+  bool quit = false;
+  // the file SAVE and BGSAVE write, see ServerOptions::dump_file
+  std::string dump_file = "dump.minikv";
+
+  // the primary's log, PSYNC hands the connection to it
+  ReplicationLog* repl_log = nullptr;
+  // set on a replica, which refuses writes from its clients
+  ReplicaClient* replica = nullptr;
+  // set by PSYNC: once the replies are written the connection leaves the
+  // event loop for repl_log, resuming at psync_replid and psync_offset
+  bool detach = false;
+  std::string psync_replid;
+  long long psync_offset = -1;
+};
+
+static const size_t kMaxScanCursors = 64;
+
+// Run one request and append its reply to *out. argv must not be empty.
+// Supported: GET, SET [EX|PX|KEEPTTL], DEL, INCR, DECR, INCRBY, DECRBY, APPEND,
+// GETSET, EXISTS, EXPIRE, PERSIST, TTL, PTTL, SCAN [MATCH] [COUNT], MGET,
+// MSET, DBSIZE, INFO, SAVE, BGSAVE, PING, ECHO, QUIT, CONFIG GET/SET of
+// maxmemory and maxmemory-policy, PSYNC for replicas, plus a COMMAND stub
+// for redis-cli and redis-benchmark. Writes rejected by the noeviction
+// policy reply with an OOM error, writes to a replica with a READONLY
+// error.
+void ExecuteCommand(Session* session, const std::vector<std::string>& argv,
+                    std::string* out);
+
+// Redis style glob: *, ?, [abc], [^a-z] and \ escapes.
+bool GlobMatch(const char* pattern, size_t plen, const char* str,
+               size_t slen);
@@ -0,0 +1,279 @@
+/**
+ * @file main.cc
+ * @brief minikv-server: serves one store over RESP
+ *
+ * Example:
+ *   ./minikv-server --port=6379 --unix_socket=/tmp/minikv.sock \
+ *                   --io_threads=4 --engine=hashed_skiplist \
+ *                   --compression=lz --block_size=32768 \
+ *                   --maxmemory=1073741824 --maxmemory_policy=allkeys-lru \
+ *                   --value_log_dir=/tmp/vlog --value_log_min_size=4096 \
+ *                   --hot_keys=16 --dir=/tmp --dbfilename=dump.minikv
+ *   redis-cli -p 6379 set k v
+ *
+ * A replica of it, serving reads:
+ *   ./minikv-server --port=6380 --replicaof=127.0.0.1:6379 --dir=/tmp
+ *   ./minikv-server --port=6381 --replicaof=/tmp/minikv.sock --dir=/tmp
+ *
+ * SIGINT / SIGTERM stop the server. Expired keys are reclaimed in the
+ * background every 100ms besides the lazy delete on access.
+ */
+
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "replication.h"
+#include "server.h"
+
+namespace {
+
+ServerOptions options;
+int FLAGS_level = 18;
+int FLAGS_lru_size = 1024;
+std::string FLAGS_engine = "skiplist";
+// load the dump file, dir/dbfilename, on startup
+bool FLAGS_load = false;
+// with --load, serve the dump file from a read-only mapping instead of
+// copying it into the store
+bool FLAGS_mmap = false;
+// codec and block size of the dump file, see base/snapshot.h
+std::string FLAGS_compression = "lz";
+int FLAGS_block_size = 32 << 10;
+// estimated bytes of items before writes evict, 0 for no limit; see
+// base/eviction.hpp for the policies
+long long FLAGS_maxmemory = 0;
+std::string FLAGS_maxmemory_policy = "noeviction";
+// host:port or the unix socket of the primary to replicate, empty to be a
+// primary
+std::string FLAGS_replicaof;
+// bytes of the write stream kept for replicas that reconnect
+long long FLAGS_repl_backlog_size = 1 << 20;
+// directory of the files the server writes: the dump file of SAVE,
+// BGSAVE and --load, and the snapshots of full resyncs, sent by a
+// primary or received by a replica
+std::string FLAGS_dir = ".";
+std::string FLAGS_dbfilename = "dump.minikv";
+// keep values of at least value_log_min_size bytes in a value log under
+// this directory, empty to keep every value in memory; see
+// base/value_log.h
+std::string FLAGS_value_log_dir;
+long long FLAGS_value_log_min_size = 4 << 10;
+// report the most read and written keys in INFO hotkeys, counting one in
+// hot_keys_sample_rate commands; 0 keys turns it off
+int FLAGS_hot_keys = 0;
+int FLAGS_hot_keys_sample_rate = 16;
+
+volatile sig_atomic_t stop_requested = 0;
+
+void OnSignal(int) { stop_requested = 1; }
+
+// --name=value
+bool ParseFlag(const char* arg, const char* name, std::string* value) {
+  size_t n = strlen(name);
+  if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, n) != 0 ||
+      arg[2 + n] != '=') {
+    return false;
+  }
+  *value = arg + 3 + n;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  for (int i = 1; i < argc; i++) {
+    std::string v;
+    if (ParseFlag(argv[i], "bind", &v)) {
+      options.bind = v;
+    } else if (ParseFlag(argv[i], "port", &v)) {
+      options.port = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "unix_socket", &v)) {
+      options.unix_socket = v;
+    } else if (ParseFlag(argv[i], "io_threads", &v)) {
+      options.io_threads = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "level", &v)) {
+      FLAGS_level = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "lru_size", &v)) {
+      FLAGS_lru_size = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "engine", &v)) {
+      FLAGS_engine = v;
+    } else if (ParseFlag(argv[i], "load", &v)) {
+      FLAGS_load = atoi(v.c_str()) != 0;
+    } else if (ParseFlag(argv[i], "mmap", &v)) {
+      FLAGS_mmap = atoi(v.c_str()) != 0;
+    } else if (ParseFlag(argv[i], "compression", &v)) {
+      FLAGS_compression = v;
+    } else if (ParseFlag(argv[i], "block_size", &v)) {
+      FLAGS_block_size = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "maxmemory", &v)) {
+      FLAGS_maxmemory = atoll(v.c_str());
+    } else if (ParseFlag(argv[i], "maxmemory_policy", &v)) {
+      FLAGS_maxmemory_policy = v;
+    } else if (ParseFlag(argv[i], "replicaof", &v)) {
+      FLAGS_replicaof = v;
+    } else if (ParseFlag(argv[i], "repl_backlog_size", &v)) {
+      FLAGS_repl_backlog_size = atoll(v.c_str());
+    } else if (ParseFlag(argv[i], "dir", &v)) {
+      FLAGS_dir = v;
+    } else if (ParseFlag(argv[i], "dbfilename", &v)) {
+      FLAGS_dbfilename = v;
+    } else if (ParseFlag(argv[i], "value_log_dir", &v)) {
+      FLAGS_value_log_dir = v;
+    } else if (ParseFlag(argv[i], "value_log_min_size", &v)) {
+      FLAGS_value_log_min_size = atoll(v.c_str());
+    } else if (ParseFlag(argv[i], "hot_keys", &v)) {
+      FLAGS_hot_keys = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "hot_keys_sample_rate", &v)) {
+      FLAGS_hot_keys_sample_rate = atoi(v.c_str());
+    } else {
+      fprintf(stderr, "invalid flag '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+  IndexEngine engine;
+  if (!ParseIndexEngine(FLAGS_engine, &engine)) {
+    fprintf(stderr, "unknown engine '%s'\n", FLAGS_engine.c_str());
+    return 1;
+  }
+
+  SnapshotOptions snapshot;
+  if (!ParseCompressionType(FLAGS_compression, &snapshot.compression)) {
+    fprintf(stderr, "unknown compression '%s'\n", FLAGS_compression.c_str());
+    return 1;
+  }
+  if (FLAGS_block_size <= 0) {
+    fprintf(stderr, "invalid block_size %d\n", FLAGS_block_size);
+    return 1;
+  }
+  snapshot.block_size = FLAGS_block_size;
+
+  EvictionPolicy policy;
+  if (!ParseEvictionPolicy(FLAGS_maxmemory_policy, &policy)) {
+    fprintf(stderr, "unknown maxmemory_policy '%s'\n",
+            FLAGS_maxmemory_policy.c_str());
+    return 1;
+  }
+  if (FLAGS_maxmemory < 0) {
+    fprintf(stderr, "invalid maxmemory %lld\n", FLAGS_maxmemory);
+    return 1;
+  }
+  if (FLAGS_repl_backlog_size <= 0) {
+    fprintf(stderr, "invalid repl_backlog_size %lld\n",
+            FLAGS_repl_backlog_size);
+    return 1;
+  }
+  if (FLAGS_value_log_min_size <= 0) {
+    fprintf(stderr, "invalid value_log_min_size %lld\n",
+            FLAGS_value_log_min_size);
+    return 1;
+  }
+  if (FLAGS_hot_keys < 0 || FLAGS_hot_keys_sample_rate <= 0) {
+    fprintf(stderr, "invalid hot_keys %d or hot_keys_sample_rate %d\n",
+            FLAGS_hot_keys, FLAGS_hot_keys_sample_rate);
+    return 1;
+  }
+  struct stat st;
+  if (stat(FLAGS_dir.c_str(), &st) != 0) {
+    fprintf(stderr, "invalid dir '%s': %s\n", FLAGS_dir.c_str(),
+            strerror(errno));
+    return 1;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    fprintf(stderr, "invalid dir '%s': not a directory\n", FLAGS_dir.c_str());
+    return 1;
+  }
+  if (FLAGS_dbfilename.empty() ||
+      FLAGS_dbfilename.find('/') != std::string::npos) {
+    fprintf(stderr, "invalid dbfilename '%s'\n", FLAGS_dbfilename.c_str());
+    return 1;
+  }
+  const std::string dump_file = FLAGS_dir + "/" + FLAGS_dbfilename;
+  options.dump_file = dump_file;
+  ReplicaOptions replica_options;
+  replica_options.sync_file = FLAGS_dir + "/replica.sync";
+  if (!FLAGS_replicaof.empty()) {
+    size_t colon = FLAGS_replicaof.rfind(':');
+    if (colon != std::string::npos && FLAGS_replicaof[0] != '/') {
+      replica_options.host = FLAGS_replicaof.substr(0, colon);
+      replica_options.port = atoi(FLAGS_replicaof.c_str() + colon + 1);
+    } else {
+      replica_options.unix_socket = FLAGS_replicaof;
+    }
+  }
+
+  Store store(FLAGS_level, FLAGS_lru_size, engine);
+  store.setSnapshotOptions(snapshot);
+  store.setHotKeys(FLAGS_hot_keys, FLAGS_hot_keys_sample_rate);
+  // before loading, so the large values of the dump go to the log
+  if (!FLAGS_value_log_dir.empty()) {
+    ValueLogOptions vlog;
+    vlog.min_value_size = static_cast<size_t>(FLAGS_value_log_min_size);
+    std::string error;
+    if (!store.openValueLog(FLAGS_value_log_dir, vlog, &error)) {
+      fprintf(stderr, "minikv-server: %s\n", error.c_str());
+      return 1;
+    }
+  }
+  if (FLAGS_load && FLAGS_mmap) {
+    std::string error;
+    if (!store.openSnapshot(dump_file, &error)) {
+      fprintf(stderr, "minikv-server: %s\n", error.c_str());
+      return 1;
+    }
+  } else if (FLAGS_load) {
+    store.loadFile(dump_file);
+  }
+  // after loading, so the splice path stays available and the loaded items
+  // are charged in one pass
+  store.setMaxMemory(static_cast<size_t>(FLAGS_maxmemory), policy);
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+
+  // a replica takes its items from the primary, a primary logs its writes
+  // for replicas that attach
+  ReplicationOptions repl_options;
+  repl_options.backlog_size = static_cast<size_t>(FLAGS_repl_backlog_size);
+  repl_options.sync_file = FLAGS_dir + "/replsync";
+  ReplicationLog repl_log(repl_options, &store);
+  ReplicaClient replica(replica_options, &store);
+  Server server(options, &store);
+  if (FLAGS_replicaof.empty()) {
+    store.setWriteListener(&repl_log);
+    server.set_replication_log(&repl_log);
+  } else {
+    server.set_replica(&replica);
+  }
+  std::string error;
+  if (!server.Start(&error)) {
+    fprintf(stderr, "minikv-server: %s\n", error.c_str());
+    return 1;
+  }
+  if (!FLAGS_replicaof.empty()) replica.Start();
+  if (server.port() >= 0) {
+    printf("minikv-server listening on %s:%d\n", options.bind.c_str(),
+           server.port());
+  }
+  if (!options.unix_socket.empty()) {
+    printf("minikv-server listening on %s\n", options.unix_socket.c_str());
+  }
+  fflush(stdout);
+
+  while (!stop_requested) {
+    usleep(100 * 1000);
+    store.cycle_del();
+  }
+  server.Stop();
+  replica.Stop();
+  repl_log.Stop();
+  store.setWriteListener(nullptr);
+  return 0;
+}
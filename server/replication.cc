@@ -0,0 +1,575 @@
+#include "replication.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <random>
+#include <sstream>
+
+#include "client.h"
+#include "resp.h"
+
+namespace {
+
+// bytes a feeder copies out of the backlog per send
+const size_t kSendChunk = 256 << 10;
+// bytes a replica reads per read() call
+const size_t kReadChunk = 64 << 10;
+// a replica retries after this many ms, doubled per failed attempt
+const int kRetryMinMs = 100;
+const int kRetryMaxMs = 5000;
+
+// tells apart the sync files of replicas in one process
+uint64_t NextReplicaId() {
+  static std::atomic<uint64_t> next(0);
+  return next++;
+}
+
+std::string NewReplid() {
+  static const char kHex[] = "0123456789abcdef";
+  std::random_device rd;
+  std::mt19937_64 rnd((uint64_t(rd()) << 32) ^ rd() ^
+                      uint64_t(time(nullptr)) ^ uint64_t(getpid()));
+  std::string id(40, '0');
+  for (char& c : id) c = kHex[rnd() & 15];
+  return id;
+}
+
+// one command of the stream, as a client would send it
+void Encode(const char* name, const std::string& key, const std::string* arg,
+            std::string* out) {
+  out->clear();
+  AppendArrayHeader(out, arg != nullptr ? 3 : 2);
+  AppendBulk(out, name);
+  AppendBulk(out, key);
+  if (arg != nullptr) AppendBulk(out, *arg);
+}
+
+// SET of the stream: KEEPTTL for seconds < 0, no option for 0, else EX
+void EncodeSet(const std::string& key, const std::string& value, int seconds,
+               std::string* out) {
+  out->clear();
+  AppendArrayHeader(out, seconds < 0 ? 4 : seconds == 0 ? 3 : 5);
+  AppendBulk(out, "SET");
+  AppendBulk(out, key);
+  AppendBulk(out, value);
+  if (seconds < 0) {
+    AppendBulk(out, "KEEPTTL");
+  } else if (seconds > 0) {
+    AppendBulk(out, "EX");
+    AppendBulk(out, std::to_string(seconds));
+  }
+}
+
+bool SendAll(int fd, const char* p, size_t n) {
+  while (n > 0) {
+    ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p += w;
+    n -= w;
+  }
+  return true;
+}
+
+bool SendAll(int fd, const std::string& s) {
+  return SendAll(fd, s.data(), s.size());
+}
+
+bool SendFile(int fd, int file, uint64_t size) {
+  off_t off = 0;
+  while (uint64_t(off) < size) {
+    ssize_t w = sendfile(fd, file, &off, size - off);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return false;
+  }
+  return true;
+}
+
+bool WriteAll(int fd, const char* p, size_t n) {
+  while (n > 0) {
+    ssize_t w = write(fd, p, n);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p += w;
+    n -= w;
+  }
+  return true;
+}
+
+// a replica never writes to the stream, so anything to read means it
+// closed the connection
+bool PeerClosed(int fd) {
+  struct pollfd p;
+  p.fd = fd;
+  p.events = POLLIN | POLLRDHUP;
+  p.revents = 0;
+  return poll(&p, 1, 0) > 0;
+}
+
+}  // namespace
+
+ReplicationLog::ReplicationLog(const ReplicationOptions& options,
+                               Store* store)
+    : options_(options),
+      store_(store),
+      replid_(NewReplid()),
+      active_(false),
+      sync_seq_(0),
+      full_syncs_(0),
+      partial_syncs_(0),
+      ring_(options.backlog_size > 0 ? options.backlog_size : 1, '\0'),
+      offset_(0),
+      stop_(false) {}
+
+ReplicationLog::~ReplicationLog() { Stop(); }
+
+void ReplicationLog::OnInsert(const std::string& k, const std::string& v) {
+  if (!active_.load(std::memory_order_relaxed)) return;
+  EncodeSet(k, v, -1, &scratch_);
+  std::lock_guard<std::mutex> lock(mu_);
+  Append(scratch_);
+}
+
+void ReplicationLog::OnSet(const std::string& k, const std::string& v,
+                           int seconds) {
+  if (!active_.load(std::memory_order_relaxed)) return;
+  EncodeSet(k, v, seconds, &scratch_);
+  std::lock_guard<std::mutex> lock(mu_);
+  Append(scratch_);
+}
+
+void ReplicationLog::OnRemove(const std::string& k) {
+  if (!active_.load(std::memory_order_relaxed)) return;
+  Encode("DEL", k, nullptr, &scratch_);
+  std::lock_guard<std::mutex> lock(mu_);
+  Append(scratch_);
+}
+
+void ReplicationLog::OnExpire(const std::string& k, int seconds) {
+  if (!active_.load(std::memory_order_relaxed)) return;
+  const std::string s = std::to_string(seconds);
+  Encode("EXPIRE", k, &s, &scratch_);
+  std::lock_guard<std::mutex> lock(mu_);
+  Append(scratch_);
+}
+
+void ReplicationLog::OnPersist(const std::string& k) {
+  if (!active_.load(std::memory_order_relaxed)) return;
+  Encode("PERSIST", k, nullptr, &scratch_);
+  std::lock_guard<std::mutex> lock(mu_);
+  Append(scratch_);
+}
+
+void ReplicationLog::AddReplica(int fd, const std::string& replid,
+                                long long offset) {
+  Reap();
+  std::lock_guard<std::mutex> lock(replicas_mu_);
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    if (stop_) {
+      close(fd);
+      return;
+    }
+  }
+  replicas_.emplace_back(new Replica());
+  Replica* r = replicas_.back().get();
+  r->fd = fd;
+  r->thread = std::thread(&ReplicationLog::Feed, this, r, replid, offset);
+}
+
+void ReplicationLog::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  std::lock_guard<std::mutex> lock(replicas_mu_);
+  // wakes feeders blocked in send
+  for (auto& r : replicas_) shutdown(r->fd, SHUT_RDWR);
+  for (auto& r : replicas_) {
+    r->thread.join();
+    close(r->fd);
+  }
+  replicas_.clear();
+}
+
+uint64_t ReplicationLog::offset() {
+  std::lock_guard<std::mutex> lock(mu_);
+  return offset_;
+}
+
+uint64_t ReplicationLog::backlog_first_offset() {
+  std::lock_guard<std::mutex> lock(mu_);
+  return FirstOffset();
+}
+
+int ReplicationLog::num_replicas() {
+  std::lock_guard<std::mutex> lock(replicas_mu_);
+  int n = 0;
+  for (auto& r : replicas_) n += r->done.load() ? 0 : 1;
+  return n;
+}
+
+void ReplicationLog::Feed(Replica* r, std::string replid, long long offset) {
+  const int fd = r->fd;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  uint64_t pos = 0;
+  bool partial;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    partial = active_ && replid == replid_ && offset >= 0 &&
+              uint64_t(offset) >= FirstOffset() && uint64_t(offset) <= offset_;
+  }
+  bool ok;
+  if (partial) {
+    pos = offset;
+    ok = SendAll(fd, "+CONTINUE\r\n");
+    partial_syncs_++;
+  } else {
+    ok = FullSync(fd, &pos);
+  }
+  std::string buf;
+  while (ok) {
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      if (!stop_ && offset_ == pos) {
+        cv_.wait_for(lock, std::chrono::milliseconds(100));
+      }
+      // a replica that fell behind the backlog has to resync
+      if (stop_ || pos < FirstOffset()) break;
+      Copy(pos, kSendChunk, &buf);
+    }
+    if (buf.empty()) {
+      ok = !PeerClosed(fd);
+    } else {
+      ok = SendAll(fd, buf);
+      pos += buf.size();
+    }
+  }
+  shutdown(fd, SHUT_RDWR);
+  r->done = true;
+}
+
+bool ReplicationLog::FullSync(int fd, uint64_t* pos) {
+  const std::string path = options_.sync_file + "." +
+                           std::to_string(getpid()) + "." +
+                           std::to_string(sync_seq_++);
+  std::promise<bool> done;
+  std::future<bool> dumped = done.get_future();
+  uint64_t start = 0;
+  int failures = 0;
+  std::string error;
+  while (!store_->bgDumpFile(
+      path, [&done](bool ok) { done.set_value(ok); },
+      [this, &start](const std::vector<std::pair<std::string, int>>& ttls) {
+        start = Cut(ttls);
+      },
+      &error)) {
+    // wait for a running BGSAVE, give up if the file cannot be written
+    std::string in_progress;
+    store_->getProperty("minikv.dump-in-progress", &in_progress);
+    if (in_progress != "1" && ++failures > 1) {
+      fprintf(stderr, "replication: full resync dump failed: %s\n",
+              error.c_str());
+      return false;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (stop_) return false;
+    }
+    usleep(10000);
+  }
+  if (!dumped.get()) {
+    fprintf(stderr, "replication: full resync dump to %s failed\n",
+            path.c_str());
+    return false;
+  }
+
+  int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  // the open fd keeps the data
+  unlink(path.c_str());
+  if (file < 0) {
+    fprintf(stderr, "replication: %s: %s\n", path.c_str(), strerror(errno));
+    return false;
+  }
+  struct stat st;
+  bool ok = fstat(file, &st) == 0;
+  if (ok) {
+    std::string header = "+FULLRESYNC " + replid_ + " " +
+                         std::to_string(start) + "\r\n$" +
+                         std::to_string(st.st_size) + "\r\n";
+    ok = SendAll(fd, header) && SendFile(fd, file, st.st_size) &&
+         SendAll(fd, "\r\n");
+  }
+  close(file);
+  full_syncs_++;
+  *pos = start;
+  return ok;
+}
+
+uint64_t ReplicationLog::Cut(
+    const std::vector<std::pair<std::string, int>>& ttls) {
+  std::lock_guard<std::mutex> lock(mu_);
+  active_ = true;
+  const uint64_t start = offset_;
+  // the dump has no ttls, the stream from start sets them again. Replicas
+  // already in sync get them once more, which does no harm.
+  for (auto& t : ttls) {
+    const std::string s = std::to_string(t.second);
+    Encode("EXPIRE", t.first, &s, &scratch_);
+    Append(scratch_);
+  }
+  return start;
+}
+
+void ReplicationLog::Reap() {
+  std::lock_guard<std::mutex> lock(replicas_mu_);
+  for (auto it = replicas_.begin(); it != replicas_.end();) {
+    if ((*it)->done.load()) {
+      (*it)->thread.join();
+      close((*it)->fd);
+      it = replicas_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void ReplicationLog::Append(const std::string& command) {
+  const size_t size = ring_.size();
+  const char* p = command.data();
+  size_t n = command.size();
+  if (n > size) {
+    offset_ += n - size;
+    p += n - size;
+    n = size;
+  }
+  const size_t at = offset_ % size;
+  const size_t first = std::min(n, size - at);
+  memcpy(&ring_[at], p, first);
+  memcpy(&ring_[0], p + first, n - first);
+  offset_ += n;
+  cv_.notify_all();
+}
+
+uint64_t ReplicationLog::FirstOffset() const {
+  return offset_ > ring_.size() ? offset_ - ring_.size() : 0;
+}
+
+void ReplicationLog::Copy(uint64_t from, size_t max,
+                          std::string* out) const {
+  const size_t size = ring_.size();
+  const size_t n = std::min<uint64_t>(offset_ - from, max);
+  const size_t at = from % size;
+  const size_t first = std::min(n, size - at);
+  out->assign(ring_.data() + at, first);
+  out->append(ring_.data(), n - first);
+}
+
+ReplicaClient::ReplicaClient(const ReplicaOptions& options, Store* store)
+    : options_(options),
+      sync_file_(options.sync_file + "." + std::to_string(getpid()) + "." +
+                 std::to_string(NextReplicaId())),
+      store_(store),
+      master_(store, &stats_),
+      stop_(false),
+      link_up_(false),
+      offset_(0),
+      full_syncs_(0),
+      partial_syncs_(0),
+      replid_("?"),
+      in_pos_(0) {}
+
+ReplicaClient::~ReplicaClient() { Stop(); }
+
+void ReplicaClient::Start() {
+  if (thread_.joinable()) return;
+  stop_ = false;
+  thread_ = std::thread(&ReplicaClient::Run, this);
+}
+
+void ReplicaClient::Stop() {
+  stop_ = true;
+  if (thread_.joinable()) thread_.join();
+}
+
+std::string ReplicaClient::replid() {
+  std::lock_guard<std::mutex> lock(mu_);
+  return replid_;
+}
+
+void ReplicaClient::Run() {
+  int delay = kRetryMinMs;
+  while (!stop_) {
+    int fd = Connect();
+    bool synced = false;
+    if (fd >= 0) {
+      Sync(fd);
+      synced = link_up_;
+      link_up_ = false;
+      close(fd);
+    }
+    delay = synced ? kRetryMinMs : std::min(2 * delay, kRetryMaxMs);
+    for (int i = 0; i < delay / 10 && !stop_; i++) usleep(10000);
+  }
+}
+
+int ReplicaClient::Connect() {
+  RespClient client;
+  std::string error;
+  bool ok = options_.unix_socket.empty()
+                ? client.ConnectTcp(options_.host, options_.port, &error)
+                : client.ConnectUnix(options_.unix_socket, &error);
+  if (!ok) return -1;
+  int fd = client.Release();
+  // reads give up now and then to look at stop_
+  struct timeval tv;
+  tv.tv_sec = 0;
+  tv.tv_usec = 100 * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  return fd;
+}
+
+void ReplicaClient::Sync(int fd) {
+  in_.clear();
+  in_pos_ = 0;
+  const std::string id = replid();
+  std::string request;
+  AppendRequest(&request, {"PSYNC", id,
+                           id == "?" ? "-1" : std::to_string(offset_.load())});
+  if (!SendAll(fd, request)) return;
+
+  std::string line;
+  if (!ReadLine(fd, &line)) return;
+  if (line.compare(0, 12, "+FULLRESYNC ") == 0) {
+    std::istringstream is(line.substr(12));
+    std::string new_id;
+    uint64_t start;
+    std::string bulk;
+    if (!(is >> new_id >> start) || !ReadLine(fd, &bulk) || bulk.empty() ||
+        bulk[0] != '$') {
+      return;
+    }
+    if (!ReceiveSnapshot(fd, strtoull(bulk.c_str() + 1, nullptr, 10)) ||
+        !ReadLine(fd, &line) || !line.empty()) {
+      unlink(sync_file_.c_str());
+      return;
+    }
+    store_->clear();
+    store_->loadFile(sync_file_);
+    unlink(sync_file_.c_str());
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      replid_ = new_id;
+    }
+    offset_ = start;
+    full_syncs_++;
+  } else if (line == "+CONTINUE") {
+    partial_syncs_++;
+  } else {
+    return;
+  }
+  link_up_ = true;
+
+  std::vector<std::string> argv;
+  std::string reply, error;
+  while (true) {
+    size_t consumed;
+    RespStatus s = ParseRequest(in_.data() + in_pos_, in_.size() - in_pos_,
+                                &argv, &consumed, &error);
+    if (s == RESP_ERROR) return;
+    if (s == RESP_INCOMPLETE) {
+      if (!Fill(fd)) return;
+      continue;
+    }
+    in_pos_ += consumed;
+    if (!argv.empty()) {
+      reply.clear();
+      ExecuteCommand(&master_, argv, &reply);
+    }
+    offset_ += consumed;
+  }
+}
+
+bool ReplicaClient::Fill(int fd) {
+  if (in_pos_ == in_.size()) {
+    in_.clear();
+    in_pos_ = 0;
+  } else if (in_pos_ > in_.size() / 2) {
+    in_.erase(0, in_pos_);
+    in_pos_ = 0;
+  }
+  while (!stop_) {
+    size_t old = in_.size();
+    in_.resize(old + kReadChunk);
+    ssize_t r = read(fd, &in_[old], kReadChunk);
+    in_.resize(old + (r > 0 ? r : 0));
+    if (r > 0) return true;
+    if (r == 0) return false;
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      return false;
+    }
+  }
+  return false;
+}
+
+bool ReplicaClient::ReadLine(int fd, std::string* line) {
+  size_t from = in_pos_;
+  while (true) {
+    size_t end = in_.find("\r\n", from);
+    if (end != std::string::npos) {
+      line->assign(in_, in_pos_, end - in_pos_);
+      in_pos_ = end + 2;
+      return true;
+    }
+    // Fill may move the unread bytes to the front
+    from = in_.size() - in_pos_;
+    if (from > 0) from--;
+    if (!Fill(fd)) return false;
+    from += in_pos_;
+  }
+}
+
+bool ReplicaClient::ReceiveSnapshot(int fd, uint64_t size) {
+  int file = open(sync_file_.c_str(),
+                  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (file < 0) {
+    fprintf(stderr, "replica: %s: %s\n", sync_file_.c_str(), strerror(errno));
+    return false;
+  }
+  uint64_t left = size;
+  bool ok = true;
+  while (ok && left > 0) {
+    if (in_pos_ == in_.size() && !Fill(fd)) {
+      ok = false;
+      break;
+    }
+    size_t n = std::min<uint64_t>(left, in_.size() - in_pos_);
+    ok = WriteAll(file, in_.data() + in_pos_, n);
+    if (!ok) {
+      fprintf(stderr, "replica: %s: %s\n", sync_file_.c_str(),
+              strerror(errno));
+    }
+    in_pos_ += n;
+    left -= n;
+  }
+  close(file);
+  return ok;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "commands.h"
+
+struct ReplicationOptions {
+  // bytes of the write stream kept for replicas that reconnect
+  size_t backlog_size = 1 << 20;
+  // full resyncs dump the store to files with this prefix, followed by
+  // the pid and a sequence number
+  std::string sync_file = "replsync";
+};
+
+// Primary side of replication, in the manner of redis. As the store's
+// write listener it encodes every mutation as a RESP command (SET, DEL,
+// EXPIRE, PERSIST) into a ring buffer, the backlog; a byte's offset is its
+// position in the whole stream. A replica sends PSYNC <replid> <offset>:
+// if it follows this log and the backlog still holds its offset the
+// stream resumes there (+CONTINUE), otherwise the store is dumped and the
+// replica gets +FULLRESYNC <replid> <offset>, the snapshot as one bulk
+// string, then the stream from that offset on. Each replica is fed by a
+// thread of its own; one that falls further behind than the backlog is
+// dropped and resyncs.
+//
+// Nothing is logged before the first replica attaches. Keys expire on the
+// replicas by the replicated ttl, and the primary's own expirations and
+// evictions are replicated as DEL.
+class ReplicationLog : public WriteListener<std::string, std::string> {
+ public:
+  ReplicationLog(const ReplicationOptions& options, Store* store);
+  ~ReplicationLog() override;
+
+  ReplicationLog(const ReplicationLog&) = delete;
+  ReplicationLog& operator=(const ReplicationLog&) = delete;
+
+  void OnInsert(const std::string& k, const std::string& v) override;
+  void OnSet(const std::string& k, const std::string& v,
+             int seconds) override;
+  void OnRemove(const std::string& k) override;
+  void OnExpire(const std::string& k, int seconds) override;
+  void OnPersist(const std::string& k) override;
+
+  // take over fd, a connection that sent PSYNC replid offset; the reply
+  // and the stream are written by a new feeder thread
+  void AddReplica(int fd, const std::string& replid, long long offset);
+  // disconnect every replica and join the feeders
+  void Stop();
+
+  // 40 hex digits, new for every log
+  const std::string& replid() const { return replid_; }
+  // bytes logged so far
+  uint64_t offset();
+  // the oldest offset a replica can resume at
+  uint64_t backlog_first_offset();
+  size_t backlog_size() const { return ring_.size(); }
+  int num_replicas();
+  uint64_t full_syncs() const { return full_syncs_.load(); }
+  uint64_t partial_syncs() const { return partial_syncs_.load(); }
+
+ private:
+  struct Replica {
+    int fd;
+    std::thread thread;
+    std::atomic<bool> done{false};
+  };
+
+  void Feed(Replica* r, std::string replid, long long offset);
+  // dump the store and send it, *pos is the offset the stream goes on at
+  bool FullSync(int fd, uint64_t* pos);
+  // under the store lock, see Store::DumpCut
+  uint64_t Cut(const std::vector<std::pair<std::string, int>>& ttls);
+  // join the feeders of replicas that are gone
+  void Reap();
+
+  // the helpers below expect the caller to hold mu_
+  void Append(const std::string& command);
+  uint64_t FirstOffset() const;
+  // up to max bytes of the stream from offset from
+  void Copy(uint64_t from, size_t max, std::string* out) const;
+
+  const ReplicationOptions options_;
+  Store* const store_;
+  const std::string replid_;
+  // set by the first full resync, written under the store lock
+  std::atomic<bool> active_;
+  std::atomic<uint64_t> sync_seq_;
+  std::atomic<uint64_t> full_syncs_;
+  std::atomic<uint64_t> partial_syncs_;
+  // encoding scratch, only used under the store lock
+  std::string scratch_;
+
+  std::mutex mu_;
+  // feeders wait here for new bytes
+  std::condition_variable cv_;
+  std::string ring_;
+  uint64_t offset_;
+  bool stop_;
+
+  // guarded by replicas_mu_
+  std::mutex replicas_mu_;
+  std::list<std::unique_ptr<Replica>> replicas_;
+};
+
+struct ReplicaOptions {
+  // the primary: a unix socket path, else a TCP host and port
+  std::string unix_socket;
+  std::string host = "127.0.0.1";
+  int port = 6379;
+  // the snapshot of a full resync is received into a file with this
+  // prefix, followed by the pid and a sequence number so that replicas
+  // sharing a directory do not overwrite each other's
+  std::string sync_file = "replica.sync";
+};
+
+// Replica side: keeps a connection to the primary, loads the snapshot of
+// a full resync into the store (cleared first) and replays the stream
+// after it. On a broken link it reconnects after 100ms and asks to resume
+// at the offset it reached; while attempts keep failing the delay doubles
+// up to 5s, so a replica that cannot sync does not make the primary dump
+// ten times a second. The server of a replica refuses writes from its
+// clients, see Session::replica.
+class ReplicaClient {
+ public:
+  ReplicaClient(const ReplicaOptions& options, Store* store);
+  ~ReplicaClient();
+
+  ReplicaClient(const ReplicaClient&) = delete;
+  ReplicaClient& operator=(const ReplicaClient&) = delete;
+
+  void Start();
+  // close the link; the replid and offset are kept for the next Start()
+  void Stop();
+
+  const ReplicaOptions& options() const { return options_; }
+  bool link_up() const { return link_up_.load(); }
+  std::string replid();
+  // bytes of the primary's stream applied so far
+  uint64_t offset() const { return offset_.load(); }
+  uint64_t full_syncs() const { return full_syncs_.load(); }
+  uint64_t partial_syncs() const { return partial_syncs_.load(); }
+
+ private:
+  void Run();
+  int Connect();
+  // PSYNC, then apply the stream until the link breaks or Stop()
+  void Sync(int fd);
+  // read more into in_; false on a closed link, an error or Stop()
+  bool Fill(int fd);
+  // the next "\r\n" terminated line, without it
+  bool ReadLine(int fd, std::string* line);
+  bool ReceiveSnapshot(int fd, uint64_t size);
+
+  const ReplicaOptions options_;
+  // options_.sync_file made unique
+  const std::string sync_file_;
+  Store* const store_;
+  // the stream is applied through the command layer, like a client
+  ServerStats stats_;
+  Session master_;
+
+  std::thread thread_;
+  std::atomic<bool> stop_;
+  std::atomic<bool> link_up_;
+  std::atomic<uint64_t> offset_;
+  std::atomic<uint64_t> full_syncs_;
+  std::atomic<uint64_t> partial_syncs_;
+  // "?" until the first full resync
+  std::mutex mu_;
+  std::string replid_;
+
+  // unparsed input is in_[in_pos_, in_.size())
+  std::string in_;
+  size_t in_pos_;
+};
@@ -0,0 +1,233 @@
+#include "resp.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// RESP nests arrays only in replies; deeper nesting is treated as garbage
+const int kMaxReplyDepth = 16;
+
+// The '\r' of the first "\r\n" in [p, end). *incomplete is set when the
+// line is not terminated yet.
+const char* FindLineEnd(const char* p, const char* end, bool* incomplete) {
+  const char* cr = static_cast<const char*>(memchr(p, '\r', end - p));
+  *incomplete = cr == nullptr || cr + 1 == end;
+  if (*incomplete) return nullptr;
+  return cr;
+}
+
+// strict decimal, optional leading '-'
+bool ParseLong(const char* p, const char* end, long long* v) {
+  if (p == end) return false;
+  bool neg = *p == '-';
+  if (neg && ++p == end) return false;
+  long long r = 0;
+  for (; p < end; p++) {
+    if (*p < '0' || *p > '9') return false;
+    if (r > (1ll << 62) / 10) return false;
+    r = r * 10 + (*p - '0');
+  }
+  *v = neg ? -r : r;
+  return true;
+}
+
+// "<prefix><integer>\r\n" at p; *next is set past the line
+RespStatus ParseHeader(const char* p, const char* end, char prefix,
+                       long long* v, const char** next) {
+  if (p == end) return RESP_INCOMPLETE;
+  if (*p != prefix) return RESP_ERROR;
+  bool incomplete;
+  const char* cr = FindLineEnd(p, end, &incomplete);
+  if (incomplete) {
+    // a length line is a handful of digits, more means garbage
+    return end - p > 32 ? RESP_ERROR : RESP_INCOMPLETE;
+  }
+  if (cr[1] != '\n' || !ParseLong(p + 1, cr, v)) return RESP_ERROR;
+  *next = cr + 2;
+  return RESP_OK;
+}
+
+RespStatus ParseInline(const char* buf, size_t n,
+                       std::vector<std::string>* argv, size_t* consumed,
+                       std::string* error) {
+  const char* nl = static_cast<const char*>(memchr(buf, '\n', n));
+  if (nl == nullptr) {
+    if (n > kRespMaxInlineLength) {
+      *error = "Protocol error: too big inline request";
+      return RESP_ERROR;
+    }
+    return RESP_INCOMPLETE;
+  }
+  const char* end = nl;
+  if (end > buf && end[-1] == '\r') end--;
+  const char* p = buf;
+  while (p < end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    const char* start = p;
+    while (p < end && *p != ' ' && *p != '\t') p++;
+    if (p > start) argv->emplace_back(start, p - start);
+  }
+  *consumed = nl + 1 - buf;
+  return RESP_OK;
+}
+
+RespStatus ParseReplyAt(const char* p, const char* end, RespValue* value,
+                        const char** next, int depth) {
+  if (p == end) return RESP_INCOMPLETE;
+  if (depth > kMaxReplyDepth) return RESP_ERROR;
+  char type = *p;
+  if (type == '+' || type == '-') {
+    bool incomplete;
+    const char* cr = FindLineEnd(p, end, &incomplete);
+    if (incomplete) return RESP_INCOMPLETE;
+    if (cr[1] != '\n') return RESP_ERROR;
+    value->type = type == '+' ? RespValue::kSimpleString : RespValue::kError;
+    value->str.assign(p + 1, cr - p - 1);
+    *next = cr + 2;
+    return RESP_OK;
+  }
+
+  long long v;
+  const char* body;
+  RespStatus s = ParseHeader(p, end, type, &v, &body);
+  if (s != RESP_OK) return s;
+  switch (type) {
+    case ':':
+      value->type = RespValue::kInteger;
+      value->integer = v;
+      *next = body;
+      return RESP_OK;
+    case '$':
+      if (v < 0) {
+        value->type = RespValue::kNil;
+        *next = body;
+        return RESP_OK;
+      }
+      if (end - body < v + 2) return RESP_INCOMPLETE;
+      if (body[v] != '\r' || body[v + 1] != '\n') return RESP_ERROR;
+      value->type = RespValue::kBulk;
+      value->str.assign(body, v);
+      *next = body + v + 2;
+      return RESP_OK;
+    case '*':
+      if (v < 0) {
+        value->type = RespValue::kNil;
+        *next = body;
+        return RESP_OK;
+      }
+      value->type = RespValue::kArray;
+      value->elements.clear();
+      for (long long i = 0; i < v; i++) {
+        value->elements.emplace_back();
+        s = ParseReplyAt(body, end, &value->elements.back(), &body,
+                         depth + 1);
+        if (s != RESP_OK) return s;
+      }
+      *next = body;
+      return RESP_OK;
+    default:
+      return RESP_ERROR;
+  }
+}
+
+void AppendLength(std::string* out, char prefix, long long n) {
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%c%lld\r\n", prefix, n);
+  out->append(buf, len);
+}
+
+}  // namespace
+
+RespStatus ParseRequest(const char* buf, size_t n,
+                        std::vector<std::string>* argv, size_t* consumed,
+                        std::string* error) {
+  argv->clear();
+  if (n == 0) return RESP_INCOMPLETE;
+  if (buf[0] != '*') return ParseInline(buf, n, argv, consumed, error);
+
+  const char* end = buf + n;
+  const char* p;
+  long long count;
+  RespStatus s = ParseHeader(buf, end, '*', &count, &p);
+  if (s == RESP_ERROR) *error = "Protocol error: invalid multibulk length";
+  if (s != RESP_OK) return s;
+  if (count > static_cast<long long>(kRespMaxArgs)) {
+    *error = "Protocol error: invalid multibulk length";
+    return RESP_ERROR;
+  }
+
+  // check that the whole request is here before copying anything, a
+  // pipelined or large request usually arrives in several reads
+  const char* q = p;
+  for (long long i = 0; i < count; i++) {
+    long long len;
+    s = ParseHeader(q, end, '$', &len, &q);
+    if (s == RESP_ERROR) {
+      *error = "Protocol error: invalid bulk length";
+    } else if (s == RESP_OK &&
+               (len < 0 || len > static_cast<long long>(kRespMaxBulkLength))) {
+      *error = "Protocol error: invalid bulk length";
+      s = RESP_ERROR;
+    }
+    if (s != RESP_OK) return s;
+    if (end - q < len + 2) return RESP_INCOMPLETE;
+    if (q[len] != '\r' || q[len + 1] != '\n') {
+      *error = "Protocol error: bulk string not terminated";
+      return RESP_ERROR;
+    }
+    q += len + 2;
+  }
+
+  if (count > 0) argv->reserve(count);
+  for (long long i = 0; i < count; i++) {
+    long long len;
+    ParseHeader(p, end, '$', &len, &p);
+    argv->emplace_back(p, len);
+    p += len + 2;
+  }
+  *consumed = p - buf;
+  return RESP_OK;
+}
+
+RespStatus ParseReply(const char* buf, size_t n, RespValue* value,
+                      size_t* consumed) {
+  const char* next;
+  RespStatus s = ParseReplyAt(buf, buf + n, value, &next, 0);
+  if (s == RESP_OK) *consumed = next - buf;
+  return s;
+}
+
+void AppendSimpleString(std::string* out, const char* s) {
+  out->push_back('+');
+  out->append(s);
+  out->append("\r\n");
+}
+
+void AppendError(std::string* out, const std::string& msg) {
+  out->push_back('-');
+  // an error is a single line
+  for (char c : msg) out->push_back(c == '\r' || c == '\n' ? ' ' : c);
+  out->append("\r\n");
+}
+
+void AppendInteger(std::string* out, long long v) {
+  AppendLength(out, ':', v);
+}
+
+void AppendBulk(std::string* out, const std::string& s) {
+  AppendLength(out, '$', s.size());
+  out->append(s);
+  out->append("\r\n");
+}
+
+void AppendNil(std::string* out) { out->append("$-1\r\n"); }
+
+void AppendArrayHeader(std::string* out, size_t n) {
+  AppendLength(out, '*', n);
+}
+
+void AppendRequest(std::string* out, const std::vector<std::string>& argv) {
+  AppendArrayHeader(out, argv.size());
+  for (const std::string& a : argv) AppendBulk(out, a);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// RESP (REdis Serialization Protocol) codec shared by the server, the
+// bundled client and the tests. Parsers work on a caller owned buffer and
+// never copy more than the values they return, so a connection can keep
+// appending to one buffer and parse requests in place.
+
+enum RespStatus {
+  // a complete message was parsed, *consumed bytes belong to it
+  RESP_OK = 0,
+  // the buffer ends inside a message, retry with more bytes
+  RESP_INCOMPLETE,
+  // malformed input, the connection should be closed
+  RESP_ERROR,
+};
+
+// Largest bulk string and argument count a request may carry.
+static const size_t kRespMaxBulkLength = 512 << 20;
+static const size_t kRespMaxArgs = 1 << 20;
+// Inline commands ("GET k\r\n") are limited to one line of this length.
+static const size_t kRespMaxInlineLength = 64 << 10;
+
+// Parse one request from buf[0, n): either a multibulk array of bulk
+// strings or an inline command. On RESP_OK argv holds the arguments (an
+// empty line yields an empty argv); on RESP_ERROR *error says why.
+RespStatus ParseRequest(const char* buf, size_t n,
+                        std::vector<std::string>* argv, size_t* consumed,
+                        std::string* error);
+
+// A decoded reply, for clients.
+struct RespValue {
+  enum Type { kSimpleString, kError, kInteger, kBulk, kArray, kNil };
+
+  Type type = kNil;
+  // kSimpleString, kError and kBulk
+  std::string str;
+  long long integer = 0;
+  std::vector<RespValue> elements;
+};
+
+// Parse one reply from buf[0, n), nested arrays included.
+RespStatus ParseReply(const char* buf, size_t n, RespValue* value,
+                      size_t* consumed);
+
+// Reply encoders, all append to *out.
+void AppendSimpleString(std::string* out, const char* s);
+void AppendError(std::string* out, const std::string& msg);
+void AppendInteger(std::string* out, long long v);
+void AppendBulk(std::string* out, const std::string& s);
+void AppendNil(std::string* out);
+void AppendArrayHeader(std::string* out, size_t n);
+
+// Encode argv as a multibulk request.
+void AppendRequest(std::string* out, const std::vector<std::string>& argv);
@@ -0,0 +1,469 @@
+#include "server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#include "replication.h"
+#include "resp.h"
+
+namespace {
+
+// bytes read per read() call
+const size_t kReadChunk = 64 << 10;
+// stop parsing requests while this much output is waiting for the client,
+// a pipelining client that does not read its replies is held here
+const size_t kMaxPendingOutput = 4 << 20;
+// buffers larger than this are released once empty instead of reused
+const size_t kMaxIdleBuffer = 1 << 20;
+const int kMaxEvents = 256;
+
+std::string ErrnoMessage(const char* what) {
+  return std::string(what) + ": " + strerror(errno);
+}
+
+void Wake(int fd) {
+  uint64_t one = 1;
+  ssize_t r = write(fd, &one, sizeof(one));
+  (void)r;
+}
+
+void Drain(int fd) {
+  uint64_t n;
+  ssize_t r = read(fd, &n, sizeof(n));
+  (void)r;
+}
+
+}  // namespace
+
+struct Connection {
+  Connection(int f, Store* store, ServerStats* stats)
+      : fd(f), session(store, stats) {}
+
+  // -1 once closed
+  int fd;
+  // unparsed input is in[in_pos, in.size())
+  std::string in;
+  size_t in_pos = 0;
+  // unsent output is out[out_pos, out.size())
+  std::string out;
+  size_t out_pos = 0;
+  // the registered epoll events
+  uint32_t events = EPOLLIN;
+  std::vector<std::string> argv;
+  Session session;
+};
+
+class Server::IoThread {
+ public:
+  IoThread(Store* store, ServerStats* stats, ReplicationLog* repl_log,
+           ReplicaClient* replica, const std::string& dump_file)
+      : store_(store), stats_(stats), repl_log_(repl_log), replica_(replica),
+        dump_file_(dump_file), epoll_fd_(-1), wake_fd_(-1), stop_(false) {}
+
+  ~IoThread() {
+    for (auto& kv : conns_) close(kv.first);
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+    if (wake_fd_ >= 0) close(wake_fd_);
+  }
+
+  bool Init(std::string* error) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wake_fd_ < 0) {
+      *error = ErrnoMessage("epoll");
+      return false;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) != 0) {
+      *error = ErrnoMessage("epoll_ctl");
+      return false;
+    }
+    thread_ = std::thread(&IoThread::Run, this);
+    return true;
+  }
+
+  // called by the acceptor, the loop takes the fd over
+  void AddConnection(int fd) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      pending_.push_back(fd);
+    }
+    Wake(wake_fd_);
+  }
+
+  void Stop() {
+    stop_.store(true);
+    if (wake_fd_ >= 0) Wake(wake_fd_);
+    if (thread_.joinable()) thread_.join();
+  }
+
+ private:
+  void Run();
+  void TakePending();
+  void OnReadable(Connection* c);
+  void OnWritable(Connection* c);
+  // run the complete requests buffered in c->in
+  void Process(Connection* c);
+  // write what the socket takes; false if the connection is gone
+  bool Flush(Connection* c);
+  // poll for output while some is pending, and for input unless the
+  // pending output reached kMaxPendingOutput
+  void UpdateEvents(Connection* c);
+  void Close(Connection* c);
+  // hand a connection that sent PSYNC over to the replication log
+  void Detach(Connection* c);
+
+  Store* store_;
+  ServerStats* stats_;
+  ReplicationLog* repl_log_;
+  ReplicaClient* replica_;
+  const std::string dump_file_;
+  int epoll_fd_;
+  int wake_fd_;
+  std::atomic<bool> stop_;
+  std::thread thread_;
+
+  std::mutex mu_;
+  std::vector<int> pending_;
+
+  // only touched by the loop thread
+  std::unordered_map<int, std::unique_ptr<Connection>> conns_;
+  // closed during the current batch; freed after it since later events of
+  // the batch may still point at them
+  std::vector<std::unique_ptr<Connection>> closed_;
+};
+
+void Server::IoThread::Run() {
+  struct epoll_event events[kMaxEvents];
+  while (!stop_.load()) {
+    int n = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    for (int i = 0; i < n; i++) {
+      Connection* c = static_cast<Connection*>(events[i].data.ptr);
+      if (c == nullptr) {
+        Drain(wake_fd_);
+        TakePending();
+        continue;
+      }
+      if (c->fd < 0) continue;
+      if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        OnReadable(c);
+        if (c->fd < 0) continue;
+      }
+      if (events[i].events & EPOLLOUT) OnWritable(c);
+    }
+    closed_.clear();
+  }
+}
+
+void Server::IoThread::TakePending() {
+  std::vector<int> fds;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    fds.swap(pending_);
+  }
+  for (int fd : fds) {
+    std::unique_ptr<Connection> c(new Connection(fd, store_, stats_));
+    c->session.repl_log = repl_log_;
+    c->session.replica = replica_;
+    c->session.dump_file = dump_file_;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = c.get();
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      close(fd);
+      continue;
+    }
+    conns_[fd] = std::move(c);
+    stats_->connected_clients.fetch_add(1);
+  }
+}
+
+void Server::IoThread::OnReadable(Connection* c) {
+  if (c->in_pos == c->in.size()) {
+    c->in.clear();
+    c->in_pos = 0;
+    if (c->in.capacity() > kMaxIdleBuffer) std::string().swap(c->in);
+  } else if (c->in_pos > c->in.size() / 2) {
+    // keep the unparsed tail at the front so the buffer does not grow
+    c->in.erase(0, c->in_pos);
+    c->in_pos = 0;
+  }
+  size_t old = c->in.size();
+  c->in.resize(old + kReadChunk);
+  ssize_t r = read(c->fd, &c->in[old], kReadChunk);
+  c->in.resize(old + (r > 0 ? r : 0));
+  if (r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR)) {
+    Close(c);
+    return;
+  }
+  Process(c);
+  Flush(c);
+}
+
+void Server::IoThread::OnWritable(Connection* c) {
+  if (!Flush(c)) return;
+  // continue with requests held back by the output limit
+  Process(c);
+  Flush(c);
+}
+
+void Server::IoThread::Process(Connection* c) {
+  std::string error;
+  while (!c->session.quit && !c->session.detach &&
+         c->out.size() - c->out_pos < kMaxPendingOutput) {
+    size_t consumed;
+    RespStatus s = ParseRequest(c->in.data() + c->in_pos,
+                                c->in.size() - c->in_pos, &c->argv,
+                                &consumed, &error);
+    if (s == RESP_INCOMPLETE) break;
+    if (s == RESP_ERROR) {
+      AppendError(&c->out, "ERR " + error);
+      c->session.quit = true;
+      break;
+    }
+    c->in_pos += consumed;
+    if (!c->argv.empty()) ExecuteCommand(&c->session, c->argv, &c->out);
+  }
+}
+
+bool Server::IoThread::Flush(Connection* c) {
+  while (c->out_pos < c->out.size()) {
+    ssize_t w = send(c->fd, c->out.data() + c->out_pos,
+                     c->out.size() - c->out_pos, MSG_NOSIGNAL);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN) {
+        UpdateEvents(c);
+        return true;
+      }
+      Close(c);
+      return false;
+    }
+    c->out_pos += w;
+  }
+  c->out.clear();
+  c->out_pos = 0;
+  if (c->out.capacity() > kMaxIdleBuffer) std::string().swap(c->out);
+  if (c->session.quit) {
+    Close(c);
+    return false;
+  }
+  if (c->session.detach) {
+    Detach(c);
+    return false;
+  }
+  UpdateEvents(c);
+  return true;
+}
+
+void Server::IoThread::UpdateEvents(Connection* c) {
+  size_t pending = c->out.size() - c->out_pos;
+  uint32_t events = 0;
+  if (pending < kMaxPendingOutput) events |= EPOLLIN;
+  if (pending > 0) events |= EPOLLOUT;
+  if (events == c->events) return;
+  struct epoll_event ev;
+  ev.events = events;
+  ev.data.ptr = c;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c->fd, &ev);
+  c->events = events;
+}
+
+void Server::IoThread::Close(Connection* c) {
+  int fd = c->fd;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  c->fd = -1;
+  auto it = conns_.find(fd);
+  closed_.push_back(std::move(it->second));
+  conns_.erase(it);
+  stats_->connected_clients.fetch_sub(1);
+}
+
+void Server::IoThread::Detach(Connection* c) {
+  int fd = c->fd;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  c->fd = -1;
+  auto it = conns_.find(fd);
+  closed_.push_back(std::move(it->second));
+  conns_.erase(it);
+  stats_->connected_clients.fetch_sub(1);
+  repl_log_->AddReplica(fd, c->session.psync_replid, c->session.psync_offset);
+}
+
+Server::Server(const ServerOptions& options, Store* store)
+    : options_(options),
+      store_(store),
+      repl_log_(nullptr),
+      replica_(nullptr),
+      tcp_fd_(-1),
+      unix_fd_(-1),
+      epoll_fd_(-1),
+      wake_fd_(-1),
+      running_(false),
+      next_thread_(0) {}
+
+Server::~Server() {
+  Stop();
+  if (tcp_fd_ >= 0) close(tcp_fd_);
+  if (unix_fd_ >= 0) close(unix_fd_);
+  if (epoll_fd_ >= 0) close(epoll_fd_);
+  if (wake_fd_ >= 0) close(wake_fd_);
+}
+
+bool Server::Listen(std::string* error) {
+  if (options_.port >= 0) {
+    tcp_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (tcp_fd_ < 0) {
+      *error = ErrnoMessage("socket");
+      return false;
+    }
+    int one = 1;
+    setsockopt(tcp_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(options_.port));
+    if (inet_pton(AF_INET, options_.bind.c_str(), &addr.sin_addr) != 1) {
+      *error = "invalid bind address " + options_.bind;
+      return false;
+    }
+    if (bind(tcp_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+             sizeof(addr)) != 0 ||
+        listen(tcp_fd_, 511) != 0) {
+      *error = ErrnoMessage("listen tcp");
+      return false;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(tcp_fd_, reinterpret_cast<struct sockaddr*>(&addr), &len);
+    stats_.tcp_port = ntohs(addr.sin_port);
+  }
+
+  if (!options_.unix_socket.empty()) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (options_.unix_socket.size() >= sizeof(addr.sun_path)) {
+      *error = "unix socket path too long";
+      return false;
+    }
+    strcpy(addr.sun_path, options_.unix_socket.c_str());
+    unix_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (unix_fd_ < 0) {
+      *error = ErrnoMessage("socket");
+      return false;
+    }
+    // a stale socket file of an earlier run
+    unlink(addr.sun_path);
+    if (bind(unix_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+             sizeof(addr)) != 0 ||
+        listen(unix_fd_, 511) != 0) {
+      *error = ErrnoMessage("listen unix");
+      return false;
+    }
+  }
+
+  if (tcp_fd_ < 0 && unix_fd_ < 0) {
+    *error = "neither a TCP port nor a unix socket to listen on";
+    return false;
+  }
+  return true;
+}
+
+bool Server::Start(std::string* error) {
+  if (running_) return true;
+  if (!Listen(error)) return false;
+
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ < 0 || wake_fd_ < 0) {
+    *error = ErrnoMessage("epoll");
+    return false;
+  }
+  int fds[] = {tcp_fd_, unix_fd_, wake_fd_};
+  for (int fd : fds) {
+    if (fd < 0) continue;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      *error = ErrnoMessage("epoll_ctl");
+      return false;
+    }
+  }
+
+  int n = options_.io_threads > 0 ? options_.io_threads : 1;
+  for (int i = 0; i < n; i++) {
+    io_threads_.emplace_back(
+        new IoThread(store_, &stats_, repl_log_, replica_,
+                     options_.dump_file));
+    if (!io_threads_.back()->Init(error)) {
+      Stop();
+      return false;
+    }
+  }
+  stats_.io_threads = n;
+  stats_.start_time = time(nullptr);
+  running_ = true;
+  acceptor_ = std::thread(&Server::AcceptLoop, this);
+  return true;
+}
+
+void Server::Stop() {
+  if (acceptor_.joinable()) {
+    Wake(wake_fd_);
+    acceptor_.join();
+  }
+  for (auto& t : io_threads_) t->Stop();
+  io_threads_.clear();
+  if (running_ && unix_fd_ >= 0) unlink(options_.unix_socket.c_str());
+  running_ = false;
+}
+
+void Server::AcceptLoop() {
+  struct epoll_event events[4];
+  while (true) {
+    int n = epoll_wait(epoll_fd_, events, 4, -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+      if (fd == wake_fd_) return;
+      Accept(fd, fd == tcp_fd_);
+    }
+  }
+}
+
+void Server::Accept(int listen_fd, bool tcp) {
+  while (true) {
+    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+    if (tcp) {
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    stats_.connections_received.fetch_add(1);
+    io_threads_[next_thread_++ % io_threads_.size()]->AddConnection(fd);
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "commands.h"
+
+struct ServerOptions {
+  // address of the TCP listener
+  std::string bind = "127.0.0.1";
+  // 0 picks a free port, see Server::port(); -1 disables TCP
+  int port = 6379;
+  // path of a unix socket to listen on as well, empty for none
+  std::string unix_socket;
+  // event loops serving the connections; a connection stays on the loop
+  // it was handed to
+  int io_threads = 4;
+  // the file SAVE and BGSAVE write
+  std::string dump_file = "dump.minikv";
+};
+
+// RESP server over a shared store. An acceptor thread hands every new
+// connection to one of io_threads epoll loops round robin. A loop reads
+// whatever the client has sent, runs every complete request in it
+// (pipelining) and writes the replies back in one go; read and write
+// buffers stay with the connection and keep their capacity between
+// requests. The store does its own locking.
+class Server {
+ public:
+  Server(const ServerOptions& options, Store* store);
+  ~Server();
+
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  // bind, listen and start the threads; false with *error on failure
+  bool Start(std::string* error);
+  // close the listeners and every connection, join the threads
+  void Stop();
+
+  // before Start: replicas may attach to log with PSYNC
+  void set_replication_log(ReplicationLog* log) { repl_log_ = log; }
+  // before Start: serve as a replica of replica's primary, clients may
+  // only read
+  void set_replica(ReplicaClient* replica) { replica_ = replica; }
+
+  // the bound TCP port, -1 if TCP is disabled
+  int port() const { return stats_.tcp_port; }
+  ServerStats* stats() { return &stats_; }
+
+ private:
+  class IoThread;
+
+  bool Listen(std::string* error);
+  void AcceptLoop();
+  void Accept(int listen_fd, bool tcp);
+
+  ServerOptions options_;
+  Store* store_;
+  ServerStats stats_;
+  ReplicationLog* repl_log_;
+  ReplicaClient* replica_;
+
+  int tcp_fd_;
+  int unix_fd_;
+  int epoll_fd_;
+  // written to wake the acceptor on Stop()
+  int wake_fd_;
+  bool running_;
+  std::thread acceptor_;
+  std::vector<std::unique_ptr<IoThread>> io_threads_;
+  size_t next_thread_;
+};
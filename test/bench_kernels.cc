@@ -0,0 +1,234 @@
+/**
+ * @file bench_kernels.cc
+ * @brief microbenchmarks of the building blocks: Arena, BloomFilter, LRU,
+ * Random, the arena backed SkipList and the unrolled skiplist
+ *
+ * Arguments are {key size, element count} unless noted otherwise, e.g.
+ *   ./bench_kernels --benchmark_filter=Bloom
+ * Configure with -DCMAKE_BUILD_TYPE=Release before comparing numbers.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../base/arena.h"
+#include "../base/bloomfilter.hpp"
+#include "../base/concurrent_arena.h"
+#include "../base/lru.hpp"
+#include "../base/random.h"
+#include "../base/skiplist.hpp"
+#include "../base/unrolled_skiplist.hpp"
+#include "bench_util.h"
+
+namespace {
+
+struct IntComparator {
+  int operator()(int a, int b) const { return a < b ? -1 : (a > b ? 1 : 0); }
+};
+
+struct StringComparator {
+  int operator()(const std::string& a, const std::string& b) const {
+    return a.compare(b);
+  }
+};
+
+// ---------------------------------------------------------------- Arena
+// args: {allocation size, allocations per arena}
+void BM_ArenaAllocate(benchmark::State& state) {
+  const size_t bytes = state.range(0);
+  const int n = state.range(1);
+  for (auto _ : state) {
+    Arena arena;
+    for (int i = 0; i < n; i++) {
+      benchmark::DoNotOptimize(arena.Allocate(bytes));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_ArenaAllocate)->ArgsProduct({{8, 64, 512, 2048}, {1 << 16}});
+
+void BM_ArenaAllocateAligned(benchmark::State& state) {
+  const size_t bytes = state.range(0);
+  const int n = state.range(1);
+  for (auto _ : state) {
+    Arena arena;
+    for (int i = 0; i < n; i++) {
+      // odd sizes so that every call has to fix up the alignment
+      benchmark::DoNotOptimize(arena.AllocateAligned(bytes + (i & 7)));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_ArenaAllocateAligned)
+    ->ArgsProduct({{8, 64, 512, 2048}, {1 << 16}});
+
+// several writers sharing one arena: Arena behind a mutex versus the
+// per-thread shards of ConcurrentArena. args: {allocation size}
+Arena* shared_arena = nullptr;
+std::mutex shared_arena_mu;
+ConcurrentArena* shared_concurrent_arena = nullptr;
+
+void BM_LockedArenaAllocate(benchmark::State& state) {
+  if (state.thread_index() == 0) shared_arena = new Arena;
+  const size_t bytes = state.range(0);
+  for (auto _ : state) {
+    std::lock_guard<std::mutex> lock(shared_arena_mu);
+    benchmark::DoNotOptimize(shared_arena->AllocateAligned(bytes));
+  }
+  if (state.thread_index() == 0) {
+    delete shared_arena;
+    shared_arena = nullptr;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LockedArenaAllocate)->Arg(64)->ThreadRange(1, 8)->UseRealTime();
+
+void BM_ConcurrentArenaAllocate(benchmark::State& state) {
+  if (state.thread_index() == 0) shared_concurrent_arena = new ConcurrentArena;
+  const size_t bytes = state.range(0);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(shared_concurrent_arena->AllocateAligned(bytes));
+  }
+  if (state.thread_index() == 0) {
+    delete shared_concurrent_arena;
+    shared_concurrent_arena = nullptr;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ConcurrentArenaAllocate)
+    ->Arg(64)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+// ---------------------------------------------------------- BloomFilter
+void BM_BloomSet(benchmark::State& state) {
+  std::vector<std::string> keys = MakeKeys(state.range(1), state.range(0));
+  BloomFilter<std::string> bf(keys.size() * 10);
+  size_t i = 0;
+  for (auto _ : state) {
+    bf._Set(keys[i]);
+    if (++i == keys.size()) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BloomSet)->ArgsProduct({{8, 16, 64}, {1 << 10, 1 << 16}});
+
+// half of the probes hit inserted keys, the other half are absent
+void BM_BloomIsIn(benchmark::State& state) {
+  const int n = state.range(1);
+  std::vector<std::string> keys = MakeKeys(n, state.range(0));
+  std::vector<std::string> probes = MakeKeys(n, state.range(0), n / 2);
+  BloomFilter<std::string> bf(keys.size() * 10);
+  for (const auto& k : keys) bf._Set(k);
+  size_t i = 0;
+  int64_t found = 0;
+  for (auto _ : state) {
+    found += bf._IsIn(probes[i]);
+    if (++i == probes.size()) i = 0;
+  }
+  benchmark::DoNotOptimize(found);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BloomIsIn)->ArgsProduct({{8, 16, 64}, {1 << 10, 1 << 16}});
+
+// ------------------------------------------------------------------ LRU
+// args: {key size, capacity}; keys are drawn from twice the capacity so
+// about half of the gets miss and every put past warmup evicts
+void BM_LRUGet(benchmark::State& state) {
+  const int capacity = state.range(1);
+  LRU<std::string, std::string> lru(capacity);
+  std::vector<std::string> keys = MakeKeys(capacity * 2, state.range(0));
+  for (int i = 0; i < capacity; i++) lru.put(keys[i * 2], "value");
+  Random rnd(301);
+  std::string v;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lru.get(keys[rnd.Uniform(keys.size())], v));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LRUGet)->ArgsProduct({{16}, {8, 1 << 10, 1 << 16}});
+
+void BM_LRUPut(benchmark::State& state) {
+  const int capacity = state.range(1);
+  LRU<std::string, std::string> lru(capacity);
+  std::vector<std::string> keys = MakeKeys(capacity * 2, state.range(0));
+  Random rnd(301);
+  for (auto _ : state) {
+    lru.put(keys[rnd.Uniform(keys.size())], "value");
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LRUPut)->ArgsProduct({{16}, {8, 1 << 10, 1 << 16}});
+
+// --------------------------------------------------------------- Random
+void BM_RandomNext(benchmark::State& state) {
+  Random rnd(301);
+  uint32_t sum = 0;
+  for (auto _ : state) {
+    sum += rnd.Next();
+  }
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RandomNext);
+
+// ------------------------------------------------- SkipList (arena based)
+// args: {element count}
+void BM_ArenaSkipListSearchInt(benchmark::State& state) {
+  const int n = state.range(0);
+  Arena arena;
+  SkipList<int, int, IntComparator> list(IntComparator(), &arena);
+  Random rnd(301);
+  std::vector<int> keys(n);
+  for (int i = 0; i < n; i++) keys[i] = i * 2;
+  for (int i = n - 1; i > 0; i--) std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+  for (int k : keys) list.Insert(k, k);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(list.Contains(rnd.Uniform(n * 2)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ArenaSkipListSearchInt)->Range(1 << 10, 1 << 20);
+
+// args: {key size, element count}
+void BM_ArenaSkipListSearchString(benchmark::State& state) {
+  const int n = state.range(1);
+  Arena arena;
+  SkipList<std::string, int, StringComparator> list(StringComparator(),
+                                                    &arena);
+  std::vector<std::string> keys = MakeKeys(n, state.range(0));
+  Random rnd(301);
+  for (int i = n - 1; i > 0; i--) std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+  for (const auto& k : keys) list.Insert(k, 0);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(list.Contains(keys[rnd.Uniform(n)]));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ArenaSkipListSearchString)
+    ->ArgsProduct({{16, 64}, {1 << 10, 1 << 16, 1 << 20}});
+
+// ----------------------------------------------------- UnrolledSkipList
+// args: {element count}, same keys and probes as BM_ArenaSkipListSearchInt
+void BM_UnrolledSkipListSearchInt(benchmark::State& state) {
+  const int n = state.range(0);
+  UnrolledSkipList<int> list;
+  Random rnd(301);
+  std::vector<int> keys(n);
+  for (int i = 0; i < n; i++) keys[i] = i * 2;
+  for (int i = n - 1; i > 0; i--) std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+  for (int k : keys) list.Insert(k, k);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(list.Contains(rnd.Uniform(n * 2)));
+  }
+  state.counters["bytes_per_key"] = double(list.MemoryUsage()) / n;
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UnrolledSkipListSearchInt)->Range(1 << 10, 1 << 20);
+
+}  // namespace
+
+BENCHMARK_MAIN();
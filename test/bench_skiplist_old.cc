@@ -0,0 +1,106 @@
+/**
+ * @file bench_skiplist_old.cc
+ * @brief microbenchmarks of the store skiplist. Kept apart from
+ * bench_kernels.cc because both skiplist headers define SkipList.
+ *
+ * The search benchmarks time SkipListIndex::Lookup alone, the node
+ * search without the store's lock, statistics, bloom filter and LRU;
+ * the insert benchmarks go through the store.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "../base/random.h"
+#include "../base/skiplist_index.hpp"
+#include "../base/skiplist_old.hpp"
+#include "bench_util.h"
+
+namespace {
+
+// args: {element count}; keys inserted in random order
+void BM_IndexSearchInt(benchmark::State& state) {
+  const int n = state.range(0);
+  SkipListIndex<int, std::string> index(18);
+  Random rnd(301);
+  std::vector<int> keys(n);
+  for (int i = 0; i < n; i++) keys[i] = i;
+  for (int i = n - 1; i > 0; i--) std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+  for (int k : keys) index.Insert(k, "value");
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(index.Lookup(rnd.Uniform(n)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IndexSearchInt)->Range(1 << 10, 1 << 20);
+
+// args: {key size, element count}
+void BM_IndexSearchString(benchmark::State& state) {
+  const int n = state.range(1);
+  SkipListIndex<std::string, std::string> index(18);
+  std::vector<std::string> keys = MakeKeys(n, state.range(0));
+  Random rnd(301);
+  for (int i = n - 1; i > 0; i--) std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+  for (const auto& k : keys) index.Insert(k, "value");
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(index.Lookup(keys[rnd.Uniform(n)]));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IndexSearchString)
+    ->ArgsProduct({{16, 64}, {1 << 10, 1 << 16, 1 << 20}});
+
+// args: {element count}; random inserts into a store prefilled with n keys
+void BM_StoreInsertInt(benchmark::State& state) {
+  const int n = state.range(0);
+  SkipList<int, std::string> list(18, 1);
+  Random rnd(301);
+  for (int i = 0; i < n; i++) list.insertElement(i * 2, "value");
+  for (auto _ : state) {
+    list.insertElement(rnd.Uniform(n * 2), "value");
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StoreInsertInt)->Range(1 << 10, 1 << 20);
+
+// policy presets, see skiplist_policy.hpp. args: {element count}; reports
+// the index bytes per key next to the lookup rate
+template <typename Policy>
+void BM_IndexPolicySearch(benchmark::State& state) {
+  const int n = state.range(0);
+  SkipListIndex<int, std::string, Less<int>, Policy> index(
+      Policy::kMaxHeight);
+  Random rnd(301);
+  for (int i = 0; i < n; i++) index.Insert(i, "value");
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(index.Lookup(rnd.Uniform(n)));
+  }
+  state.counters["bytes_per_key"] = double(index.MemoryUsage()) / n;
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_IndexPolicySearch, FastSearchPolicy)
+    ->Range(1 << 16, 1 << 20);
+BENCHMARK_TEMPLATE(BM_IndexPolicySearch, EulerPolicy)->Range(1 << 16, 1 << 20);
+BENCHMARK_TEMPLATE(BM_IndexPolicySearch, CompactPolicy)
+    ->Range(1 << 16, 1 << 20);
+
+template <typename Policy>
+void BM_StorePolicyInsert(benchmark::State& state) {
+  const int n = state.range(0);
+  SkipList<int, std::string, Less<int>, Policy> list(Policy::kMaxHeight, 1);
+  Random rnd(301);
+  for (int i = 0; i < n; i++) list.insertElement(i * 2, "value");
+  for (auto _ : state) {
+    list.insertElement(rnd.Uniform(n * 2), "value");
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_StorePolicyInsert, FastSearchPolicy)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_StorePolicyInsert, EulerPolicy)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_StorePolicyInsert, CompactPolicy)->Arg(1 << 20);
+
+}  // namespace
+
+BENCHMARK_MAIN();
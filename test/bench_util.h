@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// key helpers shared by the microbenchmarks
+
+// zero padded decimal key of exactly key_size bytes (at least the digits)
+inline std::string MakeKey(int i, int key_size) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%016d", i);
+  std::string key(buf);
+  if (static_cast<int>(key.size()) < key_size) {
+    key.insert(0, key_size - key.size(), 'k');
+  } else if (static_cast<int>(key.size()) > key_size) {
+    key = key.substr(key.size() - key_size);
+  }
+  return key;
+}
+
+inline std::vector<std::string> MakeKeys(int n, int key_size,
+                                         int offset = 0) {
+  std::vector<std::string> keys;
+  keys.reserve(n);
+  for (int i = 0; i < n; i++) keys.push_back(MakeKey(offset + i, key_size));
+  return keys;
+}
@@ -0,0 +1,596 @@
+/**
+ * @file db_bench.cc
+ * @brief db_bench style benchmark for the skiplist store
+ *
+ * Example:
+ *   ./db_bench --benchmarks=fillrandom,readrandom,ycsba --num=100000 \
+ *              --threads=1,2,4 --distribution=zipfian --engine=art
+ *
+ * Every benchmark runs once per entry of --threads and reports ops/sec and
+ * p50/p99/p999 latency. --csv=1 switches to one comma separated line per run
+ * so results can be diffed between releases. Configure with
+ * -DCMAKE_BUILD_TYPE=Release before comparing numbers. Benchmarks that
+ * remove keys (deleterandom, ttlmix) run on a newly filled store at every
+ * thread count, and the benchmark after them starts over as well.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../base/histogram.hpp"
+#include "../base/random.h"
+#include "../base/skiplist_old.hpp"
+
+namespace {
+
+std::string FLAGS_benchmarks =
+    "fillseq,fillrandom,overwrite,readrandom,readmissing,readwhilewriting,"
+    "deleterandom,scan,ttlmix,ycsba,ycsbb,ycsbc,ycsbd,ycsbe,ycsbf";
+// number of keys in the key space
+int FLAGS_num = 100000;
+// operations per run, split across the threads; -1 means FLAGS_num
+int FLAGS_ops = -1;
+std::string FLAGS_threads = "1";
+int FLAGS_value_size = 100;
+std::string FLAGS_distribution = "uniform";
+double FLAGS_zipf_theta = 0.99;
+int FLAGS_scan_length = 50;
+int FLAGS_ttl_max = 3;
+int FLAGS_level = 18;
+int FLAGS_lru_size = LRU_DEFAULT_SIZE;
+// index engine of the store: skiplist, art, bplustree or hashed_skiplist
+std::string FLAGS_engine = "skiplist";
+IndexEngine store_engine = SKIPLIST_ENGINE;
+// keys tracked by the hot key sketches, 0 for none; see setHotKeys
+int FLAGS_hot_keys = 0;
+int FLAGS_hot_keys_sample_rate = 16;
+uint32_t FLAGS_seed = 301;
+bool FLAGS_csv = false;
+
+typedef SkipList<int, std::string> Store;
+
+double NowMicros() {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Zipfian generator over [0, n) following Gray et al. as used by YCSB.
+// zeta(n) is computed once and shared by all threads.
+class ZipfianTable {
+ public:
+  ZipfianTable(uint64_t n, double theta) : n_(n), theta_(theta) {
+    zetan_ = Zeta(n, theta);
+    double zeta2 = Zeta(2, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan_);
+    half_pow_theta_ = 1.0 + std::pow(0.5, theta);
+  }
+
+  // u is uniform in [0, 1); rank 0 is the most popular item
+  uint64_t Rank(double u) const {
+    double uz = u * zetan_;
+    if (uz < 1.0) return 0;
+    if (uz < half_pow_theta_) return 1;
+    uint64_t r = static_cast<uint64_t>(n_ * std::pow(eta_ * u - eta_ + 1,
+                                                     alpha_));
+    return r >= n_ ? n_ - 1 : r;
+  }
+
+ private:
+  static double Zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++) sum += 1.0 / std::pow(i, theta);
+    return sum;
+  }
+
+  uint64_t n_;
+  double theta_;
+  double zetan_;
+  double alpha_;
+  double eta_;
+  double half_pow_theta_;
+};
+
+uint64_t FNVHash64(uint64_t v) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (int i = 0; i < 8; i++) {
+    hash ^= v & 0xff;
+    hash *= 1099511628211ULL;
+    v >>= 8;
+  }
+  return hash;
+}
+
+enum Distribution { kUniform, kZipfian, kLatest };
+
+struct SharedState {
+  Store* db = nullptr;
+  std::unique_ptr<ZipfianTable> zipf;
+  // keys [0, inserted) exist, used by the latest distribution and inserts
+  std::atomic<int> inserted{0};
+  // set once the measured threads finish, stops background writers
+  std::atomic<bool> done{false};
+
+  std::mutex mu;
+  std::condition_variable cv;
+  int ready = 0;
+  bool start = false;
+};
+
+class ThreadState {
+ public:
+  ThreadState(int tid, uint32_t seed, SharedState* shared, Distribution dist)
+      : tid_(tid), rnd_(seed), shared_(shared), dist_(dist) {
+    value_.resize(FLAGS_value_size);
+    for (auto& c : value_) c = static_cast<char>('a' + rnd_.Uniform(26));
+  }
+
+  double NextDouble() { return rnd_.Next() / 2147483648.0; }
+
+  // key drawn from the configured distribution over [0, n)
+  int NextKey(int n) {
+    if (n <= 0) return 0;
+    switch (dist_) {
+      case kZipfian:
+        // scrambled, so the hot keys are spread over the key space
+        return static_cast<int>(
+            FNVHash64(shared_->zipf->Rank(NextDouble())) % n);
+      case kLatest: {
+        int rank = static_cast<int>(shared_->zipf->Rank(NextDouble()) % n);
+        return n - 1 - rank;
+      }
+      default:
+        return static_cast<int>(rnd_.Uniform(n));
+    }
+  }
+
+  int tid() const { return tid_; }
+  Random* rnd() { return &rnd_; }
+  SharedState* shared() { return shared_; }
+  const std::string& value() const { return value_; }
+
+  void Start() { last_ = NowMicros(); }
+  void FinishedOp() {
+    double now = NowMicros();
+    hist.Add(static_cast<uint64_t>((now - last_) * 1000));
+    last_ = now;
+    done++;
+  }
+
+  HistogramData hist;
+  int64_t done = 0;
+  double start_time = 0;
+  double finish_time = 0;
+
+ private:
+  int tid_;
+  Random rnd_;
+  SharedState* shared_;
+  Distribution dist_;
+  std::string value_;
+  double last_ = 0;
+};
+
+typedef void (*BenchFn)(ThreadState*, int ops);
+
+void FillSeq(ThreadState* t, int ops) {
+  Store* db = t->shared()->db;
+  int begin = t->tid() * ops;
+  t->Start();
+  for (int i = 0; i < ops; i++) {
+    db->insertElement(begin + i, t->value());
+    t->FinishedOp();
+  }
+}
+
+void FillRandom(ThreadState* t, int ops) {
+  Store* db = t->shared()->db;
+  t->Start();
+  for (int i = 0; i < ops; i++) {
+    db->insertElement(t->rnd()->Uniform(FLAGS_num), t->value());
+    t->FinishedOp();
+  }
+}
+
+void Overwrite(ThreadState* t, int ops) {
+  Store* db = t->shared()->db;
+  t->Start();
+  for (int i = 0; i < ops; i++) {
+    db->insertElement(t->NextKey(FLAGS_num), t->value());
+    t->FinishedOp();
+  }
+}
+
+void ReadRandom(ThreadState* t, int ops) {
+  Store* db = t->shared()->db;
+  std::string v;
+  t->Start();
+  for (int i = 0; i < ops; i++) {
+    db->searchElement(t->NextKey(FLAGS_num), v);
+    t->FinishedOp();
+  }
+}
+
+void ReadMissing(ThreadState* t, int ops) {
+  Store* db = t->shared()->db;
+  std::string v;
+  t->Start();
+  for (int i = 0; i < ops; i++) {
+    db->searchElement(FLAGS_num + t->NextKey(FLAGS_num), v);
+    t->FinishedOp();
+  }
+}
+
+void DeleteRandom(ThreadState* t, int ops) {
+  Store* db = t->shared()->db;
+  t->Start();
+  for (int i = 0; i < ops; i++) {
+    db->deleteElement(t->NextKey(FLAGS_num));
+    t->FinishedOp();
+  }
+}
+
+void Scan(ThreadState* t, int ops) {
+  Store* db = t->shared()->db;
+  std::vector<std::pair<int, std::string>> items;
+  t->Start();
+  for (int i = 0; i < ops; i++) {
+    items.clear();
+    db->scanElement(t->NextKey(FLAGS_num), FLAGS_scan_length, &items);
+    t->FinishedOp();
+  }
+}
+
+// writes with short ttls mixed with reads, ttl queries and cycle deletes
+void TTLMix(ThreadState* t, int ops) {
+  Store* db = t->shared()->db;
+  std::string v;
+  t->Start();
+  for (int i = 0; i < ops; i++) {
+    int key = t->NextKey(FLAGS_num);
+    uint32_t dice = t->rnd()->Uniform(100);
+    if (dice < 30) {
+      db->insertElement(key, t->value());
+      db->element_expire_time(key, 1 + t->rnd()->Uniform(FLAGS_ttl_max));
+    } else if (dice < 80) {
+      db->searchElement(key, v);
+    } else if (dice < 99) {
+      db->element_ttl(key);
+    } else {
+      db->cycle_del();
+    }
+    t->FinishedOp();
+  }
+}
+
+// YCSB core workloads, see
+// https://github.com/brianfrankcooper/YCSB/wiki/Core-Workloads
+struct YCSBMix {
+  int read;
+  int update;
+  int insert;
+  int scan;
+  int rmw;
+};
+
+void RunYCSB(ThreadState* t, int ops, const YCSBMix& mix) {
+  SharedState* shared = t->shared();
+  Store* db = shared->db;
+  std::string v;
+  std::vector<std::pair<int, std::string>> items;
+  t->Start();
+  for (int i = 0; i < ops; i++) {
+    int n = shared->inserted.load(std::memory_order_relaxed);
+    int dice = static_cast<int>(t->rnd()->Uniform(100));
+    if ((dice -= mix.read) < 0) {
+      db->searchElement(t->NextKey(n), v);
+    } else if ((dice -= mix.update) < 0) {
+      db->insertElement(t->NextKey(n), t->value());
+    } else if ((dice -= mix.insert) < 0) {
+      db->insertElement(shared->inserted.fetch_add(1), t->value());
+    } else if ((dice -= mix.scan) < 0) {
+      items.clear();
+      db->scanElement(t->NextKey(n), 1 + t->rnd()->Uniform(FLAGS_scan_length),
+                      &items);
+    } else {
+      int key = t->NextKey(n);
+      db->searchElement(key, v);
+      db->insertElement(key, t->value());
+    }
+    t->FinishedOp();
+  }
+}
+
+void YCSBA(ThreadState* t, int ops) { RunYCSB(t, ops, {50, 50, 0, 0, 0}); }
+void YCSBB(ThreadState* t, int ops) { RunYCSB(t, ops, {95, 5, 0, 0, 0}); }
+void YCSBC(ThreadState* t, int ops) { RunYCSB(t, ops, {100, 0, 0, 0, 0}); }
+void YCSBD(ThreadState* t, int ops) { RunYCSB(t, ops, {95, 0, 5, 0, 0}); }
+void YCSBE(ThreadState* t, int ops) { RunYCSB(t, ops, {0, 0, 5, 95, 0}); }
+void YCSBF(ThreadState* t, int ops) { RunYCSB(t, ops, {50, 0, 0, 0, 50}); }
+
+// background writer for readwhilewriting, not measured
+void WriterLoop(ThreadState* t) {
+  Store* db = t->shared()->db;
+  while (!t->shared()->done.load(std::memory_order_acquire)) {
+    db->insertElement(t->rnd()->Uniform(FLAGS_num), t->value());
+  }
+}
+
+struct Benchmark {
+  const char* name;
+  BenchFn fn;
+  // start from an empty store
+  bool fresh;
+  // needs the key space filled before running
+  bool prefill;
+  // runs one unmeasured writer next to the readers
+  bool with_writer;
+  // removes keys, so whatever runs next, the same benchmark at the next
+  // thread count included, starts over from a new store
+  bool drains;
+  // a fixed distribution overriding --distribution
+  const char* distribution;
+};
+
+const Benchmark kBenchmarks[] = {
+    {"fillseq", FillSeq, true, false, false, false, nullptr},
+    {"fillrandom", FillRandom, true, false, false, false, nullptr},
+    {"overwrite", Overwrite, false, true, false, false, nullptr},
+    {"readrandom", ReadRandom, false, true, false, false, nullptr},
+    {"readmissing", ReadMissing, false, true, false, false, nullptr},
+    {"readwhilewriting", ReadRandom, false, true, true, false, nullptr},
+    {"deleterandom", DeleteRandom, true, true, false, true, nullptr},
+    {"scan", Scan, false, true, false, false, nullptr},
+    {"ttlmix", TTLMix, true, false, false, true, nullptr},
+    {"ycsba", YCSBA, true, true, false, false, "zipfian"},
+    {"ycsbb", YCSBB, true, true, false, false, "zipfian"},
+    {"ycsbc", YCSBC, true, true, false, false, "zipfian"},
+    {"ycsbd", YCSBD, true, true, false, false, "latest"},
+    {"ycsbe", YCSBE, true, true, false, false, "zipfian"},
+    {"ycsbf", YCSBF, true, true, false, false, "zipfian"},
+};
+
+Distribution ParseDistribution(const std::string& s) {
+  if (s == "zipfian") return kZipfian;
+  if (s == "latest") return kLatest;
+  if (s != "uniform") {
+    fprintf(stderr, "unknown distribution %s, using uniform\n", s.c_str());
+  }
+  return kUniform;
+}
+
+std::vector<std::string> Split(const std::string& s) {
+  std::vector<std::string> out;
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) out.push_back(item);
+  }
+  return out;
+}
+
+class BenchmarkRunner {
+ public:
+  void Run() {
+    if (FLAGS_csv) {
+      printf("benchmark,threads,ops,ops_per_sec,p50_us,p99_us,p999_us\n");
+    } else {
+      PrintHeader();
+    }
+
+    for (const std::string& name : Split(FLAGS_benchmarks)) {
+      const Benchmark* bench = nullptr;
+      for (const Benchmark& b : kBenchmarks) {
+        if (name == b.name) bench = &b;
+      }
+      if (bench == nullptr) {
+        fprintf(stderr, "unknown benchmark '%s'\n", name.c_str());
+        continue;
+      }
+      for (const std::string& t : Split(FLAGS_threads)) {
+        RunOne(*bench, std::max(1, atoi(t.c_str())));
+      }
+    }
+  }
+
+ private:
+  void PrintHeader() {
+    printf("Keys:         %d\n", FLAGS_num);
+    printf("Ops:          %d\n", FLAGS_ops < 0 ? FLAGS_num : FLAGS_ops);
+    printf("Values:       %d bytes\n", FLAGS_value_size);
+    printf("Distribution: %s (theta %.2f)\n", FLAGS_distribution.c_str(),
+           FLAGS_zipf_theta);
+    printf("Store:        %s, level %d, lru %d\n", FLAGS_engine.c_str(),
+           FLAGS_level, FLAGS_lru_size);
+    printf("------------------------------------------------\n");
+  }
+
+  void ResetStore() {
+    store_.reset(new Store(FLAGS_level, FLAGS_lru_size, store_engine));
+    store_->setHotKeys(FLAGS_hot_keys, FLAGS_hot_keys_sample_rate);
+    filled_ = false;
+    drained_ = false;
+  }
+
+  void Prefill() {
+    for (int i = 0; i < FLAGS_num; i++) {
+      store_->insertElement(i, std::string(FLAGS_value_size, 'x'));
+    }
+    filled_ = true;
+  }
+
+  void RunOne(const Benchmark& bench, int threads) {
+    if (bench.fresh || !store_ || drained_) ResetStore();
+    if (bench.prefill && !filled_) Prefill();
+    if (bench.fn == FillSeq || bench.fn == FillRandom) filled_ = true;
+    drained_ = bench.drains;
+
+    SharedState shared;
+    shared.db = store_.get();
+    shared.inserted = bench.prefill ? FLAGS_num : 0;
+    Distribution dist = ParseDistribution(
+        bench.distribution ? bench.distribution : FLAGS_distribution);
+    if (dist != kUniform) {
+      if (!zipf_) zipf_.reset(new ZipfianTable(FLAGS_num, FLAGS_zipf_theta));
+      shared.zipf.reset(new ZipfianTable(*zipf_));
+    }
+
+    int total = FLAGS_ops < 0 ? FLAGS_num : FLAGS_ops;
+    int per_thread = std::max(1, total / threads);
+
+    std::vector<std::unique_ptr<ThreadState>> states;
+    for (int i = 0; i < threads; i++) {
+      states.emplace_back(new ThreadState(i, NextSeed(), &shared, dist));
+    }
+    std::unique_ptr<ThreadState> writer;
+    std::thread writer_thread;
+    if (bench.with_writer) {
+      writer.reset(new ThreadState(threads, NextSeed(), &shared, kUniform));
+      writer_thread = std::thread(WriterLoop, writer.get());
+    }
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+      ThreadState* t = states[i].get();
+      workers.emplace_back([t, &shared, &bench, per_thread]() {
+        {
+          std::unique_lock<std::mutex> l(shared.mu);
+          shared.ready++;
+          shared.cv.notify_all();
+          shared.cv.wait(l, [&shared]() { return shared.start; });
+        }
+        t->start_time = NowMicros();
+        bench.fn(t, per_thread);
+        t->finish_time = NowMicros();
+      });
+    }
+    {
+      std::unique_lock<std::mutex> l(shared.mu);
+      shared.cv.wait(l, [&]() { return shared.ready == threads; });
+      shared.start = true;
+      shared.cv.notify_all();
+    }
+    for (auto& w : workers) w.join();
+    shared.done.store(true, std::memory_order_release);
+    if (writer_thread.joinable()) writer_thread.join();
+
+    HistogramData merged;
+    int64_t ops = 0;
+    double start = states[0]->start_time;
+    double finish = states[0]->finish_time;
+    for (auto& t : states) {
+      merged.Merge(t->hist);
+      ops += t->done;
+      start = std::min(start, t->start_time);
+      finish = std::max(finish, t->finish_time);
+    }
+    // wall clock from the first thread starting to the last one finishing
+    double elapsed = finish - start;
+    double ops_per_sec = elapsed > 0 ? ops * 1e6 / elapsed : 0;
+    double p50 = merged.Percentile(50) / 1000;
+    double p99 = merged.Percentile(99) / 1000;
+    double p999 = merged.Percentile(99.9) / 1000;
+    if (FLAGS_csv) {
+      printf("%s,%d,%lld,%.0f,%.3f,%.3f,%.3f\n", bench.name, threads,
+             static_cast<long long>(ops), ops_per_sec, p50, p99, p999);
+    } else {
+      printf(
+          "%-16s : threads=%-3d %10.0f ops/sec  p50=%8.3f us  p99=%8.3f us  "
+          "p999=%8.3f us\n",
+          bench.name, threads, ops_per_sec, p50, p99, p999);
+    }
+    fflush(stdout);
+  }
+
+  // every thread of every benchmark gets its own stream, so e.g.
+  // readrandom does not replay the keys fillrandom wrote
+  uint32_t NextSeed() { return FLAGS_seed + 7919 * ++total_thread_count_; }
+
+  std::unique_ptr<Store> store_;
+  std::unique_ptr<ZipfianTable> zipf_;
+  bool filled_ = false;
+  // the last benchmark removed keys
+  bool drained_ = false;
+  uint32_t total_thread_count_ = 0;
+};
+
+bool ParseFlag(const char* arg, const char* name, std::string* value) {
+  size_t n = strlen(name);
+  if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, n) != 0 ||
+      arg[2 + n] != '=') {
+    return false;
+  }
+  *value = arg + 3 + n;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  for (int i = 1; i < argc; i++) {
+    std::string v;
+    if (ParseFlag(argv[i], "benchmarks", &v)) {
+      FLAGS_benchmarks = v;
+    } else if (ParseFlag(argv[i], "num", &v)) {
+      FLAGS_num = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "ops", &v)) {
+      FLAGS_ops = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "threads", &v)) {
+      FLAGS_threads = v;
+    } else if (ParseFlag(argv[i], "value_size", &v)) {
+      FLAGS_value_size = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "distribution", &v)) {
+      FLAGS_distribution = v;
+    } else if (ParseFlag(argv[i], "zipf_theta", &v)) {
+      FLAGS_zipf_theta = atof(v.c_str());
+    } else if (ParseFlag(argv[i], "scan_length", &v)) {
+      FLAGS_scan_length = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "ttl_max", &v)) {
+      FLAGS_ttl_max = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "level", &v)) {
+      FLAGS_level = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "lru_size", &v)) {
+      FLAGS_lru_size = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "engine", &v)) {
+      FLAGS_engine = v;
+    } else if (ParseFlag(argv[i], "hot_keys", &v)) {
+      FLAGS_hot_keys = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "hot_keys_sample_rate", &v)) {
+      FLAGS_hot_keys_sample_rate = atoi(v.c_str());
+    } else if (ParseFlag(argv[i], "seed", &v)) {
+      FLAGS_seed = static_cast<uint32_t>(strtoul(v.c_str(), nullptr, 10));
+    } else if (ParseFlag(argv[i], "csv", &v)) {
+      FLAGS_csv = atoi(v.c_str()) != 0;
+    } else {
+      fprintf(stderr, "invalid flag '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+  if (FLAGS_num <= 0) {
+    fprintf(stderr, "--num must be positive\n");
+    return 1;
+  }
+  if (FLAGS_hot_keys < 0 || FLAGS_hot_keys_sample_rate <= 0) {
+    fprintf(stderr, "invalid --hot_keys or --hot_keys_sample_rate\n");
+    return 1;
+  }
+  if (!ParseIndexEngine(FLAGS_engine, &store_engine)) {
+    fprintf(stderr, "unknown engine '%s'\n", FLAGS_engine.c_str());
+    return 1;
+  }
+  BenchmarkRunner runner;
+  runner.Run();
+  return 0;
+}
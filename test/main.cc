@@ -16,7 +16,7 @@
 #include <ostream>
 #include <string>
 
-#include "../base/skiplist.hpp"
+#include "../base/skiplist_old.hpp"
 
 std::string randStr(int len) {
   std::string ans = "";
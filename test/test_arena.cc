@@ -1,6 +1,11 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <cstring>
+#include <thread>
+
 #include "../base/arena.h"
+#include "../base/concurrent_arena.h"
 #include "../base/random.h"
 
 TEST(TestArena, allocateTest) {
@@ -84,3 +89,120 @@ TEST(TestArena, SimpleTest) {
     }
   }
 }
+
+TEST(TestArena, blockSizeTest) {
+  Arena arena(1 << 16);
+  EXPECT_EQ(arena.GetBlockSize(), 1 << 16);
+  // 小于block_size/4的内存都落在同一个块中
+  for (int i = 0; i < 16; i++) arena.Allocate(4000);
+  EXPECT_EQ(arena.GetBlocksSize(), 1);
+  EXPECT_EQ(arena.MemoryUsage(), (1 << 16) + 8);
+  EXPECT_EQ(arena.GetRemainBytes(), (1 << 16) - 64000);
+  // 放不下时换块, 旧块剩余的1536字节计入浪费
+  arena.Allocate(4000);
+  EXPECT_EQ(arena.GetBlocksSize(), 2);
+  EXPECT_EQ(arena.WastedBytes(), (1 << 16) - 64000);
+  EXPECT_GT(arena.Fragmentation(), 0);
+  // 大内存单独分配, 不产生浪费
+  arena.Allocate(62000);
+  EXPECT_EQ(arena.GetBlocksSize(), 3);
+  EXPECT_EQ(arena.WastedBytes(), (1 << 16) - 64000);
+}
+
+TEST(TestArena, mmapTest) {
+  // 块按页对齐, 多出的部分同样可用
+  Arena arena(5000, Arena::kMmap);
+  char* p = arena.Allocate(100);
+  memset(p, 1, 100);
+  EXPECT_EQ(arena.GetBlocksSize(), 1);
+  EXPECT_GE(arena.GetRemainBytes(), 5000 - 100);
+  EXPECT_EQ(arena.HugePageBlocks(), 0);
+  char* big = arena.AllocateAligned(100000);
+  memset(big, 2, 100000);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(big) & 7, 0);
+  EXPECT_GE(arena.MemoryUsage(), 100000 + 5000);
+}
+
+TEST(TestArena, hugePageTest) {
+  // 没有预留大页时退回到透明大页或堆, 行为必须与普通Arena一致
+  Arena arena(2 << 20, Arena::kHugePage);
+  Random rnd(301);
+  std::vector<std::pair<size_t, char*> > allocated;
+  for (int i = 0; i < 10000; i++) {
+    size_t s = rnd.Uniform(1000) + 1;
+    char* r = arena.AllocateAligned(s);
+    memset(r, i % 256, s);
+    allocated.push_back(std::make_pair(s, r));
+  }
+  for (size_t i = 0; i < allocated.size(); i++) {
+    for (size_t b = 0; b < allocated[i].first; b++) {
+      ASSERT_EQ(int(allocated[i].second[b]) & 0xff, i % 256);
+    }
+  }
+  EXPECT_LE(arena.HugePageBlocks(), arena.GetBlocksSize());
+
+  // 单独分配的大内存来自堆, 不会按2MB取整
+  Arena small(1 << 16, Arena::kHugePage);
+  small.Allocate(100);
+  size_t usage = small.MemoryUsage();
+  const size_t n = (3 << 20) + 1000;
+  char* big = small.Allocate(n);
+  memset(big, 1, n);
+  EXPECT_EQ(small.MemoryUsage() - usage, n + sizeof(char*));
+  EXPECT_EQ(small.WastedBytes(), 0);
+}
+
+TEST(TestConcurrentArena, SimpleTest) {
+  ConcurrentArena arena(4096);
+  Random rnd(301);
+  std::vector<std::pair<size_t, char*> > allocated;
+  for (int i = 0; i < 10000; i++) {
+    size_t s = rnd.OneIn(100) ? rnd.Uniform(6000) + 1 : rnd.Uniform(64) + 1;
+    char* r = rnd.OneIn(2) ? arena.AllocateAligned(s) : arena.Allocate(s);
+    memset(r, i % 256, s);
+    allocated.push_back(std::make_pair(s, r));
+  }
+  for (size_t i = 0; i < allocated.size(); i++) {
+    for (size_t b = 0; b < allocated[i].first; b++) {
+      ASSERT_EQ(int(allocated[i].second[b]) & 0xff, i % 256);
+    }
+  }
+}
+
+TEST(TestConcurrentArena, MultiThreadTest) {
+  ConcurrentArena arena;
+  const int kThreads = 8;
+  const int N = 20000;
+  std::vector<std::vector<std::pair<size_t, char*> > > allocated(kThreads);
+  std::vector<std::thread> threads;
+  std::atomic<size_t> total(0);
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t]() {
+      Random rnd(1000 + t);
+      for (int i = 0; i < N; i++) {
+        size_t s = rnd.OneIn(1000) ? rnd.Uniform(8000) + 1
+                                   : rnd.Uniform(100) + 1;
+        char* r;
+        if (rnd.OneIn(2)) {
+          r = arena.AllocateAligned(s);
+          ASSERT_EQ(reinterpret_cast<uintptr_t>(r) & 7, 0);
+        } else {
+          r = arena.Allocate(s);
+        }
+        // 每个线程写入自己的编号, 分配区域重叠时会被其他线程覆盖
+        memset(r, t, s);
+        allocated[t].push_back(std::make_pair(s, r));
+        total += s;
+      }
+    });
+  }
+  for (auto& th : threads) th.join();
+  for (int t = 0; t < kThreads; t++) {
+    for (const auto& a : allocated[t]) {
+      for (size_t b = 0; b < a.first; b++) {
+        ASSERT_EQ(a.second[b], t);
+      }
+    }
+  }
+  ASSERT_GE(arena.MemoryUsage(), total.load());
+}
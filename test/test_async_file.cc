@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <string>
+
+#include "../base/async_file.h"
+#include "../base/random.h"
+
+namespace {
+
+std::string ReadFile(const std::string& fname) {
+  std::ifstream in(fname, std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+bool SyncAndWait(AsyncFile* file) {
+  std::promise<bool> done;
+  std::future<bool> ok = done.get_future();
+  file->Sync([&done](bool r) { done.set_value(r); });
+  return ok.get();
+}
+
+}  // namespace
+
+// 参数为是否尝试io_uring, 不可用时两组测试都走线程池
+class TestAsyncFile : public ::testing::TestWithParam<bool> {
+ protected:
+  void SetUp() override {
+    fname_ = "/tmp/minikv_async_file_" + std::to_string(getpid());
+    // 缓冲区很小, 让写跨越多个缓冲区并用到临时分配的缓冲区
+    options_.buffer_size = 4096;
+    options_.num_buffers = 2;
+    options_.use_io_uring = GetParam();
+  }
+
+  void TearDown() override { unlink(fname_.c_str()); }
+
+  std::string fname_;
+  AsyncFileOptions options_;
+};
+
+TEST_P(TestAsyncFile, writeTest) {
+  AsyncFile file(options_);
+  std::string error;
+  ASSERT_TRUE(file.Open(fname_, true, &error)) << error;
+  if (!GetParam()) {
+    EXPECT_STREQ(file.backend(), "threadpool");
+  }
+
+  Random rnd(301);
+  std::string expect;
+  for (int i = 0; i < 2000; i++) {
+    std::string s(rnd.Uniform(300), 'a' + i % 26);
+    if (rnd.OneIn(50)) s.assign(10000, 'z');
+    file.Append(s);
+    expect += s;
+  }
+  EXPECT_EQ(file.size(), expect.size());
+  ASSERT_TRUE(SyncAndWait(&file));
+  EXPECT_EQ(ReadFile(fname_), expect);
+  ASSERT_TRUE(file.Close());
+}
+
+// 交替写入和Sync, 每个Sync完成时它之前的数据都已经写入
+TEST_P(TestAsyncFile, syncTest) {
+  AsyncFile file(options_);
+  std::string error;
+  ASSERT_TRUE(file.Open(fname_, true, &error)) << error;
+  const int n = 200;
+  std::atomic<int> synced(0);
+  std::atomic<bool> all_ok(true);
+  for (int i = 0; i < n; i++) {
+    file.Append(std::string(1000 + i, 'x'));
+    uint64_t size = file.size();
+    file.Sync([&, size](bool ok) {
+      if (!ok || ReadFile(fname_).size() < size) all_ok = false;
+      synced++;
+    });
+  }
+  ASSERT_TRUE(file.Close());
+  EXPECT_EQ(synced.load(), n);
+  EXPECT_TRUE(all_ok.load());
+}
+
+TEST_P(TestAsyncFile, appendTest) {
+  std::string error;
+  {
+    AsyncFile file(options_);
+    ASSERT_TRUE(file.Open(fname_, true, &error)) << error;
+    file.Append("hello ");
+    ASSERT_TRUE(file.Close());
+  }
+  AsyncFile file(options_);
+  ASSERT_TRUE(file.Open(fname_, false, &error)) << error;
+  EXPECT_EQ(file.size(), 6u);
+  file.Append("world");
+  ASSERT_TRUE(SyncAndWait(&file));
+  EXPECT_EQ(ReadFile(fname_), "hello world");
+}
+
+// /dev/full上的写返回ENOSPC, 之后的Sync和Close都报告失败
+TEST_P(TestAsyncFile, errorTest) {
+  AsyncFile file(options_);
+  std::string error;
+  ASSERT_TRUE(file.Open("/dev/full", true, &error)) << error;
+  file.Append(std::string(10000, 'x'));
+  EXPECT_FALSE(SyncAndWait(&file));
+  EXPECT_FALSE(file.Close());
+  EXPECT_FALSE(file.error().empty());
+  EXPECT_FALSE(file.Open("/nonexistent/dir/file", true, &error));
+}
+
+INSTANTIATE_TEST_CASE_P(Backends, TestAsyncFile, ::testing::Bool());
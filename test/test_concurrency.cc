@@ -0,0 +1,378 @@
+/**
+ * @file test_concurrency.cc
+ * @brief multi-threaded torture of the store skiplist
+ *
+ * Threads run random operations with per-thread deterministic generators
+ * and record every call with invoke/response timestamps. The history is then
+ * checked for linearizability against a sequential model map.
+ *
+ * Also meant to run under the sanitizers:
+ *   cmake -S . -B build-tsan -DKV_SANITIZER=thread
+ *   cmake -S . -B build-asan -DKV_SANITIZER=address
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "../base/random.h"
+#include "../base/skiplist_old.hpp"
+
+namespace {
+
+enum OpType { kInsert, kSearch, kDelete };
+
+struct Operation {
+  OpType type;
+  int key;
+  // value written by insert or returned by a successful search
+  std::string value;
+  // insert: 1 if the key existed, search/delete: 1 if found
+  int result;
+  uint64_t invoke;
+  uint64_t response;
+};
+
+// state of a single key in the sequential model
+struct KeyState {
+  bool present = false;
+  std::string value;
+
+  bool operator==(const KeyState& o) const {
+    return present == o.present && (!present || value == o.value);
+  }
+};
+
+// applies op to the model, false if the recorded result is impossible
+bool Step(const KeyState& s, const Operation& op, KeyState* next) {
+  *next = s;
+  switch (op.type) {
+    case kInsert:
+      if (op.result != (s.present ? 1 : 0)) return false;
+      next->present = true;
+      next->value = op.value;
+      return true;
+    case kSearch:
+      if (op.result != (s.present ? 1 : 0)) return false;
+      return !s.present || s.value == op.value;
+    case kDelete:
+      if (op.result != (s.present ? 1 : 0)) return false;
+      next->present = false;
+      next->value.clear();
+      return true;
+  }
+  return false;
+}
+
+/*
+  Wing & Gong's search with Lowe's memoization. Calls and returns are kept in
+  a doubly linked list ordered by time; an operation can be linearized when
+  its call comes before every pending return. Each step tries to linearize
+  the first candidate, backtracking on a return that cannot be passed.
+  Visited (linearized set, state) pairs are cached.
+*/
+class LinearizabilityChecker {
+ public:
+  explicit LinearizabilityChecker(const std::vector<Operation>& ops)
+      : ops_(ops) {}
+
+  bool Check() {
+    const int n = ops_.size();
+    if (n == 0) return true;
+    std::vector<Event> events;
+    for (int i = 0; i < n; i++) {
+      events.push_back({ops_[i].invoke, i, true});
+      events.push_back({ops_[i].response, i, false});
+    }
+    std::sort(events.begin(), events.end(),
+              [](const Event& a, const Event& b) { return a.time < b.time; });
+
+    // entry 0 is a sentinel head
+    entries_.assign(events.size() + 1, Entry());
+    call_of_.assign(n, 0);
+    ret_of_.assign(n, 0);
+    for (size_t i = 0; i < events.size(); i++) {
+      Entry& e = entries_[i + 1];
+      e.op = events[i].op;
+      e.is_call = events[i].is_call;
+      e.prev = i;
+      e.next = i + 2 <= events.size() ? i + 2 : kNil;
+      entries_[i].next = i + 1;
+      if (e.is_call) {
+        call_of_[e.op] = i + 1;
+      } else {
+        ret_of_[e.op] = i + 1;
+      }
+    }
+
+    std::vector<uint64_t> linearized((n + 63) / 64, 0);
+    std::vector<std::pair<int, KeyState>> stack;
+    KeyState state;
+    size_t cur = entries_[0].next;
+    while (entries_[0].next != kNil) {
+      const Entry& e = entries_[cur];
+      if (e.is_call) {
+        KeyState next;
+        bool ok = Step(state, ops_[e.op], &next);
+        if (ok) {
+          linearized[e.op / 64] |= uint64_t(1) << (e.op % 64);
+          if (cache_.insert(Key(linearized, next)).second) {
+            stack.emplace_back(e.op, state);
+            state = next;
+            Lift(e.op);
+            cur = entries_[0].next;
+            continue;
+          }
+          linearized[e.op / 64] &= ~(uint64_t(1) << (e.op % 64));
+        }
+        cur = e.next;
+      } else {
+        // the earliest pending return cannot be passed: backtrack
+        if (stack.empty()) return false;
+        int op = stack.back().first;
+        state = stack.back().second;
+        stack.pop_back();
+        linearized[op / 64] &= ~(uint64_t(1) << (op % 64));
+        Unlift(op);
+        cur = entries_[call_of_[op]].next;
+      }
+    }
+    return true;
+  }
+
+ private:
+  static const size_t kNil = static_cast<size_t>(-1);
+
+  struct Event {
+    uint64_t time;
+    int op;
+    bool is_call;
+  };
+
+  struct Entry {
+    int op = -1;
+    bool is_call = false;
+    size_t prev = kNil;
+    size_t next = kNil;
+  };
+
+  void Unlink(size_t i) {
+    Entry& e = entries_[i];
+    entries_[e.prev].next = e.next;
+    if (e.next != kNil) entries_[e.next].prev = e.prev;
+  }
+
+  void Relink(size_t i) {
+    Entry& e = entries_[i];
+    entries_[e.prev].next = i;
+    if (e.next != kNil) entries_[e.next].prev = i;
+  }
+
+  void Lift(int op) {
+    Unlink(call_of_[op]);
+    Unlink(ret_of_[op]);
+  }
+
+  // undo in the reverse order of Lift
+  void Unlift(int op) {
+    Relink(ret_of_[op]);
+    Relink(call_of_[op]);
+  }
+
+  static std::string Key(const std::vector<uint64_t>& bits,
+                         const KeyState& s) {
+    std::string key(reinterpret_cast<const char*>(bits.data()),
+                    bits.size() * sizeof(uint64_t));
+    key.push_back(s.present ? '1' : '0');
+    key += s.value;
+    return key;
+  }
+
+  const std::vector<Operation>& ops_;
+  std::vector<Entry> entries_;
+  std::vector<size_t> call_of_;
+  std::vector<size_t> ret_of_;
+  std::unordered_set<std::string> cache_;
+};
+
+// operations on different keys commute, so the history is linearizable iff
+// every per-key sub-history is
+bool CheckHistory(const std::vector<Operation>& history) {
+  std::map<int, std::vector<Operation>> by_key;
+  for (const auto& op : history) by_key[op.key].push_back(op);
+  for (const auto& kv : by_key) {
+    LinearizabilityChecker checker(kv.second);
+    if (!checker.Check()) {
+      ADD_FAILURE() << "history of key " << kv.first
+                    << " is not linearizable (" << kv.second.size()
+                    << " operations)";
+      return false;
+    }
+  }
+  return true;
+}
+
+const int kThreads = 8;
+const int kOpsPerThread = 2000;
+const int kKeySpace = 64;
+
+}  // namespace
+
+TEST(TestLinearizability, checkerAcceptsSequential) {
+  std::vector<Operation> h = {
+      {kInsert, 1, "a", 0, 1, 2},
+      {kSearch, 1, "a", 1, 3, 4},
+      {kDelete, 1, "", 1, 5, 6},
+      {kSearch, 1, "", 0, 7, 8},
+  };
+  EXPECT_TRUE(CheckHistory(h));
+}
+
+TEST(TestLinearizability, checkerAcceptsOverlap) {
+  // the search overlaps the insert, so it may see either state
+  std::vector<Operation> h = {
+      {kInsert, 1, "a", 0, 1, 4},
+      {kSearch, 1, "a", 1, 2, 3},
+      {kSearch, 1, "", 0, 2, 5},
+  };
+  EXPECT_TRUE(CheckHistory(h));
+}
+
+TEST(TestLinearizability, checkerRejectsStaleRead) {
+  std::vector<Operation> h = {
+      {kInsert, 1, "a", 0, 1, 2},
+      {kInsert, 1, "b", 1, 3, 4},
+      // strictly after the second insert but returns the first value
+      {kSearch, 1, "a", 1, 5, 6},
+  };
+  LinearizabilityChecker checker(h);
+  EXPECT_FALSE(checker.Check());
+}
+
+TEST(TestConcurrency, linearizableHistory) {
+  SkipList<int, std::string> list(12, 4);
+  std::atomic<uint64_t> clock(0);
+  std::vector<std::vector<Operation>> logs(kThreads);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t]() {
+      Random rnd(1000 + t);
+      std::vector<Operation>& log = logs[t];
+      log.reserve(kOpsPerThread);
+      for (int i = 0; i < kOpsPerThread; i++) {
+        Operation op;
+        op.key = rnd.Uniform(kKeySpace);
+        uint32_t dice = rnd.Uniform(10);
+        op.invoke = clock.fetch_add(1);
+        if (dice < 4) {
+          op.type = kInsert;
+          // unique values make stale reads detectable
+          op.value = std::to_string(t) + ":" + std::to_string(i);
+          op.result = list.insertElement(op.key, op.value);
+        } else if (dice < 8) {
+          op.type = kSearch;
+          op.result = list.searchElement(op.key, op.value) ? 1 : 0;
+        } else {
+          op.type = kDelete;
+          op.result = list.deleteElement(op.key) ? 1 : 0;
+        }
+        op.response = clock.fetch_add(1);
+        log.push_back(op);
+      }
+    });
+  }
+  for (auto& th : threads) th.join();
+
+  std::vector<Operation> history;
+  for (const auto& log : logs) {
+    history.insert(history.end(), log.begin(), log.end());
+  }
+  EXPECT_TRUE(CheckHistory(history));
+
+  // the final state must match the key count
+  int live = 0;
+  std::string v;
+  for (int k = 0; k < kKeySpace; k++) live += list.searchElement(k, v);
+  EXPECT_EQ(live, list.size());
+}
+
+// ttl paths are time dependent and not modelled; this only has to survive
+// the sanitizers and keep the size consistent
+TEST(TestConcurrency, ttlTorture) {
+  SkipList<int, std::string> list(12, 4);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&list, t]() {
+      Random rnd(2000 + t);
+      std::string v;
+      std::vector<std::pair<int, std::string>> items;
+      for (int i = 0; i < kOpsPerThread; i++) {
+        int key = rnd.Uniform(kKeySpace);
+        switch (rnd.Uniform(7)) {
+          case 0:
+            list.insertElement(key, "v");
+            break;
+          case 1:
+            // zero second ttls expire immediately
+            list.element_expire_time(key, rnd.Uniform(2));
+            break;
+          case 2:
+            list.element_ttl(key);
+            break;
+          case 3:
+            list.searchElement(key, v);
+            break;
+          case 4:
+            list.deleteElement(key);
+            break;
+          case 5:
+            items.clear();
+            list.scanElement(key, 8, &items);
+            break;
+          default:
+            list.cycle_del();
+            break;
+        }
+      }
+    });
+  }
+  for (auto& th : threads) th.join();
+
+  std::vector<std::pair<int, std::string>> items;
+  list.scanElement(0, kKeySpace, &items);
+  EXPECT_LE(static_cast<int>(items.size()), list.size());
+}
+
+// concurrent increments and appends lose no update: every counter and
+// the appended string end with the exact totals
+TEST(TestConcurrency, updateNoLostWrites) {
+  SkipList<int, std::string> list(12, 4);
+  const int kCounters = 4;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&list, t]() {
+      long long n;
+      size_t size;
+      for (int i = 0; i < kOpsPerThread; i++) {
+        list.incrementElement(i % kCounters, 1, &n);
+        if (i % 16 == 0) list.appendElement(-1, "x", &size);
+      }
+    });
+  }
+  for (auto& th : threads) th.join();
+
+  std::string v;
+  for (int k = 0; k < kCounters; k++) {
+    ASSERT_TRUE(list.searchElement(k, v));
+    EXPECT_EQ(std::stoll(v), kThreads * kOpsPerThread / kCounters);
+  }
+  ASSERT_TRUE(list.searchElement(-1, v));
+  EXPECT_EQ(v.size(), size_t(kThreads * ((kOpsPerThread + 15) / 16)));
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../base/hot_keys.hpp"
+#include "../base/random.h"
+#include "../base/skiplist_old.hpp"
+
+// 少数热点key混在大量只出现几次的key中, 采样后仍能找出热点并估出次数
+TEST(TestHotKeys, heavyHitterTest) {
+  HotKeys<int> hot(8, 4, 8192);
+  Random rnd(301);
+  std::map<int, uint64_t> count;
+  int cold = 1000;
+  for (int i = 0; i < 200000; i++) {
+    int k;
+    if (rnd.OneIn(2)) {
+      // 0到7, 越小的key越热
+      k = rnd.Skewed(3);
+    } else {
+      k = cold++;
+    }
+    count[k]++;
+    hot.Add(k);
+  }
+  std::vector<std::pair<int, uint64_t>> top = hot.Top();
+  ASSERT_EQ(top.size(), 8u);
+  for (size_t i = 1; i < top.size(); i++) {
+    EXPECT_GE(top[i - 1].second, top[i].second);
+  }
+  // 热点key都在, 估计值与真实次数相差不超过一成
+  for (int k = 0; k < 8; k++) {
+    bool found = false;
+    for (auto& e : top) found = found || e.first == k;
+    EXPECT_TRUE(found) << k;
+    EXPECT_NEAR(double(hot.Estimate(k)), double(count[k]), 0.1 * count[k]);
+  }
+  EXPECT_LT(hot.Estimate(cold - 1), 100u);
+
+  hot.Clear();
+  EXPECT_TRUE(hot.Top().empty());
+  EXPECT_EQ(hot.Estimate(0), 0u);
+}
+
+// 计数周期性减半, 不再被访问的热点被新的热点替换
+TEST(TestHotKeys, decayTest) {
+  HotKeys<std::string> hot(2, 1, 64);
+  for (int i = 0; i < 5000; i++) hot.Add("old" + std::to_string(i % 2));
+  for (int i = 0; i < 5000; i++) {
+    hot.Add("new" + std::to_string(i % 2));
+    hot.Add("cold" + std::to_string(i));
+  }
+  std::vector<std::pair<std::string, uint64_t>> top = hot.Top();
+  ASSERT_EQ(top.size(), 2u);
+  EXPECT_EQ(top[0].first.substr(0, 3), "new");
+  EXPECT_EQ(top[1].first.substr(0, 3), "new");
+}
+
+// store的读写分别统计, 关闭后不再返回
+TEST(TestHotKeys, storeTest) {
+  SkipList<int, std::string> list(12, 4);
+  EXPECT_TRUE(list.hotKeys(false).empty());
+  list.setHotKeys(4, 1);
+  for (int i = 0; i < 100; i++) list.insertElement(i, std::to_string(i));
+  for (int i = 0; i < 1000; i++) list.insertElement(7, "seven");
+  std::string v;
+  for (int i = 0; i < 1000; i++) list.searchElement(i % 3, v);
+
+  std::vector<std::pair<int, uint64_t>> writes = list.hotKeys(true);
+  ASSERT_FALSE(writes.empty());
+  EXPECT_EQ(writes[0].first, 7);
+  EXPECT_GE(writes[0].second, 1000u);
+  std::vector<std::pair<int, uint64_t>> reads = list.hotKeys(false);
+  ASSERT_GE(reads.size(), 3u);
+  for (int i = 0; i < 3; i++) EXPECT_LT(reads[i].first, 3);
+
+  std::string value;
+  ASSERT_TRUE(list.getProperty("minikv.hot-writes", &value));
+  EXPECT_EQ(value.substr(0, value.find('\n')),
+            "7 " + std::to_string(writes[0].second));
+  list.setHotKeys(0, 1);
+  EXPECT_TRUE(list.hotKeys(true).empty());
+  ASSERT_TRUE(list.getProperty("minikv.hot-reads", &value));
+  EXPECT_EQ(value, "");
+}
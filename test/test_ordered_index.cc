@@ -0,0 +1,319 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <climits>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../base/random.h"
+#include "../base/skiplist_old.hpp"
+
+// 负数检验ART的符号位处理, 字符串key互为前缀且含0字节
+template <typename K>
+K MakeKey(Random* rnd);
+
+template <>
+int MakeKey<int>(Random* rnd) {
+  return static_cast<int>(rnd->Uniform(2000)) - 1000;
+}
+
+template <>
+std::string MakeKey<std::string>(Random* rnd) {
+  const char* prefixes[] = {"", "a", "ab", "abc", "user0000", "\xff"};
+  std::string k = prefixes[rnd->Uniform(6)];
+  k += std::string(rnd->Uniform(2), '\0');
+  if (rnd->OneIn(2)) k += std::to_string(rnd->Uniform(300));
+  return k;
+}
+
+// 排在MakeKey的所有key之后, j为两位数时按j递增
+template <typename K>
+K RunKey(int j);
+
+template <>
+int RunKey<int>(int j) {
+  return 1000 + j;
+}
+
+template <>
+std::string RunKey<std::string>(int j) {
+  return "\xff\xff" + std::to_string(j);
+}
+
+template <typename K, typename V>
+class HashedSkipListIndex : public SkipListIndex<K, V> {
+ public:
+  HashedSkipListIndex() : SkipListIndex<K, V>(12, true) {}
+};
+
+template <typename Index>
+class TestOrderedIndex : public ::testing::Test {};
+
+// 小fanout的B+tree更容易触发分裂和删空节点
+typedef ::testing::Types<
+    SkipListIndex<int, std::string>, SkipListIndex<std::string, std::string>,
+    HashedSkipListIndex<int, std::string>,
+    HashedSkipListIndex<std::string, std::string>,
+    ArtIndex<int, std::string>, ArtIndex<std::string, std::string>,
+    BPlusTreeIndex<int, std::string, Less<int>, 4>,
+    BPlusTreeIndex<std::string, std::string, Less<std::string>, 4>>
+    Engines;
+
+template <typename Index>
+struct Factory {
+  static Index* New() { return new Index(); }
+};
+template <typename K, typename V, typename Comp, typename Policy>
+struct Factory<SkipListIndex<K, V, Comp, Policy>> {
+  static SkipListIndex<K, V, Comp, Policy>* New() {
+    return new SkipListIndex<K, V, Comp, Policy>(12);
+  }
+};
+
+template <typename K, typename V>
+K KeyOf(const OrderedIndex<K, V>*);
+
+TYPED_TEST_CASE(TestOrderedIndex, Engines);
+
+TYPED_TEST(TestOrderedIndex, modelTest) {
+  typedef decltype(KeyOf(static_cast<TypeParam*>(nullptr))) K;
+  std::unique_ptr<TypeParam> index(Factory<TypeParam>::New());
+  std::map<K, std::string> model;
+  Random rnd(301);
+  for (int i = 0; i < 20000; i++) {
+    K k = MakeKey<K>(&rnd);
+    std::string v = std::to_string(i);
+    switch (rnd.Uniform(3)) {
+      case 0:
+        EXPECT_EQ(index->Insert(k, v), model.count(k) == 0);
+        model[k] = v;
+        break;
+      case 1: {
+        std::string* got = index->Lookup(k);
+        ASSERT_EQ(got != nullptr, model.count(k) == 1);
+        if (got) {
+          EXPECT_EQ(*got, model[k]);
+        }
+        break;
+      }
+      default:
+        EXPECT_EQ(index->Erase(k), model.erase(k) == 1);
+        break;
+    }
+    ASSERT_EQ(index->Size(), model.size());
+  }
+  EXPECT_GT(index->MemoryUsage(), 0u);
+
+  auto it = index->NewIterator();
+  auto expect = model.begin();
+  for (it->SeekToFirst(); it->Valid(); it->Next(), ++expect) {
+    ASSERT_TRUE(expect != model.end());
+    EXPECT_EQ(it->key(), expect->first);
+    EXPECT_EQ(it->value(), expect->second);
+  }
+  EXPECT_TRUE(expect == model.end());
+
+  for (int i = 0; i < 1000; i++) {
+    K target = MakeKey<K>(&rnd);
+    it->Seek(target);
+    auto lb = model.lower_bound(target);
+    ASSERT_EQ(it->Valid(), lb != model.end());
+    if (lb != model.end()) {
+      EXPECT_EQ(it->key(), lb->first);
+    }
+  }
+
+  // 全部删除后结构应回到空树
+  for (auto& kv : model) EXPECT_TRUE(index->Erase(kv.first));
+  EXPECT_EQ(index->Size(), 0u);
+  it->SeekToFirst();
+  EXPECT_FALSE(it->Valid());
+  EXPECT_TRUE(index->Insert(K(), "again"));
+  EXPECT_EQ(*index->Lookup(K()), "again");
+}
+
+// 随机插入删除和尾部整段接入之后, 名次与模型一致
+TYPED_TEST(TestOrderedIndex, rankTest) {
+  typedef decltype(KeyOf(static_cast<TypeParam*>(nullptr))) K;
+  std::unique_ptr<TypeParam> index(Factory<TypeParam>::New());
+  std::map<K, std::string> model;
+  Random rnd(17);
+  for (int i = 0; i < 3000; i++) {
+    K k = MakeKey<K>(&rnd);
+    if (rnd.OneIn(3)) {
+      EXPECT_EQ(index->Erase(k), model.erase(k) == 1);
+    } else {
+      index->Insert(k, std::to_string(i));
+      model[k] = std::to_string(i);
+    }
+  }
+  // 比现有key都大的一段
+  std::vector<std::pair<K, std::string>> run;
+  for (int j = 10; j < 30; j++) {
+    run.emplace_back(RunKey<K>(j), "run");
+    model[run.back().first] = "run";
+  }
+  index->InsertRun(run.data(), run.size());
+  ASSERT_EQ(index->Size(), model.size());
+
+  auto it = index->NewIterator();
+  size_t i = 0;
+  for (auto& kv : model) {
+    EXPECT_EQ(index->Rank(kv.first), i);
+    it->SeekToRank(i);
+    ASSERT_TRUE(it->Valid());
+    EXPECT_EQ(it->key(), kv.first);
+    i++;
+  }
+  it->SeekToRank(model.size());
+  EXPECT_FALSE(it->Valid());
+  for (int j = 0; j < 1000; j++) {
+    K target = MakeKey<K>(&rnd);
+    size_t expect = std::distance(model.begin(), model.lower_bound(target));
+    EXPECT_EQ(index->Rank(target), expect);
+  }
+}
+
+class TestStoreEngine : public ::testing::TestWithParam<IndexEngine> {};
+
+TEST_P(TestStoreEngine, storeTest) {
+  SkipList<int, std::string> list(12, 4, GetParam());
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(list.insertElement(i * 2, std::to_string(i)), 0);
+  }
+  EXPECT_EQ(list.insertElement(10, "x"), 1);
+  std::string v;
+  EXPECT_TRUE(list.searchElement(10, v));
+  EXPECT_EQ(v, "x");
+  EXPECT_FALSE(list.searchElement(11, v));
+  EXPECT_TRUE(list.deleteElement(10));
+  EXPECT_FALSE(list.deleteElement(10));
+  EXPECT_EQ(list.size(), 999);
+
+  std::vector<std::pair<int, std::string>> items;
+  EXPECT_EQ(list.scanElement(9, 3, &items), 3);
+  ASSERT_EQ(items.size(), 3u);
+  EXPECT_EQ(items[0].first, 12);
+  EXPECT_EQ(items[2].first, 16);
+
+  std::string value;
+  ASSERT_TRUE(list.getProperty("minikv.num-entries", &value));
+  EXPECT_EQ(value, "999");
+  ASSERT_TRUE(list.getProperty("minikv.stats", &value));
+  EXPECT_NE(value.find("minikv_keys 999"), std::string::npos);
+  ASSERT_TRUE(list.getProperty("minikv.index-engine", &value));
+  const char* names[] = {"skiplist", "art", "bplustree", "skiplist+hash"};
+  EXPECT_EQ(value, names[GetParam()]);
+}
+
+// 并行载入: 空的store按块整段接到索引尾部, 非空的store逐个插入
+TEST_P(TestStoreEngine, parallelLoadTest) {
+  const std::string path = "/tmp/minikv_load_" + std::to_string(getpid());
+  std::map<int, std::string> expect;
+  {
+    SkipList<int, std::string> list(12, 4, GetParam());
+    SnapshotOptions options;
+    options.block_size = 256;
+    list.setSnapshotOptions(options);
+    for (int i = -3000; i < 3000; i += 3) {
+      list.insertElement(i, std::to_string(i * 7));
+      expect[i] = std::to_string(i * 7);
+    }
+    ASSERT_TRUE(list.dumpFile(path));
+  }
+  std::vector<std::pair<int, std::string>> want(expect.begin(), expect.end());
+  for (int threads : {1, 4}) {
+    SkipList<int, std::string> list(12, 4, GetParam());
+    list.loadFile(path, threads);
+    ASSERT_EQ(list.size(), int(expect.size()));
+    std::vector<std::pair<int, std::string>> items;
+    list.scanElement(INT_MIN, 10000, &items);
+    EXPECT_EQ(items, want);
+    std::string v;
+    for (auto& kv : expect) {
+      ASSERT_TRUE(list.searchElement(kv.first, v)) << kv.first;
+      EXPECT_EQ(v, kv.second);
+    }
+    EXPECT_FALSE(list.searchElement(1, v));
+    // 载入后仍能在任意位置插入
+    EXPECT_EQ(list.insertElement(1, "one"), 0);
+    EXPECT_EQ(list.insertElement(3000, "end"), 0);
+    ASSERT_TRUE(list.searchElement(1, v));
+    EXPECT_EQ(v, "one");
+  }
+  SkipList<int, std::string> list(12, 4, GetParam());
+  list.insertElement(0, "old");
+  list.insertElement(1, "one");
+  list.loadFile(path, 4);
+  EXPECT_EQ(list.size(), int(expect.size()) + 1);
+  std::string v;
+  ASSERT_TRUE(list.searchElement(0, v));
+  EXPECT_EQ(v, "0");
+  unlink(path.c_str());
+}
+
+INSTANTIATE_TEST_CASE_P(Engines, TestStoreEngine,
+                        ::testing::Values(SKIPLIST_ENGINE, ART_ENGINE,
+                                          BPLUSTREE_ENGINE,
+                                          HASHED_SKIPLIST_ENGINE));
+
+// 过期删除也要同步摘掉hash表中的节点
+TEST(TestStoreEngine, hashExpireTest) {
+  SkipList<int, std::string> list(12, 1, HASHED_SKIPLIST_ENGINE);
+  for (int i = 0; i < 100; i++) list.insertElement(i, std::to_string(i));
+  for (int i = 0; i < 100; i += 2) list.element_expire_time(i, 0);
+  std::string v;
+  EXPECT_FALSE(list.searchElement(0, v));
+  list.cycle_del();
+  EXPECT_EQ(list.size(), 50);
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(list.searchElement(i, v), i % 2 == 1);
+  }
+  EXPECT_EQ(list.insertElement(4, "new"), 0);
+  EXPECT_TRUE(list.searchElement(4, v));
+  EXPECT_EQ(v, "new");
+}
+
+template <typename T>
+class Greater {
+ public:
+  bool operator()(const T& a, const T& b) const { return b < a; }
+};
+
+// ART只能按默认顺序排列, hash表的相等与比较器不一致, 自定义比较器时退回跳表
+TEST(TestStoreEngine, artFallbackTest) {
+  SkipList<int, std::string, Greater<int>> list(12, 4, ART_ENGINE);
+  std::string value;
+  ASSERT_TRUE(list.getProperty("minikv.index-engine", &value));
+  EXPECT_EQ(value, "skiplist");
+  SkipList<int, std::string, Greater<int>> hashed(12, 4,
+                                                  HASHED_SKIPLIST_ENGINE);
+  ASSERT_TRUE(hashed.getProperty("minikv.index-engine", &value));
+  EXPECT_EQ(value, "skiplist");
+  for (int i = 0; i < 10; i++) list.insertElement(i, std::to_string(i));
+  std::vector<std::pair<int, std::string>> items;
+  list.scanElement(5, 10, &items);
+  ASSERT_EQ(items.size(), 6u);
+  EXPECT_EQ(items.front().first, 5);
+  EXPECT_EQ(items.back().first, 0);
+}
+
+// 节点arena从mmap或大页取块, 行为与堆上的arena一致
+TEST(TestStoreEngine, nodeArenaTest) {
+  for (Arena::BlockSource source : {Arena::kMmap, Arena::kHugePage}) {
+    SkipList<int, std::string> list(12, 4, HASHED_SKIPLIST_ENGINE, source);
+    for (int i = 0; i < 5000; i++) list.insertElement(i, std::to_string(i));
+    for (int i = 0; i < 5000; i += 2) list.deleteElement(i);
+    EXPECT_EQ(list.size(), 2500);
+    std::string v;
+    for (int i = 0; i < 5000; i++) {
+      ASSERT_EQ(list.searchElement(i, v), i % 2 == 1) << i;
+      if (i % 2 == 1) {
+        EXPECT_EQ(v, std::to_string(i));
+      }
+    }
+  }
+}
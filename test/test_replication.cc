@@ -0,0 +1,236 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../server/client.h"
+#include "../server/replication.h"
+#include "../server/server.h"
+
+typedef std::vector<std::pair<std::string, std::string>> Items;
+
+// 主库和从库在同一个进程中, 通过unix socket连接
+class TestReplication : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    prefix_ = "/tmp/minikv_repl_" + std::to_string(getpid());
+    primary_.reset(new Store(12, 16));
+    ReplicationOptions repl;
+    // 断开期间写入超过64KB时需要全量同步
+    repl.backlog_size = 64 << 10;
+    repl.sync_file = prefix_ + ".dump";
+    log_.reset(new ReplicationLog(repl, primary_.get()));
+    primary_->setWriteListener(log_.get());
+
+    ServerOptions options;
+    options.port = -1;
+    options.unix_socket = prefix_ + ".sock";
+    options.io_threads = 2;
+    server_.reset(new Server(options, primary_.get()));
+    server_->set_replication_log(log_.get());
+    std::string error;
+    ASSERT_TRUE(server_->Start(&error)) << error;
+
+    replica_store_.reset(new Store(12, 16));
+    ReplicaOptions replica;
+    replica.unix_socket = options.unix_socket;
+    replica.sync_file = prefix_ + ".sync";
+    replica_.reset(new ReplicaClient(replica, replica_store_.get()));
+  }
+
+  void TearDown() override {
+    replica_->Stop();
+    server_->Stop();
+    log_->Stop();
+    primary_->setWriteListener(nullptr);
+  }
+
+  // 等待从库应用完主库已经写入的所有操作
+  bool CaughtUp() {
+    for (int i = 0; i < 5000; i++) {
+      if (replica_->link_up() && replica_->offset() == log_->offset()) {
+        return true;
+      }
+      usleep(1000);
+    }
+    return false;
+  }
+
+  static Items All(Store* store) {
+    Items items;
+    store->scanElement("", 1 << 30, &items);
+    return items;
+  }
+
+  std::string prefix_;
+  std::unique_ptr<Store> primary_;
+  std::unique_ptr<ReplicationLog> log_;
+  std::unique_ptr<Server> server_;
+  std::unique_ptr<Store> replica_store_;
+  std::unique_ptr<ReplicaClient> replica_;
+};
+
+// 全量同步快照和ttl, 然后回放写入, 删除, 过期和persist
+TEST_F(TestReplication, streamTest) {
+  for (int i = 0; i < 2000; i++) {
+    primary_->insertElement("key" + std::to_string(i), std::to_string(i));
+  }
+  primary_->element_expire_time("key1", 100);
+  replica_->Start();
+  ASSERT_TRUE(CaughtUp());
+  EXPECT_EQ(replica_->full_syncs(), 1u);
+  EXPECT_EQ(All(replica_store_.get()), All(primary_.get()));
+  EXPECT_GT(replica_store_->element_ttl("key1"), 90);
+  EXPECT_EQ(replica_store_->element_ttl("key2"), -1);
+
+  primary_->insertElement("new", "v");
+  primary_->insertElement("key3", "overwritten");
+  primary_->deleteElement("key4");
+  primary_->element_expire_time("key5", 50);
+  primary_->element_persist("key1");
+  primary_->element_expire_time("key6", 0);
+  // INCR保留ttl, SET EX的value和ttl一起同步
+  primary_->element_expire_time("key7", 100);
+  long long n;
+  primary_->incrementElement("key7", 1, &n);
+  primary_->setElement("key8", "v", 30);
+  ASSERT_TRUE(CaughtUp());
+  std::string v;
+  EXPECT_FALSE(replica_store_->searchElement("key6", v));
+  EXPECT_FALSE(primary_->searchElement("key6", v));
+  ASSERT_TRUE(CaughtUp());
+  EXPECT_EQ(All(replica_store_.get()), All(primary_.get()));
+  EXPECT_EQ(replica_store_->element_ttl("key1"), -1);
+  EXPECT_GT(replica_store_->element_ttl("key5"), 40);
+  EXPECT_GT(replica_store_->element_ttl("key7"), 90);
+  EXPECT_GT(replica_store_->element_ttl("key8"), 20);
+  ASSERT_TRUE(replica_store_->searchElement("key3", v));
+  EXPECT_EQ(v, "overwritten");
+
+  // 从库的server只读
+  ServerOptions options;
+  options.port = -1;
+  options.unix_socket = prefix_ + ".replica.sock";
+  options.io_threads = 1;
+  Server replica_server(options, replica_store_.get());
+  replica_server.set_replica(replica_.get());
+  std::string error;
+  ASSERT_TRUE(replica_server.Start(&error)) << error;
+  RespClient c;
+  ASSERT_TRUE(c.ConnectUnix(options.unix_socket, &error)) << error;
+  RespValue r;
+  ASSERT_TRUE(c.Call({"GET", "new"}, &r));
+  EXPECT_EQ(r.str, "v");
+  ASSERT_TRUE(c.Call({"SET", "k", "v"}, &r));
+  EXPECT_EQ(r.type, RespValue::kError);
+  EXPECT_EQ(r.str.compare(0, 8, "READONLY"), 0);
+  ASSERT_TRUE(c.Call({"INFO", "replication"}, &r));
+  EXPECT_NE(r.str.find("role:slave"), std::string::npos);
+  EXPECT_NE(r.str.find("master_link_status:up"), std::string::npos);
+  replica_server.Stop();
+
+  RespClient p;
+  ASSERT_TRUE(p.ConnectUnix(prefix_ + ".sock", &error)) << error;
+  ASSERT_TRUE(p.Call({"INFO", "replication"}, &r));
+  EXPECT_NE(r.str.find("connected_slaves:1"), std::string::npos);
+  EXPECT_NE(r.str.find("master_replid:" + log_->replid()), std::string::npos);
+  // 通过RESP写入主库
+  ASSERT_TRUE(p.Call({"SET", "resp", "1", "EX", "100"}, &r));
+  ASSERT_TRUE(CaughtUp());
+  ASSERT_TRUE(replica_store_->searchElement("resp", v));
+  EXPECT_GT(replica_store_->element_ttl("resp"), 90);
+}
+
+// 断开后backlog还在时从断点继续, 否则重新全量同步
+TEST_F(TestReplication, resyncTest) {
+  for (int i = 0; i < 100; i++) {
+    primary_->insertElement("a" + std::to_string(i), "v");
+  }
+  replica_->Start();
+  ASSERT_TRUE(CaughtUp());
+  replica_->Stop();
+  for (int i = 0; i < 100; i++) {
+    primary_->insertElement("b" + std::to_string(i), "v");
+  }
+  primary_->deleteElement("a1");
+  replica_->Start();
+  ASSERT_TRUE(CaughtUp());
+  EXPECT_EQ(replica_->full_syncs(), 1u);
+  EXPECT_EQ(replica_->partial_syncs(), 1u);
+  EXPECT_EQ(All(replica_store_.get()), All(primary_.get()));
+
+  replica_->Stop();
+  const std::string big(1024, 'x');
+  for (int i = 0; i < 200; i++) {
+    primary_->insertElement("c" + std::to_string(i), big);
+  }
+  primary_->deleteElement("a2");
+  EXPECT_GT(log_->backlog_first_offset(), replica_->offset());
+  replica_->Start();
+  ASSERT_TRUE(CaughtUp());
+  EXPECT_EQ(replica_->full_syncs(), 2u);
+  EXPECT_EQ(All(replica_store_.get()), All(primary_.get()));
+  EXPECT_EQ(log_->full_syncs(), 2u);
+  EXPECT_EQ(log_->partial_syncs(), 1u);
+}
+
+// 主库淘汰的key在从库上也被删除
+TEST_F(TestReplication, evictionTest) {
+  primary_->setMaxMemory(200 * EntryCharge(std::string(), std::string()),
+                         ALLKEYS_LRU);
+  replica_->Start();
+  ASSERT_TRUE(CaughtUp());
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_GE(primary_->insertElement("k" + std::to_string(i), "v"), 0);
+  }
+  ASSERT_TRUE(CaughtUp());
+  EXPECT_LT(primary_->size(), 1000);
+  EXPECT_EQ(All(replica_store_.get()), All(primary_.get()));
+}
+
+// 删除只在映射快照中的key也要同步到从库
+TEST_F(TestReplication, snapshotDeleteTest) {
+  Store source(12, 16);
+  for (int i = 0; i < 100; i++) {
+    source.insertElement("s" + std::to_string(i), std::to_string(i));
+  }
+  const std::string path = prefix_ + ".base";
+  ASSERT_TRUE(source.dumpFile(path));
+  std::string error;
+  ASSERT_TRUE(primary_->openSnapshot(path, &error)) << error;
+  replica_->Start();
+  ASSERT_TRUE(CaughtUp());
+  std::string v;
+  ASSERT_TRUE(replica_store_->searchElement("s7", v));
+
+  ASSERT_TRUE(primary_->deleteElement("s7"));
+  ASSERT_TRUE(CaughtUp());
+  EXPECT_FALSE(primary_->searchElement("s7", v));
+  EXPECT_FALSE(replica_store_->searchElement("s7", v));
+  EXPECT_EQ(All(replica_store_.get()), All(primary_.get()));
+  unlink(path.c_str());
+}
+
+// 两个从库使用相同的sync_file前缀, 全量同步时不会互相覆盖
+TEST_F(TestReplication, sharedSyncFileTest) {
+  for (int i = 0; i < 2000; i++) {
+    primary_->insertElement("k" + std::to_string(i), std::to_string(i));
+  }
+  Store other(12, 16);
+  ReplicaClient second(replica_->options(), &other);
+  replica_->Start();
+  second.Start();
+  ASSERT_TRUE(CaughtUp());
+  for (int i = 0; i < 5000 && !(second.link_up() &&
+                                 second.offset() == log_->offset());
+       i++) {
+    usleep(1000);
+  }
+  EXPECT_EQ(second.full_syncs(), 1u);
+  EXPECT_EQ(All(replica_store_.get()), All(primary_.get()));
+  EXPECT_EQ(All(&other), All(primary_.get()));
+  second.Stop();
+}
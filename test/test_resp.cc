@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../server/commands.h"
+#include "../server/resp.h"
+
+TEST(TestResp, multibulkTest) {
+  std::string buf =
+      "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$0\r\n\r\n"
+      "*1\r\n$4\r\nPING\r\n";
+  std::vector<std::string> argv;
+  size_t consumed;
+  std::string error;
+  ASSERT_EQ(ParseRequest(buf.data(), buf.size(), &argv, &consumed, &error),
+            RESP_OK);
+  ASSERT_EQ(argv.size(), 3u);
+  EXPECT_EQ(argv[0], "SET");
+  EXPECT_EQ(argv[1], "k");
+  EXPECT_EQ(argv[2], "");
+  // 流水线中的第二个请求从consumed处开始
+  ASSERT_EQ(ParseRequest(buf.data() + consumed, buf.size() - consumed, &argv,
+                         &consumed, &error),
+            RESP_OK);
+  ASSERT_EQ(argv.size(), 1u);
+  EXPECT_EQ(argv[0], "PING");
+}
+
+// 请求在任意位置被截断都应返回INCOMPLETE, 而不是出错
+TEST(TestResp, incompleteTest) {
+  std::string value("a\r\nb\0c", 6);
+  std::string buf;
+  AppendRequest(&buf, {"SET", "key", value});
+  std::vector<std::string> argv;
+  size_t consumed;
+  std::string error;
+  for (size_t n = 0; n < buf.size(); n++) {
+    ASSERT_EQ(ParseRequest(buf.data(), n, &argv, &consumed, &error),
+              RESP_INCOMPLETE)
+        << n;
+  }
+  ASSERT_EQ(ParseRequest(buf.data(), buf.size(), &argv, &consumed, &error),
+            RESP_OK);
+  EXPECT_EQ(consumed, buf.size());
+  EXPECT_EQ(argv[2], value);
+}
+
+TEST(TestResp, inlineTest) {
+  std::string buf = "  GET   foo \r\nPING\n\r\n";
+  std::vector<std::string> argv;
+  size_t consumed;
+  std::string error;
+  ASSERT_EQ(ParseRequest(buf.data(), buf.size(), &argv, &consumed, &error),
+            RESP_OK);
+  EXPECT_EQ(argv, std::vector<std::string>({"GET", "foo"}));
+  size_t off = consumed;
+  ASSERT_EQ(ParseRequest(buf.data() + off, buf.size() - off, &argv, &consumed,
+                         &error),
+            RESP_OK);
+  EXPECT_EQ(argv, std::vector<std::string>({"PING"}));
+  off += consumed;
+  // 空行得到空的argv
+  ASSERT_EQ(ParseRequest(buf.data() + off, buf.size() - off, &argv, &consumed,
+                         &error),
+            RESP_OK);
+  EXPECT_TRUE(argv.empty());
+  EXPECT_EQ(ParseRequest("GET", 3, &argv, &consumed, &error), RESP_INCOMPLETE);
+}
+
+TEST(TestResp, errorTest) {
+  const char* bad[] = {"*x\r\n", "*1\r\n:1\r\n", "*1\r\n$-1\r\n",
+                       "*1\r\n$1\r\nab\r\n", "*1\r\n$99999999999\r\n"};
+  std::vector<std::string> argv;
+  size_t consumed;
+  std::string error;
+  for (const char* b : bad) {
+    EXPECT_EQ(ParseRequest(b, strlen(b), &argv, &consumed, &error), RESP_ERROR)
+        << b;
+    EXPECT_FALSE(error.empty());
+  }
+}
+
+TEST(TestResp, replyTest) {
+  std::string buf;
+  AppendSimpleString(&buf, "OK");
+  AppendError(&buf, "ERR bad\r\nthing");
+  AppendInteger(&buf, -42);
+  AppendNil(&buf);
+  AppendArrayHeader(&buf, 2);
+  AppendBulk(&buf, std::string("x\0y", 3));
+  AppendArrayHeader(&buf, 1);
+  AppendInteger(&buf, 7);
+
+  RespValue v;
+  size_t consumed, off = 0;
+  std::vector<RespValue> replies;
+  while (off < buf.size()) {
+    ASSERT_EQ(ParseReply(buf.data() + off, buf.size() - off, &v, &consumed),
+              RESP_OK);
+    replies.push_back(v);
+    off += consumed;
+  }
+  ASSERT_EQ(replies.size(), 5u);
+  EXPECT_EQ(replies[0].type, RespValue::kSimpleString);
+  EXPECT_EQ(replies[0].str, "OK");
+  EXPECT_EQ(replies[1].type, RespValue::kError);
+  EXPECT_EQ(replies[1].str, "ERR bad  thing");
+  EXPECT_EQ(replies[2].integer, -42);
+  EXPECT_EQ(replies[3].type, RespValue::kNil);
+  ASSERT_EQ(replies[4].elements.size(), 2u);
+  EXPECT_EQ(replies[4].elements[0].str, std::string("x\0y", 3));
+  EXPECT_EQ(replies[4].elements[1].elements[0].integer, 7);
+
+  // 截断在嵌套数组的任意位置
+  std::string arr;
+  AppendArrayHeader(&arr, 2);
+  AppendBulk(&arr, "abc");
+  AppendArrayHeader(&arr, 1);
+  AppendNil(&arr);
+  for (size_t n = 0; n < arr.size(); n++) {
+    EXPECT_EQ(ParseReply(arr.data(), n, &v, &consumed), RESP_INCOMPLETE) << n;
+  }
+}
+
+TEST(TestResp, globTest) {
+  struct {
+    const char* pattern;
+    const char* str;
+    bool match;
+  } cases[] = {
+      {"*", "", true},          {"*", "abc", true},
+      {"a*c", "abbbc", true},   {"a*c", "abcd", false},
+      {"h?llo", "hello", true}, {"h?llo", "hllo", false},
+      {"h[ae]llo", "hallo", true}, {"h[^e]llo", "hello", false},
+      {"h[a-b]llo", "hbllo", true}, {"h\\*llo", "h*llo", true},
+      {"h\\*llo", "hello", false},  {"user:*:name", "user:42:name", true},
+  };
+  for (auto& c : cases) {
+    EXPECT_EQ(GlobMatch(c.pattern, strlen(c.pattern), c.str, strlen(c.str)),
+              c.match)
+        << c.pattern << " " << c.str;
+  }
+}
@@ -0,0 +1,262 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../server/client.h"
+#include "../server/server.h"
+
+class TestServer : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ServerOptions options;
+    // 端口0由系统分配
+    options.port = 0;
+    options.unix_socket = "/tmp/minikv_test_" + std::to_string(getpid());
+    options.io_threads = 2;
+    options.dump_file = options.unix_socket + ".dump";
+    socket_ = options.unix_socket;
+    store_.reset(new Store(12, 16));
+    server_.reset(new Server(options, store_.get()));
+    std::string error;
+    ASSERT_TRUE(server_->Start(&error)) << error;
+    ASSERT_GT(server_->port(), 0);
+  }
+
+  void TearDown() override {
+    server_->Stop();
+    unlink((socket_ + ".dump").c_str());
+  }
+
+  void Connect(RespClient* client) {
+    std::string error;
+    ASSERT_TRUE(client->ConnectTcp("127.0.0.1", server_->port(), &error))
+        << error;
+  }
+
+  RespValue Call(RespClient* client, const std::vector<std::string>& argv) {
+    RespValue v;
+    EXPECT_TRUE(client->Call(argv, &v));
+    return v;
+  }
+
+  std::string socket_;
+  std::unique_ptr<Store> store_;
+  std::unique_ptr<Server> server_;
+};
+
+TEST_F(TestServer, commandTest) {
+  RespClient c;
+  Connect(&c);
+  EXPECT_EQ(Call(&c, {"PING"}).str, "PONG");
+  EXPECT_EQ(Call(&c, {"SET", "k", "v"}).str, "OK");
+  EXPECT_EQ(Call(&c, {"get", "k"}).str, "v");
+  EXPECT_EQ(Call(&c, {"GET", "nope"}).type, RespValue::kNil);
+  EXPECT_EQ(Call(&c, {"TTL", "k"}).integer, -1);
+  EXPECT_EQ(Call(&c, {"TTL", "nope"}).integer, -2);
+  EXPECT_EQ(Call(&c, {"SET", "t", "v", "EX", "100"}).str, "OK");
+  // ttl按秒计, 中间可能跨过一秒
+  EXPECT_GE(Call(&c, {"TTL", "t"}).integer, 99);
+  EXPECT_EQ(Call(&c, {"SET", "p", "v", "PX", "1500"}).str, "OK");
+  // 毫秒向上取整到秒
+  EXPECT_GE(Call(&c, {"TTL", "p"}).integer, 1);
+  EXPECT_LE(Call(&c, {"PTTL", "p"}).integer, 2000);
+  // 不带EX的SET清除旧的ttl
+  EXPECT_EQ(Call(&c, {"SET", "t", "w"}).str, "OK");
+  EXPECT_EQ(Call(&c, {"TTL", "t"}).integer, -1);
+  EXPECT_EQ(Call(&c, {"EXPIRE", "t", "50"}).integer, 1);
+  // KEEPTTL保留旧的ttl, 不能与EX同时使用
+  EXPECT_EQ(Call(&c, {"SET", "t", "x", "KEEPTTL"}).str, "OK");
+  EXPECT_GE(Call(&c, {"TTL", "t"}).integer, 49);
+  EXPECT_EQ(Call(&c, {"SET", "t", "x", "KEEPTTL", "EX", "9"}).type,
+            RespValue::kError);
+  EXPECT_EQ(Call(&c, {"EXPIRE", "nope", "50"}).integer, 0);
+  EXPECT_EQ(Call(&c, {"PERSIST", "t"}).integer, 1);
+  EXPECT_EQ(Call(&c, {"EXPIRE", "t", "0"}).integer, 1);
+  EXPECT_EQ(Call(&c, {"GET", "t"}).type, RespValue::kNil);
+
+  EXPECT_EQ(Call(&c, {"MSET", "a", "1", "b", "2"}).str, "OK");
+  RespValue v = Call(&c, {"MGET", "a", "nope", "b"});
+  ASSERT_EQ(v.elements.size(), 3u);
+  EXPECT_EQ(v.elements[0].str, "1");
+  EXPECT_EQ(v.elements[1].type, RespValue::kNil);
+  EXPECT_EQ(v.elements[2].str, "2");
+  EXPECT_EQ(Call(&c, {"DEL", "a", "b", "nope"}).integer, 2);
+  EXPECT_EQ(Call(&c, {"DBSIZE"}).integer, 2);
+  EXPECT_EQ(Call(&c, {"EXISTS", "k", "p", "a"}).integer, 2);
+
+  // 计数和追加保留ttl, GETSET与SET一样清除ttl
+  EXPECT_EQ(Call(&c, {"INCR", "n"}).integer, 1);
+  EXPECT_EQ(Call(&c, {"INCRBY", "n", "41"}).integer, 42);
+  EXPECT_EQ(Call(&c, {"DECR", "n"}).integer, 41);
+  EXPECT_EQ(Call(&c, {"DECRBY", "n", "50"}).integer, -9);
+  EXPECT_EQ(Call(&c, {"INCR", "k"}).type, RespValue::kError);
+  EXPECT_EQ(Call(&c, {"INCRBY", "n", "x"}).type, RespValue::kError);
+  EXPECT_EQ(Call(&c, {"EXPIRE", "n", "100"}).integer, 1);
+  EXPECT_EQ(Call(&c, {"APPEND", "n", "0"}).integer, 3);
+  EXPECT_EQ(Call(&c, {"GET", "n"}).str, "-90");
+  EXPECT_GE(Call(&c, {"TTL", "n"}).integer, 99);
+  EXPECT_EQ(Call(&c, {"GETSET", "n", "1"}).str, "-90");
+  EXPECT_EQ(Call(&c, {"TTL", "n"}).integer, -1);
+  EXPECT_EQ(Call(&c, {"GETSET", "m", "1"}).type, RespValue::kNil);
+  EXPECT_EQ(Call(&c, {"DEL", "n", "m"}).integer, 2);
+
+  EXPECT_EQ(Call(&c, {"SET", "k"}).type, RespValue::kError);
+  EXPECT_EQ(Call(&c, {"SET", "k", "v", "EX", "0"}).type, RespValue::kError);
+  EXPECT_EQ(Call(&c, {"SET", "k", "v", "NX"}).type, RespValue::kError);
+  EXPECT_EQ(Call(&c, {"NOSUCH"}).type, RespValue::kError);
+
+  v = Call(&c, {"INFO"});
+  EXPECT_NE(v.str.find("connected_clients:1"), std::string::npos);
+  EXPECT_NE(v.str.find("keys:2"), std::string::npos);
+  EXPECT_NE(v.str.find("rdb_bgsave_in_progress:0"), std::string::npos);
+  EXPECT_EQ(Call(&c, {"QUIT"}).str, "OK");
+  EXPECT_FALSE(c.ReadReply(&v));
+}
+
+// 流水线: 一次写入多个请求, 回复按请求顺序返回
+// SAVE和BGSAVE写入ServerOptions::dump_file
+TEST_F(TestServer, saveTest) {
+  RespClient c;
+  Connect(&c);
+  EXPECT_EQ(Call(&c, {"SET", "k", "v"}).str, "OK");
+  EXPECT_EQ(Call(&c, {"SAVE"}).str, "OK");
+  Store loaded(12, 16);
+  loaded.loadFile(socket_ + ".dump");
+  std::string v;
+  ASSERT_TRUE(loaded.searchElement("k", v));
+  EXPECT_EQ(v, "v");
+  unlink((socket_ + ".dump").c_str());
+  EXPECT_EQ(Call(&c, {"BGSAVE"}).str, "Background saving started");
+  for (int i = 0; i < 5000 && access((socket_ + ".dump").c_str(), F_OK) != 0;
+       i++) {
+    usleep(1000);
+  }
+  EXPECT_EQ(access((socket_ + ".dump").c_str(), F_OK), 0);
+}
+
+TEST_F(TestServer, pipelineTest) {
+  RespClient c;
+  Connect(&c);
+  const int n = 5000;
+  for (int i = 0; i < n; i++) {
+    c.Append({"SET", "key" + std::to_string(i), std::to_string(i)});
+    c.Append({"GET", "key" + std::to_string(i)});
+  }
+  // 一个请求跨越两次写入
+  c.AppendRaw("*2\r\n$3\r\nGET\r\n$4\r\nke");
+  ASSERT_TRUE(c.Flush());
+  usleep(10000);
+  c.AppendRaw("y7\r\n");
+  ASSERT_TRUE(c.Flush());
+  RespValue v;
+  for (int i = 0; i < n; i++) {
+    ASSERT_TRUE(c.ReadReply(&v));
+    EXPECT_EQ(v.str, "OK");
+    ASSERT_TRUE(c.ReadReply(&v));
+    EXPECT_EQ(v.str, std::to_string(i));
+  }
+  ASSERT_TRUE(c.ReadReply(&v));
+  EXPECT_EQ(v.str, "7");
+}
+
+TEST_F(TestServer, scanTest) {
+  RespClient c;
+  Connect(&c);
+  std::set<std::string> expect;
+  for (int i = 0; i < 1000; i++) {
+    std::string k = (i % 2 ? "user:" : "item:") + std::to_string(i);
+    Call(&c, {"SET", k, "v"});
+    if (i % 2) expect.insert(k);
+  }
+  std::set<std::string> got;
+  std::string cursor = "0";
+  int rounds = 0;
+  do {
+    RespValue v =
+        Call(&c, {"SCAN", cursor, "MATCH", "user:*", "COUNT", "64"});
+    ASSERT_EQ(v.elements.size(), 2u);
+    cursor = v.elements[0].str;
+    for (auto& e : v.elements[1].elements) {
+      EXPECT_TRUE(got.insert(e.str).second) << "returned twice: " << e.str;
+    }
+    ASSERT_LT(++rounds, 100);
+  } while (cursor != "0");
+  EXPECT_EQ(got, expect);
+  EXPECT_EQ(Call(&c, {"SCAN", "12345"}).type, RespValue::kError);
+}
+
+// 多个客户端通过TCP和unix socket并发读写同一个store
+TEST_F(TestServer, clientsTest) {
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([this, t] {
+      RespClient c;
+      std::string error;
+      bool ok = t % 2 ? c.ConnectUnix(socket_, &error)
+                      : c.ConnectTcp("127.0.0.1", server_->port(), &error);
+      ASSERT_TRUE(ok) << error;
+      for (int i = 0; i < 500; i++) {
+        std::string k = std::to_string(t) + ":" + std::to_string(i);
+        c.Append({"SET", k, k});
+        c.Append({"GET", k});
+      }
+      ASSERT_TRUE(c.Flush());
+      RespValue v;
+      for (int i = 0; i < 500; i++) {
+        ASSERT_TRUE(c.ReadReply(&v));
+        ASSERT_TRUE(c.ReadReply(&v));
+        EXPECT_EQ(v.str, std::to_string(t) + ":" + std::to_string(i));
+      }
+    });
+  }
+  for (auto& th : threads) th.join();
+  EXPECT_EQ(store_->size(), 2000);
+}
+
+// CONFIG SET打开maxmemory, noeviction时写入返回OOM错误
+TEST_F(TestServer, maxmemoryTest) {
+  RespClient c;
+  Connect(&c);
+  RespValue v = Call(&c, {"CONFIG", "GET", "maxmemory-policy"});
+  ASSERT_EQ(v.elements.size(), 2u);
+  EXPECT_EQ(v.elements[1].str, "noeviction");
+  EXPECT_EQ(Call(&c, {"CONFIG", "SET", "maxmemory", "4096"}).str, "OK");
+  EXPECT_EQ(Call(&c, {"CONFIG", "SET", "maxmemory-policy", "lru"}).type,
+            RespValue::kError);
+  int n = 0;
+  while (Call(&c, {"SET", "key" + std::to_string(n), "v"}).str == "OK") {
+    ASSERT_LT(++n, 1000);
+  }
+  v = Call(&c, {"SET", "key" + std::to_string(n), "v"});
+  EXPECT_EQ(v.type, RespValue::kError);
+  EXPECT_EQ(v.str.compare(0, 3, "OOM"), 0);
+  EXPECT_EQ(Call(&c, {"MSET", "a", "1"}).type, RespValue::kError);
+
+  EXPECT_EQ(Call(&c, {"CONFIG", "SET", "maxmemory-policy", "allkeys-lru"}).str,
+            "OK");
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(Call(&c, {"SET", "new" + std::to_string(i), "v"}).str, "OK");
+  }
+  EXPECT_LE(Call(&c, {"DBSIZE"}).integer, n + 1);
+  v = Call(&c, {"INFO", "memory"});
+  EXPECT_NE(v.str.find("maxmemory:4096"), std::string::npos);
+  EXPECT_NE(v.str.find("maxmemory_policy:allkeys-lru"), std::string::npos);
+  v = Call(&c, {"INFO", "stats"});
+  EXPECT_EQ(v.str.find("evicted_keys:0"), std::string::npos);
+}
+
+TEST_F(TestServer, protocolErrorTest) {
+  RespClient c;
+  Connect(&c);
+  c.AppendRaw("*1\r\n$x\r\n");
+  ASSERT_TRUE(c.Flush());
+  RespValue v;
+  ASSERT_TRUE(c.ReadReply(&v));
+  EXPECT_EQ(v.type, RespValue::kError);
+  // 协议错误后连接被关闭
+  EXPECT_FALSE(c.ReadReply(&v));
+}
@@ -0,0 +1,593 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../base/random.h"
+#include "../base/skiplist_old.hpp"
+
+TEST(TestKeyPrefix, orderTest) {
+  typedef KeyPrefix<std::string> P;
+  EXPECT_LT(P::of("a"), P::of("b"));
+  EXPECT_LT(P::of(""), P::of("a"));
+  // 高位字节按无符号比较, 与std::string一致
+  EXPECT_LT(P::of("a"), P::of("\xff"));
+  EXPECT_LT(std::string("a"), std::string("\xff"));
+  // 只看前8个字节, 前缀相同时需要比较完整的key
+  EXPECT_EQ(P::of("abcdefgh1"), P::of("abcdefgh2"));
+  // 补零的短key与带0字节的key前缀相同
+  EXPECT_EQ(P::of("ab"), P::of(std::string("ab\0", 3)));
+}
+
+// 随机key共享较长的前缀, 大部分比较会落到完整key上
+TEST(TestSkipListOld, stringKeyTest) {
+  SkipList<std::string, std::string> list(12, 4);
+  std::map<std::string, std::string> model;
+  Random rnd(301);
+  const char* prefixes[] = {"", "user", "user0000", "user00001", "\xff"};
+  for (int i = 0; i < 20000; i++) {
+    std::string k = prefixes[rnd.Uniform(5)];
+    k += std::string(rnd.Uniform(3), '\0');
+    k += std::to_string(rnd.Uniform(500));
+    std::string v = std::to_string(i);
+    switch (rnd.Uniform(3)) {
+      case 0:
+        EXPECT_EQ(list.insertElement(k, v), model.count(k) ? 1 : 0);
+        model[k] = v;
+        break;
+      case 1: {
+        std::string got;
+        bool found = list.searchElement(k, got);
+        ASSERT_EQ(found, model.count(k) == 1);
+        if (found) {
+          EXPECT_EQ(got, model[k]);
+        }
+        break;
+      }
+      default:
+        EXPECT_EQ(list.deleteElement(k), model.erase(k) == 1);
+        break;
+    }
+  }
+  ASSERT_EQ(list.size(), static_cast<int>(model.size()));
+
+  std::vector<std::pair<std::string, std::string>> items;
+  list.scanElement("", model.size() + 1, &items);
+  ASSERT_EQ(items.size(), model.size());
+  auto it = model.begin();
+  for (size_t i = 0; i < items.size(); i++, ++it) {
+    EXPECT_EQ(items[i].first, it->first);
+    EXPECT_EQ(items[i].second, it->second);
+  }
+}
+
+// 快照写入临时文件, 落盘后替换目标文件, 再完整地加载回来
+TEST(TestSkipListOld, dumpTest) {
+  const std::string path = "/tmp/minikv_dump_" + std::to_string(getpid());
+  SkipList<int, std::string> list(12, 4);
+  for (int i = 0; i < 5000; i++) list.insertElement(i, "v" + std::to_string(i));
+  ASSERT_TRUE(list.dumpFile(path));
+  std::string status;
+  ASSERT_TRUE(list.getProperty("minikv.last-dump-status", &status));
+  EXPECT_EQ(status, "ok");
+
+  // 后台快照的回调在写入线程上执行; 二进制格式的value可以带':'和换行
+  list.insertElement(5000, "a:b\nc");
+  std::promise<bool> done;
+  ASSERT_TRUE(list.bgDumpFile(path, [&done](bool ok) { done.set_value(ok); }));
+  ASSERT_TRUE(done.get_future().get());
+  EXPECT_NE(access((path + ".tmp").c_str(), F_OK), 0);
+
+  SkipList<int, std::string> loaded(12, 4);
+  loaded.loadFile(path);
+  ASSERT_EQ(loaded.size(), 5001);
+  std::string v;
+  ASSERT_TRUE(loaded.searchElement(4321, v));
+  EXPECT_EQ(v, "v4321");
+  ASSERT_TRUE(loaded.searchElement(5000, v));
+  EXPECT_EQ(v, "a:b\nc");
+
+  // 仍能读取旧版本的文本格式
+  {
+    std::ofstream out(path, std::ios::trunc);
+    out << "1:one\n2:two\n";
+  }
+  SkipList<int, std::string> text(12, 4);
+  text.loadFile(path);
+  ASSERT_EQ(text.size(), 2);
+  ASSERT_TRUE(text.searchElement(2, v));
+  EXPECT_EQ(v, "two");
+  unlink(path.c_str());
+
+  EXPECT_FALSE(list.dumpFile("/nonexistent/dir/dump"));
+  ASSERT_TRUE(list.getProperty("minikv.last-dump-status", &status));
+  EXPECT_EQ(status, "err");
+}
+
+// 映射快照后的读写与把快照载入内存时一致
+TEST(TestSkipListOld, mappedTest) {
+  const std::string path = "/tmp/minikv_mapped_" + std::to_string(getpid());
+  std::map<int, std::string> expect;
+  {
+    SkipList<int, std::string> list(12, 4);
+    SnapshotOptions options;
+    options.block_size = 512;
+    list.setSnapshotOptions(options);
+    for (int i = 0; i < 3000; i += 2) {
+      list.insertElement(i, "v" + std::to_string(i));
+      expect[i] = "v" + std::to_string(i);
+    }
+    ASSERT_TRUE(list.dumpFile(path));
+  }
+
+  SkipList<int, std::string> list(12, 4);
+  std::string error;
+  ASSERT_TRUE(list.openSnapshot(path, &error)) << error;
+  EXPECT_FALSE(list.openSnapshot(path, &error));
+  std::string mapped;
+  ASSERT_TRUE(list.getProperty("minikv.mapped-snapshot", &mapped));
+  EXPECT_EQ(mapped, path);
+  EXPECT_EQ(list.size(), 1500);
+  std::string v;
+  ASSERT_TRUE(list.searchElement(1234, v));
+  EXPECT_EQ(v, "v1234");
+  EXPECT_FALSE(list.searchElement(1235, v));
+
+  // 写入进入内存中的索引, 覆盖或删除快照中的key
+  EXPECT_EQ(list.insertElement(10, "new10"), 1);
+  EXPECT_EQ(list.insertElement(11, "v11"), 0);
+  EXPECT_TRUE(list.deleteElement(20));
+  EXPECT_FALSE(list.deleteElement(20));
+  EXPECT_FALSE(list.deleteElement(21));
+  EXPECT_TRUE(list.deleteElement(11));
+  EXPECT_EQ(list.insertElement(20, "v20again"), 0);
+  EXPECT_TRUE(list.deleteElement(20));
+  expect[10] = "new10";
+  expect.erase(20);
+  EXPECT_EQ(list.size(), int(expect.size()));
+  ASSERT_TRUE(list.searchElement(10, v));
+  EXPECT_EQ(v, "new10");
+  EXPECT_FALSE(list.searchElement(20, v));
+  EXPECT_EQ(list.element_ttl(30), -1);
+  EXPECT_EQ(list.element_ttl(31), -2);
+  EXPECT_TRUE(list.element_expire_time(40, 100));
+  EXPECT_GT(list.element_ttl(40), 0);
+  EXPECT_EQ(list.size(), int(expect.size()));
+
+  // 扫描合并两边
+  std::vector<std::pair<int, std::string>> items;
+  EXPECT_EQ(list.scanElement(5, 10, &items), 10);
+  std::vector<std::pair<int, std::string>> want;
+  for (auto it = expect.lower_bound(5); want.size() < 10; ++it) {
+    want.push_back(*it);
+  }
+  EXPECT_EQ(items, want);
+
+  // 下一次快照把两边合并到一个文件
+  ASSERT_TRUE(list.dumpFile(path));
+  SkipList<int, std::string> loaded(12, 4);
+  loaded.loadFile(path);
+  ASSERT_EQ(loaded.size(), int(expect.size()));
+  items.clear();
+  loaded.scanElement(0, 5000, &items);
+  want.assign(expect.begin(), expect.end());
+  EXPECT_EQ(items, want);
+  unlink(path.c_str());
+}
+
+// 名次, 区间计数和分页, 过期的key占位直到被回收, 快照与索引合并计算
+TEST(TestSkipListOld, rankTest) {
+  SkipList<int, std::string> list(12, 4);
+  for (int i = 0; i < 1000; i++) list.insertElement(i * 2, std::to_string(i));
+  EXPECT_EQ(list.rankElement(0), 0u);
+  EXPECT_EQ(list.rankElement(7), 4u);
+  EXPECT_EQ(list.rankElement(5000), 1000u);
+  EXPECT_EQ(list.countRange(10, 20), 5u);
+  EXPECT_EQ(list.countRange(20, 10), 0u);
+  int k;
+  std::string v;
+  ASSERT_TRUE(list.selectElement(500, &k, &v));
+  EXPECT_EQ(k, 1000);
+  EXPECT_EQ(v, "500");
+  EXPECT_FALSE(list.selectElement(1000, &k, &v));
+
+  list.element_expire_time(6, 0);
+  EXPECT_EQ(list.rankElement(7), 4u);
+  EXPECT_FALSE(list.selectElement(3, &k, &v));
+  std::vector<std::pair<int, std::string>> items;
+  EXPECT_EQ(list.pageElement(2, 3, &items), 2);
+  ASSERT_EQ(items.size(), 2u);
+  EXPECT_EQ(items[0].first, 4);
+  EXPECT_EQ(items[1].first, 8);
+  list.cycle_del();
+  EXPECT_EQ(list.rankElement(7), 3u);
+  ASSERT_TRUE(list.selectElement(3, &k, &v));
+  EXPECT_EQ(k, 8);
+
+  const std::string path = "/tmp/minikv_rank_" + std::to_string(getpid());
+  SnapshotOptions options;
+  options.block_size = 256;
+  list.setSnapshotOptions(options);
+  ASSERT_TRUE(list.dumpFile(path));
+  SkipList<int, std::string> mapped(12, 4);
+  std::string error;
+  ASSERT_TRUE(mapped.openSnapshot(path, &error)) << error;
+  std::map<int, std::string> expect;
+  items.clear();
+  list.scanElement(0, 2000, &items);
+  expect.insert(items.begin(), items.end());
+  mapped.insertElement(11, "11");
+  mapped.deleteElement(100);
+  mapped.insertElement(102, "new");
+  expect[11] = "11";
+  expect.erase(100);
+  expect[102] = "new";
+  for (int x : {-1, 7, 11, 12, 100, 101, 103, 5000}) {
+    EXPECT_EQ(mapped.rankElement(x),
+              size_t(std::distance(expect.begin(), expect.lower_bound(x))));
+  }
+  EXPECT_EQ(mapped.countRange(0, 2000), expect.size());
+  items.clear();
+  EXPECT_EQ(mapped.pageElement(48, 4, &items), 4);
+  std::vector<std::pair<int, std::string>> want(
+      std::next(expect.begin(), 48), std::next(expect.begin(), 52));
+  EXPECT_EQ(items, want);
+  unlink(path.c_str());
+}
+
+size_t UsedMemory(SkipList<int, std::string>* list) {
+  std::string v;
+  EXPECT_TRUE(list->getProperty("minikv.used-memory", &v));
+  return std::stoull(v);
+}
+
+// 原地读改写: 计数, 追加, CAS, GETSET, 缓存与ttl保持一致
+TEST(TestSkipListOld, updateTest) {
+  SkipList<std::string, std::string> list(12, 4);
+  long long n;
+  EXPECT_EQ(list.incrementElement("c", 5, &n), 0);
+  EXPECT_EQ(n, 5);
+  EXPECT_EQ(list.incrementElement("c", -7, &n), 0);
+  EXPECT_EQ(n, -2);
+  std::string v;
+  // 读入LRU之后再修改, 不能读到旧值
+  ASSERT_TRUE(list.searchElement("c", v));
+  EXPECT_EQ(v, "-2");
+  EXPECT_EQ(list.incrementElement("c", 1, &n), 0);
+  ASSERT_TRUE(list.searchElement("c", v));
+  EXPECT_EQ(v, "-1");
+
+  list.insertElement("s", "abc");
+  EXPECT_EQ(list.incrementElement("s", 1, &n), -2);
+  list.insertElement("s", " 1");
+  EXPECT_EQ(list.incrementElement("s", 1, &n), -2);
+  list.insertElement("s", std::string("1\0", 2));
+  EXPECT_EQ(list.incrementElement("s", 1, &n), -2);
+  list.insertElement("s", "9223372036854775807");
+  EXPECT_EQ(list.incrementElement("s", 1, &n), -2);
+  ASSERT_TRUE(list.searchElement("s", v));
+  EXPECT_EQ(v, "9223372036854775807");
+
+  size_t size;
+  EXPECT_EQ(list.appendElement("a", "hello", &size), 0);
+  EXPECT_EQ(size, 5u);
+  EXPECT_EQ(list.appendElement("a", " world", &size), 0);
+  EXPECT_EQ(size, 11u);
+  ASSERT_TRUE(list.searchElement("a", v));
+  EXPECT_EQ(v, "hello world");
+
+  EXPECT_EQ(list.compareAndSwap("a", "hello", "x"), 0);
+  EXPECT_EQ(list.compareAndSwap("nope", "", "x"), 0);
+  EXPECT_FALSE(list.searchElement("nope", v));
+  EXPECT_EQ(list.compareAndSwap("a", "hello world", "x"), 1);
+  ASSERT_TRUE(list.searchElement("a", v));
+  EXPECT_EQ(v, "x");
+
+  std::string old;
+  EXPECT_EQ(list.getSetElement("g", "1", &old), 0);
+  EXPECT_EQ(list.getSetElement("g", "2", &old), 1);
+  EXPECT_EQ(old, "1");
+
+  EXPECT_EQ(list.updateElement("g", [](std::string* v, bool found) {
+    EXPECT_TRUE(found);
+    *v += *v;
+    return true;
+  }), 1);
+  EXPECT_EQ(list.updateElement("g", [](std::string*, bool) { return false; }),
+            0);
+  ASSERT_TRUE(list.searchElement("g", v));
+  EXPECT_EQ(v, "22");
+  EXPECT_EQ(list.size(), 4);
+
+  // 修改保留ttl, 过期的key按不存在处理
+  list.element_expire_time("c", 100);
+  EXPECT_EQ(list.incrementElement("c", 1, &n), 0);
+  EXPECT_GT(list.element_ttl("c"), 0);
+  list.element_expire_time("c", 0);
+  EXPECT_EQ(list.incrementElement("c", 3, &n), 0);
+  EXPECT_EQ(n, 3);
+  EXPECT_EQ(list.element_ttl("c"), -1);
+
+  // 整数类型的value直接相加, 不能超出类型的范围
+  SkipList<int, int> ints(12, 4);
+  EXPECT_EQ(ints.incrementElement(1, 2147483647, &n), 0);
+  EXPECT_EQ(ints.incrementElement(1, 1, &n), -2);
+  int i;
+  ASSERT_TRUE(ints.searchElement(1, i));
+  EXPECT_EQ(i, 2147483647);
+}
+
+// 记录store通知的每一次写入
+class RecordingListener : public WriteListener<std::string, std::string> {
+ public:
+  void OnInsert(const std::string& k, const std::string& v) override {
+    events.push_back("insert " + k + " " + v);
+  }
+  void OnSet(const std::string& k, const std::string& v,
+             int seconds) override {
+    events.push_back("set " + k + " " + v + " " + std::to_string(seconds));
+  }
+  void OnRemove(const std::string& k) override {
+    events.push_back("remove " + k);
+  }
+  void OnExpire(const std::string& k, int seconds) override {
+    events.push_back("expire " + k + " " + std::to_string(seconds));
+  }
+  void OnPersist(const std::string& k) override {
+    events.push_back("persist " + k);
+  }
+  std::vector<std::string> events;
+};
+
+// setElement在同一次加锁中写入value和ttl, 只产生一个事件
+TEST(TestSkipListOld, setTtlTest) {
+  SkipList<std::string, std::string> list(12, 4);
+  RecordingListener listener;
+  list.setWriteListener(&listener);
+  EXPECT_EQ(list.setElement("k", "1", 100), 0);
+  EXPECT_GT(list.element_ttl("k"), 90);
+  // insertElement保留ttl, setElement替换或清除ttl
+  EXPECT_EQ(list.insertElement("k", "2"), 1);
+  EXPECT_GT(list.element_ttl("k"), 90);
+  EXPECT_EQ(list.setElement("k", "3", 0), 1);
+  EXPECT_EQ(list.element_ttl("k"), -1);
+  list.element_expire_time("k", 100);
+  std::string old;
+  EXPECT_EQ(list.getSetElement("k", "4", &old), 1);
+  EXPECT_EQ(old, "3");
+  EXPECT_EQ(list.element_ttl("k"), -1);
+  // 旧的ttl已经到期时, 新写入的value不受影响
+  list.element_expire_time("k", 0);
+  EXPECT_EQ(list.setElement("k", "5", 0), 0);
+  std::string v;
+  ASSERT_TRUE(list.searchElement("k", v));
+  EXPECT_EQ(v, "5");
+  list.setWriteListener(nullptr);
+
+  std::vector<std::string> expect = {"set k 1 100", "insert k 2", "set k 3 0",
+                                     "expire k 100", "set k 4 0", "expire k 0",
+                                     "remove k", "set k 5 0"};
+  EXPECT_EQ(listener.events, expect);
+}
+
+// 快照中的key修改后进入索引, 占用的内存与直接写入的相同
+TEST(TestSkipListOld, updateChargeTest) {
+  const std::string path = "/tmp/minikv_update_" + std::to_string(getpid());
+  {
+    SkipList<int, std::string> list(12, 4);
+    list.insertElement(1, "10");
+    ASSERT_TRUE(list.dumpFile(path));
+  }
+  SkipList<int, std::string> mapped(12, 4);
+  std::string error;
+  ASSERT_TRUE(mapped.openSnapshot(path, &error)) << error;
+  long long n;
+  EXPECT_EQ(mapped.incrementElement(1, 5, &n), 0);
+  EXPECT_EQ(n, 15);
+  EXPECT_EQ(mapped.size(), 1);
+  std::string v;
+  ASSERT_TRUE(mapped.searchElement(1, v));
+  EXPECT_EQ(v, "15");
+  unlink(path.c_str());
+
+  SkipList<int, std::string> a(12, 4), b(12, 4);
+  a.setMaxMemory(1 << 20, ALLKEYS_LRU);
+  b.setMaxMemory(1 << 20, ALLKEYS_LRU);
+  size_t size;
+  for (int i = 0; i < 100; i++) {
+    a.appendElement(i % 10, std::string(10, 'x'), &size);
+    a.incrementElement(100 + i % 7, i, &n);
+  }
+  for (int i = 0; i < 10; i++) b.insertElement(i, std::string(100, 'x'));
+  for (int i = 0; i < 7; i++) {
+    long long sum = 0;
+    for (int j = i; j < 100; j += 7) sum += j;
+    b.insertElement(100 + i, std::to_string(sum));
+  }
+  EXPECT_EQ(UsedMemory(&a), UsedMemory(&b));
+}
+
+// 缓存满时复用最久未使用的节点, get会把key移到表头
+TEST(TestLRU, reuseTest) {
+  LRU<std::string, std::string> lru(2);
+  std::string v;
+  lru.put("a", "1");
+  lru.put("b", "2");
+  EXPECT_TRUE(lru.get("a", v));
+  lru.put("c", "3");
+  EXPECT_FALSE(lru.is_find("b"));
+  EXPECT_TRUE(lru.get("c", v));
+  EXPECT_EQ(v, "3");
+  lru.put("a", "4");
+  lru.put("d", "5");
+  EXPECT_FALSE(lru.is_find("c"));
+  EXPECT_TRUE(lru.get("a", v));
+  EXPECT_EQ(v, "4");
+  lru.del("a");
+  EXPECT_FALSE(lru.is_find("a"));
+  EXPECT_TRUE(lru.is_find("d"));
+
+  LRU<std::string, std::string> off(0);
+  off.put("a", "1");
+  EXPECT_FALSE(off.is_find("a"));
+}
+
+// 右值写入直接移动到索引中, 读到的值不受影响
+TEST(TestSkipListOld, moveInsertTest) {
+  for (IndexEngine engine : {SKIPLIST_ENGINE, BPLUSTREE_ENGINE, ART_ENGINE}) {
+    SkipList<std::string, std::string> list(12, 4, engine);
+    std::string v(100, 'v');
+    EXPECT_EQ(list.insertElement("k", std::move(v)), 0);
+    v = std::string(200, 'w');
+    EXPECT_EQ(list.insertElement("k", std::move(v)), 1);
+    std::string got;
+    ASSERT_TRUE(list.searchElement("k", got));
+    EXPECT_EQ(got, std::string(200, 'w'));
+    const std::string copied = "c";
+    EXPECT_EQ(list.insertElement("k2", copied), 0);
+    EXPECT_EQ(copied, "c");
+    ASSERT_TRUE(list.searchElement("k2", got));
+    EXPECT_EQ(got, "c");
+  }
+}
+
+TEST(TestSkipListOld, evictionTest) {
+  const std::string value(40, 'v');
+  const size_t charge = EntryCharge(0, value);
+  const size_t cap = 1000 * charge;
+
+  // noeviction: 超过上限后拒绝写入, 删除后可以继续写
+  {
+    SkipList<int, std::string> list(12, 4);
+    for (int i = 0; i < 500; i++) list.insertElement(i, value);
+    list.setMaxMemory(cap, NO_EVICTION);
+    EXPECT_EQ(UsedMemory(&list), 500 * charge);
+    int i = 500;
+    while (list.insertElement(i, value) >= 0) i++;
+    EXPECT_LE(UsedMemory(&list), cap + charge);
+    EXPECT_EQ(list.size(), i);
+    EXPECT_TRUE(list.deleteElement(0));
+    EXPECT_TRUE(list.deleteElement(1));
+    EXPECT_EQ(list.insertElement(i, value), 0);
+    // 覆盖同样大小的value不改变占用
+    size_t used = UsedMemory(&list);
+    EXPECT_EQ(list.insertElement(3, value), 1);
+    EXPECT_EQ(UsedMemory(&list), used);
+    EXPECT_EQ(list.insertElement(i + 1, value), 0);
+    EXPECT_EQ(list.insertElement(i + 2, value), -1);
+    list.setMaxMemory(0, NO_EVICTION);
+    EXPECT_EQ(list.insertElement(-1, value), 0);
+    EXPECT_EQ(UsedMemory(&list), 0u);
+  }
+
+  // allkeys-lru: 最近读过的key和新写的key留下
+  {
+    SkipList<int, std::string> list(12, 4);
+    list.setMaxMemory(cap, ALLKEYS_LRU);
+    for (int i = 0; i < 1000; i++) ASSERT_EQ(list.insertElement(i, value), 0);
+    usleep(20000);
+    std::string v;
+    for (int i = 0; i < 250; i++) ASSERT_TRUE(list.searchElement(i, v));
+    for (int i = 1000; i < 1250; i++) {
+      ASSERT_EQ(list.insertElement(i, value), 0);
+    }
+    // 写入前检查上限, 最后一次写入可以超出一个key
+    EXPECT_LE(UsedMemory(&list), cap + charge);
+    EXPECT_EQ(list.size(), 1001);
+    int hot = 0;
+    for (int i = 0; i < 250; i++) hot += list.searchElement(i, v);
+    EXPECT_GE(hot, 240);
+    EXPECT_GE(list.getStatistics()->GetTickerCount(EVICTED_KEYS), 249u);
+  }
+
+  // allkeys-lfu: 读过多次的key留下
+  {
+    SkipList<int, std::string> list(12, 4);
+    list.setMaxMemory(cap, ALLKEYS_LFU);
+    for (int i = 0; i < 1000; i++) list.insertElement(i, value);
+    std::string v;
+    for (int round = 0; round < 50; round++) {
+      for (int i = 0; i < 250; i++) list.searchElement(i, v);
+    }
+    for (int i = 1000; i < 1500; i++) {
+      ASSERT_EQ(list.insertElement(i, value), 0);
+    }
+    int hot = 0;
+    for (int i = 0; i < 250; i++) hot += list.searchElement(i, v);
+    EXPECT_GE(hot, 245);
+  }
+
+  // volatile-*: 只淘汰带ttl的key, 没有可淘汰的key时拒绝写入
+  for (EvictionPolicy policy : {VOLATILE_LRU, VOLATILE_TTL}) {
+    SkipList<int, std::string> list(12, 4);
+    list.setMaxMemory(cap, policy);
+    for (int i = 0; i < 1000; i++) list.insertElement(i, value);
+    // 前100个key的ttl最短
+    for (int i = 0; i < 300; i++) {
+      list.element_expire_time(i, i < 100 ? 100 : 1000);
+    }
+    for (int i = 1000; i < 1100; i++) {
+      ASSERT_EQ(list.insertElement(i, value), 0);
+    }
+    std::string v;
+    for (int i = 300; i < 1100; i++) {
+      ASSERT_TRUE(list.searchElement(i, v)) << i;
+    }
+    if (policy == VOLATILE_TTL) {
+      int shortest = 0;
+      for (int i = 0; i < 100; i++) shortest += list.searchElement(i, v);
+      EXPECT_LE(shortest, 30);
+    }
+    int i = 1100;
+    while (list.insertElement(i, value) >= 0) i++;
+    EXPECT_EQ(list.size(), 1001);
+    for (int j = 0; j < 300; j++) EXPECT_FALSE(list.searchElement(j, v));
+    // persist之后不再是候选
+    list.setMaxMemory(cap + 10 * charge, policy);
+    list.insertElement(-1, value);
+    list.element_expire_time(-1, 100);
+    EXPECT_TRUE(list.element_persist(-1));
+    while (list.insertElement(i, value) >= 0) i++;
+    EXPECT_TRUE(list.searchElement(-1, v));
+  }
+
+  std::string policy;
+  SkipList<int, std::string> list(12, 4);
+  list.setMaxMemory(cap, VOLATILE_TTL);
+  ASSERT_TRUE(list.getProperty("minikv.maxmemory-policy", &policy));
+  EXPECT_EQ(policy, "volatile-ttl");
+  EvictionPolicy parsed;
+  EXPECT_TRUE(ParseEvictionPolicy("allkeys-lfu", &parsed));
+  EXPECT_EQ(parsed, ALLKEYS_LFU);
+  EXPECT_FALSE(ParseEvictionPolicy("allkeys-random", &parsed));
+}
+
+// 每层的增长比例应接近p, 且不超过max_height
+template <typename Policy>
+void CheckHeights(double p) {
+  typename Policy::RandomGenerator rnd(301);
+  const int N = 200000;
+  int reached[Policy::kMaxHeight + 1] = {0};
+  for (int i = 0; i < N; i++) {
+    int h = Policy::RandomHeight(&rnd);
+    ASSERT_GE(h, 1);
+    ASSERT_LE(h, Policy::kMaxHeight);
+    for (int j = 1; j <= h; j++) reached[j]++;
+  }
+  EXPECT_NEAR(double(reached[2]) / reached[1], p, 0.01);
+  EXPECT_NEAR(double(reached[3]) / reached[2], p, 0.02);
+  ASSERT_LE(Policy::RandomHeight(&rnd, 3), 3);
+}
+
+TEST(TestSkipListPolicy, heightTest) {
+  CheckHeights<FastSearchPolicy>(0.5);
+  CheckHeights<EulerPolicy>(0.367879);
+  CheckHeights<CompactPolicy>(0.25);
+  // leveldb的Random同样可以作为生成器
+  CheckHeights<SkipListPolicy<12, 1, 4, Random>>(0.25);
+}
@@ -0,0 +1,334 @@
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <future>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../base/async_file.h"
+#include "../base/coding.h"
+#include "../base/compression.h"
+#include "../base/random.h"
+#include "../base/snapshot.h"
+
+namespace {
+
+std::string RandomString(Random* rnd, size_t n) {
+  std::string s(n, '\0');
+  for (size_t i = 0; i < n; i++) s[i] = static_cast<char>(rnd->Uniform(256));
+  return s;
+}
+
+// 由少量固定的片段拼成, 和常见的key和value一样容易压缩
+std::string RepetitiveString(Random* rnd, size_t n) {
+  static const char* const kWords[] = {
+      "user:1000", "{\"status\":\"active\"", ",\"name\":\"minikv\"",
+      "order:2024-", "\"count\":42}"};
+  std::string s;
+  while (s.size() < n) s += kWords[rnd->Uniform(5)];
+  s.resize(n);
+  return s;
+}
+
+// 不压缩, 每个字节加1, 用来测试自定义算法
+class ShiftCodec : public Codec {
+ public:
+  CompressionType type() const override { return CompressionType(200); }
+  const char* Name() const override { return "shift"; }
+  void Compress(const char* in, size_t n, std::string* out) const override {
+    for (size_t i = 0; i < n; i++) out->push_back(char(in[i] + 1));
+  }
+  bool Uncompress(const char* in, size_t n, std::string* out) const override {
+    for (size_t i = 0; i < n; i++) out->push_back(char(in[i] - 1));
+    return true;
+  }
+};
+
+}  // namespace
+
+TEST(TestCoding, varintTest) {
+  std::string s;
+  const uint64_t values[] = {0, 1, 127, 128, 300, UINT32_MAX, UINT64_MAX};
+  for (uint64_t v : values) PutVarint64(&s, v);
+  PutVarint32(&s, 16384);
+  const char* p = s.data();
+  const char* limit = p + s.size();
+  for (uint64_t v : values) {
+    uint64_t r;
+    ASSERT_TRUE(GetVarint64(&p, limit, &r));
+    EXPECT_EQ(r, v);
+  }
+  uint32_t r32;
+  ASSERT_TRUE(GetVarint32(&p, limit, &r32));
+  EXPECT_EQ(r32, 16384u);
+  EXPECT_EQ(p, limit);
+  // 截断的变长整数
+  std::string t;
+  PutVarint32(&t, 300);
+  p = t.data();
+  EXPECT_FALSE(GetVarint32(&p, t.data() + 1, &r32));
+}
+
+TEST(TestCoding, crc32cTest) {
+  // RFC 3720的测试向量
+  std::string zeros(32, '\0');
+  EXPECT_EQ(Crc32c(zeros.data(), zeros.size()), 0x8a9136aau);
+  const char* digits = "123456789";
+  EXPECT_EQ(Crc32c(digits, 9), 0xe3069283u);
+  // 分段计算与整体相同
+  EXPECT_EQ(Crc32c(digits + 4, 5, Crc32c(digits, 4)), 0xe3069283u);
+}
+
+TEST(TestCompression, roundTripTest) {
+  Random rnd(301);
+  std::vector<std::string> inputs = {"", "a", "abcabcabcabcabcabc",
+                                     std::string(100000, 'x')};
+  for (int i = 0; i < 50; i++) {
+    inputs.push_back(RandomString(&rnd, rnd.Uniform(5000)));
+    inputs.push_back(RepetitiveString(&rnd, rnd.Uniform(100000)));
+  }
+  for (int t = 1; t < kFirstCustomCompression; t++) {
+    const Codec* codec = GetCodec(CompressionType(t));
+    if (codec == nullptr) continue;
+    for (const std::string& in : inputs) {
+      std::string compressed, out = "prefix";
+      codec->Compress(in.data(), in.size(), &compressed);
+      ASSERT_TRUE(codec->Uncompress(compressed.data(), compressed.size(), &out))
+          << codec->Name();
+      ASSERT_EQ(out, "prefix" + in) << codec->Name();
+    }
+  }
+  const Codec* lz = GetCodec(kLZCompression);
+  ASSERT_NE(lz, nullptr);
+  std::string in = RepetitiveString(&rnd, 32 << 10), compressed;
+  lz->Compress(in.data(), in.size(), &compressed);
+  EXPECT_LT(compressed.size(), in.size() / 2);
+}
+
+TEST(TestCompression, corruptionTest) {
+  Random rnd(301);
+  const Codec* lz = GetCodec(kLZCompression);
+  std::string in = RepetitiveString(&rnd, 10000), compressed;
+  lz->Compress(in.data(), in.size(), &compressed);
+  // 截断和随机改写都不能越界, 只能返回false或得到错误的数据
+  for (size_t n = 0; n < compressed.size(); n += 7) {
+    std::string out;
+    EXPECT_FALSE(lz->Uncompress(compressed.data(), n, &out));
+  }
+  for (int i = 0; i < 1000; i++) {
+    std::string bad = compressed;
+    bad[rnd.Uniform(bad.size())] = static_cast<char>(rnd.Uniform(256));
+    std::string out;
+    lz->Uncompress(bad.data(), bad.size(), &out);
+  }
+}
+
+TEST(TestCompression, registryTest) {
+  CompressionType type;
+  ASSERT_TRUE(ParseCompressionType("none", &type));
+  EXPECT_EQ(type, kNoCompression);
+  ASSERT_TRUE(ParseCompressionType("lz", &type));
+  EXPECT_EQ(type, kLZCompression);
+  EXPECT_FALSE(ParseCompressionType("shift", &type));
+
+  static const ShiftCodec shift;
+  ASSERT_TRUE(RegisterCodec(&shift));
+  EXPECT_FALSE(RegisterCodec(&shift));
+  ASSERT_TRUE(ParseCompressionType("shift", &type));
+  EXPECT_EQ(GetCodec(type), &shift);
+}
+
+// 参数为压缩算法的名字, 未编译的算法跳过
+class TestSnapshot : public ::testing::TestWithParam<std::string> {
+ protected:
+  void SetUp() override {
+    if (!ParseCompressionType(GetParam(), &options_.compression)) {
+      GTEST_SKIP() << GetParam() << " is not built in";
+    }
+    fname_ = "/tmp/minikv_snapshot_" + std::to_string(getpid());
+    // 块很小, 让快照有很多块
+    options_.block_size = 1024;
+  }
+
+  void TearDown() override { unlink(fname_.c_str()); }
+
+  // 写入data, 返回文件大小
+  uint64_t Write(const std::vector<std::pair<std::string, std::string>>& data) {
+    AsyncFile file;
+    std::string error;
+    EXPECT_TRUE(file.Open(fname_, true, &error)) << error;
+    SnapshotWriter writer(&file, options_);
+    for (size_t i = 0; i < data.size(); i++) {
+      writer.Add(data[i].first, data[i].second);
+      if (i % 100 == 0) writer.Flush();
+    }
+    writer.Finish();
+    std::promise<bool> done;
+    file.Sync([&done](bool ok) { done.set_value(ok); });
+    EXPECT_TRUE(done.get_future().get());
+    EXPECT_EQ(writer.num_entries(), data.size());
+    EXPECT_EQ(writer.file_bytes(), file.size());
+    return writer.file_bytes();
+  }
+
+  std::string fname_;
+  SnapshotOptions options_;
+};
+
+TEST_P(TestSnapshot, readTest) {
+  Random rnd(301);
+  std::map<std::string, std::string> data;
+  for (int i = 0; i < 5000; i++) {
+    data[RepetitiveString(&rnd, 1 + rnd.Uniform(30))] =
+        RepetitiveString(&rnd, rnd.Uniform(200));
+  }
+  uint64_t raw = 0;
+  for (auto& kv : data) raw += kv.first.size() + kv.second.size();
+  uint64_t size = Write({data.begin(), data.end()});
+  if (options_.compression != kNoCompression) {
+    EXPECT_LT(size, raw / 2);
+  }
+
+  std::unique_ptr<SnapshotReader> reader;
+  std::string error;
+  ASSERT_TRUE(SnapshotReader::Open(fname_, &reader, &error)) << error;
+  EXPECT_TRUE(SnapshotReader::IsSnapshotFile(fname_));
+  EXPECT_TRUE(reader->sorted());
+  EXPECT_EQ(reader->num_entries(), data.size());
+  EXPECT_GT(reader->num_blocks(), 10u);
+
+  SnapshotReader::Iterator it(reader.get());
+  auto expect = data.begin();
+  for (it.SeekToFirst(); it.Valid(); it.Next(), ++expect) {
+    ASSERT_NE(expect, data.end());
+    EXPECT_EQ(std::string(it.key(), it.key_size()), expect->first);
+    EXPECT_EQ(std::string(it.value(), it.value_size()), expect->second);
+  }
+  EXPECT_EQ(expect, data.end());
+  EXPECT_TRUE(it.error().empty());
+
+  std::string value;
+  for (auto& kv : data) {
+    ASSERT_TRUE(reader->Get(kv.first, &value, &error)) << kv.first;
+    EXPECT_EQ(value, kv.second);
+  }
+  EXPECT_FALSE(reader->Get("not-a-key", &value, &error));
+  EXPECT_TRUE(error.empty());
+  EXPECT_FALSE(reader->Get("\xff", &value, &error));
+}
+
+TEST_P(TestSnapshot, mmapTest) {
+  std::map<std::string, std::string> data;
+  for (int i = 0; i < 3000; i++) {
+    data[std::to_string(100000 + i * 2)] = std::string(i % 100, 'a' + i % 26);
+  }
+  Write({data.begin(), data.end()});
+  std::unique_ptr<SnapshotReader> reader;
+  std::string error, value;
+  ASSERT_TRUE(SnapshotReader::Open(fname_, &reader, &error, true)) << error;
+  EXPECT_TRUE(reader->mapped());
+  // 第二次读同一个块时跳过crc
+  for (int round = 0; round < 2; round++) {
+    for (auto& kv : data) {
+      ASSERT_TRUE(reader->Get(kv.first, &value, &error)) << kv.first;
+      EXPECT_EQ(value, kv.second);
+    }
+  }
+  EXPECT_TRUE(reader->Get("100002", nullptr, &error));
+  EXPECT_FALSE(reader->Get("100001", nullptr, &error));
+
+  // Seek到不存在的key时停在下一个key
+  SnapshotReader::Iterator it(reader.get());
+  it.Seek("100001");
+  ASSERT_TRUE(it.Valid());
+  EXPECT_EQ(std::string(it.key(), it.key_size()), "100002");
+  it.Seek("103001");
+  ASSERT_TRUE(it.Valid());
+  EXPECT_EQ(std::string(it.key(), it.key_size()), "103002");
+  it.Seek("2");
+  EXPECT_FALSE(it.Valid());
+  EXPECT_TRUE(it.error().empty());
+}
+
+TEST_P(TestSnapshot, unsortedTest) {
+  std::vector<std::pair<std::string, std::string>> data;
+  for (int i = 999; i >= 0; i--) {
+    data.emplace_back("k" + std::to_string(i), std::to_string(i * i));
+  }
+  Write(data);
+  std::unique_ptr<SnapshotReader> reader;
+  std::string error, value;
+  ASSERT_TRUE(SnapshotReader::Open(fname_, &reader, &error)) << error;
+  EXPECT_FALSE(reader->sorted());
+  ASSERT_TRUE(reader->Get("k0", &value, &error));
+  EXPECT_EQ(value, "0");
+  ASSERT_TRUE(reader->Get("k500", &value, &error));
+  EXPECT_EQ(value, "250000");
+}
+
+TEST_P(TestSnapshot, emptyTest) {
+  Write({});
+  std::unique_ptr<SnapshotReader> reader;
+  std::string error;
+  ASSERT_TRUE(SnapshotReader::Open(fname_, &reader, &error)) << error;
+  EXPECT_EQ(reader->num_entries(), 0u);
+  SnapshotReader::Iterator it(reader.get());
+  it.SeekToFirst();
+  EXPECT_FALSE(it.Valid());
+}
+
+TEST_P(TestSnapshot, corruptionTest) {
+  std::vector<std::pair<std::string, std::string>> data;
+  for (int i = 0; i < 2000; i++) {
+    data.emplace_back(std::to_string(100000 + i), std::string(50, 'v'));
+  }
+  Write(data);
+  // 改写第一个块中间的一个字节, crc应该发现
+  int fd = open(fname_.c_str(), O_WRONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(pwrite(fd, "\x5a", 1, 10), 1);
+  close(fd);
+
+  std::unique_ptr<SnapshotReader> reader;
+  std::string error, value;
+  ASSERT_TRUE(SnapshotReader::Open(fname_, &reader, &error)) << error;
+  EXPECT_FALSE(reader->Get("100000", &value, &error));
+  EXPECT_NE(error.find("checksum"), std::string::npos) << error;
+  SnapshotReader::Iterator it(reader.get());
+  it.SeekToFirst();
+  EXPECT_FALSE(it.Valid());
+  EXPECT_FALSE(it.error().empty());
+
+  // 截断的文件没有footer
+  ASSERT_EQ(truncate(fname_.c_str(), 100), 0);
+  EXPECT_FALSE(SnapshotReader::IsSnapshotFile(fname_));
+  EXPECT_FALSE(SnapshotReader::Open(fname_, &reader, &error));
+}
+
+INSTANTIATE_TEST_SUITE_P(Codecs, TestSnapshot,
+                         ::testing::Values("none", "lz", "lz4", "zstd"));
+
+TEST(TestSnapshotCoder, orderTest) {
+  // 整数编码后的字节序与数值顺序一致
+  const int64_t values[] = {INT64_MIN, -300, -1, 0, 1, 255, 256, INT64_MAX};
+  std::string prev;
+  for (int64_t v : values) {
+    std::string s;
+    SnapshotCoder<int64_t>::Encode(v, &s);
+    EXPECT_LT(prev, s);
+    int64_t r;
+    ASSERT_TRUE(SnapshotCoder<int64_t>::Decode(s.data(), s.size(), &r));
+    EXPECT_EQ(r, v);
+    prev = s;
+  }
+  int r;
+  EXPECT_FALSE(SnapshotCoder<int>::Decode("abc", 3, &r));
+
+  std::string s;
+  SnapshotCoder<double>::Encode(1.5, &s);
+  double d;
+  ASSERT_TRUE(SnapshotCoder<double>::Decode(s.data(), s.size(), &d));
+  EXPECT_EQ(d, 1.5);
+}
@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../base/histogram.hpp"
+#include "../base/statistics.hpp"
+
+TEST(TestHistogram, bucketLayout) {
+  // 小于8的值各占一个桶, 之后每个2的幂分成8个线性子桶
+  for (uint64_t v = 0; v < 8; v++) {
+    EXPECT_EQ(HistogramBuckets::IndexOf(v), v);
+  }
+  for (size_t i = 0; i + 1 < HistogramBuckets::kNumBuckets; i++) {
+    uint64_t lo = HistogramBuckets::LowerBound(i);
+    uint64_t hi = HistogramBuckets::UpperBound(i);
+    ASSERT_LT(lo, hi);
+    ASSERT_EQ(HistogramBuckets::IndexOf(lo), i);
+    ASSERT_EQ(HistogramBuckets::IndexOf(hi - 1), i);
+  }
+}
+
+TEST(TestHistogram, percentile) {
+  HistogramData data;
+  for (uint64_t v = 1; v <= 10000; v++) {
+    data.Add(v);
+  }
+  EXPECT_EQ(data.count, 10000);
+  EXPECT_EQ(data.min, 1);
+  EXPECT_EQ(data.max, 10000);
+  // 桶的相对误差为 1/8
+  EXPECT_NEAR(data.Percentile(50), 5000, 5000 / 8.0);
+  EXPECT_NEAR(data.Percentile(99), 9900, 9900 / 8.0);
+  EXPECT_LE(data.Percentile(100), 10000);
+}
+
+TEST(TestStatistics, concurrentUpdates) {
+  Statistics stats;
+  const int kThreads = 8;
+  const int kOps = 10000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&stats, t]() {
+      for (int i = 0; i < kOps; i++) {
+        stats.RecordTick(LRU_HIT);
+        stats.MeasureTime(SEARCH_LATENCY, t * kOps + i);
+      }
+    });
+  }
+  for (auto& th : threads) th.join();
+
+  EXPECT_EQ(stats.GetTickerCount(LRU_HIT), kThreads * kOps);
+  HistogramData data;
+  stats.GetHistogram(SEARCH_LATENCY, &data);
+  EXPECT_EQ(data.count, kThreads * kOps);
+  EXPECT_EQ(data.max, kThreads * kOps - 1);
+
+  std::string text = stats.ToPrometheus();
+  EXPECT_NE(text.find("minikv_lru_hit_total 80000"), std::string::npos);
+  EXPECT_NE(text.find("minikv_search_seconds_count 80000"), std::string::npos);
+
+  stats.Reset();
+  EXPECT_EQ(stats.GetTickerCount(LRU_HIT), 0);
+}
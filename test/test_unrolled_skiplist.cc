@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+
+#include "../base/random.h"
+#include "../base/unrolled_skiplist.hpp"
+
+TEST(TestUnrolledSkipList, emptyTest) {
+  UnrolledSkipList<std::string> list;
+  std::string v;
+  EXPECT_FALSE(list.Get(10, &v));
+  EXPECT_FALSE(list.Erase(10));
+  UnrolledSkipList<std::string>::Iterator iter(&list);
+  iter.SeekToFirst();
+  EXPECT_FALSE(iter.Valid());
+  iter.Seek(0);
+  EXPECT_FALSE(iter.Valid());
+}
+
+// 顺序插入会不断分裂最后一个块, 逆序插入会不断分裂第一个块
+TEST(TestUnrolledSkipList, splitTest) {
+  UnrolledSkipList<int> list;
+  for (int i = 0; i < 1000; i++) EXPECT_TRUE(list.Insert(i, i));
+  for (int i = -1; i >= -1000; i--) EXPECT_TRUE(list.Insert(i, i));
+  EXPECT_EQ(list.Size(), 2000);
+  EXPECT_FALSE(list.Insert(5, 50));
+  int v;
+  ASSERT_TRUE(list.Get(5, &v));
+  EXPECT_EQ(v, 50);
+
+  UnrolledSkipList<int>::Iterator iter(&list);
+  int expected = -1000;
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    EXPECT_EQ(iter.key(), expected++);
+  }
+  EXPECT_EQ(expected, 1000);
+}
+
+TEST(TestUnrolledSkipList, randomTest) {
+  UnrolledSkipList<std::string> list;
+  std::map<int, std::string> model;
+  Random rnd(301);
+  const int kKeySpace = 5000;
+  for (int i = 0; i < 200000; i++) {
+    // 包含负数与边界值
+    int key = static_cast<int>(rnd.Uniform(kKeySpace)) - kKeySpace / 2;
+    if (rnd.OneIn(1000)) key = rnd.OneIn(2) ? INT32_MIN : INT32_MAX;
+    std::string v;
+    switch (rnd.Uniform(4)) {
+      case 0:
+      case 1:
+        v = std::to_string(i);
+        EXPECT_EQ(list.Insert(key, v), model.count(key) == 0);
+        model[key] = v;
+        break;
+      case 2:
+        ASSERT_EQ(list.Get(key, &v), model.count(key) == 1);
+        if (model.count(key)) {
+          EXPECT_EQ(v, model[key]);
+        }
+        break;
+      default:
+        EXPECT_EQ(list.Erase(key), model.erase(key) == 1);
+        break;
+    }
+  }
+  ASSERT_EQ(list.Size(), model.size());
+
+  UnrolledSkipList<std::string>::Iterator iter(&list);
+  auto it = model.begin();
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next(), ++it) {
+    ASSERT_TRUE(it != model.end());
+    EXPECT_EQ(iter.key(), it->first);
+    EXPECT_EQ(iter.value(), it->second);
+  }
+  EXPECT_TRUE(it == model.end());
+
+  for (int i = 0; i < 1000; i++) {
+    int target = static_cast<int>(rnd.Uniform(kKeySpace + 200)) -
+                 kKeySpace / 2 - 100;
+    iter.Seek(target);
+    auto lb = model.lower_bound(target);
+    ASSERT_EQ(iter.Valid(), lb != model.end());
+    if (lb != model.end()) {
+      EXPECT_EQ(iter.key(), lb->first);
+    }
+  }
+
+  // 全部删除后块也全部释放
+  for (const auto& kv : model) EXPECT_TRUE(list.Erase(kv.first));
+  EXPECT_EQ(list.Size(), 0);
+  iter.SeekToFirst();
+  EXPECT_FALSE(iter.Valid());
+}
@@ -0,0 +1,264 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../base/random.h"
+#include "../base/skiplist_old.hpp"
+#include "../base/value_log.h"
+
+typedef SkipList<std::string, std::string> Store;
+typedef std::vector<std::pair<std::string, std::string>> Items;
+
+namespace {
+
+std::string TestDir(const char* name) {
+  return "/tmp/minikv_vlog_" + std::to_string(getpid()) + "_" + name;
+}
+
+Items All(Store* store) {
+  Items items;
+  store->scanElement("", 1 << 30, &items);
+  return items;
+}
+
+uint64_t Property(Store* store, const char* name) {
+  std::string v;
+  EXPECT_TRUE(store->getProperty(name, &v));
+  return std::stoull(v);
+}
+
+}  // namespace
+
+// 写满一个文件后换新文件, 按指针读回, 失效比例够高时才被选中回收
+TEST(TestValueLog, logTest) {
+  const std::string dir = TestDir("log");
+  ValueLogOptions options;
+  options.file_size = 1000;
+  std::unique_ptr<ValueLog> log;
+  std::string error;
+  ASSERT_TRUE(ValueLog::Open(dir, options, &log, &error)) << error;
+
+  std::vector<ValuePointer> ptrs;
+  for (int i = 0; i < 10; i++) {
+    const std::string key = "k" + std::to_string(i);
+    const std::string value(300, char('a' + i));
+    ValuePointer ptr;
+    ASSERT_TRUE(log->Add(key.data(), key.size(), value.data(), value.size(),
+                         &ptr, &error))
+        << error;
+    ptrs.push_back(ptr);
+  }
+  // 每个文件4条记录
+  EXPECT_EQ(log->num_files(), 3u);
+  EXPECT_EQ(log->live_bytes(), 3000u);
+  std::string value;
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(log->Get(ptrs[i], &value, &error)) << error;
+    EXPECT_EQ(value, std::string(300, char('a' + i)));
+  }
+
+  int n = 0;
+  ASSERT_TRUE(log->ForEach(
+      ptrs[4].file,
+      [&](const char* key, size_t klen, const char* v, size_t vlen,
+          const ValuePointer& ptr) {
+        EXPECT_EQ(std::string(key, klen), "k" + std::to_string(4 + n));
+        EXPECT_EQ(std::string(v, vlen), std::string(300, char('e' + n)));
+        EXPECT_TRUE(ptr == ptrs[4 + n]);
+        n++;
+      },
+      &error))
+      << error;
+  EXPECT_EQ(n, 4);
+
+  uint32_t file;
+  uint64_t live;
+  log->Drop(ptrs[0]);
+  EXPECT_FALSE(log->PickGarbageFile(&file, &live));
+  log->Drop(ptrs[1]);
+  ASSERT_TRUE(log->PickGarbageFile(&file, &live));
+  EXPECT_EQ(file, ptrs[0].file);
+  EXPECT_EQ(live, 600u);
+  log->RemoveFile(file);
+  EXPECT_FALSE(log->Get(ptrs[2], &value, &error));
+  EXPECT_EQ(log->num_files(), 2u);
+
+  // 当前文件被选中时换一个新文件
+  log->Drop(ptrs[8]);
+  log->Drop(ptrs[9]);
+  ASSERT_TRUE(log->PickGarbageFile(&file, &live));
+  EXPECT_EQ(file, ptrs[9].file);
+  ValuePointer ptr;
+  ASSERT_TRUE(log->Add("x", 1, "y", 1, &ptr, &error)) << error;
+  EXPECT_NE(ptr.file, file);
+
+  // 重新打开时删除旧的文件
+  log.reset();
+  ASSERT_TRUE(ValueLog::Open(dir, options, &log, &error)) << error;
+  EXPECT_EQ(log->num_files(), 1u);
+  EXPECT_EQ(log->total_bytes(), 0u);
+  log->Clear();
+  rmdir(dir.c_str());
+}
+
+// 大value只在value log中, 读, 扫描, 快照和GC之后都与模型一致
+TEST(TestValueLog, storeTest) {
+  const std::string dir = TestDir("store");
+  Store store(12, 16);
+  ValueLogOptions options;
+  options.min_value_size = 1000;
+  options.file_size = 64 << 10;
+  options.gc_interval_ms = 0;
+  std::string error;
+  ASSERT_TRUE(store.openValueLog(dir, options, &error)) << error;
+  EXPECT_FALSE(store.openValueLog(dir, options, &error));
+  store.setMaxMemory(size_t(1) << 40, ALLKEYS_LRU);
+
+  std::map<std::string, std::string> model;
+  Random rnd(301);
+  for (int i = 0; i < 5000; i++) {
+    std::string k = "key" + std::to_string(rnd.Uniform(300));
+    switch (rnd.Uniform(4)) {
+      case 0:
+      case 1: {
+        // 一半是大value
+        size_t n = rnd.OneIn(2) ? 1000 + rnd.Uniform(3000) : rnd.Uniform(50);
+        std::string v(n, char('a' + rnd.Uniform(26)));
+        v += std::to_string(i);
+        EXPECT_EQ(store.insertElement(k, v), model.count(k) ? 1 : 0);
+        model[k] = v;
+        break;
+      }
+      case 2: {
+        std::string got;
+        bool found = store.searchElement(k, got);
+        ASSERT_EQ(found, model.count(k) == 1);
+        if (found) {
+          EXPECT_EQ(got, model[k]);
+        }
+        break;
+      }
+      default:
+        EXPECT_EQ(store.deleteElement(k), model.erase(k) == 1);
+        break;
+    }
+  }
+  Items expect(model.begin(), model.end());
+  ASSERT_EQ(All(&store), expect);
+
+  uint64_t live = 0;
+  for (auto& kv : model) {
+    if (kv.second.size() >= 1000) live += kv.second.size();
+  }
+  EXPECT_EQ(Property(&store, "minikv.value-log-live-bytes"), live);
+  // 只有一个指针的开销, 而不是整个value
+  EXPECT_LT(Property(&store, "minikv.used-memory"), live);
+  const uint64_t before = Property(&store, "minikv.value-log-bytes");
+  ASSERT_GT(before, 2 * live);
+
+  while (store.gcValueLog()) {
+  }
+  EXPECT_LT(Property(&store, "minikv.value-log-bytes"), before);
+  EXPECT_GT(store.getStatistics()->GetTickerCount(VLOG_GC_FILES), 0u);
+  EXPECT_EQ(Property(&store, "minikv.value-log-live-bytes"), live);
+  ASSERT_EQ(All(&store), expect);
+  for (auto& kv : model) {
+    std::string got;
+    ASSERT_TRUE(store.searchElement(kv.first, got));
+    EXPECT_EQ(got, kv.second);
+  }
+
+  // 快照中的value是内联的, 不需要value log就能加载
+  const std::string dump = dir + ".dump";
+  ASSERT_TRUE(store.dumpFile(dump));
+  Store loaded(12, 16);
+  loaded.loadFile(dump);
+  EXPECT_EQ(All(&loaded), expect);
+  // 带value log的空store加载时把大value分出去
+  Store separated(12, 16);
+  ASSERT_TRUE(separated.openValueLog(dir + ".2", options, &error)) << error;
+  separated.loadFile(dump);
+  EXPECT_EQ(All(&separated), expect);
+  EXPECT_EQ(Property(&separated, "minikv.value-log-live-bytes"), live);
+
+  store.clear();
+  EXPECT_EQ(Property(&store, "minikv.value-log-live-bytes"), 0u);
+  EXPECT_TRUE(All(&store).empty());
+  unlink(dump.c_str());
+}
+
+// 后台GC与覆盖写并发, 搬走的value不会覆盖更新的写入
+TEST(TestValueLog, gcThreadTest) {
+  const std::string dir = TestDir("gc");
+  Store store(12, 16);
+  ValueLogOptions options;
+  options.min_value_size = 100;
+  options.file_size = 16 << 10;
+  options.gc_interval_ms = 1;
+  std::string error;
+  ASSERT_TRUE(store.openValueLog(dir, options, &error)) << error;
+
+  const int kThreads = 2;
+  std::vector<std::thread> writers;
+  for (int t = 0; t < kThreads; t++) {
+    writers.emplace_back([&store, t] {
+      for (int i = 0; i < 5000; i++) {
+        std::string k = std::to_string(t) + ":" + std::to_string(i % 50);
+        store.insertElement(k, std::string(200, 'v') + std::to_string(i));
+      }
+    });
+  }
+  for (auto& w : writers) w.join();
+  for (int t = 0; t < kThreads; t++) {
+    for (int i = 4950; i < 5000; i++) {
+      std::string k = std::to_string(t) + ":" + std::to_string(i % 50);
+      std::string got;
+      ASSERT_TRUE(store.searchElement(k, got));
+      EXPECT_EQ(got, std::string(200, 'v') + std::to_string(i));
+    }
+  }
+  EXPECT_GT(store.getStatistics()->GetTickerCount(VLOG_GC_FILES), 0u);
+  EXPECT_EQ(Property(&store, "minikv.value-log-live-bytes"),
+            uint64_t(kThreads * 50 * 204));
+}
+
+// 追加到超过阈值的value移入value log, 之后的修改从value log读出再写回
+TEST(TestValueLog, updateTest) {
+  const std::string dir = TestDir("update");
+  Store store(12, 16);
+  ValueLogOptions options;
+  options.min_value_size = 100;
+  options.gc_interval_ms = 0;
+  std::string error;
+  ASSERT_TRUE(store.openValueLog(dir, options, &error)) << error;
+  store.setMaxMemory(size_t(1) << 40, ALLKEYS_LRU);
+
+  size_t size;
+  for (int i = 0; i < 20; i++) {
+    ASSERT_EQ(store.appendElement("k", std::string(10, 'a' + i), &size), 0);
+  }
+  EXPECT_EQ(size, 200u);
+  EXPECT_EQ(Property(&store, "minikv.value-log-live-bytes"), 200u);
+  std::string expect;
+  for (int i = 0; i < 20; i++) expect += std::string(10, 'a' + i);
+  // 与直接写入的大value占用相同
+  Store direct(12, 16);
+  ASSERT_TRUE(direct.openValueLog(dir + ".2", options, &error)) << error;
+  direct.setMaxMemory(size_t(1) << 40, ALLKEYS_LRU);
+  direct.insertElement("k", expect);
+  EXPECT_EQ(Property(&store, "minikv.used-memory"),
+            Property(&direct, "minikv.used-memory"));
+  std::string got;
+  ASSERT_TRUE(store.searchElement("k", got));
+  EXPECT_EQ(got, expect);
+
+  EXPECT_EQ(store.compareAndSwap("k", expect, "small"), 1);
+  EXPECT_EQ(Property(&store, "minikv.value-log-live-bytes"), 0u);
+  ASSERT_TRUE(store.searchElement("k", got));
+  EXPECT_EQ(got, "small");
+  store.clear();
+}